@@ -1,3 +1,4 @@
+#define _CRT_SECURE_NO_WARNINGS
 #include <windows.h>
 #include <stdint.h>
 #include <stdbool.h>
@@ -6,6 +7,11 @@
 
 #include "input.c"
 #include "k4a.c"
+#include "rvl.c"
+#include "recording.c"
+#include "depth_source.c"
+#include "job_system.c"
+#include "colormap.c"
 #include "linalg.h"
 
 typedef struct
@@ -43,11 +49,15 @@ typedef struct
     float sensitivity;
 } view_control;
 
+// A point as point_cloud.c computes it: the position in millimeters and the hue of the color in 1/65535 of the color
+// circle, saturation and value are 1.
 typedef struct
 {
-    float xyz[3];
-    float rgb[3];
-} color_point;
+    int16_t x, y, z;
+    uint16_t hue;
+} packed_point;
+
+#include "point_cloud.c"
 
 typedef struct
 {
@@ -55,8 +65,8 @@ typedef struct
     v3f Color;
 } vertex_out;
 
-typedef vertex_out vertex_program(color_point In, mat4 Mvp);
-typedef v3f        pixel_program(v3f HSV);
+typedef vertex_out vertex_program(packed_point In, mat4 Mvp);
+typedef uint32_t   pixel_program(v3f HSV, uint32_t *Colormap);
 
 typedef struct
 {
@@ -64,6 +74,10 @@ typedef struct
 
     vertex_program *VertexProgram;
     pixel_program *PixelProgram;
+
+    // The framebuffer colors of the hues, see colormap.c.
+    colormap_kind ColormapKind;
+    uint32_t Colormap[COLORMAP_SIZE];
 } graphics_pipeline;
 
 struct scroll_update {
@@ -73,6 +87,7 @@ struct scroll_update {
 
 static struct scroll_update global_scroll_update;
 static bool GlobalRunning = false;
+static colormap_kind GlobalColormapKind = COLORMAP_HUE;
 
 static framebuffer *CreateFramebuffer(int Width, int Height, int BytesPerPixel)
 {
@@ -107,7 +122,28 @@ static void DisplayFramebuffer(framebuffer *Framebuffer, HDC WindowDC, int Width
                   DIB_RGB_COLORS, SRCCOPY);
 }
 
-static void ClearFramebuffer(framebuffer *Framebuffer, float Red, float Green, float Blue, float Alpha)
+// Both buffers are cleared in bands of rows on all threads.
+#define FRAMEBUFFER_CLEAR_ROWS 16
+
+typedef struct
+{
+    uint32_t *Memory;
+    uint32_t Width;
+    uint32_t Value;
+} buffer_clear;
+
+static void ClearRows(void *Data, int Begin, int End)
+{
+    buffer_clear *Clear = (buffer_clear *)Data;
+    uint32_t *Row = Clear->Memory + (size_t)Begin * Clear->Width;
+    size_t PixelCount = (size_t)(End - Begin) * Clear->Width;
+    for(size_t Index = 0; Index < PixelCount; ++Index)
+    {
+        Row[Index] = Clear->Value;
+    }
+}
+
+static void ClearFramebuffer(job_system *Jobs, framebuffer *Framebuffer, float Red, float Green, float Blue, float Alpha)
 {
     uint32_t R = (uint32_t)(0xFF * Red);
     uint32_t G = (uint32_t)(0xFF * Green);
@@ -115,12 +151,8 @@ static void ClearFramebuffer(framebuffer *Framebuffer, float Red, float Green, f
     uint32_t A = (uint32_t)(0xFF * Alpha);
     uint32_t Color = A << 24 | R << 16 | G << 8 | B << 0;
 
-    uint32_t PixelCount = Framebuffer->Width * Framebuffer->Height;
-
-    for(size_t Index = 0; Index < PixelCount; ++Index)
-    {
-        Framebuffer->Memory[Index] = Color;
-    }
+    buffer_clear Clear = { Framebuffer->Memory, (uint32_t)Framebuffer->Width, Color };
+    job_parallel_for(Jobs, Framebuffer->Height, FRAMEBUFFER_CLEAR_ROWS, ClearRows, &Clear);
 }
 
 static depth_buffer *CreateDepthBuffer(uint32_t Width, uint32_t Height)
@@ -135,13 +167,11 @@ static depth_buffer *CreateDepthBuffer(uint32_t Width, uint32_t Height)
     return(DepthBuffer);
 }
 
-static void ClearDepthBuffer(depth_buffer *DepthBuffer)
+static void ClearDepthBuffer(job_system *Jobs, depth_buffer *DepthBuffer)
 {
-    uint32_t PixelCount = DepthBuffer->Width * DepthBuffer->Height;
-    for(size_t Index = 0; Index < PixelCount; ++Index)
-    {
-        DepthBuffer->Memory[Index] = 0;
-    }
+    // A depth of 0.0f has all bits cleared.
+    buffer_clear Clear = { (uint32_t *)DepthBuffer->Memory, DepthBuffer->Width, 0 };
+    job_parallel_for(Jobs, (int)DepthBuffer->Height, FRAMEBUFFER_CLEAR_ROWS, ClearRows, &Clear);
 }
 
 static graphics_pipeline *CreateGraphicsPipeline(uint32_t ViewportWidth, uint32_t ViewportHeight, vertex_program *VertexProgram, pixel_program *PixelProgram)
@@ -157,6 +187,22 @@ static graphics_pipeline *CreateGraphicsPipeline(uint32_t ViewportWidth, uint32_
     return(Pipeline);
 }
 
+// Converts the colors of the colormap to the pixels of the framebuffer once, so a pixel only has to look up its hue.
+static void SetColormap(graphics_pipeline *Pipeline, colormap_kind Kind)
+{
+    uint8_t RGBA[COLORMAP_SIZE * 4];
+    colormap_build(Kind, RGBA);
+    
+    for(int Index = 0; Index < COLORMAP_SIZE; ++Index)
+    {
+        uint32_t Red   = RGBA[Index * 4 + 0];
+        uint32_t Green = RGBA[Index * 4 + 1];
+        uint32_t Blue  = RGBA[Index * 4 + 2];
+        Pipeline->Colormap[Index] = 0xFFu << 24 | Red << 16 | Green << 8 | Blue << 0;
+    }
+    Pipeline->ColormapKind = Kind;
+}
+
 static void ToggleFullscreen(HWND Window)
 {
     static DWORD PrevWindowStyle;
@@ -240,6 +286,12 @@ LRESULT CALLBACK MainWndProc(HWND Window, UINT Message, WPARAM wParam, LPARAM lP
                 {
                     b32 AltDown = (lParam & (1 << 29)) != 0;
 
+                    // M switches to the next colormap.
+                    if(Key == 'M' && Down)
+                    {
+                        GlobalColormapKind = (colormap_kind)((GlobalColormapKind + 1) % COLORMAP_COUNT);
+                    }
+
                     if(Key == VK_F11 && Down)
                     {
                         ToggleFullscreen(Window);
@@ -388,57 +440,60 @@ static void PrintAverage(average *Average, double Value) {
     }
 }
 
-static void calculate_point_cloud(color_point *VertexArray, uint32_t *VertexCount, v2f *xy_map, uint16_t *depth_map, int depth_map_count)
+static void calculate_point_cloud(packed_point *VertexArray, uint32_t *VertexCount, job_system *Jobs, packed_point *Scratch, float *History, v2f *xy_map, uint16_t *depth_map, int depth_map_width, int depth_map_height, bool Filter)
 {
-    //float focal_length = 1.8f; // 1.8 mm = 0.0018 m
-
-    uint32_t insert_index = 0;
-    for(size_t i = 0; i < depth_map_count; ++i)
-    {
-        float d = (float)depth_map[i];
-
-        //int u = (int)i / depth_map_width;
-        //int v = (int)i % depth_map_width;
-
-        //float x_over_z = (u - (depth_map_width  / 2.0f)) / focal_length;
-        //float y_over_z = (v - (depth_map_height / 2.0f)) / focal_length;
-
-        //float xc = (float)u / focal_length;
-        //float yc = (float)v / focal_length;
-
-        //float z = d / sqrtf(1.0f + x_over_z * x_over_z + y_over_z * y_over_z);
-
-        color_point point;
-        point.xyz[0] = xy_map[i].x * d / 1000.0f;
-        point.xyz[1] = -xy_map[i].y * d / 1000.0f;
-        point.xyz[2] = -d / 1000.0f /*+ max_camera_z*/;
-
-        if(point.xyz[2] != 0.0f)
-        {
-            // interpolate
-            float min_z = 0.5f;
-            float max_z = 3.86f;
-
-#define clamp(x, low, high) (x) < (low) ? (low) : ((x) > (high) ? (high) : (x))
+    *VertexCount = point_cloud_compute(Jobs, VertexArray, Scratch, xy_map, depth_map, History, depth_map_width, depth_map_height, Filter);
+}
 
-            float hue = (-point.xyz[2] - min_z) / (max_z - min_z);
-            hue = clamp(hue, 0.0f, 1.0f);
+// ProcessVertices() works on all threads of a job_system. The vertices are shaded in chunks, then the fragments are
+// sorted by the band of rows they fall into, keeping the order of the vertices within a band, and every band is
+// depth tested and written by one thread. No two threads write the same pixel and every pixel sees its fragments in
+// the order of the vertices, so the image is the same as when the vertices are drawn one after another.
+#define RASTER_BAND_ROWS 16
+#define RASTER_MAX_BANDS 128
+#define RASTER_MIN_CHUNK_SIZE 8192
+#define RASTER_MAX_CHUNKS 64
 
-            // the hue of the hsv color goes from red to red so we want to scale with 2/3 which is blue
-            float range = 2.0f / 3.0f;
+typedef struct
+{
+    uint32_t Index; // Of the pixel, or RASTER_CLIPPED.
+    uint32_t Color;
+    float Depth;
+} fragment;
 
-            hue *= range;
-            hue = range - hue;
+#define RASTER_CLIPPED 0xFFFFFFFF
 
-            point.rgb[0] = hue;
-            point.rgb[1] = 1.0f;
-            point.rgb[2] = 1.0f;
+typedef struct
+{
+    fragment *Fragments; // One per vertex, in the order of the vertices.
+    fragment *Binned; // The fragments that were not clipped, sorted by band.
+    uint32_t MaxVertexCount;
 
-            VertexArray[insert_index++] = point;
-        }
-    }
+    // How many fragments every chunk has in every band, then where the next one of them goes in Binned.
+    uint32_t Counts[RASTER_MAX_CHUNKS][RASTER_MAX_BANDS];
+    uint32_t BandOffsets[RASTER_MAX_BANDS + 1];
+} raster_bins;
 
-    *VertexCount = insert_index;
+typedef struct
+{
+    raster_bins *Bins;
+    graphics_pipeline *Pipeline;
+    framebuffer *Framebuffer;
+    depth_buffer *DepthBuffer;
+    packed_point *VertexArray;
+    uint32_t VertexCount;
+    uint32_t ChunkSize;
+    uint32_t BandSize; // In pixels.
+    mat4 Mvp;
+} raster_job;
+
+static raster_bins *CreateRasterBins(uint32_t MaxVertexCount)
+{
+    raster_bins *Bins = (raster_bins *)VirtualAlloc(NULL, sizeof(raster_bins), MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
+    Bins->Fragments = (fragment *)VirtualAlloc(NULL, 2 * sizeof(fragment) * MaxVertexCount, MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
+    Bins->Binned = Bins->Fragments + MaxVertexCount;
+    Bins->MaxVertexCount = MaxVertexCount;
+    return(Bins);
 }
 
 static bool ClipCondition(v4f P)
@@ -449,126 +504,172 @@ static bool ClipCondition(v4f P)
     return(!(X && Y && Z));
 }
 
-static void ProcessVertices(color_point *VertexArray, uint32_t VertexCount, graphics_pipeline *Pipeline, framebuffer *Framebuffer, depth_buffer *DepthBuffer, mat4 Mvp)
+static fragment ShadeVertex(packed_point Vertex, graphics_pipeline *Pipeline, mat4 Mvp)
 {
-    for(uint32_t Index = 0; Index < VertexCount; ++Index)
+    fragment Fragment = { RASTER_CLIPPED, 0, 0.0f };
+
+    // Per Vertex Operations (LOCAL SPACE (=> WORLD SPACE => VIEW SPACE) => CLIP SPACE)
+    vertex_out VertexOut = Pipeline->VertexProgram(Vertex, Mvp);
+
+    // Clipping
+    if(ClipCondition(VertexOut.Position))
     {
-        color_point Vertex = VertexArray[Index];
+        return(Fragment);
+    }
 
-        // Per Vertex Operations (LOCAL SPACE (=> WORLD SPACE => VIEW SPACE) => CLIP SPACE)
-        vertex_out VertexOut = Pipeline->VertexProgram(Vertex, Mvp);
+    // Perspective Division (CLIP SPACE => NORMALIZED DEVICE COORDINATES)
+    v3f NDC;
+    if(VertexOut.Position.w != 0.0f)
+    {
+        NDC.x = VertexOut.Position.x / VertexOut.Position.w;
+        NDC.y = -VertexOut.Position.y / VertexOut.Position.w;
+        NDC.z = VertexOut.Position.z / VertexOut.Position.w;
+    }
+    else
+    {
+        NDC.x = VertexOut.Position.x;
+        NDC.y = VertexOut.Position.y;
+        NDC.z = VertexOut.Position.z;
+    }
 
-        // Clipping
-        if(ClipCondition(VertexOut.Position))
-        {
-            continue;
-        }
+    uint32_t Width = Pipeline->ViewportDimensions.w;
+    uint32_t Height = Pipeline->ViewportDimensions.h;
 
-        // Perspective Division (CLIP SPACE => NORMALIZED DEVICE COORDINATES)
-        v3f NDC;
-        if(VertexOut.Position.w != 0.0f)
-        {
-            NDC.x = VertexOut.Position.x / VertexOut.Position.w;
-            NDC.y = -VertexOut.Position.y / VertexOut.Position.w;
-            NDC.z = VertexOut.Position.z / VertexOut.Position.w;
-        }
-        else
-        {
-            NDC.x = VertexOut.Position.x;
-            NDC.y = VertexOut.Position.y;
-            NDC.z = VertexOut.Position.z;
-        }
+    // Viewport Transform (NORMALIZED DEVICE COORDINATES => SCREEN COORDINATES)
+    v2u ViewportPosition =
+    {
+        (uint32_t)(floor(Width / 2 * NDC.x) + Width / 2),
+        (uint32_t)(floor(Height / 2 * NDC.y) + Height / 2),
+        /* (int)((Far - Near) / 2.0f * NDC.z + (Far + Near) / 2.0f) */
+    };
+
+    // Per Pixel Operations
+    uint32_t Color = Pipeline->PixelProgram(VertexOut.Color, Pipeline->Colormap);
+
+    Fragment.Index = ViewportPosition.y * Width + ViewportPosition.x;
+    Fragment.Color = Color;
+    Fragment.Depth = (NDC.z + 1) / 2; // Convert from range -1..1 to 0..1
+    return(Fragment);
+}
 
-        uint32_t Width = Pipeline->ViewportDimensions.w;
-        uint32_t Height = Pipeline->ViewportDimensions.h;
+static void ShadeChunks(void *Data, int Begin, int End)
+{
+    raster_job *Job = (raster_job *)Data;
+    raster_bins *Bins = Job->Bins;
+    for(int Chunk = Begin; Chunk < End; ++Chunk)
+    {
+        uint32_t *Counts = Bins->Counts[Chunk];
+        memset(Counts, 0, sizeof(Bins->Counts[Chunk]));
 
-        // Viewport Transform (NORMALIZED DEVICE COORDINATES => SCREEN COORDINATES)
-        v2u ViewportPosition =
+        uint32_t First = Chunk * Job->ChunkSize;
+        uint32_t Last = (First + Job->ChunkSize < Job->VertexCount) ? First + Job->ChunkSize : Job->VertexCount;
+        for(uint32_t Index = First; Index < Last; ++Index)
         {
-            (uint32_t)(floor(Width / 2 * NDC.x) + Width / 2),
-            (uint32_t)(floor(Height / 2 * NDC.y) + Height / 2),
-            /* (int)((Far - Near) / 2.0f * NDC.z + (Far + Near) / 2.0f) */
-        };
+            fragment Fragment = ShadeVertex(Job->VertexArray[Index], Job->Pipeline, Job->Mvp);
+            Bins->Fragments[Index] = Fragment;
+            if(Fragment.Index != RASTER_CLIPPED)
+            {
+                ++Counts[Fragment.Index / Job->BandSize];
+            }
+        }
+    }
+}
 
-        // Per Pixel Operations
-        v3f Color = Pipeline->PixelProgram(VertexOut.Color);
+static void BinChunks(void *Data, int Begin, int End)
+{
+    raster_job *Job = (raster_job *)Data;
+    raster_bins *Bins = Job->Bins;
+    for(int Chunk = Begin; Chunk < End; ++Chunk)
+    {
+        uint32_t *Offsets = Bins->Counts[Chunk];
 
-        uint32_t Alpha = 0xFF;
-        uint32_t Red   = (uint32_t)(0xFF * Color.x);
-        uint32_t Green = (uint32_t)(0xFF * Color.y);
-        uint32_t Blue  = (uint32_t)(0xFF * Color.z);
+        uint32_t First = Chunk * Job->ChunkSize;
+        uint32_t Last = (First + Job->ChunkSize < Job->VertexCount) ? First + Job->ChunkSize : Job->VertexCount;
+        for(uint32_t Index = First; Index < Last; ++Index)
+        {
+            fragment Fragment = Bins->Fragments[Index];
+            if(Fragment.Index != RASTER_CLIPPED)
+            {
+                Bins->Binned[Offsets[Fragment.Index / Job->BandSize]++] = Fragment;
+            }
+        }
+    }
+}
 
-        size_t FramebufferIndex = ViewportPosition.y * Width + ViewportPosition.x;
+static void RasterizeBands(void *Data, int Begin, int End)
+{
+    raster_job *Job = (raster_job *)Data;
+    raster_bins *Bins = Job->Bins;
+    for(uint32_t Index = Bins->BandOffsets[Begin]; Index < Bins->BandOffsets[End]; ++Index)
+    {
+        fragment Fragment = Bins->Binned[Index];
 
         // Occlusion Culling
-        float Depth = (NDC.z + 1) / 2;
-        if(DepthBuffer->Memory[FramebufferIndex] != 0 && Depth >= DepthBuffer->Memory[FramebufferIndex])
+        float *Depth = Job->DepthBuffer->Memory + Fragment.Index;
+        if(*Depth != 0 && Fragment.Depth >= *Depth)
         {
             continue;
         }
 
-        Framebuffer->Memory[FramebufferIndex] = Alpha << 24 | Red << 16 | Green << 8 | Blue << 0;
-        DepthBuffer->Memory[FramebufferIndex] = Depth; // Convert from range -1..1 to 0..1
+        Job->Framebuffer->Memory[Fragment.Index] = Fragment.Color;
+        *Depth = Fragment.Depth;
     }
 }
 
-vertex_out VertexProgram(color_point In, mat4 Mvp)
+static void ProcessVertices(job_system *Jobs, raster_bins *Bins, packed_point *VertexArray, uint32_t VertexCount, graphics_pipeline *Pipeline, framebuffer *Framebuffer, depth_buffer *DepthBuffer, mat4 Mvp)
 {
-    vertex_out Out;
+    assert(VertexCount <= Bins->MaxVertexCount);
 
-    Out.Position = mat4_mul_v4f(Mvp, (v4f){In.xyz[0], In.xyz[1], In.xyz[2], 1.0f});
-    Out.Color = (v3f){In.rgb[0], In.rgb[1], In.rgb[2]};
-
-    return(Out);
-}
+    uint32_t Height = Pipeline->ViewportDimensions.h;
+    uint32_t BandRows = RASTER_BAND_ROWS;
+    while((Height + BandRows - 1) / BandRows > RASTER_MAX_BANDS)
+    {
+        BandRows *= 2;
+    }
+    int BandCount = (int)((Height + BandRows - 1) / BandRows);
 
-v3f HSVToRGB(v3f HSV)
-{
-    v3f RGB;
+    uint32_t ChunkSize = (VertexCount + RASTER_MAX_CHUNKS - 1) / RASTER_MAX_CHUNKS;
+    ChunkSize = (ChunkSize < RASTER_MIN_CHUNK_SIZE) ? RASTER_MIN_CHUNK_SIZE : ChunkSize;
+    int ChunkCount = (int)((VertexCount + ChunkSize - 1) / ChunkSize);
 
-    int I;
-    float F, P, Q, T;
+    raster_job Job = { Bins, Pipeline, Framebuffer, DepthBuffer, VertexArray, VertexCount, ChunkSize, BandRows * Pipeline->ViewportDimensions.w, Mvp };
 
-    float H = HSV.x;
-    float S = HSV.y;
-    float V = HSV.z;
+    job_parallel_for(Jobs, ChunkCount, 1, ShadeChunks, &Job);
 
-    if (S == 0) // No saturation => grayscale; V == lightness/darkness
-    {
-        RGB = (v3f){V, V, V};
-    }
-    else
+    // Band by band, and within a band chunk by chunk, the fragments keep the order of their vertices.
+    uint32_t Offset = 0;
+    for(int Band = 0; Band < BandCount; ++Band)
     {
-        H *= 6;
-        I = (int)H;
-        F = H - I;
-        P = V * (1 - S);
-        Q = V * (1 - S * F);
-        T = V * (1 - S * (1 - F));
-        switch (I) {
-            case 0:  RGB = (v3f){V, T, P}; break;
-            case 1:  RGB = (v3f){Q, V, P}; break;
-            case 2:  RGB = (v3f){P, V, T}; break;
-            case 3:  RGB = (v3f){P, Q, V}; break;
-            case 4:  RGB = (v3f){T, P, V}; break;
-            default: RGB = (v3f){V, P, Q}; break;
+        Bins->BandOffsets[Band] = Offset;
+        for(int Chunk = 0; Chunk < ChunkCount; ++Chunk)
+        {
+            uint32_t Count = Bins->Counts[Chunk][Band];
+            Bins->Counts[Chunk][Band] = Offset;
+            Offset += Count;
         }
     }
+    Bins->BandOffsets[BandCount] = Offset;
 
-    return(RGB);
+    job_parallel_for(Jobs, ChunkCount, 1, BinChunks, &Job);
+    job_parallel_for(Jobs, BandCount, 1, RasterizeBands, &Job);
 }
 
-
-v3f PixelProgram(v3f HSV)
+vertex_out VertexProgram(packed_point In, mat4 Mvp)
 {
-    v3f RGB;
+    vertex_out Out;
 
-    RGB = HSVToRGB(HSV);
+    Out.Position = mat4_mul_v4f(Mvp, (v4f){In.x * 0.001f, In.y * 0.001f, In.z * 0.001f, 1.0f});
+    Out.Color = (v3f){In.hue * (1.0f / 65535.0f), 1.0f, 1.0f};
 
-    return(RGB);
+    return(Out);
+}
+
+uint32_t PixelProgram(v3f HSV, uint32_t *Colormap)
+{
+    return(Colormap[colormap_index(HSV.x)]);
 }
 
-int main(void)
+int main(int ArgumentCount, char **Arguments)
 {
     WNDCLASS WindowClass = {0};
 
@@ -610,33 +711,28 @@ int main(void)
             framebuffer  *Framebuffer = CreateFramebuffer(1280, 720, 4);
             depth_buffer *DepthBuffer = CreateDepthBuffer(1280, 720);
             graphics_pipeline *Pipeline = CreateGraphicsPipeline(1280, 720, VertexProgram, PixelProgram);
+            SetColormap(Pipeline, GlobalColormapKind);
 
             camera_config Config = K4A_DEVICE_CONFIG_INIT_DISABLE_ALL;
             Config.depth_mode = K4A_DEPTH_MODE_NFOV_UNBINNED;
             Config.camera_fps = K4A_FRAMES_PER_SECOND_30;
             Config.synchronized_images_only = false;
 
-            tof_camera Camera_ = camera_init(&Config);
-            tof_camera *Camera = &Camera_;
+            // The camera, a recording or a synthetic scene, see depth_source.c for the arguments.
+            depth_source Source_;
+            depth_source *Source = &Source_;
 
-            if(Camera->device)
+            if(depth_source_open(Source, &Config, ArgumentCount, Arguments))
             {
-                int DepthMapWidth = Camera->max_capture_width;
-                int DepthMapHeight = Camera->max_capture_height;
+                int DepthMapWidth = Source->width;
+                int DepthMapHeight = Source->height;
                 int DepthMapCount = DepthMapWidth * DepthMapHeight;
 
-                k4a_calibration_t calibration;
-                k4a_device_get_calibration(Camera->device, Config.depth_mode, Config.color_resolution, &calibration);
+                depth_source_intrinsics SourceIntrinsics;
+                depth_source_get_intrinsics(Source, &SourceIntrinsics);
 
-                k4a_image_t xy_image = NULL;
-                k4a_image_create(K4A_IMAGE_FORMAT_CUSTOM,
-                                 calibration.depth_camera_calibration.resolution_width,
-                                 calibration.depth_camera_calibration.resolution_height,
-                                 calibration.depth_camera_calibration.resolution_width * (int)sizeof(k4a_float2_t),
-                                 &xy_image);
-
-                k4a_create_xy_table(&calibration, xy_image);
-                v2f *xy_map = (v2f *)k4a_image_get_buffer(xy_image);
+                xy_table xy_table_ = depth_source_load_xy_table(&SourceIntrinsics);
+                v2f *xy_map = (v2f *)xy_table_.data;
 
                 dimensions depth_image_dimensions = {DepthMapWidth, DepthMapHeight};
 
@@ -651,12 +747,18 @@ int main(void)
                 };
                 view_control *Control = &Control_;
 
-                size_t DepthMapSize = DepthMapCount * sizeof(uint16_t);
-                uint16_t *DepthMap = (uint16_t *)VirtualAlloc(NULL, DepthMapSize, MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
-
-                color_point *VertexArray = (color_point *)VirtualAlloc(NULL, sizeof(color_point) * DepthMapCount, MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
+                packed_point *VertexArray = (packed_point *)VirtualAlloc(NULL, sizeof(packed_point) * DepthMapCount, MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
                 uint32_t VertexCount = 0;
 
+                // The point cloud and the rendering run on a thread per core. The threads write their points to scratch
+                // first and the bins keep the fragments of a frame until they are drawn, see ProcessVertices().
+                job_system *Jobs = job_system_create(0);
+                packed_point *Scratch = (packed_point *)VirtualAlloc(NULL, sizeof(packed_point) * DepthMapCount, MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
+                // The depth of every pixel in the last frame for the temporal filter, updated in place. VirtualAlloc()
+                // zeroes it.
+                float *History = Source->temporal ? (float *)VirtualAlloc(NULL, sizeof(float) * DepthMapCount, MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE) : NULL;
+                raster_bins *Bins = CreateRasterBins((uint32_t)DepthMapCount);
+
                 float DeltaTime = 0.0f;
                 float TotalTime = 0.0f;
 
@@ -694,6 +796,12 @@ int main(void)
                     ProcessWindowMessages();
                     HandleInput(Window, Control, DeltaTime);
 
+                    if(Pipeline->ColormapKind != GlobalColormapKind)
+                    {
+                        SetColormap(Pipeline, GlobalColormapKind);
+                        printf("Colormap: %s\n", colormap_name(GlobalColormapKind));
+                    }
+
 #define DYNAMIC_TEST 0
 #if DYNAMIC_TEST
                     Control->position = (v3f){.x = linalg_sin(TotalTime) * 3, .y = linalg_cos(TotalTime) * 3, .z = 3.0f};
@@ -705,14 +813,16 @@ int main(void)
                     dimensions RenderDimensions = {(uint32_t)ClientRect.right, (uint32_t)ClientRect.bottom};
 
                     // Depth Data Acquisition
-                    bool DepthMapUpdate = camera_get_depth_map(Camera, 0, DepthMap, DepthMapSize);
+                    depth_frame DepthFrame = {0};
+                    bool DepthMapUpdate = depth_source_next_frame(Source, &DepthFrame);
 
                     // Point Cloud Computation
                     LARGE_INTEGER BeginCounter, EndCounter;
                     QueryPerformanceCounter(&BeginCounter);
                     if (DepthMapUpdate)
                     {
-                        calculate_point_cloud(VertexArray, &VertexCount, xy_map, DepthMap, DepthMapCount);
+                        calculate_point_cloud(VertexArray, &VertexCount, Jobs, Scratch, History, xy_map, DepthFrame.depth_map, DepthMapWidth, DepthMapHeight, Source->filter);
+                        depth_source_release_frame(Source, &DepthFrame);
                     }
                     QueryPerformanceCounter(&EndCounter);
                     PrintAverage(&PointCloudComputeTimer, (double)(EndCounter.QuadPart - BeginCounter.QuadPart) / (Freq.QuadPart / 1000.0));
@@ -725,14 +835,14 @@ int main(void)
                     // Rendering
                     QueryPerformanceCounter(&BeginCounter);
 
-                    ClearFramebuffer(Framebuffer, 0.0f, 0.0f, 0.0f, 1.0f);
-                    ClearDepthBuffer(DepthBuffer);
+                    ClearFramebuffer(Jobs, Framebuffer, 0.0f, 0.0f, 0.0f, 1.0f);
+                    ClearDepthBuffer(Jobs, DepthBuffer);
 
                     mat4 Model = Control->model;
                     mat4 View = look_at(Control->position, v3f_add(Control->position, Control->forward), Control->up);
                     mat4 Proj = perspective(Control->fov, (float)RenderDimensions.w / (float)RenderDimensions.h, 0.1f, 100.0f);
                     mat4 Mvp = mat4_mul(Proj, mat4_mul(View, Model));
-                    ProcessVertices(VertexArray, VertexCount, Pipeline, Framebuffer, DepthBuffer, Mvp);
+                    ProcessVertices(Jobs, Bins, VertexArray, VertexCount, Pipeline, Framebuffer, DepthBuffer, Mvp);
 
                     DisplayFramebuffer(Framebuffer, WindowDC, RenderDimensions.w, RenderDimensions.h);
 
@@ -747,11 +857,13 @@ int main(void)
                     TotalTime += DeltaTime;
                 }
 
-                //camera_release(Camera);
+                depth_source_stop_recording(Source);
+                job_system_destroy(Jobs);
+                //depth_source_close(Source);
             }
             else
             {
-                fprintf(stderr, "Could not initialize camera.\n");
+                fprintf(stderr, "Could not open the depth source.\n");
             }
         }
         else
@@ -1,3 +1,4 @@
+#define _CRT_SECURE_NO_WARNINGS
 #include <stdint.h>
 #include <stddef.h>
 #include <stdbool.h>
@@ -32,11 +33,17 @@ static void PrintAverage(average *Average, float Value) {
 }
 
 #include "k4a.c"
+#include "rvl.c"
+#include "recording.c"
+#include "depth_source.c"
+#include "job_system.c"
+#include "colormap.c"
 #include "opengl_renderer.c"
 #include "write_to_ply.c"
 
 #include "linalg.h"
 #include "opengl_renderer.h"
+#include "point_cloud.c"
 
 struct scroll_update { 
     double yoffset;
@@ -45,6 +52,13 @@ struct scroll_update {
 // NOTE: this has to be a global since we can only retrieve the scroll offset in the callback
 static struct scroll_update global_scroll_update;
 
+struct colormap_update {
+    colormap_kind kind;
+    int           updated;
+};
+// NOTE: set in the key callback, the renderer is only changed from the main loop
+static struct colormap_update global_colormap_update;
+
 void handle_input(GLFWwindow *window, view_control *control, float delta_time)
 {
     //
@@ -135,65 +149,27 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
     global_scroll_update.updated = 1;
 }
 
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+    // M switches to the next colormap, see colormap.c.
+    if(key == GLFW_KEY_M && action == GLFW_PRESS)
+    {
+        global_colormap_update.kind = (colormap_kind)((global_colormap_update.kind + 1) % COLORMAP_COUNT);
+        global_colormap_update.updated = 1;
+    }
+}
+
 void glfw_error_callback(int error, const char* description)
 {
     fprintf(stderr, "Error: %s\n", description);
 }
 
-void calculate_point_cloud(opengl_frame *frame, v2f *xy_map, uint16_t *depth_map, int depth_map_count)
+void calculate_point_cloud(opengl_frame *frame, job_system *jobs, packed_point *scratch, float *history, v2f *xy_map, uint16_t *depth_map, int depth_map_width, int depth_map_height, bool filter)
 {
-    //float focal_length = 1.8f; // 1.8 mm = 0.0018 m
-
-    uint32_t insert_index = 0;
-    for(size_t i = 0; i < depth_map_count; ++i)
-    {
-        float d = (float)depth_map[i];
-
-        //int u = (int)i / depth_map_width;
-        //int v = (int)i % depth_map_width;
-
-        //float x_over_z = (u - (depth_map_width  / 2.0f)) / focal_length;
-        //float y_over_z = (v - (depth_map_height / 2.0f)) / focal_length;
-
-        //float xc = (float)u / focal_length;
-        //float yc = (float)v / focal_length;
-
-        //float z = d / sqrtf(1.0f + x_over_z * x_over_z + y_over_z * y_over_z);
-
-        color_point point;
-        point.xyz[0] = xy_map[i].x * d / 1000.0f;
-        point.xyz[1] = -xy_map[i].y * d / 1000.0f;
-        point.xyz[2] = -d / 1000.0f /*+ max_camera_z*/;
-
-        if(point.xyz[2] != 0.0f)
-        {
-            // interpolate
-            float min_z = 0.5f;
-            float max_z = 3.86f;
-
-#define clamp(x, low, high) (x) < (low) ? (low) : ((x) > (high) ? (high) : (x))
-
-            float hue = (-point.xyz[2] - min_z) / (max_z - min_z);
-            hue = clamp(hue, 0.0f, 1.0f);
-
-            // the hue of the hsv color goes from red to red so we want to scale with 2/3 which is blue
-            float range = 2.0f / 3.0f;
-
-            hue *= range;
-            hue = range - hue;
-
-            point.rgb[0] = hue;
-            point.rgb[1] = 1.0f;
-            point.rgb[2] = 1.0f;
-
-            frame->vertex_array[insert_index++] = point;
-        }
-    }
-
-    frame->vertex_count = insert_index;
+    frame->vertex_count = point_cloud_compute(jobs, frame->vertex_array, scratch, xy_map, depth_map, history, depth_map_width, depth_map_height, filter);
 }
 
-int main(void)
+int main(int argument_count, char **arguments)
 {
     //srand((unsigned)time(NULL));
 
@@ -214,33 +190,34 @@ int main(void)
 
             glfwSetMouseButtonCallback(window, mouse_button_callback);
             glfwSetScrollCallback(window, scroll_callback);
+            glfwSetKeyCallback(window, key_callback);
 
             camera_config config = K4A_DEVICE_CONFIG_INIT_DISABLE_ALL;
             config.depth_mode = K4A_DEPTH_MODE_NFOV_UNBINNED;
             config.camera_fps = K4A_FRAMES_PER_SECOND_30;
             config.synchronized_images_only = false;
 
-            tof_camera camera_ = camera_init(&config);
-            tof_camera *camera = &camera_;
+            // The camera, a recording or a synthetic scene, see depth_source.c for the arguments.
+            depth_source source_;
+            depth_source *source = &source_;
 
-            if(camera->device)
+            if(depth_source_open(source, &config, argument_count, arguments))
             {
-                int depth_map_width = camera->max_capture_width;
-                int depth_map_height = camera->max_capture_height;
+                int depth_map_width = source->width;
+                int depth_map_height = source->height;
                 int depth_map_count = depth_map_width * depth_map_height;
 
-                k4a_calibration_t calibration;
-                k4a_device_get_calibration(camera->device, config.depth_mode, config.color_resolution, &calibration);
+                depth_source_intrinsics source_intrinsics;
+                depth_source_get_intrinsics(source, &source_intrinsics);
 
-                k4a_image_t xy_image = NULL;
-                k4a_image_create(K4A_IMAGE_FORMAT_CUSTOM,
-                                 calibration.depth_camera_calibration.resolution_width,
-                                 calibration.depth_camera_calibration.resolution_height,
-                                 calibration.depth_camera_calibration.resolution_width * (int)sizeof(k4a_float2_t),
-                                 &xy_image);
+                xy_table xy_table_ = depth_source_load_xy_table(&source_intrinsics);
+                v2f *xy_map = (v2f *)xy_table_.data;
 
-                k4a_create_xy_table(&calibration, xy_image);
-                v2f *xy_map = (v2f *)k4a_image_get_buffer(xy_image);
+                // The point cloud is computed in tiles of rows on every core, see point_cloud.c.
+                job_system *jobs = job_system_create(0);
+                packed_point *scratch = (packed_point *)malloc(depth_map_count * sizeof(packed_point));
+                // The depth of every pixel in the last frame for the temporal filter, updated in place.
+                float *history = source->temporal ? (float *)calloc(depth_map_count, sizeof(float)) : NULL;
 
                 depth_image_dimension dim = {depth_map_width, depth_map_height};
                 open_gl *opengl = opengl_init(&dim);
@@ -256,9 +233,6 @@ int main(void)
                 };
                 view_control *control = &control_;
 
-                size_t depth_map_size = depth_map_count * sizeof(uint16_t);
-                uint16_t *depth_map = (uint16_t *)malloc(depth_map_size);
-
                 float delta_time = 0.0f;
                 float total_time = 0.0f;
 
@@ -290,6 +264,13 @@ int main(void)
 
                     handle_input(window, control, delta_time);
 
+                    if(global_colormap_update.updated)
+                    {
+                        opengl_set_colormap(opengl, global_colormap_update.kind);
+                        printf("Colormap: %s\n", colormap_name(global_colormap_update.kind));
+                        global_colormap_update.updated = 0;
+                    }
+
                     // @nocheckin
                     // int IsEven = (FrameCount & 1) == 0;
                     // control->position = (v3f){.x = (IsEven ? -1 : 1) * 3.0f, .y = control->position.y, .z = 4.0f};
@@ -304,7 +285,8 @@ int main(void)
 
                     opengl_frame *frame = opengl_begin_frame(opengl, render_dim);
 
-                    bool point_cloud_update = camera_get_depth_map(camera, 0, depth_map, depth_map_size);
+                    depth_frame depth = {0};
+                    bool point_cloud_update = depth_source_next_frame(source, &depth);
                     // point_cloud_update = true;
                     // if (point_cloud_update)
                     // {
@@ -315,7 +297,7 @@ int main(void)
                     //     printf("Random depth map\n");
                     //     for (int i = 0; i < depth_map_count; ++i)
                     //     {
-                    //         depth_map[i] = rand() % (6000 + 1 - 300) + 300;
+                    //         depth.depth_map[i] = rand() % (6000 + 1 - 300) + 300;
                     //     }
                     // }
 
@@ -324,7 +306,8 @@ int main(void)
                     double TimeBegin = glfwGetTime();
                     if (point_cloud_update)
                     {
-                        calculate_point_cloud(frame, xy_map, depth_map, depth_map_count);
+                        calculate_point_cloud(frame, jobs, scratch, history, xy_map, depth.depth_map, depth_map_width, depth_map_height, source->filter);
+                        depth_source_release_frame(source, &depth);
                     }
                     double TimeEnd = glfwGetTime();
                     DepthImageCount += point_cloud_update;
@@ -355,12 +338,17 @@ int main(void)
                     PrintAverage(&AvgWhole, delta_time * 1000);
                 }
 
+                depth_source_stop_recording(source);
+                job_system_destroy(jobs);
+                free(scratch);
+                free(history);
+
                 // Calling this increases the closing time noticeably...
-                //camera_release(camera);
+                //depth_source_close(source);
             }
             else
             {
-                fprintf(stderr, "Could not initialize camera.\n");
+                fprintf(stderr, "Could not open the depth source.\n");
             }
 
             glfwDestroyWindow(window);
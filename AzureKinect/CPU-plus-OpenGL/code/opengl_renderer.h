@@ -9,6 +9,14 @@ typedef struct
     float rgb[3];
 } color_point;
 
+// A point as point_cloud.c computes it: the position in millimeters and the hue of the color in 1/65535 of the color
+// circle, saturation and value are 1.
+typedef struct
+{
+    int16_t x, y, z;
+    uint16_t hue;
+} packed_point;
+
 typedef struct
 {
     mat4 model;
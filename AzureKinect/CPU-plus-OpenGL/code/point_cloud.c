@@ -0,0 +1,848 @@
+// Turns a depth map into the points of the visualizers that compute the point cloud on the CPU: every pixel with a
+// depth becomes a packed_point at xy_map * depth (y and z pointing the way the renderers expect) with the color
+// (hue, 1, 1) in HSV, the hue going from blue close to the camera to red far away. Pixels without a depth are left out,
+// and so are those without a ray, which have NaN in xy_map, so the points are compacted.
+//
+// A packed_point has 8 bytes: the position in millimeters as 16 bit integers, which covers 32.7 m in every direction,
+// and the hue in 1/65535. That is a third of what a point was with floats, for the upload to the GPU as much as for
+// the caches, and the depth map has millimeters too.
+//
+// There is a kernel for AVX2 (8 pixels at a time), one for SSE4.1 (4 pixels at a time) and a scalar one. The vector
+// kernels leave out the pixels without a depth with a lookup table that moves the valid lanes to the front, there is
+// no branch per pixel in any of them. Which one runs is decided at runtime from what the CPU supports. All of them
+// produce exactly the same points.
+//
+// point_cloud_compute() splits the depth map into tiles of rows that are computed on all threads of a job_system, see
+// point_cloud_compute_parallel().
+//
+// With the filter of depth_source.c (DEPTH_FILTER_TOLERANCE) the kernels take the depth of a pixel from its 3x3
+// neighbors instead, in the same pass, see point_cloud_compute_filtered_with(). They go through the depth map a row at
+// a time, and the three rows a row of pixels reads are used by the next two rows again, so in a tile every depth is
+// loaded from memory once. The filtered depths are never written anywhere.
+//
+// With the temporal filter (DEPTH_TEMPORAL_WEIGHT) the kernels also take a history, a float per pixel that holds its
+// depth after the filter in the last frame. It is read and written by the same kernel that computes the point, after
+// the spatial filter if that runs too, and it is the only state kept from one frame to the next.
+//
+// packed_point and v2f have to be defined and depth_source.c and job_system.c included before this file is included.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define POINT_CLOUD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define POINT_CLOUD_TARGET(features)
+#else
+#define POINT_CLOUD_TARGET(features) __attribute__((target(features)))
+#endif
+#endif
+
+// The hue interpolates between these depths in meters.
+#define POINT_CLOUD_MIN_Z 0.5f
+#define POINT_CLOUD_MAX_Z 3.86f
+
+// The hue of the hsv color goes from red to red so it is scaled with 2/3, which is blue.
+#define POINT_CLOUD_HUE_RANGE (2.0f / 3.0f)
+
+// What a unit of the coordinates and of the hue of a packed_point is. Coordinates are saturated to 16 bits.
+#define POINT_CLOUD_UNITS_PER_METER 1000.0f
+#define POINT_CLOUD_MIN_UNITS -32768.0f
+#define POINT_CLOUD_MAX_UNITS 32767.0f
+#define POINT_CLOUD_HUE_UNITS 65535.0f
+
+// Adding and subtracting 1.5 * 2^23 rounds a float below 2^22 to an integer, to the nearest and ties to even like
+// _mm_cvtps_epi32() does.
+#define POINT_CLOUD_ROUND 12582912.0f
+
+// DEPTH_FILTER_TOLERANCE in 1/65536, the filter compares depths as 16 bit integers.
+#define POINT_CLOUD_FILTER_TOLERANCE ((int)(DEPTH_FILTER_TOLERANCE * 65536.0f + 0.5f))
+
+// Rows per tile of point_cloud_compute_parallel(), doubled for tall depth maps so there are never more tiles than fit.
+#define POINT_CLOUD_TILE_ROWS 8
+#define POINT_CLOUD_MAX_TILES 256
+
+typedef enum
+{
+    point_cloud_isa_scalar,
+    point_cloud_isa_sse41,
+    point_cloud_isa_avx2,
+    point_cloud_isa_count
+} point_cloud_isa;
+
+static const char *point_cloud_isa_names[point_cloud_isa_count] = { "scalar", "SSE4.1", "AVX2" };
+
+static int16_t point_cloud_pack_coordinate(float meters)
+{
+    float units = meters * POINT_CLOUD_UNITS_PER_METER;
+    units = units > POINT_CLOUD_MIN_UNITS ? units : POINT_CLOUD_MIN_UNITS;
+    units = units < POINT_CLOUD_MAX_UNITS ? units : POINT_CLOUD_MAX_UNITS;
+    return((int16_t)((units + POINT_CLOUD_ROUND) - POINT_CLOUD_ROUND));
+}
+
+static uint16_t point_cloud_pack_hue(float hue)
+{
+    return((uint16_t)((hue * POINT_CLOUD_HUE_UNITS + POINT_CLOUD_ROUND) - POINT_CLOUD_ROUND));
+}
+
+// Every kernel does the same float operations in the same order and none of them is a multiply followed by an add,
+// which the compiler could fuse for one kernel but not the other. Returns 1 if the point is kept, which it is if the
+// pixel has a depth and a ray. The pixels outside of the field of view of the lens have NaN in the XY table, and the
+// packing would clamp their coordinates to POINT_CLOUD_MIN_UNITS.
+static inline uint32_t point_cloud_project(packed_point *point, v2f xy, float depth)
+{
+    const float hue_scale = 1.0f / (POINT_CLOUD_MAX_Z - POINT_CLOUD_MIN_Z);
+
+    float z = depth * 0.001f;
+
+    float hue = (z - POINT_CLOUD_MIN_Z) * hue_scale;
+    hue = hue < 0.0f ? 0.0f : (hue > 1.0f ? 1.0f : hue);
+    hue = (1.0f - hue) * POINT_CLOUD_HUE_RANGE;
+
+    point->x = point_cloud_pack_coordinate(xy.x * z);
+    point->y = point_cloud_pack_coordinate(-(xy.y * z));
+    point->z = point_cloud_pack_coordinate(-z);
+    point->hue = point_cloud_pack_hue(hue);
+
+    return(depth != 0.0f && xy.x == xy.x);
+}
+
+// The depth of a pixel after the temporal filter, which is its new history too. Nothing is special about a pixel
+// without a history or without a depth: a history of 0 is never close to a depth, and a depth of 0 is close to no
+// history but 0, so both start over from the depth.
+static inline float point_cloud_temporal(float *history, float depth)
+{
+    float h = *history;
+    float difference = depth - h;
+    bool same_surface = (difference < 0.0f ? -difference : difference) <= depth * DEPTH_TEMPORAL_TOLERANCE;
+    // The multiply by a power of two is exact, fused with the add or not.
+    h = same_surface ? h + difference * DEPTH_TEMPORAL_WEIGHT : depth;
+    *history = h;
+    return(h);
+}
+
+// history is NULL without the temporal filter.
+static uint32_t point_cloud_compute_scalar(packed_point *points, const v2f *xy_map, const uint16_t *depth_map, float *history, int begin, int end, uint32_t point_count)
+{
+    for(int i = begin; i < end; ++i)
+    {
+        float depth = (float)depth_map[i];
+        if(history)
+        {
+            depth = point_cloud_temporal(history + i, depth);
+        }
+
+        // Written for every pixel and kept only if there is a depth and a ray.
+        point_count += point_cloud_project(points + point_count, xy_map[i], depth);
+    }
+
+    return(point_count);
+}
+
+// The depth of pixel (x, y) after the filter, 0 if it has none or is a flying pixel. Of the neighbors on its surface
+// only the differences to its depth are summed up, which are never more than the tolerance, so the vector kernels can
+// do everything but the division in 16 bit integers and get exactly the same.
+static inline float point_cloud_filter_depth(const uint16_t *depth_map, int width, int height, int x, int y)
+{
+    int depth = depth_map[y * width + x];
+    int tolerance = (depth * POINT_CLOUD_FILTER_TOLERANCE) >> 16;
+
+    int difference_sum = 0;
+    int count = 0;
+    for(int neighbor_y = y - 1; neighbor_y <= y + 1; ++neighbor_y)
+    {
+        for(int neighbor_x = x - 1; neighbor_x <= x + 1; ++neighbor_x)
+        {
+            bool inside = neighbor_x >= 0 && neighbor_x < width && neighbor_y >= 0 && neighbor_y < height;
+            int difference = (inside ? depth_map[neighbor_y * width + neighbor_x] : 0) - depth;
+            bool same_surface = (difference < 0 ? -difference : difference) <= tolerance;
+            difference_sum += same_surface ? difference : 0;
+            count += same_surface;
+        }
+    }
+
+    // The pixel itself is one of them.
+    bool keep = depth != 0 && count > DEPTH_FILTER_MIN_NEIGHBORS;
+    return(keep ? (float)depth + (float)difference_sum / (float)count : 0.0f);
+}
+
+// The points of the pixels from x = begin to end of row y with the filtered depth.
+static uint32_t point_cloud_filter_scalar(packed_point *points, const v2f *xy_map, const uint16_t *depth_map, float *history, int width, int height, int y, int begin, int end, uint32_t point_count)
+{
+    for(int x = begin; x < end; ++x)
+    {
+        float depth = point_cloud_filter_depth(depth_map, width, height, x, y);
+        if(history)
+        {
+            depth = point_cloud_temporal(history + y * width + x, depth);
+        }
+        point_count += point_cloud_project(points + point_count, xy_map[y * width + x], depth);
+    }
+
+    return(point_count);
+}
+
+#if defined(POINT_CLOUD_X86)
+
+// For every mask of valid lanes the lanes that are moved to the front, in order.
+static uint64_t point_cloud_compact_avx2[256]; // 8 lanes, 1 byte each.
+static uint8_t point_cloud_compact_sse41[16][16]; // 4 lanes, the 4 bytes of each for _mm_shuffle_epi8().
+
+static void point_cloud_init_tables(void)
+{
+    for(int mask = 0; mask < 256; ++mask)
+    {
+        uint64_t lanes = 0;
+        int count = 0;
+        for(int lane = 0; lane < 8; ++lane)
+        {
+            if(mask & (1 << lane))
+            {
+                lanes |= (uint64_t)lane << (8 * count++);
+            }
+        }
+        point_cloud_compact_avx2[mask] = lanes;
+    }
+
+    for(int mask = 0; mask < 16; ++mask)
+    {
+        int count = 0;
+        memset(point_cloud_compact_sse41[mask], 0x80, 16);
+        for(int lane = 0; lane < 4; ++lane)
+        {
+            if(mask & (1 << lane))
+            {
+                for(int byte = 0; byte < 4; ++byte)
+                {
+                    point_cloud_compact_sse41[mask][4 * count + byte] = (uint8_t)(4 * lane + byte);
+                }
+                ++count;
+            }
+        }
+    }
+}
+
+// Packs and writes 4 points, of which the first ones are the valid ones. The ones after them are overwritten by the
+// next call.
+POINT_CLOUD_TARGET("sse4.1,popcnt")
+static inline void point_cloud_store_4(packed_point *points, __m128 x, __m128 y, __m128 z, __m128 hue)
+{
+    const __m128 scale = _mm_set1_ps(POINT_CLOUD_UNITS_PER_METER);
+    const __m128 min_units = _mm_set1_ps(POINT_CLOUD_MIN_UNITS);
+    const __m128 max_units = _mm_set1_ps(POINT_CLOUD_MAX_UNITS);
+
+    __m128i x_units = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(x, scale), min_units), max_units));
+    __m128i y_units = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(y, scale), min_units), max_units));
+    __m128i z_units = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(z, scale), min_units), max_units));
+    __m128i hue_units = _mm_cvtps_epi32(_mm_mul_ps(hue, _mm_set1_ps(POINT_CLOUD_HUE_UNITS)));
+
+    // x0 x1 x2 x3 y0 y1 y2 y3 and z0 z1 z2 z3 h0 h1 h2 h3, interleaved twice to x0 y0 z0 h0 x1 y1 z1 h1 ...
+    __m128i xy = _mm_packs_epi32(x_units, y_units);
+    __m128i z_hue = _mm_blend_epi16(_mm_packs_epi32(z_units, z_units), _mm_packus_epi32(hue_units, hue_units), 0xF0);
+    __m128i xz = _mm_unpacklo_epi16(xy, z_hue);
+    __m128i y_hue = _mm_unpackhi_epi16(xy, z_hue);
+    _mm_storeu_si128((__m128i *)(points + 0), _mm_unpacklo_epi16(xz, y_hue));
+    _mm_storeu_si128((__m128i *)(points + 2), _mm_unpackhi_epi16(xz, y_hue));
+}
+
+// The 4 depths from depth_map on as floats.
+POINT_CLOUD_TARGET("sse4.1,popcnt")
+static inline __m128 point_cloud_load_4(const uint16_t *depth_map)
+{
+    return(_mm_cvtepi32_ps(_mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i *)depth_map))));
+}
+
+// point_cloud_temporal() of 4 pixels with the history from history on. Only the lanes set in update write their
+// history, the others are pixels that were done already.
+POINT_CLOUD_TARGET("sse4.1,popcnt")
+static inline __m128 point_cloud_temporal_4(float *history, __m128 d, __m128 update)
+{
+    const __m128 tolerance = _mm_set1_ps(DEPTH_TEMPORAL_TOLERANCE);
+    const __m128 weight = _mm_set1_ps(DEPTH_TEMPORAL_WEIGHT);
+    const __m128 sign = _mm_set1_ps(-0.0f);
+
+    __m128 old_h = _mm_loadu_ps(history);
+    __m128 difference = _mm_sub_ps(d, old_h);
+    __m128 same_surface = _mm_cmple_ps(_mm_andnot_ps(sign, difference), _mm_mul_ps(d, tolerance));
+    __m128 h = _mm_blendv_ps(d, _mm_add_ps(old_h, _mm_mul_ps(difference, weight)), same_surface);
+    _mm_storeu_ps(history, _mm_blendv_ps(old_h, h, update));
+    return(h);
+}
+
+// The lanes of a vector of 4 floats whose bits are set in mask.
+POINT_CLOUD_TARGET("sse4.1,popcnt")
+static inline __m128 point_cloud_lanes_4(int mask)
+{
+    const __m128i bits = _mm_setr_epi32(1, 2, 4, 8);
+    return(_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(mask), bits), bits)));
+}
+
+// Computes the points of 4 pixels with the rays from xy_map on and the depths d, writes those in mask that have a ray
+// to points and returns how many there are. There are never more points than pixels before them, so all 4 fit.
+POINT_CLOUD_TARGET("sse4.1,popcnt")
+static inline uint32_t point_cloud_project_4(packed_point *points, const v2f *xy_map, __m128 d, int mask)
+{
+    const __m128 scale = _mm_set1_ps(0.001f);
+    const __m128 min_z = _mm_set1_ps(POINT_CLOUD_MIN_Z);
+    const __m128 hue_scale = _mm_set1_ps(1.0f / (POINT_CLOUD_MAX_Z - POINT_CLOUD_MIN_Z));
+    const __m128 hue_range = _mm_set1_ps(POINT_CLOUD_HUE_RANGE);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 sign = _mm_set1_ps(-0.0f);
+
+    __m128 z = _mm_mul_ps(d, scale);
+
+    __m128 xy0 = _mm_loadu_ps(&xy_map[0].x);
+    __m128 xy1 = _mm_loadu_ps(&xy_map[2].x);
+    __m128 x = _mm_shuffle_ps(xy0, xy1, _MM_SHUFFLE(2, 0, 2, 0));
+    // The pixels without a ray, see point_cloud_project().
+    mask &= _mm_movemask_ps(_mm_cmpord_ps(x, x));
+    x = _mm_mul_ps(x, z);
+    __m128 y = _mm_xor_ps(_mm_mul_ps(_mm_shuffle_ps(xy0, xy1, _MM_SHUFFLE(3, 1, 3, 1)), z), sign);
+
+    __m128 hue = _mm_mul_ps(_mm_sub_ps(z, min_z), hue_scale);
+    hue = _mm_min_ps(_mm_max_ps(hue, zero), one);
+    hue = _mm_mul_ps(_mm_sub_ps(one, hue), hue_range);
+
+    __m128i lanes = _mm_loadu_si128((const __m128i *)point_cloud_compact_sse41[mask]);
+    x = _mm_castsi128_ps(_mm_shuffle_epi8(_mm_castps_si128(x), lanes));
+    y = _mm_castsi128_ps(_mm_shuffle_epi8(_mm_castps_si128(y), lanes));
+    z = _mm_castsi128_ps(_mm_shuffle_epi8(_mm_castps_si128(_mm_xor_ps(z, sign)), lanes));
+    hue = _mm_castsi128_ps(_mm_shuffle_epi8(_mm_castps_si128(hue), lanes));
+
+    point_cloud_store_4(points, x, y, z, hue);
+    return(_mm_popcnt_u32((unsigned int)mask));
+}
+
+POINT_CLOUD_TARGET("sse4.1,popcnt")
+static uint32_t point_cloud_compute_sse41(packed_point *points, const v2f *xy_map, const uint16_t *depth_map, float *history, int depth_map_count)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 all_lanes = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+    uint32_t point_count = 0;
+    int i = 0;
+    for(; i + 4 <= depth_map_count; i += 4)
+    {
+        __m128 d = point_cloud_load_4(depth_map + i);
+        if(history)
+        {
+            d = point_cloud_temporal_4(history + i, d, all_lanes);
+        }
+        int mask = _mm_movemask_ps(_mm_cmpneq_ps(d, zero));
+        point_count += point_cloud_project_4(points + point_count, xy_map + i, d, mask);
+    }
+
+    return(point_cloud_compute_scalar(points, xy_map, depth_map, history, i, depth_map_count, point_count));
+}
+
+// Like point_cloud_filter_depth() for the 8 pixels from depth_map + i on, which all have their neighbors in the depth
+// map. The filtered depths of the first and the last 4 of them go to depths, and those that keep a depth are set in
+// masks.
+POINT_CLOUD_TARGET("sse4.1,popcnt")
+static inline void point_cloud_filter_8_sse41(const uint16_t *depth_map, int i, int width, __m128 *depths, int *masks)
+{
+    const __m128i tolerance_scale = _mm_set1_epi16((short)POINT_CLOUD_FILTER_TOLERANCE);
+    const __m128i min_neighbors = _mm_set1_epi16(DEPTH_FILTER_MIN_NEIGHBORS);
+    const __m128i zero = _mm_setzero_si128();
+
+    __m128i depth = _mm_loadu_si128((const __m128i *)(depth_map + i));
+    __m128i tolerance = _mm_mulhi_epu16(depth, tolerance_scale);
+
+    __m128i difference_sum = zero;
+    __m128i count = zero;
+    for(int row = i - width; row <= i + width; row += width)
+    {
+        for(int column = -1; column <= 1; ++column)
+        {
+            __m128i neighbor = _mm_loadu_si128((const __m128i *)(depth_map + row + column));
+            __m128i distance = _mm_or_si128(_mm_subs_epu16(neighbor, depth), _mm_subs_epu16(depth, neighbor));
+            __m128i same_surface = _mm_cmpeq_epi16(_mm_max_epu16(distance, tolerance), tolerance);
+            // Wraps around for the neighbors that are far away, which are not summed up.
+            difference_sum = _mm_add_epi16(difference_sum, _mm_and_si128(same_surface, _mm_sub_epi16(neighbor, depth)));
+            count = _mm_sub_epi16(count, same_surface);
+        }
+    }
+
+    __m128i keep = _mm_andnot_si128(_mm_cmpeq_epi16(depth, zero), _mm_cmpgt_epi16(count, min_neighbors));
+    for(int half = 0; half < 2; ++half)
+    {
+        __m128i d = _mm_cvtepu16_epi32(depth);
+        __m128 filtered = _mm_add_ps(_mm_cvtepi32_ps(d), _mm_div_ps(_mm_cvtepi32_ps(_mm_cvtepi16_epi32(difference_sum)),
+                                                                     _mm_cvtepi32_ps(_mm_cvtepi16_epi32(count))));
+        __m128 keep_half = _mm_castsi128_ps(_mm_cvtepi16_epi32(keep));
+        depths[half] = _mm_and_ps(filtered, keep_half);
+        masks[half] = _mm_movemask_ps(keep_half);
+
+        depth = _mm_srli_si128(depth, 8);
+        difference_sum = _mm_srli_si128(difference_sum, 8);
+        count = _mm_srli_si128(count, 8);
+        keep = _mm_srli_si128(keep, 8);
+    }
+}
+
+// The points of row y, which is not the first or the last one, with the filtered depth.
+POINT_CLOUD_TARGET("sse4.1,popcnt")
+static uint32_t point_cloud_filter_row_sse41(packed_point *points, const v2f *xy_map, const uint16_t *depth_map, float *history, int width, int height, int y, uint32_t point_count)
+{
+    // The first and the last pixel have neighbors outside of the depth map.
+    point_count = point_cloud_filter_scalar(points, xy_map, depth_map, history, width, height, y, 0, 1, point_count);
+
+    int x = 1;
+    while(x < width - 1)
+    {
+        // The pixels left at the end of the row are done with the last 8 before the last pixel, leaving out those that
+        // are done already.
+        int first = x;
+        if(x + 8 >= width)
+        {
+            first = width - 9;
+            if(first < 1)
+            {
+                break;
+            }
+        }
+        int done_mask = ~((1 << (x - first)) - 1);
+
+        __m128 depths[2];
+        int masks[2];
+        int i = y * width + first;
+        point_cloud_filter_8_sse41(depth_map, i, width, depths, masks);
+        if(history)
+        {
+            depths[0] = point_cloud_temporal_4(history + i, depths[0], point_cloud_lanes_4(done_mask));
+            depths[1] = point_cloud_temporal_4(history + i + 4, depths[1], point_cloud_lanes_4(done_mask >> 4));
+        }
+        point_count += point_cloud_project_4(points + point_count, xy_map + i, depths[0], masks[0] & done_mask);
+        point_count += point_cloud_project_4(points + point_count, xy_map + i + 4, depths[1], masks[1] & (done_mask >> 4));
+        x = first + 8;
+    }
+
+    return(point_cloud_filter_scalar(points, xy_map, depth_map, history, width, height, y, x, width, point_count));
+}
+
+// Like point_cloud_store_4() for 8 points.
+POINT_CLOUD_TARGET("avx2,popcnt")
+static inline void point_cloud_store_8(packed_point *points, __m256 x, __m256 y, __m256 z, __m256 hue)
+{
+    const __m256 scale = _mm256_set1_ps(POINT_CLOUD_UNITS_PER_METER);
+    const __m256 min_units = _mm256_set1_ps(POINT_CLOUD_MIN_UNITS);
+    const __m256 max_units = _mm256_set1_ps(POINT_CLOUD_MAX_UNITS);
+
+    __m256i x_units = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(x, scale), min_units), max_units));
+    __m256i y_units = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(y, scale), min_units), max_units));
+    __m256i z_units = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(z, scale), min_units), max_units));
+    __m256i hue_units = _mm256_cvtps_epi32(_mm256_mul_ps(hue, _mm256_set1_ps(POINT_CLOUD_HUE_UNITS)));
+
+    // The same as in point_cloud_store_4() in both 128 bit halves, which hold points 0 to 3 and 4 to 7.
+    __m256i xy = _mm256_packs_epi32(x_units, y_units);
+    __m256i z_hue = _mm256_blend_epi16(_mm256_packs_epi32(z_units, z_units), _mm256_packus_epi32(hue_units, hue_units), 0xF0);
+    __m256i xz = _mm256_unpacklo_epi16(xy, z_hue);
+    __m256i y_hue = _mm256_unpackhi_epi16(xy, z_hue);
+    __m256i points_0145 = _mm256_unpacklo_epi16(xz, y_hue);
+    __m256i points_2367 = _mm256_unpackhi_epi16(xz, y_hue);
+    _mm256_storeu_si256((__m256i *)(points + 0), _mm256_permute2x128_si256(points_0145, points_2367, 0x20));
+    _mm256_storeu_si256((__m256i *)(points + 4), _mm256_permute2x128_si256(points_0145, points_2367, 0x31));
+}
+
+// Like point_cloud_load_4() for 8 depths.
+POINT_CLOUD_TARGET("avx2,popcnt")
+static inline __m256 point_cloud_load_8(const uint16_t *depth_map)
+{
+    return(_mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)depth_map))));
+}
+
+// Like point_cloud_temporal_4() for 8 pixels.
+POINT_CLOUD_TARGET("avx2,popcnt")
+static inline __m256 point_cloud_temporal_8(float *history, __m256 d, __m256 update)
+{
+    const __m256 tolerance = _mm256_set1_ps(DEPTH_TEMPORAL_TOLERANCE);
+    const __m256 weight = _mm256_set1_ps(DEPTH_TEMPORAL_WEIGHT);
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+
+    __m256 old_h = _mm256_loadu_ps(history);
+    __m256 difference = _mm256_sub_ps(d, old_h);
+    __m256 same_surface = _mm256_cmp_ps(_mm256_andnot_ps(sign, difference), _mm256_mul_ps(d, tolerance), _CMP_LE_OQ);
+    __m256 h = _mm256_blendv_ps(d, _mm256_add_ps(old_h, _mm256_mul_ps(difference, weight)), same_surface);
+    _mm256_storeu_ps(history, _mm256_blendv_ps(old_h, h, update));
+    return(h);
+}
+
+// Like point_cloud_lanes_4() for 8 lanes.
+POINT_CLOUD_TARGET("avx2,popcnt")
+static inline __m256 point_cloud_lanes_8(int mask)
+{
+    const __m256i bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    return(_mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(mask), bits), bits)));
+}
+
+// Like point_cloud_project_4() for 8 pixels.
+POINT_CLOUD_TARGET("avx2,popcnt")
+static inline uint32_t point_cloud_project_8(packed_point *points, const v2f *xy_map, __m256 d, int mask)
+{
+    const __m256 scale = _mm256_set1_ps(0.001f);
+    const __m256 min_z = _mm256_set1_ps(POINT_CLOUD_MIN_Z);
+    const __m256 hue_scale = _mm256_set1_ps(1.0f / (POINT_CLOUD_MAX_Z - POINT_CLOUD_MIN_Z));
+    const __m256 hue_range = _mm256_set1_ps(POINT_CLOUD_HUE_RANGE);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+
+    __m256 z = _mm256_mul_ps(d, scale);
+
+    // x0 y0 x1 y1 x2 y2 x3 y3 and x4 y4 ... shuffled within the 128 bit halves to x0 x1 x4 x5 x2 x3 x6 x7.
+    __m256 xy0 = _mm256_loadu_ps(&xy_map[0].x);
+    __m256 xy1 = _mm256_loadu_ps(&xy_map[4].x);
+    __m256 x = _mm256_shuffle_ps(xy0, xy1, _MM_SHUFFLE(2, 0, 2, 0));
+    __m256 y = _mm256_shuffle_ps(xy0, xy1, _MM_SHUFFLE(3, 1, 3, 1));
+    x = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(x), _MM_SHUFFLE(3, 1, 2, 0)));
+    y = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(y), _MM_SHUFFLE(3, 1, 2, 0)));
+    mask &= _mm256_movemask_ps(_mm256_cmp_ps(x, x, _CMP_ORD_Q));
+    x = _mm256_mul_ps(x, z);
+    y = _mm256_xor_ps(_mm256_mul_ps(y, z), sign);
+
+    __m256 hue = _mm256_mul_ps(_mm256_sub_ps(z, min_z), hue_scale);
+    hue = _mm256_min_ps(_mm256_max_ps(hue, zero), one);
+    hue = _mm256_mul_ps(_mm256_sub_ps(one, hue), hue_range);
+
+    __m256i lanes = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(point_cloud_compact_avx2 + mask)));
+    x = _mm256_permutevar8x32_ps(x, lanes);
+    y = _mm256_permutevar8x32_ps(y, lanes);
+    z = _mm256_permutevar8x32_ps(_mm256_xor_ps(z, sign), lanes);
+    hue = _mm256_permutevar8x32_ps(hue, lanes);
+
+    point_cloud_store_8(points, x, y, z, hue);
+    return(_mm_popcnt_u32((unsigned int)mask));
+}
+
+POINT_CLOUD_TARGET("avx2,popcnt")
+static uint32_t point_cloud_compute_avx2(packed_point *points, const v2f *xy_map, const uint16_t *depth_map, float *history, int depth_map_count)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 all_lanes = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+    uint32_t point_count = 0;
+    int i = 0;
+    for(; i + 8 <= depth_map_count; i += 8)
+    {
+        __m256 d = point_cloud_load_8(depth_map + i);
+        if(history)
+        {
+            d = point_cloud_temporal_8(history + i, d, all_lanes);
+        }
+        int mask = _mm256_movemask_ps(_mm256_cmp_ps(d, zero, _CMP_NEQ_OQ));
+        point_count += point_cloud_project_8(points + point_count, xy_map + i, d, mask);
+    }
+
+    return(point_cloud_compute_scalar(points, xy_map, depth_map, history, i, depth_map_count, point_count));
+}
+
+// Like point_cloud_filter_8_sse41() for 16 pixels, of which the filtered depths of the first and the last 8 go to
+// depths.
+POINT_CLOUD_TARGET("avx2,popcnt")
+static inline void point_cloud_filter_16_avx2(const uint16_t *depth_map, int i, int width, __m256 *depths, int *masks)
+{
+    const __m256i tolerance_scale = _mm256_set1_epi16((short)POINT_CLOUD_FILTER_TOLERANCE);
+    const __m256i min_neighbors = _mm256_set1_epi16(DEPTH_FILTER_MIN_NEIGHBORS);
+    const __m256i zero = _mm256_setzero_si256();
+
+    __m256i depth = _mm256_loadu_si256((const __m256i *)(depth_map + i));
+    __m256i tolerance = _mm256_mulhi_epu16(depth, tolerance_scale);
+
+    __m256i difference_sum = zero;
+    __m256i count = zero;
+    for(int row = i - width; row <= i + width; row += width)
+    {
+        for(int column = -1; column <= 1; ++column)
+        {
+            __m256i neighbor = _mm256_loadu_si256((const __m256i *)(depth_map + row + column));
+            __m256i distance = _mm256_or_si256(_mm256_subs_epu16(neighbor, depth), _mm256_subs_epu16(depth, neighbor));
+            __m256i same_surface = _mm256_cmpeq_epi16(_mm256_max_epu16(distance, tolerance), tolerance);
+            difference_sum = _mm256_add_epi16(difference_sum, _mm256_and_si256(same_surface, _mm256_sub_epi16(neighbor, depth)));
+            count = _mm256_sub_epi16(count, same_surface);
+        }
+    }
+
+    __m256i keep = _mm256_andnot_si256(_mm256_cmpeq_epi16(depth, zero), _mm256_cmpgt_epi16(count, min_neighbors));
+    for(int half = 0; half < 2; ++half)
+    {
+        __m128i depth_half = half ? _mm256_extracti128_si256(depth, 1) : _mm256_castsi256_si128(depth);
+        __m128i sum_half = half ? _mm256_extracti128_si256(difference_sum, 1) : _mm256_castsi256_si128(difference_sum);
+        __m128i count_half = half ? _mm256_extracti128_si256(count, 1) : _mm256_castsi256_si128(count);
+        __m128i keep_half = half ? _mm256_extracti128_si256(keep, 1) : _mm256_castsi256_si128(keep);
+
+        __m256 filtered = _mm256_add_ps(_mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(depth_half)),
+                                        _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(sum_half)),
+                                                      _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(count_half))));
+        __m256 keep_lanes = _mm256_castsi256_ps(_mm256_cvtepi16_epi32(keep_half));
+        depths[half] = _mm256_and_ps(filtered, keep_lanes);
+        masks[half] = _mm256_movemask_ps(keep_lanes);
+    }
+}
+
+// Like point_cloud_filter_row_sse41() 16 pixels at a time.
+POINT_CLOUD_TARGET("avx2,popcnt")
+static uint32_t point_cloud_filter_row_avx2(packed_point *points, const v2f *xy_map, const uint16_t *depth_map, float *history, int width, int height, int y, uint32_t point_count)
+{
+    point_count = point_cloud_filter_scalar(points, xy_map, depth_map, history, width, height, y, 0, 1, point_count);
+
+    int x = 1;
+    while(x < width - 1)
+    {
+        int first = x;
+        if(x + 16 >= width)
+        {
+            first = width - 17;
+            if(first < 1)
+            {
+                break;
+            }
+        }
+        int done_mask = ~((1 << (x - first)) - 1);
+
+        __m256 depths[2];
+        int masks[2];
+        int i = y * width + first;
+        point_cloud_filter_16_avx2(depth_map, i, width, depths, masks);
+        if(history)
+        {
+            depths[0] = point_cloud_temporal_8(history + i, depths[0], point_cloud_lanes_8(done_mask));
+            depths[1] = point_cloud_temporal_8(history + i + 8, depths[1], point_cloud_lanes_8(done_mask >> 8));
+        }
+        point_count += point_cloud_project_8(points + point_count, xy_map + i, depths[0], masks[0] & done_mask);
+        point_count += point_cloud_project_8(points + point_count, xy_map + i + 8, depths[1], masks[1] & (done_mask >> 8));
+        x = first + 16;
+    }
+
+    return(point_cloud_filter_scalar(points, xy_map, depth_map, history, width, height, y, x, width, point_count));
+}
+
+static bool point_cloud_has_sse41(void)
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return((info[2] & (1 << 19)) && (info[2] & (1 << 23))); // SSE4.1 and POPCNT
+#else
+    return(__builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("popcnt"));
+#endif
+}
+
+static bool point_cloud_has_avx2(void)
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    bool os_saves_ymm = (info[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6; // OSXSAVE, then XMM and YMM state enabled
+    __cpuid(info, 0);
+    if(!os_saves_ymm || info[0] < 7)
+    {
+        return(false);
+    }
+    __cpuidex(info, 7, 0);
+    return((info[1] & (1 << 5)) != 0);
+#else
+    return(__builtin_cpu_supports("avx2"));
+#endif
+}
+
+#endif
+
+// The best kernel the CPU can run.
+point_cloud_isa point_cloud_get_best_isa(void)
+{
+#if defined(POINT_CLOUD_X86)
+    if(point_cloud_has_avx2() && point_cloud_has_sse41())
+    {
+        return(point_cloud_isa_avx2);
+    }
+    if(point_cloud_has_sse41())
+    {
+        return(point_cloud_isa_sse41);
+    }
+#endif
+    return(point_cloud_isa_scalar);
+}
+
+// Has to be called before any kernel runs, on one thread.
+static void point_cloud_prepare(void)
+{
+#if defined(POINT_CLOUD_X86)
+    static bool tables_initialized = false;
+    if(!tables_initialized)
+    {
+        point_cloud_init_tables();
+        tables_initialized = true;
+    }
+#endif
+}
+
+// Computes the points of all pixels that have a depth with the kernel for isa, which the CPU has to support, and
+// returns how many there are. points needs room for depth_map_count of them. history has a float per pixel for the
+// temporal filter, see DEPTH_TEMPORAL_WEIGHT, all 0 before the first frame, or is NULL to leave it out.
+uint32_t point_cloud_compute_with(point_cloud_isa isa, packed_point *points, const v2f *xy_map, const uint16_t *depth_map, float *history, int depth_map_count)
+{
+    point_cloud_prepare();
+
+#if defined(POINT_CLOUD_X86)
+    switch(isa)
+    {
+        case point_cloud_isa_avx2: return(point_cloud_compute_avx2(points, xy_map, depth_map, history, depth_map_count));
+        case point_cloud_isa_sse41: return(point_cloud_compute_sse41(points, xy_map, depth_map, history, depth_map_count));
+        default: break;
+    }
+#endif
+    return(point_cloud_compute_scalar(points, xy_map, depth_map, history, 0, depth_map_count, 0));
+}
+
+// Like point_cloud_compute_with() for the rows from first_row to end_row of a depth map of width * height with the
+// filtered depths, see DEPTH_FILTER_TOLERANCE. The filter reads the rows around them too, but only the points of
+// these rows are computed, so points needs room for a point per pixel of them.
+uint32_t point_cloud_compute_filtered_with(point_cloud_isa isa, packed_point *points, const v2f *xy_map, const uint16_t *depth_map, float *history, int width, int height, int first_row, int end_row)
+{
+    point_cloud_prepare();
+
+    uint32_t point_count = 0;
+    for(int y = first_row; y < end_row; ++y)
+    {
+        // The pixels of the first and the last row have neighbors outside of the depth map, which only the scalar
+        // kernel looks out for.
+        bool inner_row = (y > 0 && y < height - 1);
+#if defined(POINT_CLOUD_X86)
+        if(inner_row && isa == point_cloud_isa_avx2)
+        {
+            point_count = point_cloud_filter_row_avx2(points, xy_map, depth_map, history, width, height, y, point_count);
+            continue;
+        }
+        if(inner_row && isa == point_cloud_isa_sse41)
+        {
+            point_count = point_cloud_filter_row_sse41(points, xy_map, depth_map, history, width, height, y, point_count);
+            continue;
+        }
+#endif
+        point_count = point_cloud_filter_scalar(points, xy_map, depth_map, history, width, height, y, 0, width, point_count);
+    }
+
+    return(point_count);
+}
+
+typedef struct
+{
+    point_cloud_isa isa;
+    bool filter;
+    packed_point *points;
+    packed_point *scratch;
+    const v2f *xy_map;
+    const uint16_t *depth_map;
+    float *history;
+    int width;
+    int height;
+    int tile_rows;
+    int tile_size; // In pixels.
+    uint32_t counts[POINT_CLOUD_MAX_TILES];
+    uint32_t offsets[POINT_CLOUD_MAX_TILES];
+} point_cloud_tiles;
+
+static void point_cloud_compute_tiles(void *data, int begin, int end)
+{
+    point_cloud_tiles *tiles = (point_cloud_tiles *)data;
+    int pixel_count = tiles->width * tiles->height;
+    for(int tile = begin; tile < end; ++tile)
+    {
+        int first = tile * tiles->tile_size;
+        if(tiles->filter)
+        {
+            // The filter reads the rows next to the tile from the depth map like any other, nothing is copied.
+            int first_row = tile * tiles->tile_rows;
+            int end_row = (tiles->height - first_row < tiles->tile_rows) ? tiles->height : first_row + tiles->tile_rows;
+            tiles->counts[tile] = point_cloud_compute_filtered_with(tiles->isa, tiles->scratch + first, tiles->xy_map,
+                                                                    tiles->depth_map, tiles->history, tiles->width,
+                                                                    tiles->height, first_row, end_row);
+        }
+        else
+        {
+            int count = (pixel_count - first < tiles->tile_size) ? pixel_count - first : tiles->tile_size;
+            tiles->counts[tile] = point_cloud_compute_with(tiles->isa, tiles->scratch + first, tiles->xy_map + first,
+                                                           tiles->depth_map + first,
+                                                           tiles->history ? tiles->history + first : NULL, count);
+        }
+    }
+}
+
+static void point_cloud_gather_tiles(void *data, int begin, int end)
+{
+    point_cloud_tiles *tiles = (point_cloud_tiles *)data;
+    for(int tile = begin; tile < end; ++tile)
+    {
+        memcpy(tiles->points + tiles->offsets[tile], tiles->scratch + tile * tiles->tile_size,
+               tiles->counts[tile] * sizeof(packed_point));
+    }
+}
+
+// Like point_cloud_compute_with() on all threads of jobs, or point_cloud_compute_filtered_with() if filter is set.
+// Either runs the temporal filter too if there is a history. Every tile of rows writes its points to scratch, starting
+// at its first pixel, and the prefix sum of the point counts of the tiles says where they go in points. So the points
+// are in the same order as on one thread, whichever thread computed which tile. scratch needs room for a point per
+// pixel too.
+uint32_t point_cloud_compute_parallel(job_system *jobs, point_cloud_isa isa, packed_point *points, packed_point *scratch, const v2f *xy_map, const uint16_t *depth_map, float *history, int width, int height, bool filter)
+{
+    if(jobs->thread_count == 1)
+    {
+        if(filter)
+        {
+            return(point_cloud_compute_filtered_with(isa, points, xy_map, depth_map, history, width, height, 0, height));
+        }
+        return(point_cloud_compute_with(isa, points, xy_map, depth_map, history, width * height));
+    }
+
+    point_cloud_prepare();
+
+    int tile_rows = POINT_CLOUD_TILE_ROWS;
+    while((height + tile_rows - 1) / tile_rows > POINT_CLOUD_MAX_TILES)
+    {
+        tile_rows *= 2;
+    }
+    int tile_count = (height + tile_rows - 1) / tile_rows;
+
+    point_cloud_tiles tiles;
+    tiles.isa = isa;
+    tiles.filter = filter;
+    tiles.points = points;
+    tiles.scratch = scratch;
+    tiles.xy_map = xy_map;
+    tiles.depth_map = depth_map;
+    tiles.history = history;
+    tiles.width = width;
+    tiles.height = height;
+    tiles.tile_rows = tile_rows;
+    tiles.tile_size = tile_rows * width;
+
+    job_parallel_for(jobs, tile_count, 1, point_cloud_compute_tiles, &tiles);
+
+    uint32_t point_count = 0;
+    for(int tile = 0; tile < tile_count; ++tile)
+    {
+        tiles.offsets[tile] = point_count;
+        point_count += tiles.counts[tile];
+    }
+
+    job_parallel_for(jobs, tile_count, 1, point_cloud_gather_tiles, &tiles);
+    return(point_count);
+}
+
+// Like point_cloud_compute_parallel() with the best kernel the CPU can run.
+uint32_t point_cloud_compute(job_system *jobs, packed_point *points, packed_point *scratch, const v2f *xy_map, const uint16_t *depth_map, float *history, int width, int height, bool filter)
+{
+    static int isa = -1;
+    if(isa < 0)
+    {
+        isa = (int)point_cloud_get_best_isa();
+        printf("Computing the point cloud with %s on %d threads%s%s.\n", point_cloud_isa_names[isa], jobs->thread_count,
+               filter ? ", filtering the depth" : "", history ? ", averaging it over time" : "");
+    }
+    return(point_cloud_compute_parallel(jobs, (point_cloud_isa)isa, points, scratch, xy_map, depth_map, history, width, height, filter));
+}
@@ -8,6 +8,10 @@ typedef cl_int (*clGetGLContextInfoKHR_fn)(const cl_context_properties* properti
 
 #define QUERY_COUNT 5
 
+// The compute kernel works on tiles of COMPUTE_TILE_SIZE x COMPUTE_TILE_SIZE pixels, it has to be the
+// reqd_work_group_size of the kernel.
+#define COMPUTE_TILE_SIZE 16
+
 typedef struct
 {
     cl_platform_id Platform;
@@ -29,8 +33,18 @@ typedef struct
     cl_mem XYMapImage;
     cl_mem PositionImage;
     cl_mem ColorImage;
+    cl_mem ColormapImage;
 
     cl_event FirstAndLastEvent[2][QUERY_COUNT][2];
+
+    // if set the kernel evaluates the lens model itself and the xy map image is only a 1x1 placeholder
+    cl_int AnalyticUnprojection;
+    cl_float16 Intrinsics;
+
+    // if set the compute kernel filters the depth first, see DEPTH_FILTER_TOLERANCE
+    cl_int SpatialFilter;
+    // the depth of every pixel in the last frame for the temporal filter (see DEPTH_TEMPORAL_WEIGHT), NULL without it
+    cl_mem History;
     
     bool SupportsGLContextSharing;
     
@@ -49,54 +63,177 @@ void BuildPointCloudComputeProgram(open_cl *OpenCL)
 {
     // Compiling the compute program.
     char *ComputeSource = 
-    "float3 HSVToRGB(float3 HSV)                                                         \n"
+    "// The colors of the hues, see colormap.c.                                          \n"
+    "__constant sampler_t ColormapSampler = CLK_NORMALIZED_COORDS_TRUE |                 \n"
+    "                                       CLK_ADDRESS_CLAMP_TO_EDGE |                  \n"
+    "                                       CLK_FILTER_LINEAR;                           \n"
+    "                                                                                    \n"
+    "// Has to give the same result as camera_unproject() in k4a.c. The intrinsics are   \n"
+    "// cx, cy, fx, fy, k1 - k6, p1, p2, codx, cody and the metric radius.               \n"
+    "bool Unproject(float16 In, float2 UV, float2 *XY)                                   \n"
     "{                                                                                   \n"
-    "    float3 RGB;                                                                     \n"
+    "    float Cx = In.s0, Cy = In.s1, Fx = In.s2, Fy = In.s3;                           \n"
+    "    float K1 = In.s4, K2 = In.s5, K3 = In.s6, K4 = In.s7, K5 = In.s8, K6 = In.s9;   \n"
+    "    float P1 = In.sa, P2 = In.sb, Codx = In.sc, Cody = In.sd, MetricRadius = In.se; \n"
+    "                                                                                    \n"
+    "    float XpD = (UV.x - Cx) / Fx - Codx;                                            \n"
+    "    float YpD = (UV.y - Cy) / Fy - Cody;                                            \n"
     "                                                                                    \n"
-    "    int I;                                                                          \n"
-    "    float F, P, Q, T;                                                               \n"
+    "    float Rs = XpD * XpD + YpD * YpD;                                               \n"
+    "    float A = 1.0f + Rs * (K1 + Rs * (K2 + Rs * K3));                               \n"
+    "    float B = 1.0f + Rs * (K4 + Rs * (K5 + Rs * K6));                               \n"
+    "    float Di = (A != 0.0f) ? B / A : B;                                             \n"
     "                                                                                    \n"
-    "    float H = HSV.x;                                                                \n"
-    "    float S = HSV.y;                                                                \n"
-    "    float V = HSV.z;                                                                \n"
+    "    float X = XpD * Di;                                                             \n"
+    "    float Y = YpD * Di;                                                             \n"
+    "    float TwoXY = 2.0f * X * Y;                                                     \n"
+    "    float XX = X * X;                                                               \n"
+    "    float YY = Y * Y;                                                               \n"
+    "    X -= (YY + 3.0f * XX) * P2 + TwoXY * P1;                                        \n"
+    "    Y -= (XX + 3.0f * YY) * P1 + TwoXY * P2;                                        \n"
     "                                                                                    \n"
-    "    if(S == 0)                                                                      \n"
+    "    float ErrorX = 0.0f, ErrorY = 0.0f;                                             \n"
+    "    for(int Pass = 0; Pass <= UNPROJECTION_ITERATIONS; ++Pass)                      \n"
     "    {                                                                               \n"
-    "        RGB = (float3){V, V, V};                                                    \n"
+    "        XX = X * X;                                                                 \n"
+    "        YY = Y * Y;                                                                 \n"
+    "        float XYp = X * Y;                                                          \n"
+    "        Rs = XX + YY;                                                               \n"
+    "                                                                                    \n"
+    "        A = 1.0f + Rs * (K1 + Rs * (K2 + Rs * K3));                                 \n"
+    "        B = 1.0f + Rs * (K4 + Rs * (K5 + Rs * K6));                                 \n"
+    "        float Bi = (B != 0.0f) ? 1.0f / B : 1.0f;                                   \n"
+    "        float D = A * Bi;                                                           \n"
+    "                                                                                    \n"
+    "        ErrorX = X * D + (Rs + 2.0f * XX) * P2 + 2.0f * XYp * P1 - XpD;             \n"
+    "        ErrorY = Y * D + (Rs + 2.0f * YY) * P1 + 2.0f * XYp * P2 - YpD;             \n"
+    "        if(Pass == UNPROJECTION_ITERATIONS)                                         \n"
+    "        {                                                                           \n"
+    "            break;                                                                  \n"
+    "        }                                                                           \n"
+    "                                                                                    \n"
+    "        float DA = K1 + Rs * (2.0f * K2 + Rs * 3.0f * K3);                          \n"
+    "        float DB = K4 + Rs * (2.0f * K5 + Rs * 3.0f * K6);                          \n"
+    "        float DD = (DA - D * DB) * Bi;                                              \n"
+    "                                                                                    \n"
+    "        float J00 = D + 2.0f * XX * DD + 6.0f * X * P2 + 2.0f * Y * P1;             \n"
+    "        float J01 = 2.0f * XYp * DD + 2.0f * Y * P2 + 2.0f * X * P1;                \n"
+    "        float J10 = 2.0f * XYp * DD + 2.0f * X * P1 + 2.0f * Y * P2;                \n"
+    "        float J11 = D + 2.0f * YY * DD + 6.0f * Y * P1 + 2.0f * X * P2;             \n"
+    "                                                                                    \n"
+    "        float Det = J00 * J11 - J01 * J10;                                          \n"
+    "        float InvDet = (Det != 0.0f) ? 1.0f / Det : 0.0f;                           \n"
+    "        X -= ( J11 * ErrorX - J01 * ErrorY) * InvDet;                               \n"
+    "        Y -= (-J10 * ErrorX + J00 * ErrorY) * InvDet;                               \n"
     "    }                                                                               \n"
-    "    else                                                                            \n"
+    "                                                                                    \n"
+    "    float ErrorU = ErrorX * Fx;                                                     \n"
+    "    float ErrorV = ErrorY * Fy;                                                     \n"
+    "                                                                                    \n"
+    "    *XY = (float2)(X + Codx, Y + Cody);                                             \n"
+    "    return((ErrorU * ErrorU + ErrorV * ErrorV <= 1e-6f) &&                          \n"
+    "           (MetricRadius <= 0.0f || Rs <= MetricRadius * MetricRadius));            \n"
+    "}                                                                                   \n"
+    "                                                                                    \n"
+    "// The mean depth of the neighbors of the pixel at Local (+ 1 in DepthTile) on its  \n"
+    "// surface, 0 for a pixel without a depth or with too few of them (a flying pixel). \n"
+    "// DEPTH_FILTER_TOLERANCE and DEPTH_FILTER_MIN_NEIGHBORS come from depth_source.c.  \n"
+    "float FilterDepth(__local float DepthTile[18][18], int2 Local)                      \n"
+    "{                                                                                   \n"
+    "    float Depth = DepthTile[Local.y + 1][Local.x + 1];                              \n"
+    "    float Tolerance = Depth * DEPTH_FILTER_TOLERANCE;                               \n"
+    "                                                                                    \n"
+    "    float Sum = 0.0f;                                                               \n"
+    "    int Count = 0;                                                                  \n"
+    "    for(int Y = Local.y; Y <= Local.y + 2; ++Y)                                     \n"
     "    {                                                                               \n"
-    "        H *= 6;                                                                     \n"
-    "        I = (int)H;                                                                 \n"
-    "        F = H - I;                                                                  \n"
-    "        P = V * (1 - S);                                                            \n"
-    "        Q = V * (1 - S * F);                                                        \n"
-    "        T = V * (1 - S * (1 - F));                                                  \n"
-    "        switch (I)                                                                  \n"
+    "        for(int X = Local.x; X <= Local.x + 2; ++X)                                 \n"
     "        {                                                                           \n"
-    "            case 1:  RGB = (float3){Q, V, P}; break;                                \n"
-    "            case 0:  RGB = (float3){V, T, P}; break;                                \n"
-    "            case 2:  RGB = (float3){P, V, T}; break;                                \n"
-    "            case 3:  RGB = (float3){P, Q, V}; break;                                \n"
-    "            case 4:  RGB = (float3){T, P, V}; break;                                \n"
-    "            default: RGB = (float3){V, P, Q}; break;                                \n"
+    "            float Neighbor = DepthTile[Y][X];                                       \n"
+    "            if(fabs(Neighbor - Depth) <= Tolerance)                                 \n"
+    "            {                                                                       \n"
+    "                Sum += Neighbor;                                                    \n"
+    "                ++Count;                                                            \n"
+    "            }                                                                       \n"
     "        }                                                                           \n"
     "    }                                                                               \n"
     "                                                                                    \n"
-    "    return(RGB);                                                                    \n"
+    "    // The pixel itself is one of them.                                             \n"
+    "    bool Keep = Depth != 0.0f && Count > DEPTH_FILTER_MIN_NEIGHBORS;                \n"
+    "    return Keep ? Sum / Count : 0.0f;                                               \n"
     "}                                                                                   \n"
     "                                                                                    \n"
-    "__kernel void ComputeKernel(__read_only  image2d_t DepthImage,                      \n"
-    "                            __read_only  image2d_t XYMap,                           \n"
-    "                            __write_only image2d_t PositionImage,                   \n"
-    "                            __write_only image2d_t ColorImage,                      \n"
-    "                            float MinDepth,                                         \n"
-    "                            float MaxDepth)                                         \n"
+    "// Works on tiles of 16x16 pixels, see COMPUTE_TILE_SIZE.                           \n"
+    "__kernel __attribute__((reqd_work_group_size(16, 16, 1)))                           \n"
+    "void ComputeKernel(__read_only  image2d_t DepthImage,                               \n"
+    "                   __read_only  image2d_t XYMap,                                    \n"
+    "                   __write_only image2d_t PositionImage,                            \n"
+    "                   __write_only image2d_t ColorImage,                               \n"
+    "                   float MinDepth,                                                  \n"
+    "                   float MaxDepth,                                                  \n"
+    "                   int AnalyticUnprojection,                                        \n"
+    "                   float16 Intrinsics,                                              \n"
+    "                   __read_only  image1d_t Colormap,                                 \n"
+    "                   int SpatialFilter,                                               \n"
+    "                   __global float *History)                                         \n"
     "{                                                                                   \n"
     "    int2 Pixel = { get_global_id(0), get_global_id(1) };                            \n"
+    "    int2 Local = { get_local_id(0), get_local_id(1) };                              \n"
+    "    int2 Size = get_image_dim(DepthImage);                                          \n"
+    "                                                                                    \n"
+    "    // The depths of the tile and the pixels around it, each read from the depth    \n"
+    "    // image once for all the work items that need it. Outside of the image there is\n"
+    "    // no depth.                                                                    \n"
+    "    __local float DepthTile[18][18];                                                \n"
+    "    int2 Corner = { (int)get_group_id(0) * 16 - 1, (int)get_group_id(1) * 16 - 1 }; \n"
+    "    for(int I = Local.y * 16 + Local.x; I < 18 * 18; I += 16 * 16)                  \n"
+    "    {                                                                               \n"
+    "        int2 Texel = Corner + (int2){ I % 18, I / 18 };                             \n"
+    "        float Neighbor = 0.0f;                                                      \n"
+    "        if(all(Texel >= 0) && all(Texel < Size))                                    \n"
+    "        {                                                                           \n"
+    "            Neighbor = (float)read_imageui(DepthImage, Texel).x;                    \n"
+    "        }                                                                           \n"
+    "        DepthTile[I / 18][I % 18] = Neighbor;                                       \n"
+    "    }                                                                               \n"
+    "    barrier(CLK_LOCAL_MEM_FENCE);                                                   \n"
     "                                                                                    \n"
-    "    float Depth = (float)read_imageui(DepthImage, Pixel).x;                         \n"
-    "    float2 XY = read_imagef(XYMap, Pixel).xy;                                       \n"
+    "    // The depth image does not have to be a multiple of the tile size.             \n"
+    "    if(Pixel.x >= Size.x || Pixel.y >= Size.y)                                      \n"
+    "    {                                                                               \n"
+    "        return;                                                                     \n"
+    "    }                                                                               \n"
+    "                                                                                    \n"
+    "    float Depth = DepthTile[Local.y + 1][Local.x + 1];                              \n"
+    "    if(SpatialFilter)                                                               \n"
+    "    {                                                                               \n"
+    "        Depth = FilterDepth(DepthTile, Local);                                      \n"
+    "    }                                                                               \n"
+    "                                                                                    \n"
+    "    // The temporal filter, see DEPTH_TEMPORAL_WEIGHT in depth_source.c. History has\n"
+    "    // the depth of every pixel in the last frame, it is NULL without the filter.   \n"
+    "    if(History)                                                                     \n"
+    "    {                                                                               \n"
+    "        int Index = Pixel.y * Size.x + Pixel.x;                                     \n"
+    "        float Difference = Depth - History[Index];                                  \n"
+    "        if(fabs(Difference) <= Depth * DEPTH_TEMPORAL_TOLERANCE)                    \n"
+    "        {                                                                           \n"
+    "            Depth = History[Index] + Difference * DEPTH_TEMPORAL_WEIGHT;            \n"
+    "        }                                                                           \n"
+    "        History[Index] = Depth;                                                     \n"
+    "    }                                                                               \n"
+    "    float2 XY;                                                                      \n"
+    "    if(AnalyticUnprojection)                                                        \n"
+    "    {                                                                               \n"
+    "        if(!Unproject(Intrinsics, (float2)(Pixel.x, Pixel.y), &XY))                 \n"
+    "        {                                                                           \n"
+    "            XY = (float2)(0.0f, 0.0f);                                              \n"
+    "        }                                                                           \n"
+    "    }                                                                               \n"
+    "    else                                                                            \n"
+    "    {                                                                               \n"
+    "        XY = read_imagef(XYMap, Pixel).xy;                                          \n"
+    "    }                                                                               \n"
     "                                                                                    \n"
     "    float W = 1.0f;                                                                 \n"
     "                                                                                    \n"
@@ -117,7 +254,7 @@ void BuildPointCloudComputeProgram(open_cl *OpenCL)
     "    Hue *= Range;                                                                   \n"
     "    Hue = Range - Hue;                                                              \n"
     "                                                                                    \n"
-    "    float3 Color = HSVToRGB((float3){ Hue, 1.0f, 1.0f });                           \n"
+    "    float3 Color = read_imagef(Colormap, ColormapSampler, Hue).xyz;                 \n"
     "                                                                                    \n"
     "    write_imagef(PositionImage, Pixel, (float4){ Position, W });                    \n"
     "    write_imagef(ColorImage, Pixel, (float4){ Color, W });                          \n"
@@ -128,10 +265,15 @@ void BuildPointCloudComputeProgram(open_cl *OpenCL)
     assert(Result == CL_SUCCESS);
     
     #if defined(NDEBUG)
-    char *Flags = "-cl-std=CL2.0";
+    char *BaseFlags = "-cl-std=CL2.0";
     #else // DEBUG
-    char *Flags = "-g -Werror -cl-std=CL2.0";
+    char *BaseFlags = "-g -Werror -cl-std=CL2.0";
     #endif
+    char Flags[256];
+    snprintf(Flags, sizeof(Flags), "%s -D UNPROJECTION_ITERATIONS=%d -D DEPTH_FILTER_TOLERANCE=%.9gf -D DEPTH_FILTER_MIN_NEIGHBORS=%d"
+             " -D DEPTH_TEMPORAL_WEIGHT=%.9gf -D DEPTH_TEMPORAL_TOLERANCE=%.9gf",
+             BaseFlags, UNPROJECTION_ITERATIONS, DEPTH_FILTER_TOLERANCE, DEPTH_FILTER_MIN_NEIGHBORS,
+             DEPTH_TEMPORAL_WEIGHT, DEPTH_TEMPORAL_TOLERANCE);
     clBuildProgram(Program, 0, NULL, Flags, NULL, NULL);
     
     cl_build_status BuildStatus;
@@ -285,6 +427,17 @@ void BuildPipelineProgram(open_cl *OpenCL)
     OpenCL->PipelineProgram = Program;
 }
 
+void OpenCLSetColormap(open_cl *OpenCL, colormap_kind Kind)
+{
+    uint8_t Colormap[COLORMAP_SIZE * 4];
+    colormap_build(Kind, Colormap);
+    
+    size_t Origin[] = { 0, 0, 0 };
+    size_t Region[] = { COLORMAP_SIZE, 1, 1 };
+    cl_int Result = clEnqueueWriteImage(OpenCL->CommandQueue, OpenCL->ColormapImage, CL_TRUE, Origin, Region, 0, 0, Colormap, 0, NULL, NULL);
+    assert(Result == CL_SUCCESS);
+}
+
 bool StringsAreEqual(size_t ALength, char *A, char *B)
 {
     bool Result = false;
@@ -310,11 +463,20 @@ bool StringsAreEqual(size_t ALength, char *A, char *B)
     return(Result);
 }
 
-open_cl *OpenCLInit(uint32_t DepthMapWidth, uint32_t DepthMapHeight, uint32_t WindowWidth, uint32_t WindowHeight, uint16_t *DepthMap, v2f *XYMap, os_specifics *OS, cl_GLuint GLFramebuffer)
+open_cl *OpenCLInit(uint32_t DepthMapWidth, uint32_t DepthMapHeight, uint32_t WindowWidth, uint32_t WindowHeight, v2f *XYMap, depth_intrinsics *Intrinsics, bool SpatialFilter, bool TemporalFilter, os_specifics *OS, cl_GLuint GLFramebuffer)
 {
     open_cl *OpenCL = (open_cl *)malloc(sizeof(open_cl));
     
     cl_int Result;
+
+    OpenCL->SpatialFilter = SpatialFilter;
+    OpenCL->History = NULL;
+    OpenCL->AnalyticUnprojection = (Intrinsics != NULL);
+    memset(&OpenCL->Intrinsics, 0, sizeof(OpenCL->Intrinsics));
+    if(Intrinsics)
+    {
+        memcpy(OpenCL->Intrinsics.s, Intrinsics, sizeof(*Intrinsics));
+    }
     
     cl_uint NumPlatforms;
     cl_platform_id Platforms[16];
@@ -450,6 +612,17 @@ PlatformFound:
             // Creating the depth buffer.
             OpenCL->DepthBuffer = clCreateBuffer(OpenCL->Context, CL_MEM_READ_WRITE, WindowWidth * WindowHeight * sizeof(unsigned int) * 2, NULL, &Result);
             assert(Result == CL_SUCCESS);
+
+            // Creating the history of the temporal filter, which never leaves the device. No pixel has one yet.
+            if(TemporalFilter)
+            {
+                size_t HistorySize = (size_t)DepthMapWidth * DepthMapHeight * sizeof(float);
+                OpenCL->History = clCreateBuffer(OpenCL->Context, CL_MEM_READ_WRITE, HistorySize, NULL, &Result);
+                assert(Result == CL_SUCCESS);
+                float Zero = 0.0f;
+                Result = clEnqueueFillBuffer(OpenCL->CommandQueue, OpenCL->History, &Zero, sizeof(Zero), 0, HistorySize, 0, NULL, NULL);
+                assert(Result == CL_SUCCESS);
+            }
             
             // Creating the depth map image.
             cl_image_desc DepthMapImageDescriptor = {0};
@@ -471,7 +644,18 @@ PlatformFound:
             
             cl_image_format XYMapImageFormat = { CL_RG, CL_FLOAT };
             
-            OpenCL->XYMapImage = clCreateImage(OpenCL->Context, CL_MEM_READ_ONLY|CL_MEM_COPY_HOST_PTR, &XYMapImageFormat, &XYMapImageDescriptor, XYMap, &Result);
+            if(OpenCL->AnalyticUnprojection)
+            {
+                // The kernel still needs an image to bind, it is never read though.
+                XYMapImageDescriptor.image_width = 1;
+                XYMapImageDescriptor.image_height = 1;
+                XYMapImageDescriptor.image_row_pitch = 0;
+                OpenCL->XYMapImage = clCreateImage(OpenCL->Context, CL_MEM_READ_ONLY, &XYMapImageFormat, &XYMapImageDescriptor, NULL, &Result);
+            }
+            else
+            {
+                OpenCL->XYMapImage = clCreateImage(OpenCL->Context, CL_MEM_READ_ONLY|CL_MEM_COPY_HOST_PTR, &XYMapImageFormat, &XYMapImageDescriptor, XYMap, &Result);
+            }
             assert(Result == CL_SUCCESS);
             
             // Creating the position image/texture.
@@ -495,6 +679,17 @@ PlatformFound:
             
             OpenCL->ColorImage = clCreateImage(OpenCL->Context, CL_MEM_READ_WRITE, &ColorImageFormat, &ColorImageDescriptor, NULL, &Result);
             assert(Result == CL_SUCCESS);
+
+            // Creating the colormap image, the colors of the hues (see colormap.c).
+            cl_image_desc ColormapImageDescriptor = {0};
+            ColormapImageDescriptor.image_type = CL_MEM_OBJECT_IMAGE1D;
+            ColormapImageDescriptor.image_width = COLORMAP_SIZE;
+            
+            cl_image_format ColormapImageFormat = { CL_RGBA, CL_UNORM_INT8 };
+            
+            OpenCL->ColormapImage = clCreateImage(OpenCL->Context, CL_MEM_READ_ONLY, &ColormapImageFormat, &ColormapImageDescriptor, NULL, &Result);
+            assert(Result == CL_SUCCESS);
+            OpenCLSetColormap(OpenCL, COLORMAP_HUE);
         }
     }
     
@@ -507,12 +702,17 @@ void OpenCLRelease(open_cl *OpenCL)
 
     clReleaseProgram(OpenCL->PointCloudComputeProgram);
     
+    clReleaseMemObject(OpenCL->ColormapImage);
     clReleaseMemObject(OpenCL->ColorImage);
     clReleaseMemObject(OpenCL->PositionImage);
     clReleaseMemObject(OpenCL->XYMapImage);
     clReleaseMemObject(OpenCL->DepthMapImage);
     clReleaseMemObject(OpenCL->DepthBuffer);
     clReleaseMemObject(OpenCL->Framebuffer);
+    if(OpenCL->History)
+    {
+        clReleaseMemObject(OpenCL->History);
+    }
     
     clReleaseCommandQueue(OpenCL->CommandQueue);
     
@@ -529,10 +729,18 @@ double GetTimeElapsed(cl_event First, cl_event Last)
     return (TimeEnd - TimeStart) / 1e6; // Milliseconds
 }
 
+// The depth map is written to the image without blocking straight out of the buffer of the SDK. The frame stays
+// acquired until the write has completed and is then handed back from here. Frames of sources other than the camera
+// have no image, their memory is reused by the next frame so they are written blocking.
+void CL_CALLBACK DepthMapWrittenCallback(cl_event Event, cl_int ExecutionStatus, void *UserData)
+{
+    k4a_image_release((k4a_image_t)UserData);
+}
+
 // DONT USE CALLBACK DO IT IN THE FUNCTION USE THE FIRST AND LAST EVENT OF BOTH COMPUTE AND TEXTURE 
 // START OF FIRST AND COMPLETE OF LAST EVENT, THEN SUBTRACT; SHOULDNT BE MUCH CPU WAIT TIME
 
-void OpenCLRenderToTexture(open_cl *OpenCL, float MinDepth, float MaxDepth, uint16_t *DepthMap, uint32_t DepthMapWidth, uint32_t DepthMapHeight, view_control *Control, bool DepthMapUpdate)
+void OpenCLRenderToTexture(open_cl *OpenCL, float MinDepth, float MaxDepth, depth_frame *DepthFrame, uint32_t DepthMapWidth, uint32_t DepthMapHeight, view_control *Control, bool DepthMapUpdate)
 {
     double OpenCLComputeTimeBegin = glfwGetTime();
 
@@ -553,6 +761,14 @@ void OpenCLRenderToTexture(open_cl *OpenCL, float MinDepth, float MaxDepth, uint
     size_t GlobalWorkSize[] = { DepthMapWidth, DepthMapHeight };
     size_t *LocalWorkSize = NULL;
 
+    // The compute kernel works on whole tiles.
+    size_t ComputeLocalWorkSize[] = { COMPUTE_TILE_SIZE, COMPUTE_TILE_SIZE };
+    size_t ComputeGlobalWorkSize[] =
+    {
+        (DepthMapWidth + COMPUTE_TILE_SIZE - 1) / COMPUTE_TILE_SIZE * COMPUTE_TILE_SIZE,
+        (DepthMapHeight + COMPUTE_TILE_SIZE - 1) / COMPUTE_TILE_SIZE * COMPUTE_TILE_SIZE
+    };
+
     cl_event WroteToDepthMapImageEvent = 0;
     cl_event ComputedPointCloud = 0;
 
@@ -566,15 +782,24 @@ void OpenCLRenderToTexture(open_cl *OpenCL, float MinDepth, float MaxDepth, uint
         size_t Origin[] = { 0, 0, 0 };
         size_t DepthMapRegion[] = { DepthMapWidth, DepthMapHeight, 1 };
 
+        cl_bool BlockingWrite = (DepthFrame->image == NULL);
         Result = clEnqueueWriteImage(
             OpenCL->CommandQueue, 
             OpenCL->DepthMapImage, 
-            CL_FALSE, 
+            BlockingWrite, 
             Origin, DepthMapRegion, 
-            DepthMapWidth * sizeof(DepthMap[0]), 0, 
-            DepthMap, 
+            DepthMapWidth * sizeof(DepthFrame->depth_map[0]), 0, 
+            DepthFrame->depth_map, 
             0, NULL, &WroteToDepthMapImageEvent);
         assert(Result == CL_SUCCESS);
+
+        if(DepthFrame->image)
+        {
+            Result = clSetEventCallback(WroteToDepthMapImageEvent, CL_COMPLETE, DepthMapWrittenCallback, DepthFrame->image);
+            assert(Result == CL_SUCCESS);
+        }
+        DepthFrame->image = NULL;
+        DepthFrame->depth_map = NULL;
         
         // Set Kernel Arguments and Enqueue the Kernel in the command queue.
         Result = 0;
@@ -584,6 +809,11 @@ void OpenCLRenderToTexture(open_cl *OpenCL, float MinDepth, float MaxDepth, uint
         Result |= clSetKernelArg(OpenCL->PointCloudComputeKernel, 3, sizeof(cl_mem), &OpenCL->ColorImage);
         Result |= clSetKernelArg(OpenCL->PointCloudComputeKernel, 4, sizeof(float), &MinDepth);
         Result |= clSetKernelArg(OpenCL->PointCloudComputeKernel, 5, sizeof(float), &MaxDepth);
+        Result |= clSetKernelArg(OpenCL->PointCloudComputeKernel, 6, sizeof(cl_int), &OpenCL->AnalyticUnprojection);
+        Result |= clSetKernelArg(OpenCL->PointCloudComputeKernel, 7, sizeof(cl_float16), &OpenCL->Intrinsics);
+        Result |= clSetKernelArg(OpenCL->PointCloudComputeKernel, 8, sizeof(cl_mem), &OpenCL->ColormapImage);
+        Result |= clSetKernelArg(OpenCL->PointCloudComputeKernel, 9, sizeof(cl_int), &OpenCL->SpatialFilter);
+        Result |= clSetKernelArg(OpenCL->PointCloudComputeKernel, 10, sizeof(cl_mem), OpenCL->History ? &OpenCL->History : NULL);
         assert(Result == CL_SUCCESS);
         
         //
@@ -592,7 +822,7 @@ void OpenCLRenderToTexture(open_cl *OpenCL, float MinDepth, float MaxDepth, uint
             OpenCL->CommandQueue, 
             OpenCL->PointCloudComputeKernel, 
             2, 
-            NULL, GlobalWorkSize, LocalWorkSize, 
+            NULL, ComputeGlobalWorkSize, ComputeLocalWorkSize, 
             1, &WroteToDepthMapImageEvent, 
             &ComputedPointCloud);
         assert(Result == CL_SUCCESS);
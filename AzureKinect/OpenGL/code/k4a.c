@@ -2,14 +2,56 @@
 
 #include <stdlib.h>
 #include <assert.h>
+#include <stdio.h>
 
 #include "opengl_renderer.h"
 
+#if defined(_WIN32)
+
+#include <windows.h>
+
+typedef HANDLE thread_t;
+
+#define atomic_load_long(pointer) InterlockedCompareExchange((volatile LONG *)(pointer), 0, 0)
+#define atomic_exchange_long(pointer, value) InterlockedExchange((volatile LONG *)(pointer), (value))
+#define atomic_exchange_pointer(pointer, value) InterlockedExchangePointer((PVOID volatile *)(pointer), (value))
+
+#elif defined(__linux__)
+
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+typedef pthread_t thread_t;
+
+#define atomic_load_long(pointer) __atomic_load_n((pointer), __ATOMIC_ACQUIRE)
+#define atomic_exchange_long(pointer, value) __atomic_exchange_n((pointer), (value), __ATOMIC_ACQ_REL)
+#define atomic_exchange_pointer(pointer, value) __atomic_exchange_n((pointer), (value), __ATOMIC_ACQ_REL)
+
+#endif
+
+// How long the capture thread waits for a capture before it checks again whether it should stop.
+#define CAPTURE_THREAD_TIMEOUT 250
+
 typedef k4a_device_configuration_t camera_config;
 
+// The capture thread blocks in k4a_device_get_capture() and leaves the newest depth image in latest. The render loop
+// takes it out with a single atomic exchange whenever it gets around to it. An image that was not taken before the
+// next one arrived is released by the capture thread, so the render loop always gets the newest one.
 typedef struct
 {
     k4a_device_t device;
+    k4a_image_t volatile latest;
+    volatile long running;
+    thread_t thread;
+} capture_mailbox;
+
+typedef struct
+{
+    k4a_device_t device;
+    capture_mailbox *mailbox;
     camera_config *config;
     uint32_t max_capture_width;
     uint32_t max_capture_height;
@@ -56,6 +98,76 @@ void camera_mode_get_image_dimensions(k4a_depth_mode_t mode, uint32_t *width, ui
     }
 }
 
+#if defined(_WIN32)
+static DWORD WINAPI camera_capture_thread_proc(LPVOID param)
+#elif defined(__linux__)
+static void *camera_capture_thread_proc(void *param)
+#endif
+{
+    capture_mailbox *mailbox = (capture_mailbox *)param;
+
+    while(atomic_load_long(&mailbox->running))
+    {
+        k4a_capture_t capture = NULL;
+        k4a_wait_result_t wait_result = k4a_device_get_capture(mailbox->device, &capture, CAPTURE_THREAD_TIMEOUT);
+        if(K4A_WAIT_RESULT_FAILED == wait_result)
+        {
+            break;
+        }
+
+        if(K4A_WAIT_RESULT_SUCCEEDED == wait_result)
+        {
+            // The image holds its own reference so the capture can be released right away.
+            k4a_image_t image = k4a_capture_get_depth_image(capture);
+            k4a_capture_release(capture);
+
+            if(image)
+            {
+                k4a_image_t stale = (k4a_image_t)atomic_exchange_pointer(&mailbox->latest, image);
+                if(stale)
+                {
+                    k4a_image_release(stale);
+                }
+            }
+        }
+    }
+
+    return(0);
+}
+
+static capture_mailbox *camera_start_capture_thread(k4a_device_t device)
+{
+    capture_mailbox *mailbox = (capture_mailbox *)calloc(1, sizeof(capture_mailbox));
+    mailbox->device = device;
+    mailbox->running = 1;
+
+#if defined(_WIN32)
+    mailbox->thread = CreateThread(NULL, 0, camera_capture_thread_proc, mailbox, 0, NULL);
+#elif defined(__linux__)
+    pthread_create(&mailbox->thread, NULL, camera_capture_thread_proc, mailbox);
+#endif
+
+    return(mailbox);
+}
+
+static void camera_stop_capture_thread(capture_mailbox *mailbox)
+{
+    atomic_exchange_long(&mailbox->running, 0);
+
+#if defined(_WIN32)
+    WaitForSingleObject(mailbox->thread, INFINITE);
+    CloseHandle(mailbox->thread);
+#elif defined(__linux__)
+    pthread_join(mailbox->thread, NULL);
+#endif
+
+    if(mailbox->latest)
+    {
+        k4a_image_release(mailbox->latest);
+    }
+    free(mailbox);
+}
+
 tof_camera camera_init(camera_config *config) 
 {
     tof_camera camera = {0};
@@ -66,7 +178,10 @@ tof_camera camera_init(camera_config *config)
     {
         if(K4A_RESULT_SUCCEEDED == k4a_device_open(K4A_DEVICE_DEFAULT, &camera.device))
         {
-            if(K4A_RESULT_SUCCEEDED == k4a_device_start_cameras(camera.device, config)) {}
+            if(K4A_RESULT_SUCCEEDED == k4a_device_start_cameras(camera.device, config))
+            {
+                camera.mailbox = camera_start_capture_thread(camera.device);
+            }
             else
             {
                 k4a_device_close(camera.device);
@@ -80,6 +195,8 @@ tof_camera camera_init(camera_config *config)
 
 void camera_release(tof_camera *camera)
 {
+    camera_stop_capture_thread(camera->mailbox);
+    camera->mailbox = NULL;
     k4a_device_stop_cameras(camera->device);
     k4a_device_close(camera->device);
     camera->device = NULL;
@@ -87,44 +204,87 @@ void camera_release(tof_camera *camera)
 
 typedef struct k4a_image_t depth_image;
 
-bool camera_get_depth_map(tof_camera *camera, int timeout, uint16_t *depth_map, size_t depth_map_size)
+// A depth image that still lives in the buffer the SDK captured it into. Nothing is copied, depth_map points straight
+// into that buffer and stays valid until camera_release_depth_frame() hands the image back to the SDK.
+typedef struct
+{
+    k4a_image_t image;
+    uint16_t *depth_map;
+} depth_frame;
+
+// Never waits. Returns false if the capture thread has not published a new depth image since the last call.
+bool camera_acquire_depth_frame(tof_camera *camera, depth_frame *frame)
 {
     bool depth_map_update = false;
-    k4a_capture_t capture = NULL;
-    k4a_wait_result_t wait_result = k4a_device_get_capture(camera->device, &capture, timeout);
-    if(K4A_WAIT_RESULT_SUCCEEDED == wait_result)
+    k4a_image_t image = (k4a_image_t)atomic_exchange_pointer(&camera->mailbox->latest, NULL);
+    if(image)
     {
-        k4a_image_t image = k4a_capture_get_depth_image(capture);
-        if(image)
-        {
-            size_t size = k4a_image_get_size(image);
-            assert(size == depth_map_size);
-            uint8_t *buffer = k4a_image_get_buffer(image);
-
-            memcpy(depth_map, buffer, size);
+        assert(k4a_image_get_size(image) == camera->max_capture_width * camera->max_capture_height * sizeof(uint16_t));
 
-            depth_map_update = true;
+        frame->image = image;
+        frame->depth_map = (uint16_t *)k4a_image_get_buffer(image);
 
-            k4a_image_release(image);
-        }
-        k4a_capture_release(capture);
+        depth_map_update = true;
     }
     return depth_map_update;
 }
 
+void camera_release_depth_frame(depth_frame *frame)
+{
+    if(frame->image)
+    {
+        k4a_image_release(frame->image);
+    }
+    frame->image = NULL;
+    frame->depth_map = NULL;
+}
+
+
+// Upper bound for the threads computing the XY table.
+#define XY_TABLE_MAX_THREADS 64
+
+#define XY_TABLE_MAGIC 0x42545958 // "XYTB"
+#define XY_TABLE_VERSION 1
 
-static void k4a_create_xy_table(const k4a_calibration_t *calibration, k4a_image_t xy_image)
+#define MAX_PATH_LENGTH 1024
+
+// Layout of the XY table cache file: this header directly followed by the table.
+typedef struct
 {
-    k4a_float2_t *table_data = (k4a_float2_t *)(void *)k4a_image_get_buffer(xy_image);
-    
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    uint32_t width;
+    uint32_t height;
+    uint32_t reserved[2];
+} xy_table_header;
+
+// The XY table either lives in a mapped cache file (mapping is set) or in memory allocated when it was computed.
+typedef struct
+{
+    k4a_float2_t *data;
+    void *mapping;
+    size_t mapping_size;
+} xy_table;
+
+typedef struct
+{
+    const k4a_calibration_t *calibration;
+    k4a_float2_t *table_data;
+    int row_begin;
+    int row_end;
+} xy_table_rows;
+
+static void k4a_create_xy_table_rows(xy_table_rows *rows)
+{
+    const k4a_calibration_t *calibration = rows->calibration;
     int width = calibration->depth_camera_calibration.resolution_width;
-    int height = calibration->depth_camera_calibration.resolution_height;
     
     k4a_float2_t p;
     k4a_float3_t ray;
     int valid;
     
-    for (int y = 0, idx = 0; y < height; y++)
+    for (int y = rows->row_begin, idx = rows->row_begin * width; y < rows->row_end; y++)
     {
         p.xy.y = (float)y;
         for (int x = 0; x < width; x++, idx++)
@@ -136,14 +296,406 @@ static void k4a_create_xy_table(const k4a_calibration_t *calibration, k4a_image_
             
             if (valid)
             {
-                table_data[idx].xy.x = ray.xyz.x;
-                table_data[idx].xy.y = ray.xyz.y;
+                rows->table_data[idx].xy.x = ray.xyz.x;
+                rows->table_data[idx].xy.y = ray.xyz.y;
             }
             else
             {
-                table_data[idx].xy.x = nanf("");
-                table_data[idx].xy.y = nanf("");
+                rows->table_data[idx].xy.x = nanf("");
+                rows->table_data[idx].xy.y = nanf("");
             }
         }
     }
 }
+
+#if defined(_WIN32)
+static DWORD WINAPI k4a_create_xy_table_thread_proc(LPVOID param)
+#elif defined(__linux__)
+static void *k4a_create_xy_table_thread_proc(void *param)
+#endif
+{
+    k4a_create_xy_table_rows((xy_table_rows *)param);
+    return(0);
+}
+
+static int get_processor_count(void)
+{
+#if defined(_WIN32)
+    SYSTEM_INFO system_info;
+    GetSystemInfo(&system_info);
+    int count = (int)system_info.dwNumberOfProcessors;
+#elif defined(__linux__)
+    int count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    if(count < 1) count = 1;
+    if(count > XY_TABLE_MAX_THREADS) count = XY_TABLE_MAX_THREADS;
+    return(count);
+}
+
+// k4a_calibration_2d_to_3d() only reads the calibration, so the rows are split into one band per core and
+// computed at the same time.
+static void k4a_create_xy_table(const k4a_calibration_t *calibration, k4a_float2_t *table_data)
+{
+    int height = calibration->depth_camera_calibration.resolution_height;
+    int thread_count = get_processor_count();
+
+    xy_table_rows rows[XY_TABLE_MAX_THREADS];
+    thread_t threads[XY_TABLE_MAX_THREADS];
+    for(int i = 0; i < thread_count; ++i)
+    {
+        rows[i].calibration = calibration;
+        rows[i].table_data = table_data;
+        rows[i].row_begin = height * i / thread_count;
+        rows[i].row_end = height * (i + 1) / thread_count;
+    }
+
+    // The calling thread does the first band itself.
+    for(int i = 1; i < thread_count; ++i)
+    {
+#if defined(_WIN32)
+        threads[i] = CreateThread(NULL, 0, k4a_create_xy_table_thread_proc, &rows[i], 0, NULL);
+#elif defined(__linux__)
+        pthread_create(&threads[i], NULL, k4a_create_xy_table_thread_proc, &rows[i]);
+#endif
+    }
+
+    k4a_create_xy_table_rows(&rows[0]);
+
+    for(int i = 1; i < thread_count; ++i)
+    {
+#if defined(_WIN32)
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
+#elif defined(__linux__)
+        pthread_join(threads[i], NULL);
+#endif
+    }
+}
+
+// The XY table only depends on the intrinsics of the depth camera and the depth mode, so those (and the version of
+// the file layout) are what the cache file is keyed by. 64 bit FNV-1a.
+static uint64_t xy_table_cache_key(const k4a_calibration_t *calibration)
+{
+    uint64_t hash = 14695981039346656037ull;
+    
+    uint32_t version = XY_TABLE_VERSION;
+    uint32_t depth_mode = (uint32_t)calibration->depth_mode;
+    const void *parts[] = { &version, &depth_mode, &calibration->depth_camera_calibration };
+    size_t part_sizes[] = { sizeof(version), sizeof(depth_mode), sizeof(calibration->depth_camera_calibration) };
+    
+    for(int part = 0; part < 3; ++part)
+    {
+        const uint8_t *bytes = (const uint8_t *)parts[part];
+        for(size_t i = 0; i < part_sizes[part]; ++i)
+        {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+    }
+    return(hash);
+}
+
+static void xy_table_cache_path(char *path, size_t path_size, uint64_t key)
+{
+    char directory[MAX_PATH_LENGTH] = ".";
+    
+#if defined(_WIN32)
+    DWORD length = GetTempPathA(sizeof(directory), directory);
+    if(length > 0 && length < sizeof(directory))
+    {
+        // GetTempPathA() leaves a trailing backslash
+        directory[length - 1] = 0;
+    }
+#elif defined(__linux__)
+    const char *cache_home = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    if(cache_home && cache_home[0])
+    {
+        snprintf(directory, sizeof(directory), "%s", cache_home);
+    }
+    else if(home && home[0])
+    {
+        snprintf(directory, sizeof(directory), "%s/.cache", home);
+        mkdir(directory, 0755);
+    }
+#endif
+    
+    snprintf(path, path_size, "%s/k4a_xy_table_%016llx.bin", directory, (unsigned long long)key);
+}
+
+static bool xy_table_header_matches(const xy_table_header *header, uint64_t key, int width, int height)
+{
+    return(header->magic == XY_TABLE_MAGIC && header->version == XY_TABLE_VERSION && header->key == key &&
+           header->width == (uint32_t)width && header->height == (uint32_t)height);
+}
+
+// Maps a cache file written by xy_table_write_cache() if there is one for this calibration.
+static bool xy_table_map_cache(const char *path, uint64_t key, int width, int height, xy_table *table)
+{
+    size_t expected_size = sizeof(xy_table_header) + (size_t)width * height * sizeof(k4a_float2_t);
+    void *view = NULL;
+    
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(file == INVALID_HANDLE_VALUE)
+    {
+        return(false);
+    }
+    
+    LARGE_INTEGER file_size;
+    if(GetFileSizeEx(file, &file_size) && (size_t)file_size.QuadPart == expected_size)
+    {
+        HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if(mapping)
+        {
+            view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            // the view keeps the mapping alive
+            CloseHandle(mapping);
+        }
+    }
+    CloseHandle(file);
+#elif defined(__linux__)
+    int file = open(path, O_RDONLY);
+    if(file < 0)
+    {
+        return(false);
+    }
+    
+    struct stat file_status;
+    if(0 == fstat(file, &file_status) && (size_t)file_status.st_size == expected_size)
+    {
+        view = mmap(NULL, expected_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, file, 0);
+        if(view == MAP_FAILED)
+        {
+            view = NULL;
+        }
+    }
+    close(file);
+#endif
+    
+    if(view && !xy_table_header_matches((const xy_table_header *)view, key, width, height))
+    {
+#if defined(_WIN32)
+        UnmapViewOfFile(view);
+#elif defined(__linux__)
+        munmap(view, expected_size);
+#endif
+        view = NULL;
+    }
+    
+    if(view)
+    {
+        table->data = (k4a_float2_t *)((uint8_t *)view + sizeof(xy_table_header));
+        table->mapping = view;
+        table->mapping_size = expected_size;
+    }
+    return(view != NULL);
+}
+
+// Writes the table next to its final name first and renames it afterwards, so a viewer that starts at the same time
+// never maps a half written file.
+static void xy_table_write_cache(const char *path, uint64_t key, int width, int height, const k4a_float2_t *table_data)
+{
+    xy_table_header header = {0};
+    header.magic = XY_TABLE_MAGIC;
+    header.version = XY_TABLE_VERSION;
+    header.key = key;
+    header.width = (uint32_t)width;
+    header.height = (uint32_t)height;
+    
+    size_t data_size = (size_t)width * height * sizeof(k4a_float2_t);
+    
+    char temporary_path[MAX_PATH_LENGTH + 8];
+    snprintf(temporary_path, sizeof(temporary_path), "%s.tmp", path);
+    
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(temporary_path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(file == INVALID_HANDLE_VALUE)
+    {
+        return;
+    }
+    
+    DWORD written_header = 0, written_data = 0;
+    WriteFile(file, &header, sizeof(header), &written_header, NULL);
+    WriteFile(file, table_data, (DWORD)data_size, &written_data, NULL);
+    CloseHandle(file);
+    
+    if(written_header != sizeof(header) || written_data != data_size ||
+       !MoveFileExA(temporary_path, path, MOVEFILE_REPLACE_EXISTING))
+    {
+        DeleteFileA(temporary_path);
+    }
+#elif defined(__linux__)
+    int file = open(temporary_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(file < 0)
+    {
+        return;
+    }
+    
+    bool written = (write(file, &header, sizeof(header)) == (ssize_t)sizeof(header) &&
+                    write(file, table_data, data_size) == (ssize_t)data_size);
+    close(file);
+    
+    if(!written || 0 != rename(temporary_path, path))
+    {
+        unlink(temporary_path);
+    }
+#endif
+}
+
+// Returns the XY table for the depth camera of the calibration. If an earlier run already computed it for the same
+// calibration and depth mode the cache file is mapped, otherwise it is computed and written to the cache.
+xy_table camera_load_xy_table(const k4a_calibration_t *calibration)
+{
+    xy_table table = {0};
+    
+    int width = calibration->depth_camera_calibration.resolution_width;
+    int height = calibration->depth_camera_calibration.resolution_height;
+    
+    uint64_t key = xy_table_cache_key(calibration);
+    char path[MAX_PATH_LENGTH];
+    xy_table_cache_path(path, sizeof(path), key);
+    
+    if(!xy_table_map_cache(path, key, width, height, &table))
+    {
+        table.data = (k4a_float2_t *)malloc((size_t)width * height * sizeof(k4a_float2_t));
+        k4a_create_xy_table(calibration, table.data);
+        xy_table_write_cache(path, key, width, height, table.data);
+    }
+    
+    return(table);
+}
+
+void camera_release_xy_table(xy_table *table)
+{
+    if(table->mapping)
+    {
+#if defined(_WIN32)
+        UnmapViewOfFile(table->mapping);
+#elif defined(__linux__)
+        munmap(table->mapping, table->mapping_size);
+#endif
+    }
+    else
+    {
+        free(table->data);
+    }
+    table->data = NULL;
+    table->mapping = NULL;
+    table->mapping_size = 0;
+}
+
+// Iterations of the Newton undistortion step in camera_unproject() and its shader/kernel versions. See the accuracy
+// report of AzureKinect/Tools for how far off this is from the SDK's XY table.
+#define UNPROJECTION_ITERATIONS 4
+
+// Intrinsics of the depth camera for evaluating the Brown-Conrady model directly where the point cloud is computed
+// instead of looking every pixel up in the XY table.
+typedef struct
+{
+    float cx, cy;
+    float fx, fy;
+    float k1, k2, k3, k4, k5, k6;
+    float p1, p2;
+    float codx, cody;
+    float metric_radius;
+} depth_intrinsics;
+
+// Returns false if the depth camera uses another lens model than Brown-Conrady, the XY table has to be used then.
+bool camera_get_depth_intrinsics(const k4a_calibration_t *calibration, depth_intrinsics *intrinsics)
+{
+    const k4a_calibration_intrinsics_t *source = &calibration->depth_camera_calibration.intrinsics;
+    if(source->type != K4A_CALIBRATION_LENS_DISTORTION_MODEL_BROWN_CONRADY)
+    {
+        return(false);
+    }
+    
+    intrinsics->cx = source->parameters.param.cx;
+    intrinsics->cy = source->parameters.param.cy;
+    intrinsics->fx = source->parameters.param.fx;
+    intrinsics->fy = source->parameters.param.fy;
+    intrinsics->k1 = source->parameters.param.k1;
+    intrinsics->k2 = source->parameters.param.k2;
+    intrinsics->k3 = source->parameters.param.k3;
+    intrinsics->k4 = source->parameters.param.k4;
+    intrinsics->k5 = source->parameters.param.k5;
+    intrinsics->k6 = source->parameters.param.k6;
+    intrinsics->p1 = source->parameters.param.p1;
+    intrinsics->p2 = source->parameters.param.p2;
+    intrinsics->codx = source->parameters.param.codx;
+    intrinsics->cody = source->parameters.param.cody;
+    intrinsics->metric_radius = source->parameters.param.metric_radius;
+    return(true);
+}
+
+// The same computation as the unproject functions of the compute shader (opengl_renderer.c) and the kernel
+// (opencl.c), those have to be kept in sync with this one.
+//
+// Inverts the distortion the way the SDK does: a closed form first guess that ignores most of the tangential part,
+// followed by Newton steps on the forward model. Unlike the SDK it always takes UNPROJECTION_ITERATIONS steps so
+// there is no divergent branching on the GPU. A pixel is invalid if it lies outside of the metric radius or the
+// remaining error is above the SDK's threshold (1e-3 pixels).
+bool camera_unproject(const depth_intrinsics *in, float u, float v, float *x_out, float *y_out)
+{
+    float xp_d = (u - in->cx) / in->fx - in->codx;
+    float yp_d = (v - in->cy) / in->fy - in->cody;
+    
+    float rs = xp_d * xp_d + yp_d * yp_d;
+    float a = 1.0f + rs * (in->k1 + rs * (in->k2 + rs * in->k3));
+    float b = 1.0f + rs * (in->k4 + rs * (in->k5 + rs * in->k6));
+    float di = (a != 0.0f) ? b / a : b;
+    
+    float x = xp_d * di;
+    float y = yp_d * di;
+    float two_xy = 2.0f * x * y;
+    float xx = x * x;
+    float yy = y * y;
+    x -= (yy + 3.0f * xx) * in->p2 + two_xy * in->p1;
+    y -= (xx + 3.0f * yy) * in->p1 + two_xy * in->p2;
+    
+    float error_x = 0.0f, error_y = 0.0f;
+    for(int pass = 0; pass <= UNPROJECTION_ITERATIONS; ++pass)
+    {
+        xx = x * x;
+        yy = y * y;
+        float xy = x * y;
+        rs = xx + yy;
+        
+        a = 1.0f + rs * (in->k1 + rs * (in->k2 + rs * in->k3));
+        b = 1.0f + rs * (in->k4 + rs * (in->k5 + rs * in->k6));
+        float bi = (b != 0.0f) ? 1.0f / b : 1.0f;
+        float d = a * bi;
+        
+        // forward model and the residual against the observed (normalized) pixel
+        error_x = x * d + (rs + 2.0f * xx) * in->p2 + 2.0f * xy * in->p1 - xp_d;
+        error_y = y * d + (rs + 2.0f * yy) * in->p1 + 2.0f * xy * in->p2 - yp_d;
+        if(pass == UNPROJECTION_ITERATIONS)
+        {
+            break;
+        }
+        
+        // Jacobian of the forward model
+        float da = in->k1 + rs * (2.0f * in->k2 + rs * 3.0f * in->k3);
+        float db = in->k4 + rs * (2.0f * in->k5 + rs * 3.0f * in->k6);
+        float dd = (da - d * db) * bi; // d(d)/d(rs)
+        
+        float j00 = d + 2.0f * xx * dd + 6.0f * x * in->p2 + 2.0f * y * in->p1;
+        float j01 = 2.0f * xy * dd + 2.0f * y * in->p2 + 2.0f * x * in->p1;
+        float j10 = 2.0f * xy * dd + 2.0f * x * in->p1 + 2.0f * y * in->p2;
+        float j11 = d + 2.0f * yy * dd + 6.0f * y * in->p1 + 2.0f * x * in->p2;
+        
+        float jacobian_determinant = j00 * j11 - j01 * j10;
+        float inverse_determinant = (jacobian_determinant != 0.0f) ? 1.0f / jacobian_determinant : 0.0f;
+        x -= ( j11 * error_x - j01 * error_y) * inverse_determinant;
+        y -= (-j10 * error_x + j00 * error_y) * inverse_determinant;
+    }
+    
+    float error_u = error_x * in->fx;
+    float error_v = error_y * in->fy;
+    bool valid = (error_u * error_u + error_v * error_v <= 1e-6f) &&
+                 (in->metric_radius <= 0.0f || rs <= in->metric_radius * in->metric_radius);
+    
+    *x_out = x + in->codx;
+    *y_out = y + in->cody;
+    return(valid);
+}
@@ -52,6 +52,7 @@ typedef void   type_glDispatchCompute(GLuint num_groups_x, GLuint num_groups_y,
 typedef void   type_glMemoryBarrier(GLbitfield barriers);
 typedef void   type_glUniform1i(GLint location, GLint v0);
 typedef void   type_glUniform1f(GLint location, GLfloat v0);
+typedef void   type_glUniform1fv(GLint location, GLsizei count, const GLfloat *value);
 typedef void   type_glTexStorage2D(GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height);
 typedef void   type_glGenQueries(GLsizei n, GLuint * ids);
 typedef void   type_glBeginQuery(GLenum target, GLuint id);
@@ -112,6 +113,7 @@ typedef void   type_glNamedBufferSubData(GLuint buffer, GLintptr offset, GLsizei
 #define GL_CLAMP_TO_EDGE                        0x812F
 #define GL_RGBA32F                              0x8814
 #define GL_RG32F                                0x8230
+#define GL_R32F                                 0x822E
 #define GL_R16UI                                0x8234
 #define GL_RG                                   0x8227
 #define GL_RED_INTEGER                          0x8D94
@@ -158,9 +160,17 @@ typedef struct
     GLuint xy_table_texture;
     GLuint xyzw_table_texture;
     GLuint rgba_color_texture;
+    GLuint colormap_texture;
+    GLuint history_texture; // Only with temporal_filter.
     
     dimensions depth_image_dimensions;
     
+    // if set the compute shader evaluates the lens model itself and there is no xy table texture
+    bool analytic_unprojection;
+    depth_intrinsics intrinsics;
+    bool spatial_filter;
+    bool temporal_filter;
+    
     opengl_function(glDebugMessageCallback);
     opengl_function(glCreateShader);
     opengl_function(glShaderSource);
@@ -199,6 +209,7 @@ typedef struct
     opengl_function(glMemoryBarrier);
     opengl_function(glUniform1i);
     opengl_function(glUniform1f);
+    opengl_function(glUniform1fv);
     opengl_function(glTexStorage2D);
     opengl_function(glGenQueries);
     opengl_function(glBeginQuery);
@@ -230,6 +241,7 @@ static void compile_default_program(open_gl *opengl)
     GLuint vertex_shader = opengl->glCreateShader(GL_VERTEX_SHADER);
     char *vertex_code = GLSL(layout(binding = 0, rgba32f) readonly uniform image2D xyzw_tex;
                              layout(binding = 1, rgba32f) readonly uniform image2D rgba_tex;
+                             layout(binding = 4) uniform sampler1D colormap;
                              
                              layout(location = 0) uniform mat4 mvp;
                              layout(location = 1) uniform float point_size;
@@ -243,7 +255,8 @@ static void compile_default_program(open_gl *opengl)
                                  vec4 vertex_position = imageLoad(xyzw_tex, pixel);
                                  vec4 vertex_color = imageLoad(rgba_tex, pixel);
 
-                                 color = vertex_color;
+                                 // The color is (hue, 1, 1) in HSV, the hue picks the color of the colormap.
+                                 color = vec4(texture(colormap, vertex_color.x).rgb, vertex_color.a);
                                  gl_Position = mvp * vertex_position;
                                  gl_PointSize = point_size;
                              });
@@ -261,12 +274,7 @@ static void compile_default_program(open_gl *opengl)
                                        discard;
                                    }
 
-                                   // converting from hsv to rgb below
-                                   // code from: https://stackoverflow.com/questions/15095909/from-rgb-to-hsv-in-opengl-glsl
-                                   vec4 k = vec4(1.0, 2.0 / 3.0, 1.0 / 3.0, 3.0);
-                                   vec3 p = abs(fract(color.xxx + k.xyz) * 6.0 - k.www);
-                                   vec3 color_rgb = color.z * mix(k.xxx, clamp(p - k.xxx, 0.0, 1.0), color.y);
-                                   frag_color = vec4(color_rgb.rgb, 1.0);
+                                   frag_color = vec4(color.rgb, 1.0);
                                });
     opengl->glShaderSource(fragment_shader, 1, &fragment_code, NULL);
     opengl->glCompileShader(fragment_shader);
@@ -302,6 +310,10 @@ static void compile_default_program(open_gl *opengl)
 #undef GLSL
 #define GLSL(Code) "#version 430 core\n" "#extension GL_NV_gpu_shader5 : enable\n" #Code
 
+// The compute shader works on tiles of COMPUTE_TILE_SIZE x COMPUTE_TILE_SIZE pixels, it has to be the local size in the
+// shader.
+#define COMPUTE_TILE_SIZE 16
+
 static void compile_compute_program(open_gl *opengl)
 {
     GLuint compute_shader = opengl->glCreateShader(GL_COMPUTE_SHADER);
@@ -315,18 +327,179 @@ static void compile_compute_program(open_gl *opengl)
 
                               layout(location = 0) uniform float min_depth;
                               layout(location = 1) uniform float max_depth;
+
+                              layout(location = 2) uniform bool analytic_unprojection;
+                              layout(location = 3) uniform int unprojection_iterations;
+                              // cx, cy, fx, fy, k1 - k6, p1, p2, codx, cody, metric radius (see depth_intrinsics)
+                              layout(location = 4) uniform float intrinsics[15];
+
+                              // The filter of depth_source.c, see DEPTH_FILTER_TOLERANCE.
+                              layout(location = 19) uniform bool spatial_filter;
+                              layout(location = 20) uniform float filter_tolerance;
+                              layout(location = 21) uniform int filter_min_neighbors;
+
+                              // The temporal filter of depth_source.c, see DEPTH_TEMPORAL_WEIGHT. The history is the depth of every pixel
+                              // after the filters in the last frame, it stays on the GPU.
+                              layout(binding = 4, r32f) uniform image2D history_image;
+                              layout(location = 22) uniform bool temporal_filter;
+                              layout(location = 23) uniform float temporal_weight;
+                              layout(location = 24) uniform float temporal_tolerance;
                               
-                              layout(local_size_x = 1, local_size_y = 1) in;
+                              layout(local_size_x = 16, local_size_y = 16) in;
+
+                              // The depths of the tile and the pixels around it, each read from the depth image once for all the invocations
+                              // that need it.
+                              shared float depth_tile[18][18];
+
+                              // The mean depth of the neighbors of the pixel at local (+ 1 in depth_tile) on its surface, 0 for a pixel without a
+                              // depth or with too few of them (a flying pixel).
+                              float filter_depth(ivec2 local)
+                              {
+                                  float depth = depth_tile[local.y + 1][local.x + 1];
+                                  float tolerance = depth * filter_tolerance;
+
+                                  float sum = 0.0;
+                                  int count = 0;
+                                  for(int y = local.y; y <= local.y + 2; ++y)
+                                  {
+                                      for(int x = local.x; x <= local.x + 2; ++x)
+                                      {
+                                          float neighbor = depth_tile[y][x];
+                                          if(abs(neighbor - depth) <= tolerance)
+                                          {
+                                              sum += neighbor;
+                                              ++count;
+                                          }
+                                      }
+                                  }
+
+                                  // The pixel itself is one of them.
+                                  return (depth != 0.0 && count > filter_min_neighbors) ? sum / float(count) : 0.0;
+                              }
+
+                              // Has to give the same result as camera_unproject() in k4a.c.
+                              bool unproject(vec2 uv, out vec2 xy)
+                              {
+                                  float cx = intrinsics[0];
+                                  float cy = intrinsics[1];
+                                  float fx = intrinsics[2];
+                                  float fy = intrinsics[3];
+                                  float k1 = intrinsics[4];
+                                  float k2 = intrinsics[5];
+                                  float k3 = intrinsics[6];
+                                  float k4 = intrinsics[7];
+                                  float k5 = intrinsics[8];
+                                  float k6 = intrinsics[9];
+                                  float p1 = intrinsics[10];
+                                  float p2 = intrinsics[11];
+                                  float codx = intrinsics[12];
+                                  float cody = intrinsics[13];
+                                  float metric_radius = intrinsics[14];
+
+                                  float xp_d = (uv.x - cx) / fx - codx;
+                                  float yp_d = (uv.y - cy) / fy - cody;
+
+                                  float rs = xp_d * xp_d + yp_d * yp_d;
+                                  float a = 1.0 + rs * (k1 + rs * (k2 + rs * k3));
+                                  float b = 1.0 + rs * (k4 + rs * (k5 + rs * k6));
+                                  float di = (a != 0.0) ? b / a : b;
+
+                                  float x = xp_d * di;
+                                  float y = yp_d * di;
+                                  float two_xy = 2.0 * x * y;
+                                  float xx = x * x;
+                                  float yy = y * y;
+                                  x -= (yy + 3.0 * xx) * p2 + two_xy * p1;
+                                  y -= (xx + 3.0 * yy) * p1 + two_xy * p2;
+
+                                  float error_x = 0.0;
+                                  float error_y = 0.0;
+                                  for(int pass = 0; pass <= unprojection_iterations; ++pass)
+                                  {
+                                      xx = x * x;
+                                      yy = y * y;
+                                      float xy_ = x * y;
+                                      rs = xx + yy;
+
+                                      a = 1.0 + rs * (k1 + rs * (k2 + rs * k3));
+                                      b = 1.0 + rs * (k4 + rs * (k5 + rs * k6));
+                                      float bi = (b != 0.0) ? 1.0 / b : 1.0;
+                                      float d = a * bi;
+
+                                      error_x = x * d + (rs + 2.0 * xx) * p2 + 2.0 * xy_ * p1 - xp_d;
+                                      error_y = y * d + (rs + 2.0 * yy) * p1 + 2.0 * xy_ * p2 - yp_d;
+                                      if(pass == unprojection_iterations)
+                                      {
+                                          break;
+                                      }
+
+                                      float da = k1 + rs * (2.0 * k2 + rs * 3.0 * k3);
+                                      float db = k4 + rs * (2.0 * k5 + rs * 3.0 * k6);
+                                      float dd = (da - d * db) * bi;
+
+                                      float j00 = d + 2.0 * xx * dd + 6.0 * x * p2 + 2.0 * y * p1;
+                                      float j01 = 2.0 * xy_ * dd + 2.0 * y * p2 + 2.0 * x * p1;
+                                      float j10 = 2.0 * xy_ * dd + 2.0 * x * p1 + 2.0 * y * p2;
+                                      float j11 = d + 2.0 * yy * dd + 6.0 * y * p1 + 2.0 * x * p2;
+
+                                      float jacobian_determinant = j00 * j11 - j01 * j10;
+                                      float inverse_determinant = (jacobian_determinant != 0.0) ? 1.0 / jacobian_determinant : 0.0;
+                                      x -= ( j11 * error_x - j01 * error_y) * inverse_determinant;
+                                      y -= (-j10 * error_x + j00 * error_y) * inverse_determinant;
+                                  }
+
+                                  float error_u = error_x * fx;
+                                  float error_v = error_y * fy;
+
+                                  xy = vec2(x + codx, y + cody);
+                                  return (error_u * error_u + error_v * error_v <= 1e-6) &&
+                                         (metric_radius <= 0.0 || rs <= metric_radius * metric_radius);
+                              }
                               
                               void main()
                               {
                                   ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+                                  ivec2 local = ivec2(gl_LocalInvocationID.xy);
+
+                                  // Loads outside of the depth image give 0, no depth.
+                                  ivec2 corner = ivec2(gl_WorkGroupID.xy) * 16 - 1;
+                                  for(uint i = gl_LocalInvocationIndex; i < 18 * 18; i += 16 * 16)
+                                  {
+                                      depth_tile[i / 18][i % 18] = float(imageLoad(depth_image, corner + ivec2(i % 18, i / 18)).r);
+                                  }
+                                  memoryBarrierShared();
+                                  barrier();
+
+                                  // The depth image does not have to be a multiple of the tile size.
+                                  if(any(greaterThanEqual(pixel, imageSize(depth_image))))
+                                  {
+                                      return;
+                                  }
                                   
                                   //
                                   // Computing 3D position.
 
-                                  float depth = float(imageLoad(depth_image, pixel));
-                                  vec2 xy_value = imageLoad(xy_table, pixel).xy;
+                                  float depth = spatial_filter ? filter_depth(local) : depth_tile[local.y + 1][local.x + 1];
+                                  if(temporal_filter)
+                                  {
+                                      float history = imageLoad(history_image, pixel).r;
+                                      float difference = depth - history;
+                                      bool same_surface = abs(difference) <= depth * temporal_tolerance;
+                                      depth = same_surface ? history + difference * temporal_weight : depth;
+                                      imageStore(history_image, pixel, vec4(depth));
+                                  }
+                                  vec2 xy_value;
+                                  if(analytic_unprojection)
+                                  {
+                                      if(!unproject(vec2(pixel), xy_value))
+                                      {
+                                          xy_value = vec2(0.0);
+                                      }
+                                  }
+                                  else
+                                  {
+                                      xy_value = imageLoad(xy_table, pixel).xy;
+                                  }
                                   
                                   float w = 1.0;
                                   
@@ -386,11 +559,28 @@ static void compile_compute_program(open_gl *opengl)
     opengl->compute_program = program;
 }
 
-open_gl *opengl_init(dimensions depth_image_dimensions)
+void opengl_set_colormap(open_gl *opengl, colormap_kind kind)
+{
+    uint8_t colormap[COLORMAP_SIZE * 4];
+    colormap_build(kind, colormap);
+
+    opengl->glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_1D, opengl->colormap_texture);
+    glTexSubImage1D(GL_TEXTURE_1D, 0, 0, COLORMAP_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, colormap);
+}
+
+// Pass the intrinsics of the depth camera to have the compute shader unproject the pixels itself, otherwise the xy
+// table is uploaded (once, it never changes). With spatial_filter the compute shader filters the depth first, see
+// DEPTH_FILTER_TOLERANCE, and with temporal_filter it averages it over time, see DEPTH_TEMPORAL_WEIGHT.
+open_gl *opengl_init(dimensions depth_image_dimensions, v2f *xy_map, depth_intrinsics *intrinsics, bool spatial_filter, bool temporal_filter)
 {
     open_gl *opengl = (open_gl *)malloc(sizeof(open_gl));
 
     opengl->depth_image_dimensions = depth_image_dimensions;
+    opengl->analytic_unprojection = (intrinsics != NULL);
+    opengl->intrinsics = intrinsics ? *intrinsics : (depth_intrinsics){0};
+    opengl->spatial_filter = spatial_filter;
+    opengl->temporal_filter = temporal_filter;
     uint32_t width = opengl->depth_image_dimensions.w;
     uint32_t height = opengl->depth_image_dimensions.h;
     
@@ -434,6 +624,7 @@ open_gl *opengl_init(dimensions depth_image_dimensions)
     get_opengl_function(glMemoryBarrier);
     get_opengl_function(glUniform1i);
     get_opengl_function(glUniform1f);
+    get_opengl_function(glUniform1fv);
     get_opengl_function(glTexStorage2D);
     get_opengl_function(glGenQueries);
     get_opengl_function(glBeginQuery);
@@ -466,14 +657,18 @@ open_gl *opengl_init(dimensions depth_image_dimensions)
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 
-    glGenTextures(1, &opengl->xy_table_texture);
-    opengl->glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, opengl->xy_table_texture);
-    opengl->glTexStorage2D(GL_TEXTURE_2D, 1, GL_RG32F, depth_image_dimensions.w, depth_image_dimensions.h);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    if(!opengl->analytic_unprojection)
+    {
+        glGenTextures(1, &opengl->xy_table_texture);
+        opengl->glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, opengl->xy_table_texture);
+        opengl->glTexStorage2D(GL_TEXTURE_2D, 1, GL_RG32F, depth_image_dimensions.w, depth_image_dimensions.h);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RG, GL_FLOAT, xy_map);
+    }
     
     glGenTextures(1, &opengl->xyzw_table_texture);
     opengl->glActiveTexture(GL_TEXTURE2);
@@ -492,6 +687,28 @@ open_gl *opengl_init(dimensions depth_image_dimensions)
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+    // The colors of the hues, see colormap.c. Filtering blends neighboring entries like the conversion from HSV did.
+    glGenTextures(1, &opengl->colormap_texture);
+    opengl->glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_1D, opengl->colormap_texture);
+    glTexImage1D(GL_TEXTURE_1D, 0, GL_RGBA8, COLORMAP_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    opengl_set_colormap(opengl, COLORMAP_HUE);
+
+    if(temporal_filter)
+    {
+        // No pixel has a history yet.
+        float *zeros = (float *)calloc((size_t)width * height, sizeof(float));
+        glGenTextures(1, &opengl->history_texture);
+        opengl->glActiveTexture(GL_TEXTURE5);
+        glBindTexture(GL_TEXTURE_2D, opengl->history_texture);
+        opengl->glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32F, depth_image_dimensions.w, depth_image_dimensions.h);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RED, GL_FLOAT, zeros);
+        free(zeros);
+    }
     
     GLuint dummy_vertex_array;
     opengl->glGenVertexArrays(1, &dummy_vertex_array);
@@ -503,7 +720,7 @@ open_gl *opengl_init(dimensions depth_image_dimensions)
     return(opengl);
 }
 
-void calculate_point_cloud(open_gl *opengl, v2f *xy_map, uint16_t *depth_map, bool depth_map_update, bool *depth_map_updates)
+void calculate_point_cloud(open_gl *opengl, uint16_t *depth_map, bool depth_map_update, bool *depth_map_updates)
 {
     static average AvgComputeTimeGPU = {1000, "Compute GPU", "ms"};
     static average AvgFullComputeTimeGPU = {1000, "Full Conversion Time GPU", "ms"};
@@ -529,10 +746,12 @@ void calculate_point_cloud(open_gl *opengl, v2f *xy_map, uint16_t *depth_map, bo
         glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RED_INTEGER, GL_UNSIGNED_SHORT, depth_map);
         opengl->glBindImageTexture(0, opengl->depth_map_texture, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R16UI);
 
-        opengl->glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, opengl->xy_table_texture);
-        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RG, GL_FLOAT, xy_map);
-        opengl->glBindImageTexture(1, opengl->xy_table_texture, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RG32F);
+        if(!opengl->analytic_unprojection)
+        {
+            opengl->glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, opengl->xy_table_texture);
+            opengl->glBindImageTexture(1, opengl->xy_table_texture, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RG32F);
+        }
 
         opengl->glActiveTexture(GL_TEXTURE2);
         glBindTexture(GL_TEXTURE_2D, opengl->xyzw_table_texture);
@@ -542,13 +761,31 @@ void calculate_point_cloud(open_gl *opengl, v2f *xy_map, uint16_t *depth_map, bo
         glBindTexture(GL_TEXTURE_2D, opengl->rgba_color_texture);
         opengl->glBindImageTexture(3, opengl->rgba_color_texture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
 
+        if(opengl->temporal_filter)
+        {
+            opengl->glActiveTexture(GL_TEXTURE5);
+            glBindTexture(GL_TEXTURE_2D, opengl->history_texture);
+            opengl->glBindImageTexture(4, opengl->history_texture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32F);
+        }
+
         opengl->glUseProgram(opengl->compute_program);
 
         opengl->glUniform1f(0, 0.5f);
         opengl->glUniform1f(1, 3.86f);
-
-        opengl->glDispatchCompute(width, height, 1);
-        opengl->glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+        opengl->glUniform1i(2, opengl->analytic_unprojection);
+        opengl->glUniform1i(3, UNPROJECTION_ITERATIONS);
+        opengl->glUniform1fv(4, 15, (float *)&opengl->intrinsics);
+        opengl->glUniform1i(19, opengl->spatial_filter);
+        opengl->glUniform1f(20, DEPTH_FILTER_TOLERANCE);
+        opengl->glUniform1i(21, DEPTH_FILTER_MIN_NEIGHBORS);
+        opengl->glUniform1i(22, opengl->temporal_filter);
+        opengl->glUniform1f(23, DEPTH_TEMPORAL_WEIGHT);
+        opengl->glUniform1f(24, DEPTH_TEMPORAL_TOLERANCE);
+
+        opengl->glDispatchCompute((width + COMPUTE_TILE_SIZE - 1) / COMPUTE_TILE_SIZE,
+                                  (height + COMPUTE_TILE_SIZE - 1) / COMPUTE_TILE_SIZE, 1);
+        // The history is read with imageLoad() by the next dispatch.
+        opengl->glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
     }
     
     // measure time
@@ -599,6 +836,9 @@ void render_point_cloud(open_gl *opengl, dimensions render_dimensions, view_cont
     opengl->glActiveTexture(GL_TEXTURE3);
     glBindTexture(GL_TEXTURE_2D, opengl->rgba_color_texture);
     opengl->glBindImageTexture(1, opengl->rgba_color_texture, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+
+    opengl->glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_1D, opengl->colormap_texture);
     
     uint32_t render_width = render_dimensions.w;
     uint32_t render_height = render_dimensions.h;
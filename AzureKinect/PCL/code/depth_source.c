@@ -0,0 +1,555 @@
+// Where the depth frames come from. The visualizers only talk to a depth_source so they run the same against the
+// camera, a recording or a synthetic scene, which is what makes runs on machines without a camera reproducible.
+//
+// Every source hands out frames of the depth mode in the camera_config it was opened with: width * height uint16_t
+// depth values in millimeters, 0 where there is no depth.
+//
+//   live                      The Azure Kinect (default).
+//   replay <recording> [fast] A recording (recording.c) played in a loop, at the pace it was recorded at or with 'fast'
+//                             every frame in order as fast as the visualizer takes them.
+//   synthetic                 A generated scene with a sphere moving in front of a wall.
+//
+// Any of them can be followed by 'record <recording> [rvl]' to write the frames that are handed out into a recording,
+// with 'rvl' compressed (rvl.c) to about a third of the size at the cost of decoding them again on replay, by
+// 'filter' to have the visualizers filter the depth before they compute the points, see DEPTH_FILTER_TOLERANCE, and by
+// 'temporal' to have them average the depth over the last frames, see DEPTH_TEMPORAL_WEIGHT.
+
+#include <math.h>
+#include <string.h>
+
+// The spatial filter of the visualizers, which runs in the same pass as the points are computed in. Of the 3x3 pixels
+// around a pixel (itself included) those whose depth is at most DEPTH_FILTER_TOLERANCE of its depth away are on its
+// surface. With fewer than DEPTH_FILTER_MIN_NEIGHBORS others on it the pixel is a flying pixel, a mix of the foreground
+// and the background at an edge, and loses its depth. The others get the mean depth of the pixels on their surface,
+// which smooths the surfaces without blurring the edges between them. Pixels outside of the depth map have no depth.
+#define DEPTH_FILTER_TOLERANCE 0.03f
+#define DEPTH_FILTER_MIN_NEIGHBORS 3
+
+// The temporal filter of the visualizers, in the same pass too. Every pixel keeps one depth from the last frame, its
+// history, and moves it DEPTH_TEMPORAL_WEIGHT of the way to its new depth, which averages the noise of a static scene
+// over about 1 / DEPTH_TEMPORAL_WEIGHT frames. A new depth more than DEPTH_TEMPORAL_TOLERANCE of it away from the
+// history is something that moved, the pixel starts over from it so moving surfaces do not leave a trail. A pixel
+// without a depth has no history. The weight is a power of two so every visualizer computes the same average.
+#define DEPTH_TEMPORAL_WEIGHT 0.25f
+#define DEPTH_TEMPORAL_TOLERANCE 0.02f
+
+typedef struct depth_source depth_source;
+
+typedef struct
+{
+    uint32_t width;
+    uint32_t height;
+    bool has_intrinsics; // The lens uses the Brown-Conrady model and can be evaluated directly.
+    depth_intrinsics intrinsics;
+    bool has_calibration; // Only sources that have a calibration of the SDK, needed for other lens models.
+    k4a_calibration_t calibration;
+} depth_source_intrinsics;
+
+typedef struct
+{
+    bool (*open)(depth_source *source, int argument_count, char **arguments);
+    // Never waits. Returns false if there is no new frame since the last call.
+    bool (*next_frame)(depth_source *source, depth_frame *frame);
+    void (*release_frame)(depth_source *source, depth_frame *frame);
+    void (*get_intrinsics)(depth_source *source, depth_source_intrinsics *intrinsics);
+    void (*close)(depth_source *source);
+} depth_source_functions;
+
+struct depth_source
+{
+    const depth_source_functions *functions;
+    const char *name;
+    camera_config *config;
+    uint32_t width;
+    uint32_t height;
+    void *state;
+    recording_writer *recording; // NULL when not recording.
+    bool filter; // The visualizers filter the depth, see DEPTH_FILTER_TOLERANCE.
+    bool temporal; // The visualizers average the depth over time, see DEPTH_TEMPORAL_WEIGHT.
+};
+
+// The frames handed out by replay and synthetic sources are not images of the SDK: frame->image stays NULL and the
+// depth map belongs to the source. It stays valid until the next call of next_frame().
+
+//
+// live
+
+static bool live_open(depth_source *source, int argument_count, char **arguments)
+{
+    tof_camera *camera = (tof_camera *)calloc(1, sizeof(tof_camera));
+    *camera = camera_init(source->config);
+    if(!camera->device)
+    {
+        free(camera);
+        return(false);
+    }
+
+    source->state = camera;
+    return(true);
+}
+
+static bool live_next_frame(depth_source *source, depth_frame *frame)
+{
+    return(camera_acquire_depth_frame((tof_camera *)source->state, frame));
+}
+
+static void live_release_frame(depth_source *source, depth_frame *frame)
+{
+    camera_release_depth_frame(frame);
+}
+
+static void live_get_intrinsics(depth_source *source, depth_source_intrinsics *intrinsics)
+{
+    tof_camera *camera = (tof_camera *)source->state;
+    k4a_device_get_calibration(camera->device, source->config->depth_mode, source->config->color_resolution, &intrinsics->calibration);
+    intrinsics->has_calibration = true;
+    intrinsics->has_intrinsics = camera_get_depth_intrinsics(&intrinsics->calibration, &intrinsics->intrinsics);
+}
+
+static void live_close(depth_source *source)
+{
+    tof_camera *camera = (tof_camera *)source->state;
+    camera_release(camera);
+    free(camera);
+}
+
+static const depth_source_functions live_source_functions =
+{
+    live_open, live_next_frame, live_release_frame, live_get_intrinsics, live_close
+};
+
+//
+// synthetic
+
+// The scene is generated once when the source is opened. This many frames are played in a loop, one per call of
+// next_frame(), so generating it does not show up in any timing.
+#define SYNTHETIC_FRAME_COUNT 30
+
+// Rays per pixel in each direction. Like on the camera a pixel at the edge of the sphere sees some of the sphere and
+// some of what is behind it, and gets a depth in between, a flying pixel.
+#define SYNTHETIC_SUBPIXELS 2
+
+typedef struct
+{
+    uint16_t *frames;
+    int next;
+} synthetic_source;
+
+// A pinhole lens with roughly the focal length of the Azure Kinect for a depth map of width * height. The binned depth
+// modes are 320 and 512 pixels wide, the unbinned ones 640 and 1024.
+static depth_intrinsics depth_source_nominal_intrinsics(uint32_t width, uint32_t height)
+{
+    bool binned = (width <= 512);
+
+    depth_intrinsics intrinsics = {0};
+    intrinsics.cx = (float)width * 0.5f;
+    intrinsics.cy = (float)height * 0.5f;
+    intrinsics.fx = binned ? 252.0f : 504.0f;
+    intrinsics.fy = intrinsics.fx;
+    return(intrinsics);
+}
+
+// Distance along the optical axis in meters to what the ray (x, y, 1) hits first: a wall 3 m away, the floor 1 m below
+// the camera and a sphere circling in between.
+static float synthetic_trace(float x, float y, float time)
+{
+    float z = 3.0f;
+
+    if(y > 0.0f && 1.0f / y < z)
+    {
+        z = 1.0f / y;
+    }
+
+    float angle = 2.0f * 3.14159265f * time;
+    float center[3] = { 0.6f * sinf(angle), 0.2f, 2.0f + 0.4f * cosf(angle) };
+    float radius = 0.35f;
+
+    // |t * (x, y, 1) - center|^2 = radius^2
+    float a = x * x + y * y + 1.0f;
+    float b = x * center[0] + y * center[1] + center[2];
+    float c = center[0] * center[0] + center[1] * center[1] + center[2] * center[2] - radius * radius;
+    float discriminant = b * b - a * c;
+    if(discriminant >= 0.0f)
+    {
+        float t = (b - sqrtf(discriminant)) / a;
+        if(t > 0.0f && t < z)
+        {
+            z = t;
+        }
+    }
+
+    return(z);
+}
+
+static bool synthetic_open(depth_source *source, int argument_count, char **arguments)
+{
+    size_t frame_count = (size_t)source->width * source->height;
+    synthetic_source *synthetic = (synthetic_source *)calloc(1, sizeof(synthetic_source));
+    synthetic->frames = (uint16_t *)malloc(frame_count * SYNTHETIC_FRAME_COUNT * sizeof(uint16_t));
+    if(!synthetic->frames)
+    {
+        free(synthetic);
+        return(false);
+    }
+
+    depth_intrinsics intrinsics = depth_source_nominal_intrinsics(source->width, source->height);
+    for(int frame = 0; frame < SYNTHETIC_FRAME_COUNT; ++frame)
+    {
+        uint16_t *depth_map = synthetic->frames + frame * frame_count;
+        float time = (float)frame / (float)SYNTHETIC_FRAME_COUNT;
+
+        for(uint32_t v = 0; v < source->height; ++v)
+        {
+            for(uint32_t u = 0; u < source->width; ++u)
+            {
+                float z = 0.0f;
+                for(int sub_v = 0; sub_v < SYNTHETIC_SUBPIXELS; ++sub_v)
+                {
+                    float offset_v = ((float)sub_v + 0.5f) / SYNTHETIC_SUBPIXELS - 0.5f;
+                    float y = ((float)v + offset_v - intrinsics.cy) / intrinsics.fy;
+                    for(int sub_u = 0; sub_u < SYNTHETIC_SUBPIXELS; ++sub_u)
+                    {
+                        float offset_u = ((float)sub_u + 0.5f) / SYNTHETIC_SUBPIXELS - 0.5f;
+                        float x = ((float)u + offset_u - intrinsics.cx) / intrinsics.fx;
+                        z += synthetic_trace(x, y, time);
+                    }
+                }
+                z /= SYNTHETIC_SUBPIXELS * SYNTHETIC_SUBPIXELS;
+                depth_map[v * source->width + u] = (uint16_t)(z * 1000.0f + 0.5f);
+            }
+        }
+    }
+
+    source->state = synthetic;
+    return(true);
+}
+
+static bool synthetic_next_frame(depth_source *source, depth_frame *frame)
+{
+    synthetic_source *synthetic = (synthetic_source *)source->state;
+    frame->image = NULL;
+    frame->depth_map = synthetic->frames + (size_t)synthetic->next * source->width * source->height;
+    synthetic->next = (synthetic->next + 1) % SYNTHETIC_FRAME_COUNT;
+    return(true);
+}
+
+static void synthetic_release_frame(depth_source *source, depth_frame *frame)
+{
+    frame->depth_map = NULL;
+}
+
+static void synthetic_get_intrinsics(depth_source *source, depth_source_intrinsics *intrinsics)
+{
+    intrinsics->has_intrinsics = true;
+    intrinsics->intrinsics = depth_source_nominal_intrinsics(source->width, source->height);
+    intrinsics->has_calibration = false;
+}
+
+static void synthetic_close(depth_source *source)
+{
+    synthetic_source *synthetic = (synthetic_source *)source->state;
+    free(synthetic->frames);
+    free(synthetic);
+}
+
+static const depth_source_functions synthetic_source_functions =
+{
+    synthetic_open, synthetic_next_frame, synthetic_release_frame, synthetic_get_intrinsics, synthetic_close
+};
+
+//
+// replay
+
+// The recordings keep what the source they were made from knew about the lens. The calibration is stored the way the SDK
+// keeps it in memory, calibration_size tells whether it was the same version of the SDK.
+typedef struct
+{
+    uint32_t depth_mode;
+    uint32_t has_intrinsics;
+    depth_intrinsics intrinsics;
+    uint32_t has_calibration;
+    uint32_t calibration_size;
+    k4a_calibration_t calibration;
+} k4a_recording_intrinsics;
+
+static bool replay_open(depth_source *source, int argument_count, char **arguments)
+{
+    if(argument_count < 1)
+    {
+        fprintf(stderr, "The replay source needs a recording.\n");
+        return(false);
+    }
+
+    bool paced = !(argument_count > 1 && 0 == strcmp(arguments[1], "fast"));
+
+    recording_player *player = (recording_player *)calloc(1, sizeof(recording_player));
+    if(!recording_player_open(player, arguments[0], paced))
+    {
+        free(player);
+        return(false);
+    }
+
+    recording_header *header = &player->reader.header;
+    const k4a_recording_intrinsics *intrinsics = (const k4a_recording_intrinsics *)player->reader.intrinsics;
+    if(header->device != recording_device_k4a || header->image_count != 1 || header->sample_size != sizeof(uint16_t) ||
+       header->intrinsics_size < sizeof(k4a_recording_intrinsics))
+    {
+        fprintf(stderr, "%s is not a recording of the Azure Kinect.\n", arguments[0]);
+    }
+    else if(header->width != source->width || header->height != source->height || intrinsics->depth_mode != (uint32_t)source->config->depth_mode)
+    {
+        fprintf(stderr, "%s was recorded in another depth mode than this visualizer uses.\n", arguments[0]);
+    }
+    else
+    {
+        source->state = player;
+        return(true);
+    }
+
+    recording_player_close(player);
+    free(player);
+    return(false);
+}
+
+// The depth map is handed out straight from the mapped recording, or from where the reader decoded it to.
+static bool replay_next_frame(depth_source *source, depth_frame *frame)
+{
+    recording_player *player = (recording_player *)source->state;
+    int64_t next = recording_player_next(player);
+    if(next < 0)
+    {
+        return(false);
+    }
+
+    frame->image = NULL;
+    frame->depth_map = (uint16_t *)recording_reader_get_frame(&player->reader, (uint64_t)next);
+    return(frame->depth_map != NULL);
+}
+
+static void replay_release_frame(depth_source *source, depth_frame *frame)
+{
+    frame->depth_map = NULL;
+}
+
+static void replay_get_intrinsics(depth_source *source, depth_source_intrinsics *intrinsics)
+{
+    recording_player *player = (recording_player *)source->state;
+    const k4a_recording_intrinsics *recorded = (const k4a_recording_intrinsics *)player->reader.intrinsics;
+
+    intrinsics->has_intrinsics = (recorded->has_intrinsics != 0);
+    intrinsics->intrinsics = recorded->intrinsics;
+    intrinsics->has_calibration = (recorded->has_calibration != 0 && recorded->calibration_size == sizeof(k4a_calibration_t));
+    if(intrinsics->has_calibration)
+    {
+        intrinsics->calibration = recorded->calibration;
+    }
+    else if(recorded->has_calibration)
+    {
+        fprintf(stderr, "The calibration in the recording is from another version of the SDK, it is not used.\n");
+    }
+}
+
+static void replay_close(depth_source *source)
+{
+    recording_player *player = (recording_player *)source->state;
+    recording_player_close(player);
+    free(player);
+}
+
+static const depth_source_functions replay_source_functions =
+{
+    replay_open, replay_next_frame, replay_release_frame, replay_get_intrinsics, replay_close
+};
+
+//
+// recording
+
+void depth_source_get_intrinsics(depth_source *source, depth_source_intrinsics *intrinsics);
+
+// Starts writing every frame that is handed out to the visualizer into a recording.
+static bool depth_source_start_recording(depth_source *source, const char *path, recording_encoding encoding)
+{
+    depth_source_intrinsics source_intrinsics;
+    depth_source_get_intrinsics(source, &source_intrinsics);
+
+    k4a_recording_intrinsics intrinsics;
+    memset(&intrinsics, 0, sizeof(intrinsics));
+    intrinsics.depth_mode = (uint32_t)source->config->depth_mode;
+    intrinsics.has_intrinsics = source_intrinsics.has_intrinsics;
+    intrinsics.intrinsics = source_intrinsics.intrinsics;
+    intrinsics.has_calibration = source_intrinsics.has_calibration;
+    intrinsics.calibration_size = sizeof(k4a_calibration_t);
+    intrinsics.calibration = source_intrinsics.calibration;
+
+    recording_header format = {0};
+    format.device = recording_device_k4a;
+    format.width = source->width;
+    format.height = source->height;
+    format.image_count = 1;
+    format.sample_size = sizeof(uint16_t);
+    format.encoding = encoding;
+
+    source->recording = recording_writer_create(path, &format, &intrinsics, sizeof(intrinsics));
+    return(source->recording != NULL);
+}
+
+// Finishes the recording if there is one. Unlike closing the camera this is quick, so it can be done even where the
+// source itself is never closed.
+void depth_source_stop_recording(depth_source *source)
+{
+    if(source->recording)
+    {
+        recording_writer_close(source->recording);
+        source->recording = NULL;
+    }
+}
+
+//
+// interface
+
+// Picks the source from the command line, see the top of this file. The config has to outlive the source.
+bool depth_source_open(depth_source *source, camera_config *config, int argument_count, char **arguments)
+{
+    memset(source, 0, sizeof(depth_source));
+    source->config = config;
+
+    const char *recording_path = NULL;
+    recording_encoding recording_encoding = recording_encoding_raw;
+    int source_argument_count = argument_count;
+    for(int i = 1; i < argument_count; ++i)
+    {
+        if(0 == strcmp(arguments[i], "record"))
+        {
+            if(i + 1 == argument_count)
+            {
+                fprintf(stderr, "'record' needs the file to record to.\n");
+                return(false);
+            }
+            recording_path = arguments[i + 1];
+            if(i + 2 < argument_count && 0 == strcmp(arguments[i + 2], "rvl"))
+            {
+                recording_encoding = recording_encoding_rvl;
+            }
+            // The file is skipped so it can have any name.
+            source_argument_count = (i < source_argument_count) ? i : source_argument_count;
+            ++i;
+        }
+        else if(0 == strcmp(arguments[i], "filter"))
+        {
+            source->filter = true;
+            source_argument_count = (i < source_argument_count) ? i : source_argument_count;
+        }
+        else if(0 == strcmp(arguments[i], "temporal"))
+        {
+            source->temporal = true;
+            source_argument_count = (i < source_argument_count) ? i : source_argument_count;
+        }
+    }
+    // Everything in front of the first of them is for the source.
+    argument_count = source_argument_count;
+
+    source->name = (argument_count > 1) ? arguments[1] : "live";
+    camera_mode_get_image_dimensions(config->depth_mode, &source->width, &source->height);
+
+    if(0 == strcmp(source->name, "live"))
+    {
+        source->functions = &live_source_functions;
+    }
+    else if(0 == strcmp(source->name, "synthetic"))
+    {
+        source->functions = &synthetic_source_functions;
+    }
+    else if(0 == strcmp(source->name, "replay"))
+    {
+        source->functions = &replay_source_functions;
+    }
+    else
+    {
+        fprintf(stderr, "Unknown depth source '%s', expected live, replay or synthetic.\n", source->name);
+        return(false);
+    }
+
+    int skip = (argument_count > 1) ? 2 : 1;
+    if(!source->functions->open(source, argument_count - skip, arguments + skip))
+    {
+        return(false);
+    }
+
+    if(recording_path && !depth_source_start_recording(source, recording_path, recording_encoding))
+    {
+        source->functions->close(source);
+        return(false);
+    }
+
+    return(true);
+}
+
+bool depth_source_next_frame(depth_source *source, depth_frame *frame)
+{
+    bool new_frame = source->functions->next_frame(source, frame);
+    if(new_frame && source->recording)
+    {
+        recording_writer_push(source->recording, frame->depth_map, source->width * source->height * (uint32_t)sizeof(uint16_t));
+    }
+    return(new_frame);
+}
+
+void depth_source_release_frame(depth_source *source, depth_frame *frame)
+{
+    source->functions->release_frame(source, frame);
+}
+
+void depth_source_get_intrinsics(depth_source *source, depth_source_intrinsics *intrinsics)
+{
+    memset(intrinsics, 0, sizeof(depth_source_intrinsics));
+    intrinsics->width = source->width;
+    intrinsics->height = source->height;
+    source->functions->get_intrinsics(source, intrinsics);
+}
+
+void depth_source_close(depth_source *source)
+{
+    depth_source_stop_recording(source);
+    source->functions->close(source);
+    source->state = NULL;
+}
+
+// The XY table for the source. Sources without a calibration of the SDK get it computed from their lens, which takes
+// no time for the pinhole of the synthetic source so it is not cached. Sources without a lens either get the nominal
+// one of depth_source_nominal_intrinsics().
+xy_table depth_source_load_xy_table(depth_source_intrinsics *intrinsics)
+{
+    if(intrinsics->has_calibration)
+    {
+        return(camera_load_xy_table(&intrinsics->calibration));
+    }
+
+    // A recording of a source that had neither, without a focal length every ray would be NaN.
+    depth_intrinsics lens = intrinsics->intrinsics;
+    if(!intrinsics->has_intrinsics)
+    {
+        fprintf(stderr, "The depth source has no intrinsics, the points are computed with a nominal pinhole lens.\n");
+        lens = depth_source_nominal_intrinsics(intrinsics->width, intrinsics->height);
+    }
+
+    xy_table table = {0};
+    table.data = (k4a_float2_t *)malloc((size_t)intrinsics->width * intrinsics->height * sizeof(k4a_float2_t));
+    assert(table.data);
+
+    for(uint32_t v = 0, idx = 0; v < intrinsics->height; ++v)
+    {
+        for(uint32_t u = 0; u < intrinsics->width; ++u, ++idx)
+        {
+            float x, y;
+            if(!camera_unproject(&lens, (float)u, (float)v, &x, &y))
+            {
+                x = nanf("");
+                y = nanf("");
+            }
+            table.data[idx].xy.x = x;
+            table.data[idx].xy.y = y;
+        }
+    }
+
+    return(table);
+}
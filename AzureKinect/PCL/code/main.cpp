@@ -11,6 +11,11 @@
 #include <vtkOpenGLRenderer.h>
 
 #include "k4a.c"
+#include "rvl.c"
+#include "recording.c"
+#include "depth_source.c"
+#include "job_system.c"
+#include "colormap.c"
 
 typedef struct {
     const int CountTo;
@@ -141,8 +146,6 @@ void MyglClear(GLbitfield mask) {
 
 #endif
 
-#define clamp(x, low, high) std::max(low, std::min(high, x))
-
 typedef struct
 {
     float x;
@@ -150,6 +153,16 @@ typedef struct
 }
 v2f;
 
+// What point_cloud.c computes, the points are turned into the ones of PCL afterwards.
+typedef struct
+{
+    int16_t x, y, z; // In millimeters.
+    uint16_t hue; // In 1/65535 of the color circle.
+}
+packed_point;
+
+#include "point_cloud.c"
+
 typedef struct
 {
     float x;
@@ -178,43 +191,46 @@ typedef struct
 }
 point;
 
-v3f HSV2RGB(v3f HSV) 
-{
-    v3f RGB;
-
-    int I;
-    float F, P, Q, T;
+// PCL looks down the other z axis than the OpenGL visualizers point_cloud.c computes the points for.
+#define POINT_CONVERSION_GRAIN 8192 // Points per tile.
 
-    float H = HSV.x;
-    float S = HSV.y;
-    float V = HSV.z;
+typedef struct
+{
+    const packed_point *Points;
+    pcl::PointXYZRGB *Converted;
+    const uint8_t *Colormap; // See colormap.c.
+}
+point_conversion;
 
-    if (S == 0) // No saturation => grayscale; V == lightness/darkness
+// M switches to the next colormap.
+static void KeyboardCallback(const pcl::visualization::KeyboardEvent &Event, void *Data)
+{
+    colormap_kind *Kind = (colormap_kind *)Data;
+    if(Event.keyDown() && (Event.getKeySym() == "m" || Event.getKeySym() == "M"))
     {
-        RGB = { V, V, V };
+        *Kind = (colormap_kind)((*Kind + 1) % COLORMAP_COUNT);
     }
-    else
+}
+
+static void ConvertPoints(void *Data, int Begin, int End)
+{
+    point_conversion *Conversion = (point_conversion *)Data;
+    for(int i = Begin; i < End; ++i)
     {
-        H *= 6;
-        I = (int)H;
-        F = H - I;
-        P = V * (1 - S);
-        Q = V * (1 - S * F);
-        T = V * (1 - S * (1 - F));
-        switch (I) {
-            case 0:  RGB = {V, T, P}; break;
-            case 1:  RGB = {Q, V, P}; break;
-            case 2:  RGB = {P, V, T}; break;
-            case 3:  RGB = {P, Q, V}; break;
-            case 4:  RGB = {T, P, V}; break;
-            default: RGB = {V, P, Q}; break;
-        }
+        const packed_point *In = Conversion->Points + i;
+        pcl::PointXYZRGB &Point = Conversion->Converted[i];
+        Point.x = -In->x * 0.001f;
+        Point.y = In->y * 0.001f;
+        Point.z = -In->z * 0.001f;
+
+        const uint8_t *RGBA = Conversion->Colormap + colormap_index_16(In->hue) * 4;
+        Point.r = RGBA[0];
+        Point.g = RGBA[1];
+        Point.b = RGBA[2];
     }
-
-    return(RGB);
 }
 
-int main(void)
+int main(int ArgumentCount, char **Arguments)
 {
 #ifdef PROFILE
     if (MH_Initialize() != MH_OK) {
@@ -243,30 +259,29 @@ int main(void)
     config.camera_fps = K4A_FRAMES_PER_SECOND_30;
     config.synchronized_images_only = false;
 
-    tof_camera camera_ = camera_init(&config);
-    tof_camera *Camera = &camera_;
+    // The camera, a recording or a synthetic scene, see depth_source.c for the arguments.
+    depth_source Source_;
+    depth_source *Source = &Source_;
 
-    if(Camera->device)
+    if(depth_source_open(Source, &config, ArgumentCount, Arguments))
     {
-        uint32_t DepthMapWidth = Camera->max_capture_width;
-        int DepthMapHeight = Camera->max_capture_height;
+        uint32_t DepthMapWidth = Source->width;
+        int DepthMapHeight = Source->height;
         int DepthMapCount = DepthMapWidth * DepthMapHeight;
 
-        k4a_calibration_t calibration;
-        k4a_device_get_calibration(Camera->device, config.depth_mode, config.color_resolution, &calibration);
-
-        k4a_image_t xy_image = NULL;
-        k4a_image_create(K4A_IMAGE_FORMAT_CUSTOM,
-                calibration.depth_camera_calibration.resolution_width,
-                calibration.depth_camera_calibration.resolution_height,
-                calibration.depth_camera_calibration.resolution_width * (int)sizeof(k4a_float2_t),
-                &xy_image);
+        depth_source_intrinsics SourceIntrinsics;
+        depth_source_get_intrinsics(Source, &SourceIntrinsics);
 
-        k4a_create_xy_table(&calibration, xy_image);
-        v2f *XYMap = (v2f *)k4a_image_get_buffer(xy_image);
+        xy_table XYTable = depth_source_load_xy_table(&SourceIntrinsics);
+        v2f *XYMap = (v2f *)XYTable.data;
+        packed_point *Points = (packed_point *)malloc(sizeof(packed_point) * DepthMapCount);
+        packed_point *Scratch = (packed_point *)malloc(sizeof(packed_point) * DepthMapCount);
+        assert(Points && Scratch);
+        // The depth of every pixel in the last frame for the temporal filter, updated in place.
+        float *History = Source->temporal ? (float *)calloc(DepthMapCount, sizeof(float)) : NULL;
 
-        size_t DepthMapSize = DepthMapCount * sizeof(uint16_t);
-        uint16_t *DepthMap = (uint16_t *)malloc(DepthMapSize);
+        // The point cloud and its conversion are computed on every core, see point_cloud.c.
+        job_system *Jobs = job_system_create(0);
 
         boost::shared_ptr<pcl::visualization::PCLVisualizer> viewer (new pcl::visualization::PCLVisualizer ("3D Viewer"));
         pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_ptr (new pcl::PointCloud<pcl::PointXYZRGB>);
@@ -276,6 +291,13 @@ int main(void)
         // viewer->addCoordinateSystem(1.0);
         viewer->initCameraParameters();
 
+        // The colors of the points, switched from the keyboard callback.
+        colormap_kind ColormapKind = COLORMAP_HUE;
+        colormap_kind RequestedColormapKind = COLORMAP_HUE;
+        uint8_t Colormap[COLORMAP_SIZE * 4];
+        colormap_build(ColormapKind, Colormap);
+        viewer->registerKeyboardCallback(KeyboardCallback, &RequestedColormapKind);
+
 #ifdef PROFILE
         HDC DeviceContext = wglGetCurrentDC();
         HGLRC GLDeviceContext = wglGetCurrentContext();
@@ -324,6 +346,13 @@ int main(void)
             // measure whole frame time start
             std::chrono::steady_clock::time_point Begin = std::chrono::steady_clock::now();
 
+            if(RequestedColormapKind != ColormapKind)
+            {
+                ColormapKind = RequestedColormapKind;
+                colormap_build(ColormapKind, Colormap);
+                printf("Colormap: %s\n", colormap_name(ColormapKind));
+            }
+
             FrameCount++;
 
             if (FrameCount % 1000 == 0)
@@ -345,7 +374,8 @@ int main(void)
             }
 #endif
 
-            bool DepthMapUpdate = camera_get_depth_map(Camera, 0, DepthMap, DepthMapSize);
+            depth_frame DepthFrame = {0};
+            bool DepthMapUpdate = depth_source_next_frame(Source, &DepthFrame);
             DepthImageCount += DepthMapUpdate;
 
             // measure start
@@ -356,42 +386,12 @@ int main(void)
             {
                 std::chrono::steady_clock::time_point FullConversionTimeBegin = std::chrono::steady_clock::now();
 
-                cloud_ptr->points.clear();
-
-                uint32_t InsertIndex = 0;
-                for(size_t i = 0; i < DepthMapCount; ++i)
-                {
-                    float d = (float)DepthMap[i];
-
-                    pcl::PointXYZRGB Point;
-                    Point.x = -XYMap[i].x * d / 1000.0f;
-                    Point.y = -XYMap[i].y * d / 1000.0f;
-                    Point.z = d / 1000.0f;
+                uint32_t PointCount = point_cloud_compute(Jobs, Points, Scratch, XYMap, DepthFrame.depth_map, History, DepthMapWidth, DepthMapHeight, Source->filter);
+                depth_source_release_frame(Source, &DepthFrame);
 
-                    if(Point.z != 0.0f)
-                    {
-                        // interpolate
-                        float min_z = 0.5f;
-                        float max_z = 3.86f;
-
-                        float hue = (Point.z - min_z) / (max_z - min_z);
-                        hue = clamp(hue, 0.0f, 1.0f);
-
-                        // the hue of the hsv color goes from red to red so we want to scale with 2/3 which is blue
-                        float range = 2.0f / 3.0f;
-
-                        hue *= range;
-                        hue = range - hue;
-
-                        v3f RGB = HSV2RGB({ hue, 1.0f, 1.0f });
-
-                        Point.r = RGB.x * 255;
-                        Point.g = RGB.y * 255;
-                        Point.b = RGB.z * 255;
-
-                        cloud_ptr->points.push_back(Point);
-                    }
-                }
+                cloud_ptr->points.resize(PointCount);
+                point_conversion Conversion = { Points, cloud_ptr->points.data(), Colormap };
+                job_parallel_for(Jobs, (int)PointCount, POINT_CONVERSION_GRAIN, ConvertPoints, &Conversion);
 
                 cloud_ptr->width = (int)cloud_ptr->points.size();
                 cloud_ptr->height = 1;
@@ -450,6 +450,9 @@ int main(void)
 
             TotalTime += DeltaTime;
         }
+
+        depth_source_stop_recording(Source);
+        job_system_destroy(Jobs);
     }
 
 #ifdef PROFILE
@@ -0,0 +1,19 @@
+@echo off
+
+IF NOT EXIST build mkdir build
+pushd build
+
+set compile_flags=/std:c11 /nologo /GR- /EHa- /Oi /WX /W4 /wd4100 /wd4189 /external:anglebrackets /external:W0 /FC /I..\..\OpenGL\third_party
+set linker_flags=/opt:ref /subsystem:console ..\lib\k4a.lib
+
+echo Building...
+echo:
+
+echo unprojection_accuracy
+cl %compile_flags% /MT /O2 /D "RELEASE" /D "NDEBUG" /D "_CRT_SECURE_NO_WARNINGS" /Fe"unprojection_accuracy" ../code/unprojection_accuracy.c /link %linker_flags%
+
+echo:
+echo point_cloud_benchmark
+cl %compile_flags% /MT /O2 /D "RELEASE" /D "NDEBUG" /D "_CRT_SECURE_NO_WARNINGS" /Fe"point_cloud_benchmark" ../code/point_cloud_benchmark.c /link %linker_flags%
+
+popd
@@ -0,0 +1,16 @@
+#!/bin/bash
+
+mkdir -p build
+pushd build >/dev/null 2>&1
+
+printf "Building...\n\n"
+
+printf "unprojection_accuracy\n\n"
+
+gcc -o unprojection_accuracy ../code/unprojection_accuracy.c -O3 -g0 -DRELEASE -DNDEBUG -lk4a -lm -lrt -pthread
+
+printf "\npoint_cloud_benchmark\n\n"
+
+gcc -o point_cloud_benchmark ../code/point_cloud_benchmark.c -O3 -g0 -DRELEASE -DNDEBUG -lk4a -lm -lrt -pthread
+
+popd >/dev/null 2>&1
@@ -0,0 +1,484 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "../../CPU-plus-OpenGL/code/k4a.c"
+#include "../../CPU-plus-OpenGL/code/rvl.c"
+#include "../../CPU-plus-OpenGL/code/recording.c"
+#include "../../CPU-plus-OpenGL/code/depth_source.c"
+#include "../../CPU-plus-OpenGL/code/job_system.c"
+#include "../../CPU-plus-OpenGL/code/opengl_renderer.h"
+#include "../../CPU-plus-OpenGL/code/point_cloud.c"
+
+/*
+Compares the point cloud kernels of point_cloud.c against the loop the CPU visualizers used before them, for every
+depth mode on the synthetic scene. The scene has a depth for every pixel, so it is measured as it is and with a
+part of the pixels knocked out at random, which is what makes the branch per pixel of the old loop expensive.
+
+For every kernel it reports the time per frame and the speedup over the old loop, and checks that it finds the same
+points as the scalar kernel, bit for bit. The kernels write packed_points of 8 bytes with the coordinates in
+millimeters where the old loop wrote color_points of 24 bytes with floats in meters, so for it the largest difference
+of a coordinate is given instead.
+
+For the NFOV unbinned mode the visualizers use it also computes the points with the best kernel on 1 to as many
+threads as there are cores, the way the visualizers do in tiles of rows on a job_system, and reports the speedup over
+one thread. The points have to be the same as from the scalar kernel for every thread count.
+
+Then every kernel runs again with the spatial filter of 'filter' (DEPTH_FILTER_TOLERANCE in depth_source.c), and the
+time it adds per frame is reported together with how many of the pixels with a depth it drops. The synthetic scene
+has flying pixels at the edge of the sphere, and with pixels knocked out many more pixels lack the neighbors to keep
+their depth. Again all kernels have to find the same points as the scalar one.
+
+Last the kernels run with the temporal filter of 'temporal' (DEPTH_TEMPORAL_WEIGHT), alone and together with the
+spatial filter. Its history carries over from frame to frame, so the frames are computed in order and the history
+starts from 0 before the points are compared.
+
+Finally the rays of a part of the pixels are made NaN, like k4a.c does for the pixels outside of the field of view of
+the lens. Every kernel has to leave them out, with and without the filters, instead of packing them into points at
+POINT_CLOUD_MIN_UNITS.
+
+Usage: point_cloud_benchmark [fraction of pixels without a depth, default 0.25]
+
+The Azure Kinect is not needed, only the k4a library to link against.
+*/
+
+#define BENCHMARK_ROUNDS 20
+
+typedef struct
+{
+    k4a_depth_mode_t mode;
+    const char *name;
+} depth_mode_info;
+
+static const depth_mode_info depth_modes[] =
+{
+    {K4A_DEPTH_MODE_NFOV_2X2BINNED, "NFOV 2x2 binned"},
+    {K4A_DEPTH_MODE_NFOV_UNBINNED,  "NFOV unbinned"},
+    {K4A_DEPTH_MODE_WFOV_2X2BINNED, "WFOV 2x2 binned"},
+    {K4A_DEPTH_MODE_WFOV_UNBINNED,  "WFOV unbinned"},
+};
+
+// The loop of calculate_point_cloud() before point_cloud.c, without the comments.
+static uint32_t reference_point_cloud(color_point *vertex_array, v2f *xy_map, uint16_t *depth_map, int depth_map_count)
+{
+    uint32_t insert_index = 0;
+    for(size_t i = 0; i < (size_t)depth_map_count; ++i)
+    {
+        float d = (float)depth_map[i];
+
+        color_point point;
+        point.xyz[0] = xy_map[i].x * d / 1000.0f;
+        point.xyz[1] = -xy_map[i].y * d / 1000.0f;
+        point.xyz[2] = -d / 1000.0f;
+
+        if(point.xyz[2] != 0.0f)
+        {
+            float min_z = 0.5f;
+            float max_z = 3.86f;
+
+#define clamp(x, low, high) (x) < (low) ? (low) : ((x) > (high) ? (high) : (x))
+
+            float hue = (-point.xyz[2] - min_z) / (max_z - min_z);
+            hue = clamp(hue, 0.0f, 1.0f);
+
+            float range = 2.0f / 3.0f;
+
+            hue *= range;
+            hue = range - hue;
+
+            point.rgb[0] = hue;
+            point.rgb[1] = 1.0f;
+            point.rgb[2] = 1.0f;
+
+            vertex_array[insert_index++] = point;
+        }
+    }
+
+    return(insert_index);
+}
+
+static double get_time(void)
+{
+    return((double)recording_get_time() * 1e-9);
+}
+
+// kernel is a point_cloud_isa or -1 for the old loop, which writes color_points instead of packed_points.
+static size_t point_size(int kernel)
+{
+    return((kernel < 0) ? sizeof(color_point) : sizeof(packed_point));
+}
+
+// The old loop has no filters. history is NULL without the temporal filter.
+static uint32_t compute(int kernel, bool filter, float *history, void *points, v2f *xy_map, uint16_t *depth_map, int width, int height)
+{
+    if(kernel < 0)
+    {
+        return(reference_point_cloud((color_point *)points, xy_map, depth_map, width * height));
+    }
+    if(filter)
+    {
+        return(point_cloud_compute_filtered_with((point_cloud_isa)kernel, (packed_point *)points, xy_map, depth_map,
+                                                 history, width, height, 0, height));
+    }
+    return(point_cloud_compute_with((point_cloud_isa)kernel, (packed_point *)points, xy_map, depth_map, history,
+                                    width * height));
+}
+
+// Milliseconds per frame of the fastest round. Like in the visualizers every frame goes into the same vertex array,
+// only afterwards the points of every frame are computed once more into points to compare them, with the history
+// starting over.
+static double measure(int kernel, bool filter, float *history, void *points, uint32_t *point_counts, v2f *xy_map, uint16_t *frames, int frame_count, int width, int height)
+{
+    int pixel_count = width * height;
+
+    double best = 1e30;
+    for(int round = 0; round < BENCHMARK_ROUNDS; ++round)
+    {
+        double start = get_time();
+        for(int frame = 0; frame < frame_count; ++frame)
+        {
+            compute(kernel, filter, history, points, xy_map, frames + (size_t)frame * pixel_count, width, height);
+        }
+        double time = get_time() - start;
+        best = (time < best) ? time : best;
+    }
+
+    if(history)
+    {
+        memset(history, 0, (size_t)pixel_count * sizeof(float));
+    }
+    for(int frame = 0; frame < frame_count; ++frame)
+    {
+        void *frame_points = (char *)points + (size_t)frame * pixel_count * point_size(kernel);
+        point_counts[frame] = compute(kernel, filter, history, frame_points, xy_map, frames + (size_t)frame * pixel_count,
+                                      width, height);
+    }
+
+    return(best / frame_count * 1000.0);
+}
+
+// Whether points has the same points as expected for every frame.
+static bool same_points(packed_point *points, uint32_t *point_counts, packed_point *expected, uint32_t *expected_counts, int frame_count, int pixel_count)
+{
+    bool identical = true;
+    for(int frame = 0; frame < frame_count; ++frame)
+    {
+        identical = identical && point_counts[frame] == expected_counts[frame] &&
+                    0 == memcmp(points + (size_t)frame * pixel_count, expected + (size_t)frame * pixel_count,
+                                expected_counts[frame] * sizeof(packed_point));
+    }
+    return(identical);
+}
+
+// Milliseconds per frame of the fastest round with point_cloud_compute_parallel(), the points go to points like in
+// measure().
+static double measure_parallel(job_system *jobs, point_cloud_isa isa, packed_point *points, packed_point *scratch, uint32_t *point_counts, v2f *xy_map, uint16_t *frames, int frame_count, int width, int height)
+{
+    int pixel_count = width * height;
+
+    double best = 1e30;
+    for(int round = 0; round < BENCHMARK_ROUNDS; ++round)
+    {
+        double start = get_time();
+        for(int frame = 0; frame < frame_count; ++frame)
+        {
+            point_cloud_compute_parallel(jobs, isa, points, scratch, xy_map, frames + (size_t)frame * pixel_count, NULL, width,
+                                         height, false);
+        }
+        double time = get_time() - start;
+        best = (time < best) ? time : best;
+    }
+
+    for(int frame = 0; frame < frame_count; ++frame)
+    {
+        point_counts[frame] = point_cloud_compute_parallel(jobs, isa, points + (size_t)frame * pixel_count, scratch, xy_map,
+                                                           frames + (size_t)frame * pixel_count, NULL, width, height,
+                                                           false);
+    }
+
+    return(best / frame_count * 1000.0);
+}
+
+// Knocks out the ray of every 7th pixel, so it lands in every lane of the vector kernels, and checks that no kernel
+// makes a point of those pixels. Without the filters there have to be as many points as pixels with a depth and a ray.
+static bool check_invalid_rays(const v2f *xy_map, uint16_t *depth_map, int width, int height)
+{
+    int pixel_count = width * height;
+    v2f *invalid_xy_map = (v2f *)malloc((size_t)pixel_count * sizeof(v2f));
+    packed_point *points = (packed_point *)malloc((size_t)pixel_count * sizeof(packed_point));
+    packed_point *expected = (packed_point *)malloc((size_t)pixel_count * sizeof(packed_point));
+    float *history = (float *)malloc((size_t)pixel_count * sizeof(float));
+    assert(invalid_xy_map && points && expected && history);
+
+    uint32_t valid_count = 0;
+    for(int i = 0; i < pixel_count; ++i)
+    {
+        invalid_xy_map[i] = xy_map[i];
+        if(i % 7 == 0)
+        {
+            invalid_xy_map[i].x = nanf("");
+            invalid_xy_map[i].y = nanf("");
+        }
+        valid_count += (depth_map[i] != 0 && i % 7 != 0);
+    }
+
+    bool passed = true;
+    for(int filters = 0; filters < 4; ++filters)
+    {
+        bool filter = (filters & 1) != 0;
+        bool temporal = (filters & 2) != 0;
+        uint32_t expected_count = 0;
+        for(int isa = point_cloud_isa_scalar; isa <= (int)point_cloud_get_best_isa(); ++isa)
+        {
+            memset(history, 0, (size_t)pixel_count * sizeof(float));
+            uint32_t point_count = compute(isa, filter, temporal ? history : NULL, points, invalid_xy_map, depth_map,
+                                           width, height);
+
+            bool dropped = filter || point_count == valid_count;
+            for(uint32_t i = 0; i < point_count; ++i)
+            {
+                const packed_point *point = points + i;
+                dropped = dropped && point->x != (int16_t)POINT_CLOUD_MIN_UNITS &&
+                          point->y != (int16_t)POINT_CLOUD_MIN_UNITS && point->z != (int16_t)POINT_CLOUD_MIN_UNITS;
+            }
+            if(isa == point_cloud_isa_scalar)
+            {
+                memcpy(expected, points, point_count * sizeof(packed_point));
+                expected_count = point_count;
+            }
+            bool identical = point_count == expected_count &&
+                             0 == memcmp(points, expected, point_count * sizeof(packed_point));
+            passed = passed && dropped && identical;
+
+            if(!dropped || !identical)
+            {
+                printf("  %s%s%s: %s\n", point_cloud_isa_names[isa], filter ? " with the filter" : "",
+                       temporal ? (filter ? " and the temporal filter" : " with the temporal filter") : "",
+                       dropped ? "DIFFERENT POINTS THAN SCALAR" : "KEEPS THE PIXELS WITHOUT A RAY");
+            }
+        }
+    }
+    printf("  Pixels without a ray: %s\n", passed ? "left out by every kernel" : "FAILED");
+
+    free(invalid_xy_map);
+    free(points);
+    free(expected);
+    free(history);
+    return(passed);
+}
+
+static bool run_benchmark(const depth_mode_info *mode, float hole_fraction)
+{
+    camera_config config = K4A_DEVICE_CONFIG_INIT_DISABLE_ALL;
+    config.depth_mode = mode->mode;
+
+    char *arguments[2] = { "point_cloud_benchmark", "synthetic" };
+    depth_source source;
+    if(!depth_source_open(&source, &config, 2, arguments))
+    {
+        return(false);
+    }
+
+    depth_source_intrinsics intrinsics;
+    depth_source_get_intrinsics(&source, &intrinsics);
+    xy_table table = depth_source_load_xy_table(&intrinsics);
+    v2f *xy_map = (v2f *)table.data;
+
+    int width = (int)source.width;
+    int height = (int)source.height;
+    int pixel_count = width * height;
+    int frame_count = SYNTHETIC_FRAME_COUNT;
+    uint16_t *frames = (uint16_t *)malloc((size_t)frame_count * pixel_count * sizeof(uint16_t));
+    packed_point *points = (packed_point *)malloc((size_t)frame_count * pixel_count * sizeof(packed_point));
+    packed_point *expected = (packed_point *)malloc((size_t)frame_count * pixel_count * sizeof(packed_point));
+    color_point *reference_points = (color_point *)malloc((size_t)frame_count * pixel_count * sizeof(color_point));
+    uint32_t *point_counts = (uint32_t *)malloc(frame_count * sizeof(uint32_t));
+    uint32_t *expected_counts = (uint32_t *)malloc(frame_count * sizeof(uint32_t));
+    assert(frames && points && expected && reference_points && point_counts && expected_counts);
+
+    uint32_t random = 12345;
+    for(int frame = 0; frame < frame_count; ++frame)
+    {
+        depth_frame depth = {0};
+        depth_source_next_frame(&source, &depth);
+        uint16_t *depth_map = frames + (size_t)frame * pixel_count;
+        memcpy(depth_map, depth.depth_map, pixel_count * sizeof(uint16_t));
+        depth_source_release_frame(&source, &depth);
+
+        for(int i = 0; i < pixel_count; ++i)
+        {
+            random = random * 1664525u + 1013904223u;
+            if((float)(random >> 8) < hole_fraction * (float)(1 << 24))
+            {
+                depth_map[i] = 0;
+            }
+        }
+    }
+
+    printf("%s (%ux%u), %.0f%% of the pixels without a depth, %d bytes per point (%d for the old loop)\n", mode->name,
+           source.width, source.height, hole_fraction * 100.0f, (int)sizeof(packed_point), (int)sizeof(color_point));
+
+    double times[point_cloud_isa_count];
+    double scalar_time = measure(point_cloud_isa_scalar, false, NULL, expected, expected_counts, xy_map, frames, frame_count,
+                                 width, height);
+    double reference_time = measure(-1, false, NULL, reference_points, point_counts, xy_map, frames, frame_count, width, height);
+    times[point_cloud_isa_scalar] = scalar_time;
+
+    // How far the old loop is from the kernels, in meters.
+    float max_difference = 0.0f;
+    bool same_count = true;
+    for(int frame = 0; frame < frame_count; ++frame)
+    {
+        same_count = same_count && point_counts[frame] == expected_counts[frame];
+        for(uint32_t i = 0; same_count && i < expected_counts[frame]; ++i)
+        {
+            const color_point *a = reference_points + (size_t)frame * pixel_count + i;
+            const packed_point *b = expected + (size_t)frame * pixel_count + i;
+            float coordinates[3] = { b->x * 0.001f, b->y * 0.001f, b->z * 0.001f };
+            for(int k = 0; k < 3; ++k)
+            {
+                float difference = fabsf(a->xyz[k] - coordinates[k]);
+                max_difference = (difference > max_difference) ? difference : max_difference;
+            }
+        }
+    }
+
+    printf("  old loop:  %7.3f ms per frame                   largest difference %.3f mm%s\n", reference_time,
+           max_difference * 1000.0f, same_count ? "" : ", DIFFERENT POINT COUNT");
+    printf("  scalar:    %7.3f ms per frame  (%5.2fx)\n", scalar_time, reference_time / scalar_time);
+
+    bool passed = same_count;
+    point_cloud_isa best_isa = point_cloud_get_best_isa();
+    for(int isa = point_cloud_isa_scalar + 1; isa <= (int)best_isa; ++isa)
+    {
+        memset(points, 0, (size_t)frame_count * pixel_count * sizeof(packed_point));
+        double time = measure(isa, false, NULL, points, point_counts, xy_map, frames, frame_count, width, height);
+        times[isa] = time;
+
+        bool identical = same_points(points, point_counts, expected, expected_counts, frame_count, pixel_count);
+        passed = passed && identical;
+
+        printf("  %-8s   %7.3f ms per frame  (%5.2fx)  %s\n", point_cloud_isa_names[isa], time, reference_time / time,
+               identical ? "same points as scalar" : "DIFFERENT POINTS THAN SCALAR");
+    }
+
+    if(mode->mode == K4A_DEPTH_MODE_NFOV_UNBINNED)
+    {
+        printf("  %s on 1 to %d threads\n", point_cloud_isa_names[best_isa], job_get_processor_count());
+
+        packed_point *scratch = (packed_point *)malloc((size_t)pixel_count * sizeof(packed_point));
+        assert(scratch);
+        double single_thread_time = 0.0;
+        for(int thread_count = 1; thread_count <= job_get_processor_count(); ++thread_count)
+        {
+            job_system *jobs = job_system_create(thread_count);
+            memset(points, 0, (size_t)frame_count * pixel_count * sizeof(packed_point));
+            double time = measure_parallel(jobs, best_isa, points, scratch, point_counts, xy_map, frames, frame_count,
+                                           width, height);
+            job_system_destroy(jobs);
+            single_thread_time = (thread_count == 1) ? time : single_thread_time;
+
+            bool identical = same_points(points, point_counts, expected, expected_counts, frame_count, pixel_count);
+            passed = passed && identical;
+
+            printf("  %2d thread%s  %7.3f ms per frame  (%5.2fx)  %s\n", thread_count, (thread_count == 1) ? " " : "s", time,
+                   single_thread_time / time, identical ? "same points as scalar" : "DIFFERENT POINTS THAN SCALAR");
+        }
+        free(scratch);
+    }
+
+    // The same with the filter, against the filtered points of the scalar kernel.
+    uint64_t unfiltered_point_count = 0;
+    for(int frame = 0; frame < frame_count; ++frame)
+    {
+        unfiltered_point_count += expected_counts[frame];
+    }
+
+    double filtered_scalar_time = measure(point_cloud_isa_scalar, true, NULL, expected, expected_counts, xy_map, frames,
+                                          frame_count, width, height);
+    uint64_t filtered_point_count = 0;
+    for(int frame = 0; frame < frame_count; ++frame)
+    {
+        filtered_point_count += expected_counts[frame];
+    }
+
+    printf("  With the filter, which drops %.2f%% of the pixels with a depth\n",
+           100.0 * (double)(unfiltered_point_count - filtered_point_count) / (double)unfiltered_point_count);
+    printf("  scalar:    %7.3f ms per frame  (%+7.3f ms)\n", filtered_scalar_time,
+           filtered_scalar_time - times[point_cloud_isa_scalar]);
+
+    for(int isa = point_cloud_isa_scalar + 1; isa <= (int)best_isa; ++isa)
+    {
+        memset(points, 0, (size_t)frame_count * pixel_count * sizeof(packed_point));
+        double time = measure(isa, true, NULL, points, point_counts, xy_map, frames, frame_count, width, height);
+
+        bool identical = same_points(points, point_counts, expected, expected_counts, frame_count, pixel_count);
+        passed = passed && identical;
+
+        printf("  %-8s   %7.3f ms per frame  (%+7.3f ms)  %s\n", point_cloud_isa_names[isa], time, time - times[isa],
+               identical ? "same points as scalar" : "DIFFERENT POINTS THAN SCALAR");
+    }
+
+    // And with the temporal filter, alone and after the spatial one. The times are against no filter at all.
+    float *history = (float *)malloc((size_t)pixel_count * sizeof(float));
+    assert(history);
+    for(int spatial = 0; spatial < 2; ++spatial)
+    {
+        printf("  With the temporal filter%s\n", spatial ? " and the filter" : "");
+        double temporal_scalar_time = measure(point_cloud_isa_scalar, spatial, history, expected, expected_counts, xy_map,
+                                              frames, frame_count, width, height);
+        printf("  scalar:    %7.3f ms per frame  (%+7.3f ms)\n", temporal_scalar_time,
+               temporal_scalar_time - times[point_cloud_isa_scalar]);
+
+        for(int isa = point_cloud_isa_scalar + 1; isa <= (int)best_isa; ++isa)
+        {
+            memset(points, 0, (size_t)frame_count * pixel_count * sizeof(packed_point));
+            double time = measure(isa, spatial, history, points, point_counts, xy_map, frames, frame_count, width, height);
+
+            bool identical = same_points(points, point_counts, expected, expected_counts, frame_count, pixel_count);
+            passed = passed && identical;
+
+            printf("  %-8s   %7.3f ms per frame  (%+7.3f ms)  %s\n", point_cloud_isa_names[isa], time, time - times[isa],
+                   identical ? "same points as scalar" : "DIFFERENT POINTS THAN SCALAR");
+        }
+    }
+
+    passed = check_invalid_rays(xy_map, frames, width, height) && passed;
+    printf("\n");
+
+    free(history);
+
+    free(frames);
+    free(points);
+    free(expected);
+    free(reference_points);
+    free(point_counts);
+    free(expected_counts);
+    camera_release_xy_table(&table);
+    depth_source_close(&source);
+    return(passed);
+}
+
+int main(int argument_count, char **arguments)
+{
+    float hole_fraction = (argument_count > 1) ? (float)atof(arguments[1]) : 0.25f;
+
+    printf("Best kernel on this CPU: %s\n\n", point_cloud_isa_names[point_cloud_get_best_isa()]);
+
+    bool passed = true;
+    for(int i = 0; i < (int)(sizeof(depth_modes) / sizeof(depth_modes[0])); ++i)
+    {
+        passed = run_benchmark(&depth_modes[i], 0.0f) && passed;
+        if(hole_fraction > 0.0f)
+        {
+            passed = run_benchmark(&depth_modes[i], hole_fraction) && passed;
+        }
+    }
+
+    return(passed ? 0 : -1);
+}
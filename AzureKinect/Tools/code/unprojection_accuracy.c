@@ -0,0 +1,187 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "../../OpenGL/code/k4a.c"
+
+/*
+Compares camera_unproject() - the analytic Brown-Conrady unprojection the OpenGL and OpenCL visualizers evaluate per
+pixel instead of reading the XY table - against the XY table the SDK computes with k4a_calibration_2d_to_3d(). The
+compute shader and the kernel do the same float computation, so this is also what to expect from them.
+
+For every depth mode it reports how many pixels disagree on being valid and the difference between the two rays
+(the x and y at z = 1): the largest one, the mean and the 99th percentile. The difference is also given in pixels
+and as the lateral offset of a point at the maximum operating range of the mode.
+
+Usage: unprojection_accuracy [raw calibration file]
+
+Without a file the calibration is read from the first connected device. A raw calibration file is what
+k4a_device_get_raw_calibration() returns (the JSON blob stored on the device).
+*/
+
+typedef struct
+{
+    k4a_depth_mode_t mode;
+    const char *name;
+    float max_depth; // meters
+} depth_mode_info;
+
+static const depth_mode_info depth_modes[] =
+{
+    {K4A_DEPTH_MODE_NFOV_2X2BINNED, "NFOV 2x2 binned", 5.46f},
+    {K4A_DEPTH_MODE_NFOV_UNBINNED,  "NFOV unbinned",   3.86f},
+    {K4A_DEPTH_MODE_WFOV_2X2BINNED, "WFOV 2x2 binned", 2.88f},
+    {K4A_DEPTH_MODE_WFOV_UNBINNED,  "WFOV unbinned",   2.21f},
+};
+
+static int compare_floats(const void *a, const void *b)
+{
+    float fa = *(const float *)a;
+    float fb = *(const float *)b;
+    return((fa > fb) - (fa < fb));
+}
+
+static uint8_t *read_raw_calibration(const char *path, size_t *size_out)
+{
+    FILE *file = fopen(path, "rb");
+    if(!file)
+    {
+        fprintf(stderr, "Could not open '%s'.\n", path);
+        return(NULL);
+    }
+    
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    
+    // the SDK wants the blob zero terminated
+    uint8_t *raw = (uint8_t *)calloc(1, size + 1);
+    size_t bytes_read = fread(raw, 1, size, file);
+    fclose(file);
+    
+    *size_out = bytes_read + 1;
+    return(raw);
+}
+
+static uint8_t *read_device_calibration(size_t *size_out)
+{
+    k4a_device_t device = NULL;
+    if(K4A_RESULT_SUCCEEDED != k4a_device_open(K4A_DEVICE_DEFAULT, &device))
+    {
+        fprintf(stderr, "Could not open the device.\n");
+        return(NULL);
+    }
+    
+    size_t size = 0;
+    k4a_device_get_raw_calibration(device, NULL, &size);
+    uint8_t *raw = (uint8_t *)malloc(size);
+    if(K4A_BUFFER_RESULT_SUCCEEDED != k4a_device_get_raw_calibration(device, raw, &size))
+    {
+        fprintf(stderr, "Could not read the calibration of the device.\n");
+        free(raw);
+        raw = NULL;
+    }
+    k4a_device_close(device);
+    
+    *size_out = size;
+    return(raw);
+}
+
+static void report_depth_mode(const k4a_calibration_t *calibration, const depth_mode_info *mode)
+{
+    depth_intrinsics intrinsics;
+    if(!camera_get_depth_intrinsics(calibration, &intrinsics))
+    {
+        printf("%s: the depth camera does not use the Brown-Conrady model, the XY table is used.\n\n", mode->name);
+        return;
+    }
+    
+    int width = calibration->depth_camera_calibration.resolution_width;
+    int height = calibration->depth_camera_calibration.resolution_height;
+    int pixel_count = width * height;
+    
+    k4a_float2_t *table = (k4a_float2_t *)malloc(pixel_count * sizeof(k4a_float2_t));
+    k4a_create_xy_table(calibration, table);
+    
+    float *errors = (float *)malloc(pixel_count * sizeof(float));
+    int error_count = 0;
+    int only_table_valid = 0;
+    int only_analytic_valid = 0;
+    double error_sum = 0.0;
+    
+    for(int v = 0, i = 0; v < height; ++v)
+    {
+        for(int u = 0; u < width; ++u, ++i)
+        {
+            float x, y;
+            bool analytic_valid = camera_unproject(&intrinsics, (float)u, (float)v, &x, &y);
+            bool table_valid = !isnan(table[i].xy.x);
+            
+            if(analytic_valid != table_valid)
+            {
+                only_table_valid += table_valid;
+                only_analytic_valid += analytic_valid;
+            }
+            else if(table_valid)
+            {
+                float dx = x - table[i].xy.x;
+                float dy = y - table[i].xy.y;
+                float error = sqrtf(dx * dx + dy * dy);
+                errors[error_count++] = error;
+                error_sum += error;
+            }
+        }
+    }
+    
+    printf("%s (%dx%d), XY table %.1f MB\n", mode->name, width, height, pixel_count * sizeof(k4a_float2_t) / (1024.0 * 1024.0));
+    printf("  valid in both:          %d\n", error_count);
+    printf("  valid only in table:    %d\n", only_table_valid);
+    printf("  valid only analytic:    %d\n", only_analytic_valid);
+    
+    if(error_count > 0)
+    {
+        qsort(errors, error_count, sizeof(float), compare_floats);
+        float max_error = errors[error_count - 1];
+        float p99_error = errors[(int)(0.99 * (error_count - 1))];
+        float mean_error = (float)(error_sum / error_count);
+        
+        float focal_length = 0.5f * (intrinsics.fx + intrinsics.fy);
+        printf("  ray difference max:     %.3e (%.5f px, %.4f mm at %.2f m)\n", max_error, max_error * focal_length, max_error * mode->max_depth * 1000.0f, mode->max_depth);
+        printf("  ray difference p99:     %.3e (%.5f px)\n", p99_error, p99_error * focal_length);
+        printf("  ray difference mean:    %.3e (%.5f px)\n", mean_error, mean_error * focal_length);
+    }
+    printf("\n");
+    
+    free(errors);
+    free(table);
+}
+
+int main(int argument_count, char **arguments)
+{
+    size_t raw_size = 0;
+    uint8_t *raw = (argument_count > 1) ? read_raw_calibration(arguments[1], &raw_size) : read_device_calibration(&raw_size);
+    if(!raw)
+    {
+        return(-1);
+    }
+    
+    printf("Analytic unprojection with %d Newton iterations against k4a_calibration_2d_to_3d()\n\n", UNPROJECTION_ITERATIONS);
+    
+    for(int i = 0; i < (int)(sizeof(depth_modes) / sizeof(depth_modes[0])); ++i)
+    {
+        k4a_calibration_t calibration;
+        if(K4A_RESULT_SUCCEEDED != k4a_calibration_get_from_raw((char *)raw, raw_size, depth_modes[i].mode, K4A_COLOR_RESOLUTION_OFF, &calibration))
+        {
+            fprintf(stderr, "Could not parse the calibration for %s.\n", depth_modes[i].name);
+            continue;
+        }
+        report_depth_mode(&calibration, &depth_modes[i]);
+    }
+    
+    free(raw);
+    return(0);
+}
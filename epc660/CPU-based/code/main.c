@@ -7,6 +7,11 @@
 
 #include "input.c"
 #include "network.c"
+#include "rvl.c"
+#include "recording.c"
+#include "depth_source.c"
+#include "job_system.c"
+#include "colormap.c"
 #include "linalg.h"
 
 #include <windows.h>
@@ -46,11 +51,15 @@ typedef struct
     float sensitivity;
 } view_control;
 
+// A point as point_cloud.c computes it: the position in millimeters and the hue of the color in 1/65535 of the color
+// circle, saturation and value are 1.
 typedef struct
 {
-    float xyz[3];
-    float rgb[3];
-} color_point;
+    int16_t x, y, z;
+    uint16_t hue;
+} packed_point;
+
+#include "point_cloud.c"
 
 typedef struct
 {
@@ -58,8 +67,8 @@ typedef struct
     v3f Color;
 } vertex_out;
 
-typedef vertex_out vertex_program(color_point In, mat4 MVP);
-typedef v3f        pixel_program(v3f HSV);
+typedef vertex_out vertex_program(packed_point In, mat4 MVP);
+typedef uint32_t   pixel_program(v3f HSV, uint32_t *Colormap);
 
 typedef struct
 {
@@ -67,6 +76,10 @@ typedef struct
     
     vertex_program *VertexProgram;
     pixel_program *PixelProgram;
+
+    // The framebuffer colors of the hues, see colormap.c.
+    colormap_kind ColormapKind;
+    uint32_t Colormap[COLORMAP_SIZE];
 } graphics_pipeline;
 
 struct scroll_update { 
@@ -76,6 +89,7 @@ struct scroll_update {
 
 static struct scroll_update global_scroll_update;
 static bool GlobalRunning = false;
+static colormap_kind GlobalColormapKind = COLORMAP_HUE;
 
 static framebuffer *CreateFramebuffer(int Width, int Height, int BytesPerPixel)
 {
@@ -110,7 +124,28 @@ static void DisplayFramebuffer(framebuffer *Framebuffer, HDC WindowDC, int Width
         DIB_RGB_COLORS, SRCCOPY);
 }
 
-static void ClearFramebuffer(framebuffer *Framebuffer, float Red, float Green, float Blue, float Alpha)
+// Both buffers are cleared in bands of rows on all threads.
+#define FRAMEBUFFER_CLEAR_ROWS 16
+
+typedef struct
+{
+    uint32_t *Memory;
+    uint32_t Width;
+    uint32_t Value;
+} buffer_clear;
+
+static void ClearRows(void *Data, int Begin, int End)
+{
+    buffer_clear *Clear = (buffer_clear *)Data;
+    uint32_t *Row = Clear->Memory + (size_t)Begin * Clear->Width;
+    size_t PixelCount = (size_t)(End - Begin) * Clear->Width;
+    for(size_t Index = 0; Index < PixelCount; ++Index)
+    {
+        Row[Index] = Clear->Value;
+    }
+}
+
+static void ClearFramebuffer(job_system *Jobs, framebuffer *Framebuffer, float Red, float Green, float Blue, float Alpha)
 {
     uint32_t R = (uint32_t)(0xFF * Red);
     uint32_t G = (uint32_t)(0xFF * Green);
@@ -118,12 +153,8 @@ static void ClearFramebuffer(framebuffer *Framebuffer, float Red, float Green, f
     uint32_t A = (uint32_t)(0xFF * Alpha);
     uint32_t Color = A << 24 | R << 16 | G << 8 | B << 0;
     
-    uint32_t PixelCount = Framebuffer->Width * Framebuffer->Height;
-    
-    for(size_t Index = 0; Index < PixelCount; ++Index)
-    {
-        Framebuffer->Memory[Index] = Color;
-    }
+    buffer_clear Clear = { Framebuffer->Memory, (uint32_t)Framebuffer->Width, Color };
+    job_parallel_for(Jobs, Framebuffer->Height, FRAMEBUFFER_CLEAR_ROWS, ClearRows, &Clear);
 }
 
 static depth_buffer *CreateDepthBuffer(uint32_t Width, uint32_t Height)
@@ -138,13 +169,11 @@ static depth_buffer *CreateDepthBuffer(uint32_t Width, uint32_t Height)
     return(DepthBuffer);
 }
 
-static void ClearDepthBuffer(depth_buffer *DepthBuffer)
+static void ClearDepthBuffer(job_system *Jobs, depth_buffer *DepthBuffer)
 {
-    uint32_t PixelCount = DepthBuffer->Width * DepthBuffer->Height;
-    for(size_t Index = 0; Index < PixelCount; ++Index)
-    {
-        DepthBuffer->Memory[Index] = 0;
-    }
+    // A depth of 0.0f has all bits cleared.
+    buffer_clear Clear = { (uint32_t *)DepthBuffer->Memory, DepthBuffer->Width, 0 };
+    job_parallel_for(Jobs, (int)DepthBuffer->Height, FRAMEBUFFER_CLEAR_ROWS, ClearRows, &Clear);
 }
 
 static graphics_pipeline *CreateGraphicsPipeline(uint32_t ViewportWidth, uint32_t ViewportHeight, vertex_program *VertexProgram, pixel_program *PixelProgram)
@@ -160,6 +189,22 @@ static graphics_pipeline *CreateGraphicsPipeline(uint32_t ViewportWidth, uint32_
     return(Pipeline);
 }
 
+// Converts the colors of the colormap to the pixels of the framebuffer once, so a pixel only has to look up its hue.
+static void SetColormap(graphics_pipeline *Pipeline, colormap_kind Kind)
+{
+    uint8_t RGBA[COLORMAP_SIZE * 4];
+    colormap_build(Kind, RGBA);
+    
+    for(int Index = 0; Index < COLORMAP_SIZE; ++Index)
+    {
+        uint32_t Red   = RGBA[Index * 4 + 0];
+        uint32_t Green = RGBA[Index * 4 + 1];
+        uint32_t Blue  = RGBA[Index * 4 + 2];
+        Pipeline->Colormap[Index] = 0xFFu << 24 | Red << 16 | Green << 8 | Blue << 0;
+    }
+    Pipeline->ColormapKind = Kind;
+}
+
 static void ToggleFullscreen(HWND Window)
 {
     static DWORD PrevWindowStyle;
@@ -243,6 +288,12 @@ LRESULT CALLBACK MainWndProc(HWND Window, UINT Message, WPARAM wParam, LPARAM lP
             {
                 b32 AltDown = (lParam & (1 << 29)) != 0;
                 
+                // M switches to the next colormap.
+                if(Key == 'M' && Down)
+                {
+                    GlobalColormapKind = (colormap_kind)((GlobalColormapKind + 1) % COLORMAP_COUNT);
+                }
+
                 if(Key == VK_F11 && Down)
                 {
                     ToggleFullscreen(Window);
@@ -419,71 +470,60 @@ static void PrintFPS(float DeltaTime)
     }
 }
 
-static void calculate_point_cloud(color_point *vertex_array, int *vertex_count, int *depth_map, int depth_map_width, int depth_map_height)
+static void calculate_point_cloud(packed_point *vertex_array, int *vertex_count, job_system *jobs, packed_point *scratch, float *history, ray_table *rays, depth_sample *depth_map)
 {
-    int insert_index = 0;
-    int depth_map_count = depth_map_width * depth_map_height;
-    for(int i = 0; i < depth_map_count; ++i)
-    {
-        int pixel[2] = { i % depth_map_width, i / depth_map_width };
-        int principal_point[2] = { depth_map_width / 2, depth_map_height / 2 };
-
-        int d0 = (depth_map[i + depth_map_count * 0] & 0xFFF) - 2048;
-        int d1 = (depth_map[i + depth_map_count * 1] & 0xFFF) - 2048;
-        int d2 = (depth_map[i + depth_map_count * 2] & 0xFFF) - 2048;
-        int d3 = (depth_map[i + depth_map_count * 3] & 0xFFF) - 2048;
-
-        // if(d0 == 0 || d1 == 0 || d2 == 0 || d3 == 0)
-        //     continue;
-        
-        float diff0 = (float)(d3 - d1);
-        float diff1 = (float)(d2 - d0);
-
-        float c = 300000000.0f;
-        float f = 12000000.0f;
-        float pi = 3.1416f;
-
-        float depth = (c / 2) * (1 / (2 * pi * f)) * (pi + atan2f(diff0, diff1));
-
-        float focal_length = 50.0f * 3.7f; // pixels per mm * focal length [mm]
-
-        float x = (pixel[0] - principal_point[0]) / focal_length;
-        float y = (pixel[1] - principal_point[1]) / focal_length;
-
-        float z = depth / sqrtf(x * x + y * y + 1);
+    *vertex_count = (int)ComputePointCloud(jobs, vertex_array, scratch, rays, depth_map, history);
+}
 
-        color_point point;
-        point.xyz[0] = x * z;
-        point.xyz[1] = -y * z;
-        point.xyz[2] = -z;
-        
-        float min_z = 0.0f;
-        float max_z = 12.5f;
+// ProcessVertices() works on all threads of a job_system. The vertices are shaded in chunks, then the fragments are
+// sorted by the band of rows they fall into, keeping the order of the vertices within a band, and every band is
+// depth tested and written by one thread. No two threads write the same pixel and every pixel sees its fragments in
+// the order of the vertices, so the image is the same as when the vertices are drawn one after another.
+#define RASTER_BAND_ROWS 16
+#define RASTER_MAX_BANDS 128
+#define RASTER_MIN_CHUNK_SIZE 8192
+#define RASTER_MAX_CHUNKS 64
 
-        if(z != 0.0f && z >= min_z && z <= max_z)
-        {
-            // interpolate
+typedef struct
+{
+    uint32_t Index; // Of the pixel, or RASTER_CLIPPED.
+    uint32_t Color;
+    float Depth;
+} fragment;
 
-#define clamp(x, low, high) (x) < (low) ? (low) : ((x) > (high) ? (high) : (x))
-            
-            float hue = (z - min_z) / (max_z - min_z);
-            hue = clamp(hue, 0.0f, 1.0f);
+#define RASTER_CLIPPED 0xFFFFFFFF
 
-            // the hue of the hsv color goes from red to red so we want to scale with 2/3 which is blue
-            float range = 2.0f / 3.0f;
-            
-            hue *= range;
-            hue = range - hue;
+typedef struct
+{
+    fragment *Fragments; // One per vertex, in the order of the vertices.
+    fragment *Binned; // The fragments that were not clipped, sorted by band.
+    uint32_t MaxVertexCount;
 
-            point.rgb[0] = hue;
-            point.rgb[1] = 1.0f;
-            point.rgb[2] = 1.0f;
+    // How many fragments every chunk has in every band, then where the next one of them goes in Binned.
+    uint32_t Counts[RASTER_MAX_CHUNKS][RASTER_MAX_BANDS];
+    uint32_t BandOffsets[RASTER_MAX_BANDS + 1];
+} raster_bins;
 
-            vertex_array[insert_index++] = point;
-        }
-    }
-
-    *vertex_count = insert_index;
+typedef struct
+{
+    raster_bins *Bins;
+    graphics_pipeline *Pipeline;
+    framebuffer *Framebuffer;
+    depth_buffer *DepthBuffer;
+    packed_point *VertexArray;
+    uint32_t VertexCount;
+    uint32_t ChunkSize;
+    uint32_t BandSize; // In pixels.
+    mat4 MVP;
+} raster_job;
+
+static raster_bins *CreateRasterBins(uint32_t MaxVertexCount)
+{
+    raster_bins *Bins = (raster_bins *)VirtualAlloc(NULL, sizeof(raster_bins), MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
+    Bins->Fragments = (fragment *)VirtualAlloc(NULL, 2 * sizeof(fragment) * MaxVertexCount, MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
+    Bins->Binned = Bins->Fragments + MaxVertexCount;
+    Bins->MaxVertexCount = MaxVertexCount;
+    return(Bins);
 }
 
 static bool ClipCondition(v4f P)
@@ -494,161 +534,172 @@ static bool ClipCondition(v4f P)
     return(!(X && Y && Z));
 }
 
-static void ProcessVertices(color_point *VertexArray, uint32_t VertexCount, graphics_pipeline *Pipeline, framebuffer *Framebuffer, depth_buffer *DepthBuffer, mat4 MVP)
+static fragment ShadeVertex(packed_point Vertex, graphics_pipeline *Pipeline, mat4 MVP)
 {
-    for(uint32_t Index = 0; Index < VertexCount; ++Index)
+    fragment Fragment = { RASTER_CLIPPED, 0, 0.0f };
+
+    // Per Vertex Operations (LOCAL SPACE (=> WORLD SPACE => VIEW SPACE) => CLIP SPACE)
+    vertex_out VertexOut = Pipeline->VertexProgram(Vertex, MVP); 
+    
+    // Clipping
+    if(ClipCondition(VertexOut.Position))
     {
-        color_point Vertex = VertexArray[Index];
-        
-        // Per Vertex Operations (LOCAL SPACE (=> WORLD SPACE => VIEW SPACE) => CLIP SPACE)
-        vertex_out VertexOut = Pipeline->VertexProgram(Vertex, MVP); 
-        
-        // Clipping
-        if(ClipCondition(VertexOut.Position))
-        {
-            continue;
-        }
-        
-        // Perspective Division (CLIP SPACE => NORMALIZED DEVICE COORDINATES)
-        v3f NDC;
-        if(VertexOut.Position.w != 0.0f)
-        {
-            NDC.x = VertexOut.Position.x / VertexOut.Position.w;
-            NDC.y = VertexOut.Position.y / VertexOut.Position.w;
-            NDC.z = VertexOut.Position.z / VertexOut.Position.w;
-        }
-        else
-        {
-            NDC.x = VertexOut.Position.x;
-            NDC.y = VertexOut.Position.y;
-            NDC.z = VertexOut.Position.z;
-        }
-        
-        uint32_t Width = Pipeline->ViewportDimensions.w;
-        uint32_t Height = Pipeline->ViewportDimensions.h;
-        
-        // Viewport Transform (NORMALIZED DEVICE COORDINATES => SCREEN COORDINATES)
-        v2u ViewportPosition = 
-        { 
-            (uint32_t)(floor(Width / 2 * NDC.x) + Width / 2),
-            (uint32_t)(floor(Height / 2 * NDC.y) + Height / 2),
-            /* (int)((Far - Near) / 2.0f * NDC.z + (Far + Near) / 2.0f) */
-        };
-        
-        // Per Pixel Operations
-        v3f Color = Pipeline->PixelProgram(VertexOut.Color);
-        
-        uint32_t Alpha = 0xFF;
-        uint32_t Red   = (uint32_t)(0xFF * Color.x);
-        uint32_t Green = (uint32_t)(0xFF * Color.y);
-        uint32_t Blue  = (uint32_t)(0xFF * Color.z);
-        
-        size_t FramebufferIndex = ViewportPosition.y * Width + ViewportPosition.x;
-        
-        // Occlusion Culling
-        float Depth = (NDC.z + 1) / 2; // Convert from range -1..1 to 0..1
-        if(DepthBuffer->Memory[FramebufferIndex] != 0 && Depth >= DepthBuffer->Memory[FramebufferIndex])
-        {
-            continue;
-        }
-        
-        Framebuffer->Memory[FramebufferIndex] = Alpha << 24 | Red << 16 | Green << 8 | Blue << 0;
-        DepthBuffer->Memory[FramebufferIndex] = Depth;
+        return(Fragment);
+    }
+    
+    // Perspective Division (CLIP SPACE => NORMALIZED DEVICE COORDINATES)
+    v3f NDC;
+    if(VertexOut.Position.w != 0.0f)
+    {
+        NDC.x = VertexOut.Position.x / VertexOut.Position.w;
+        NDC.y = VertexOut.Position.y / VertexOut.Position.w;
+        NDC.z = VertexOut.Position.z / VertexOut.Position.w;
+    }
+    else
+    {
+        NDC.x = VertexOut.Position.x;
+        NDC.y = VertexOut.Position.y;
+        NDC.z = VertexOut.Position.z;
     }
-}
-
-vertex_out VertexProgram(color_point In, mat4 MVP)
-{
-    vertex_out Out;
     
-    Out.Position = mat4_mul_v4f(MVP, (v4f){In.xyz[0], In.xyz[1], In.xyz[2], 1.0f});
-    Out.Color = (v3f){In.rgb[0], In.rgb[1], In.rgb[2]};
+    uint32_t Width = Pipeline->ViewportDimensions.w;
+    uint32_t Height = Pipeline->ViewportDimensions.h;
     
-    return(Out);
+    // Viewport Transform (NORMALIZED DEVICE COORDINATES => SCREEN COORDINATES)
+    v2u ViewportPosition = 
+    { 
+        (uint32_t)(floor(Width / 2 * NDC.x) + Width / 2),
+        (uint32_t)(floor(Height / 2 * NDC.y) + Height / 2),
+        /* (int)((Far - Near) / 2.0f * NDC.z + (Far + Near) / 2.0f) */
+    };
+    
+    // Per Pixel Operations
+    uint32_t Color = Pipeline->PixelProgram(VertexOut.Color, Pipeline->Colormap);
+
+    Fragment.Index = ViewportPosition.y * Width + ViewportPosition.x;
+    Fragment.Color = Color;
+    Fragment.Depth = (NDC.z + 1) / 2; // Convert from range -1..1 to 0..1
+    return(Fragment);
 }
 
-v3f HSVToRGB(v3f HSV) 
+static void ShadeChunks(void *Data, int Begin, int End)
 {
-    v3f RGB;
-    
-    int I;
-    float F, P, Q, T;
-    
-    float H = HSV.x;
-    float S = HSV.y;
-    float V = HSV.z;
-    
-    if (S == 0) // No saturation => grayscale; V == lightness/darkness
+    raster_job *Job = (raster_job *)Data;
+    raster_bins *Bins = Job->Bins;
+    for(int Chunk = Begin; Chunk < End; ++Chunk)
     {
-        RGB = (v3f){V, V, V};
+        uint32_t *Counts = Bins->Counts[Chunk];
+        memset(Counts, 0, sizeof(Bins->Counts[Chunk]));
+
+        uint32_t First = Chunk * Job->ChunkSize;
+        uint32_t Last = (First + Job->ChunkSize < Job->VertexCount) ? First + Job->ChunkSize : Job->VertexCount;
+        for(uint32_t Index = First; Index < Last; ++Index)
+        {
+            fragment Fragment = ShadeVertex(Job->VertexArray[Index], Job->Pipeline, Job->MVP);
+            Bins->Fragments[Index] = Fragment;
+            if(Fragment.Index != RASTER_CLIPPED)
+            {
+                ++Counts[Fragment.Index / Job->BandSize];
+            }
+        }
     }
-    else
+}
+
+static void BinChunks(void *Data, int Begin, int End)
+{
+    raster_job *Job = (raster_job *)Data;
+    raster_bins *Bins = Job->Bins;
+    for(int Chunk = Begin; Chunk < End; ++Chunk)
     {
-        H *= 6;
-        I = (int)H;
-        F = H - I;
-        P = V * (1 - S);
-        Q = V * (1 - S * F);
-        T = V * (1 - S * (1 - F));
-        switch (I) {
-            case 0:  RGB = (v3f){V, T, P}; break;
-            case 1:  RGB = (v3f){Q, V, P}; break;
-            case 2:  RGB = (v3f){P, V, T}; break;
-            case 3:  RGB = (v3f){P, Q, V}; break;
-            case 4:  RGB = (v3f){T, P, V}; break;
-            default: RGB = (v3f){V, P, Q}; break;
+        uint32_t *Offsets = Bins->Counts[Chunk];
+
+        uint32_t First = Chunk * Job->ChunkSize;
+        uint32_t Last = (First + Job->ChunkSize < Job->VertexCount) ? First + Job->ChunkSize : Job->VertexCount;
+        for(uint32_t Index = First; Index < Last; ++Index)
+        {
+            fragment Fragment = Bins->Fragments[Index];
+            if(Fragment.Index != RASTER_CLIPPED)
+            {
+                Bins->Binned[Offsets[Fragment.Index / Job->BandSize]++] = Fragment;
+            }
         }
     }
-    
-    return(RGB);
 }
 
-
-v3f PixelProgram(v3f HSV)
+static void RasterizeBands(void *Data, int Begin, int End)
 {
-    v3f RGB;
-    
-    RGB = HSVToRGB(HSV);
-    
-    return(RGB);
+    raster_job *Job = (raster_job *)Data;
+    raster_bins *Bins = Job->Bins;
+    for(uint32_t Index = Bins->BandOffsets[Begin]; Index < Bins->BandOffsets[End]; ++Index)
+    {
+        fragment Fragment = Bins->Binned[Index];
+
+        // Occlusion Culling
+        float *Depth = Job->DepthBuffer->Memory + Fragment.Index;
+        if(*Depth != 0 && Fragment.Depth >= *Depth)
+        {
+            continue;
+        }
+
+        Job->Framebuffer->Memory[Fragment.Index] = Fragment.Color;
+        *Depth = Fragment.Depth;
+    }
 }
 
-void to_proper_layout(uint8_t *depth_map, size_t depth_map_size, size_t single_image_size, int width, int height, uint8_t *scratch_memory)
+static void ProcessVertices(job_system *Jobs, raster_bins *Bins, packed_point *VertexArray, uint32_t VertexCount, graphics_pipeline *Pipeline, framebuffer *Framebuffer, depth_buffer *DepthBuffer, mat4 MVP)
 {
-    memcpy(scratch_memory, depth_map, depth_map_size);
+    assert(VertexCount <= Bins->MaxVertexCount);
 
-    size_t row_size = width * sizeof(int);
-
-    int k = 0;
-    for(int i = 0; i < 4; ++i)
+    uint32_t Height = Pipeline->ViewportDimensions.h;
+    uint32_t BandRows = RASTER_BAND_ROWS;
+    while((Height + BandRows - 1) / BandRows > RASTER_MAX_BANDS)
     {
-        uint8_t *scratch_image = scratch_memory + i * single_image_size;
+        BandRows *= 2;
+    }
+    int BandCount = (int)((Height + BandRows - 1) / BandRows);
 
-        // go through image by 2 rows starting at the end and going to 1
-        for(int j = height - 2; j >= 0; j -= 2)
-        {
-            uint8_t *scratch_row = scratch_image + j * row_size;
-            uint8_t *row = depth_map + k * row_size;
+    uint32_t ChunkSize = (VertexCount + RASTER_MAX_CHUNKS - 1) / RASTER_MAX_CHUNKS;
+    ChunkSize = (ChunkSize < RASTER_MIN_CHUNK_SIZE) ? RASTER_MIN_CHUNK_SIZE : ChunkSize;
+    int ChunkCount = (int)((VertexCount + ChunkSize - 1) / ChunkSize);
 
-            memcpy(row, scratch_row, row_size);
+    raster_job Job = { Bins, Pipeline, Framebuffer, DepthBuffer, VertexArray, VertexCount, ChunkSize, BandRows * Pipeline->ViewportDimensions.w, MVP };
 
-            ++k;
-        }
+    job_parallel_for(Jobs, ChunkCount, 1, ShadeChunks, &Job);
 
-        // go through image by 2 rows starting at beginning going to end
-        for(int j = 1; j < height; j += 2)
+    // Band by band, and within a band chunk by chunk, the fragments keep the order of their vertices.
+    uint32_t Offset = 0;
+    for(int Band = 0; Band < BandCount; ++Band)
+    {
+        Bins->BandOffsets[Band] = Offset;
+        for(int Chunk = 0; Chunk < ChunkCount; ++Chunk)
         {
-            uint8_t *scratch_row = scratch_image + j * row_size;
-            uint8_t *row = depth_map + k * row_size;
-
-            memcpy(row, scratch_row, row_size);
-        
-            ++k;
+            uint32_t Count = Bins->Counts[Chunk][Band];
+            Bins->Counts[Chunk][Band] = Offset;
+            Offset += Count;
         }
     }
+    Bins->BandOffsets[BandCount] = Offset;
+
+    job_parallel_for(Jobs, ChunkCount, 1, BinChunks, &Job);
+    job_parallel_for(Jobs, BandCount, 1, RasterizeBands, &Job);
+}
+
+vertex_out VertexProgram(packed_point In, mat4 MVP)
+{
+    vertex_out Out;
+    
+    Out.Position = mat4_mul_v4f(MVP, (v4f){In.x * 0.001f, In.y * 0.001f, In.z * 0.001f, 1.0f});
+    Out.Color = (v3f){In.hue * (1.0f / 65535.0f), 1.0f, 1.0f};
+    
+    return(Out);
+}
+
+uint32_t PixelProgram(v3f HSV, uint32_t *Colormap)
+{
+    return(Colormap[colormap_index(HSV.x)]);
 }
 
-int main(void)
+int main(int ArgumentCount, char **Arguments)
 {
     WNDCLASS WindowClass = {0};
     
@@ -687,47 +738,20 @@ int main(void)
         {
             HDC WindowDC = GetDC(Window);
 
-            connection Connection =
-            {
-                INVALID_SOCKET,
-                INVALID_SOCKET
-            };
+            // The camera, a recording or a synthetic scene, see depth_source.c for the arguments. For the camera this waits
+            // until it connected and starts the "producer" thread that gets the data from it.
+            depth_source Source_;
+            depth_source *Source = &Source_;
 
-            // This will create a socket, bind it, listen and accept when a connection comes in.
-            int Connected = Connect(&Connection);
-            if(0 == Connected)
+            if(OpenDepthSource(Source, ArgumentCount, Arguments))
             {
-                uint32_t depth_map_width = 320;
-                uint32_t depth_map_height = 240;
-                uint32_t depth_image_size = 307200;
-
-                uint32_t depth_map_size = depth_image_size * 4;
-
-                uint8_t *depth_map = (uint8_t *)malloc(depth_map_size);
-                if(NULL == depth_map)
-                {
-                    fprintf(stderr, "Not enough memory available to run this process.\n");
-                    exit(-1);
-                }
-                
-                // Allocate memory to temporarily operate in when laying out memory properly.
-                uint8_t *scratch_memory = (uint8_t *)malloc(depth_map_size);
-
-                // This all relevant data the thread functions needs. (Kinda like normal function parameters.)
-                get_depth_image_data ThreadDataIn = 
-                {
-                    Connection.Client,
-                    depth_map,
-                    depth_map_size,
-                    depth_image_size
-                };
-
-                // Starts a "producer" thread that gets the data from the ToF-camera and puts it into depth_map.
-                CreateMyThread(&ThreadDataIn);
+                uint32_t depth_map_width = Source->Width;
+                uint32_t depth_map_height = Source->Height;
 
                 framebuffer  *Framebuffer = CreateFramebuffer(1280, 720, 4);
                 depth_buffer *DepthBuffer = CreateDepthBuffer(1280, 720);
                 graphics_pipeline *Pipeline = CreateGraphicsPipeline(1280, 720, VertexProgram, PixelProgram);
+                SetColormap(Pipeline, GlobalColormapKind);
                 
                 dimensions depth_image_dimensions = { depth_map_width, depth_map_height };
                 
@@ -744,8 +768,22 @@ int main(void)
                 
                 int depth_map_count = depth_map_width * depth_map_height;
 
-                color_point *VertexArray = (color_point *)VirtualAlloc(NULL, sizeof(color_point) * depth_map_count, MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
+                // Unlike the rows of the image y points up here.
+                depth_source_intrinsics Intrinsics;
+                GetDepthSourceIntrinsics(Source, &Intrinsics);
+                ray_table Rays = CreateRayTable(&Intrinsics, Source->MinAmplitude, Source->Filter, true);
+
+                packed_point *VertexArray = (packed_point *)VirtualAlloc(NULL, sizeof(packed_point) * depth_map_count, MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
                 int VertexCount = 0;
+
+                // The point cloud and the rendering run on a thread per core. The threads write their points to scratch
+                // first and the bins keep the fragments of a frame until they are drawn, see ProcessVertices().
+                job_system *Jobs = job_system_create(0);
+                packed_point *Scratch = (packed_point *)VirtualAlloc(NULL, sizeof(packed_point) * depth_map_count, MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
+                // The distance of every pixel in the last frame for the temporal filter, updated in place. VirtualAlloc()
+                // zeroes it.
+                float *History = Source->Temporal ? (float *)VirtualAlloc(NULL, sizeof(float) * depth_map_count, MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE) : NULL;
+                raster_bins *Bins = CreateRasterBins((uint32_t)depth_map_count);
                 
                 float DeltaTime = 0.0f;
 
@@ -757,30 +795,34 @@ int main(void)
                     
                     ProcessWindowMessages();
                     HandleInput(Window, Control, DeltaTime);
+
+                    if(Pipeline->ColormapKind != GlobalColormapKind)
+                    {
+                        SetColormap(Pipeline, GlobalColormapKind);
+                        printf("Colormap: %s\n", colormap_name(GlobalColormapKind));
+                    }
                     
                     RECT ClientRect;
                     GetClientRect(Window, &ClientRect);
                     dimensions RenderDimensions = {(uint32_t)ClientRect.right, (uint32_t)ClientRect.bottom};
                     
-                    // Here we are waiting for the producer thread to signal that the Buffer is full. We time out at 5ms which is ~200 Hz.
-                    if(WaitForOtherThread(5))
+                    // Here we pick up the newest frame the producer thread has finished. If there is none yet we wait for one
+                    // but time out at 5ms which is ~200 Hz. The producer keeps receiving into another slot in the meantime.
+                    depth_sample *depth_map = NextDepthFrame(Source, 5);
+                    if(depth_map)
                     {
-                        // to_proper_layout() lays the depth data out in 4 consecutive images. Here we use the extra memory we allocated earlier.
-                        to_proper_layout(depth_map, depth_map_size, depth_image_size, depth_map_width, depth_map_height, scratch_memory);
-                        calculate_point_cloud(VertexArray, &VertexCount, (int *)depth_map, depth_map_width, depth_map_height);
-                        
-                        // Signal that the buffer was read so that the producer thread can start filling in the depth buffer.
-                        SignalOtherThread();
+                        calculate_point_cloud(VertexArray, &VertexCount, Jobs, Scratch, History, &Rays, depth_map);
+                        ReleaseDepthFrame(Source, depth_map);
                     }
 
-                    ClearFramebuffer(Framebuffer, 0.0f, 0.0f, 0.0f, 1.0f);
-                    ClearDepthBuffer(DepthBuffer);
+                    ClearFramebuffer(Jobs, Framebuffer, 0.0f, 0.0f, 0.0f, 1.0f);
+                    ClearDepthBuffer(Jobs, DepthBuffer);
                     
                     mat4 Model = Control->model;
                     mat4 View = look_at(Control->position, v3f_add(Control->position, Control->forward), Control->up);
                     mat4 Proj = perspective(Control->fov, (float)RenderDimensions.w / (float)RenderDimensions.h, 0.1f, 100.0f);
                     mat4 MVP = mat4_mul(Proj, mat4_mul(View, Model));
-                    ProcessVertices(VertexArray, VertexCount, Pipeline, Framebuffer, DepthBuffer, MVP);
+                    ProcessVertices(Jobs, Bins, VertexArray, (uint32_t)VertexCount, Pipeline, Framebuffer, DepthBuffer, MVP);
                     
                     DisplayFramebuffer(Framebuffer, WindowDC, RenderDimensions.w, RenderDimensions.h);
                     
@@ -790,15 +832,13 @@ int main(void)
                     PrintFPS(DeltaTime);
                 }
 
-                free(scratch_memory);
-
-                TerminateMyThread();
-
-                Disconnect(Connection.Host);
+                job_system_destroy(Jobs);
+                FreeRayTable(&Rays);
+                CloseDepthSource(Source);
             }
             else
             {
-                fprintf(stderr, "Could not establish a connection.\n");
+                fprintf(stderr, "Could not open the depth source.\n");
             }
         }
         else
@@ -0,0 +1,341 @@
+// Lossless compression of depth frames in the spirit of RVL (Wilson, "Fast Lossless Depth Image Compression", 2017):
+// every sample is predicted by the one in front of it, the differences are zig-zag coded so small ones of either sign
+// become small numbers and those take only as many bits as they need. Runs without any change, which is what holes in
+// the depth map turn into, take almost no space.
+//
+// RVL gives every difference its own variable length code made of nibbles, so one sample can only be decoded after the
+// one in front of it. Here the samples are coded in blocks of RVL_BLOCK_SIZE that share one width instead, stored as
+// bit planes: plane k holds bit k of the 16 differences of the block. That costs a little ratio on very noisy data but
+// turns encoding and decoding into the same few vector instructions for every block.
+//
+// A block starts with a control byte:
+//   1 .. 16      The width in bits, 2 bytes for each of that many planes follow.
+//   0x80 | n-1   n blocks (up to RVL_MAX_RUN) in which every sample is the same as the one in front of it.
+//
+// The last block is padded by repeating the last sample. The SSE2 and the scalar code produce the same bytes.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RVL_SSE2 1
+#endif
+
+#define RVL_BLOCK_SIZE 16
+#define RVL_RUN_FLAG 0x80
+#define RVL_MAX_RUN 128
+
+// The largest size rvl_encode() can produce for sample_count samples.
+size_t rvl_max_encoded_size(size_t sample_count)
+{
+    size_t block_count = (sample_count + RVL_BLOCK_SIZE - 1) / RVL_BLOCK_SIZE;
+    return(block_count * (1 + 2 * 16));
+}
+
+static int rvl_bit_width(unsigned int bits)
+{
+    int width = 0;
+    while(bits >> width)
+    {
+        ++width;
+    }
+    return(width);
+}
+
+// Writes the planes of a block to output and returns their width, 0 if the block has no change at all.
+static int rvl_encode_block_scalar(const uint16_t *samples, uint16_t previous, uint8_t *output)
+{
+    uint16_t zigzag[RVL_BLOCK_SIZE];
+    unsigned int any = 0;
+
+    for(int i = 0; i < RVL_BLOCK_SIZE; ++i)
+    {
+        int16_t delta = (int16_t)(samples[i] - previous);
+        zigzag[i] = (uint16_t)(((uint16_t)delta << 1) ^ (uint16_t)(delta >> 15));
+        any |= zigzag[i];
+        previous = samples[i];
+    }
+
+    int width = rvl_bit_width(any);
+    for(int k = 0; k < width; ++k)
+    {
+        unsigned int plane = 0;
+        for(int i = 0; i < RVL_BLOCK_SIZE; ++i)
+        {
+            plane |= ((zigzag[i] >> k) & 1u) << i;
+        }
+        output[2 * k + 0] = (uint8_t)plane;
+        output[2 * k + 1] = (uint8_t)(plane >> 8);
+    }
+
+    return(width);
+}
+
+static void rvl_decode_block_scalar(const uint8_t *input, int width, uint16_t previous, uint16_t *samples)
+{
+    uint16_t zigzag[RVL_BLOCK_SIZE] = {0};
+
+    for(int k = 0; k < width; ++k)
+    {
+        unsigned int plane = input[2 * k + 0] | (input[2 * k + 1] << 8);
+        for(int i = 0; i < RVL_BLOCK_SIZE; ++i)
+        {
+            zigzag[i] |= (uint16_t)(((plane >> i) & 1u) << k);
+        }
+    }
+
+    for(int i = 0; i < RVL_BLOCK_SIZE; ++i)
+    {
+        uint16_t delta = (uint16_t)((zigzag[i] >> 1) ^ (0u - (zigzag[i] & 1u)));
+        previous = (uint16_t)(previous + delta);
+        samples[i] = previous;
+    }
+}
+
+#if defined(RVL_SSE2)
+
+// _mm_movemask_epi8() collects the top bit of every byte, so the low and the high bytes of the differences are split
+// into two vectors and shifted up one bit per plane.
+static int rvl_encode_block_sse2(const uint16_t *samples, uint16_t previous, uint8_t *output)
+{
+    __m128i a0 = _mm_loadu_si128((const __m128i *)samples);
+    __m128i a1 = _mm_loadu_si128((const __m128i *)(samples + 8));
+    __m128i p0 = _mm_insert_epi16(_mm_slli_si128(a0, 2), previous, 0);
+    __m128i p1 = _mm_or_si128(_mm_slli_si128(a1, 2), _mm_srli_si128(a0, 14));
+
+    __m128i d0 = _mm_sub_epi16(a0, p0);
+    __m128i d1 = _mm_sub_epi16(a1, p1);
+    __m128i z0 = _mm_xor_si128(_mm_slli_epi16(d0, 1), _mm_srai_epi16(d0, 15));
+    __m128i z1 = _mm_xor_si128(_mm_slli_epi16(d1, 1), _mm_srai_epi16(d1, 15));
+
+    __m128i any = _mm_or_si128(z0, z1);
+    any = _mm_or_si128(any, _mm_srli_si128(any, 8));
+    any = _mm_or_si128(any, _mm_srli_si128(any, 4));
+    any = _mm_or_si128(any, _mm_srli_si128(any, 2));
+    int width = rvl_bit_width((unsigned int)_mm_cvtsi128_si32(any) & 0xFFFF);
+
+    __m128i low_byte = _mm_set1_epi16(0xFF);
+    __m128i low = _mm_packus_epi16(_mm_and_si128(z0, low_byte), _mm_and_si128(z1, low_byte));
+    __m128i high = _mm_packus_epi16(_mm_srli_epi16(z0, 8), _mm_srli_epi16(z1, 8));
+
+    for(int k = 7; k >= 0; --k)
+    {
+        if(k < width)
+        {
+            int plane = _mm_movemask_epi8(low);
+            output[2 * k + 0] = (uint8_t)plane;
+            output[2 * k + 1] = (uint8_t)(plane >> 8);
+        }
+        if(k + 8 < width)
+        {
+            int plane = _mm_movemask_epi8(high);
+            output[2 * (k + 8) + 0] = (uint8_t)plane;
+            output[2 * (k + 8) + 1] = (uint8_t)(plane >> 8);
+        }
+        low = _mm_add_epi8(low, low);
+        high = _mm_add_epi8(high, high);
+    }
+
+    return(width);
+}
+
+// Spreads the 16 bits of a plane over the 16 bytes of a vector, 1 where the bit is set.
+static __m128i rvl_expand_plane(const uint8_t *input)
+{
+    const __m128i select = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+
+    __m128i plane = _mm_cvtsi32_si128(input[0] | (input[1] << 8));
+    plane = _mm_unpacklo_epi8(plane, plane);
+    plane = _mm_unpacklo_epi16(plane, plane);
+    plane = _mm_unpacklo_epi32(plane, plane);
+    plane = _mm_cmpeq_epi8(_mm_and_si128(plane, select), select);
+    return(_mm_and_si128(plane, _mm_set1_epi8(1)));
+}
+
+static void rvl_decode_block_sse2(const uint8_t *input, int width, uint16_t previous, uint16_t *samples)
+{
+    __m128i low = _mm_setzero_si128();
+    __m128i high = _mm_setzero_si128();
+
+    for(int k = width - 1; k >= 8; --k)
+    {
+        high = _mm_or_si128(_mm_add_epi8(high, high), rvl_expand_plane(input + 2 * k));
+    }
+    for(int k = (width < 8 ? width : 8) - 1; k >= 0; --k)
+    {
+        low = _mm_or_si128(_mm_add_epi8(low, low), rvl_expand_plane(input + 2 * k));
+    }
+
+    __m128i z0 = _mm_unpacklo_epi8(low, high);
+    __m128i z1 = _mm_unpackhi_epi8(low, high);
+
+    __m128i one = _mm_set1_epi16(1);
+    __m128i d0 = _mm_xor_si128(_mm_srli_epi16(z0, 1), _mm_sub_epi16(_mm_setzero_si128(), _mm_and_si128(z0, one)));
+    __m128i d1 = _mm_xor_si128(_mm_srli_epi16(z1, 1), _mm_sub_epi16(_mm_setzero_si128(), _mm_and_si128(z1, one)));
+
+    // Prefix sums of the differences.
+    d0 = _mm_add_epi16(d0, _mm_slli_si128(d0, 2));
+    d1 = _mm_add_epi16(d1, _mm_slli_si128(d1, 2));
+    d0 = _mm_add_epi16(d0, _mm_slli_si128(d0, 4));
+    d1 = _mm_add_epi16(d1, _mm_slli_si128(d1, 4));
+    d0 = _mm_add_epi16(d0, _mm_slli_si128(d0, 8));
+    d1 = _mm_add_epi16(d1, _mm_slli_si128(d1, 8));
+
+    __m128i a0 = _mm_add_epi16(d0, _mm_set1_epi16((short)previous));
+    __m128i a1 = _mm_add_epi16(d1, _mm_set1_epi16((short)_mm_extract_epi16(a0, 7)));
+    _mm_storeu_si128((__m128i *)samples, a0);
+    _mm_storeu_si128((__m128i *)(samples + 8), a1);
+}
+
+#endif
+
+static size_t rvl_encode_internal(const uint16_t *samples, size_t sample_count, uint8_t *output, bool vectorized)
+{
+    uint8_t *start = output;
+    uint16_t previous = 0;
+    int run = 0;
+
+    for(size_t i = 0; i < sample_count; i += RVL_BLOCK_SIZE)
+    {
+        const uint16_t *block = samples + i;
+
+        uint16_t padded[RVL_BLOCK_SIZE];
+        if(sample_count - i < RVL_BLOCK_SIZE)
+        {
+            size_t rest = sample_count - i;
+            memcpy(padded, block, rest * sizeof(uint16_t));
+            for(size_t j = rest; j < RVL_BLOCK_SIZE; ++j)
+            {
+                padded[j] = padded[rest - 1];
+            }
+            block = padded;
+        }
+
+#if defined(RVL_SSE2)
+        int width = vectorized ? rvl_encode_block_sse2(block, previous, output + 1) : rvl_encode_block_scalar(block, previous, output + 1);
+#else
+        int width = rvl_encode_block_scalar(block, previous, output + 1);
+#endif
+        previous = block[RVL_BLOCK_SIZE - 1];
+
+        if(width == 0)
+        {
+            if(++run == RVL_MAX_RUN)
+            {
+                *output++ = (uint8_t)(RVL_RUN_FLAG | (run - 1));
+                run = 0;
+            }
+            continue;
+        }
+
+        if(run > 0)
+        {
+            // The planes were written one byte too early, they have to make room for the run.
+            memmove(output + 2, output + 1, 2 * width);
+            *output++ = (uint8_t)(RVL_RUN_FLAG | (run - 1));
+            run = 0;
+        }
+
+        *output = (uint8_t)width;
+        output += 1 + 2 * width;
+    }
+
+    if(run > 0)
+    {
+        *output++ = (uint8_t)(RVL_RUN_FLAG | (run - 1));
+    }
+
+    return((size_t)(output - start));
+}
+
+static bool rvl_decode_internal(const uint8_t *input, size_t input_size, uint16_t *samples, size_t sample_count, bool vectorized)
+{
+    const uint8_t *end = input + input_size;
+    uint16_t previous = 0;
+    size_t i = 0;
+
+    while(i < sample_count)
+    {
+        if(input == end)
+        {
+            return(false);
+        }
+
+        uint8_t control = *input++;
+        if(control & RVL_RUN_FLAG)
+        {
+            size_t count = (size_t)((control & ~RVL_RUN_FLAG) + 1) * RVL_BLOCK_SIZE;
+            if(count > sample_count - i)
+            {
+                count = sample_count - i;
+            }
+            for(size_t j = 0; j < count; ++j)
+            {
+                samples[i + j] = previous;
+            }
+            i += count;
+            continue;
+        }
+
+        int width = control;
+        if(width > 16 || (size_t)(end - input) < (size_t)(2 * width))
+        {
+            return(false);
+        }
+
+        uint16_t padded[RVL_BLOCK_SIZE];
+        uint16_t *block = (sample_count - i < RVL_BLOCK_SIZE) ? padded : samples + i;
+
+#if defined(RVL_SSE2)
+        if(vectorized)
+        {
+            rvl_decode_block_sse2(input, width, previous, block);
+        }
+        else
+        {
+            rvl_decode_block_scalar(input, width, previous, block);
+        }
+#else
+        rvl_decode_block_scalar(input, width, previous, block);
+#endif
+        input += 2 * width;
+        previous = block[RVL_BLOCK_SIZE - 1];
+
+        if(block == padded)
+        {
+            memcpy(samples + i, padded, (sample_count - i) * sizeof(uint16_t));
+            i = sample_count;
+        }
+        else
+        {
+            i += RVL_BLOCK_SIZE;
+        }
+    }
+
+    return(input == end);
+}
+
+// Compresses the samples into output, which needs room for rvl_max_encoded_size() bytes. Returns the bytes written.
+size_t rvl_encode(const uint16_t *samples, size_t sample_count, uint8_t *output)
+{
+    return(rvl_encode_internal(samples, sample_count, output, true));
+}
+
+// Returns false if the input is not exactly sample_count samples.
+bool rvl_decode(const uint8_t *input, size_t input_size, uint16_t *samples, size_t sample_count)
+{
+    return(rvl_decode_internal(input, input_size, samples, sample_count, true));
+}
+
+// The same without vector instructions, only there to compare against.
+size_t rvl_encode_scalar(const uint16_t *samples, size_t sample_count, uint8_t *output)
+{
+    return(rvl_encode_internal(samples, sample_count, output, false));
+}
+
+bool rvl_decode_scalar(const uint8_t *input, size_t input_size, uint16_t *samples, size_t sample_count)
+{
+    return(rvl_decode_internal(input, input_size, samples, sample_count, false));
+}
@@ -0,0 +1,375 @@
+// A fixed pool of worker threads and a parallel for on top of it, for the stages of the CPU visualizers that work on
+// a whole image or point cloud per frame and would otherwise leave all but one core idle.
+//
+// job_parallel_for() splits a range into tiles of grain items and gives every thread, the calling one included, a
+// contiguous run of them in its own deque. A thread takes its tiles from the back of its deque and, once that is empty,
+// steals from the front of the others, so a thread that got cheap tiles helps with the expensive ones of the others.
+// The call returns when every tile is done. Which thread runs a tile is up to chance, so a stage that has to produce
+// the same output every time writes its results per tile and puts them together afterwards.
+//
+// Workers that run out of tiles spin for a while before they sleep, the stages of a frame follow each other closely.
+// Only the thread that created the system may call job_parallel_for(), and not from inside a job.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#if defined(_WIN32)
+
+#include <windows.h>
+
+#define job_atomic_load(pointer) InterlockedCompareExchange((volatile LONG *)(pointer), 0, 0)
+#define job_atomic_store(pointer, value) InterlockedExchange((volatile LONG *)(pointer), (value))
+#define job_atomic_exchange(pointer, value) InterlockedExchange((volatile LONG *)(pointer), (value))
+#define job_atomic_decrement(pointer) InterlockedDecrement((volatile LONG *)(pointer))
+#define job_pause() YieldProcessor()
+#define job_yield() SwitchToThread()
+
+#elif defined(__linux__)
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#define job_atomic_load(pointer) __atomic_load_n((pointer), __ATOMIC_ACQUIRE)
+#define job_atomic_store(pointer, value) __atomic_store_n((pointer), (value), __ATOMIC_RELEASE)
+#define job_atomic_exchange(pointer, value) __atomic_exchange_n((pointer), (value), __ATOMIC_ACQ_REL)
+#define job_atomic_decrement(pointer) __atomic_sub_fetch((pointer), 1, __ATOMIC_ACQ_REL)
+#if defined(__x86_64__) || defined(__i386__)
+#define job_pause() __builtin_ia32_pause()
+#else
+#define job_pause()
+#endif
+#define job_yield() sched_yield()
+
+#endif
+
+#define JOB_MAX_THREADS 64
+#define JOB_DEQUE_CAPACITY 1024 // Also the most tiles a parallel for is split into.
+
+// How often an idle worker looks for tiles before it sleeps, about 0.1 to 0.5 ms. The thread that waits for the last
+// tiles of a parallel for gives up its time slice after as many tries, the workers might not have a core to run on.
+#define JOB_SPIN_COUNT 2000
+
+// Called with the items [begin, end) of the range, which may be more than one tile.
+typedef void job_function(void *data, int begin, int end);
+
+typedef struct
+{
+    job_function *function;
+    void *data;
+    int begin;
+    int end;
+} job;
+
+// Only ever used under its spin lock, jobs[top] to jobs[bottom - 1] are waiting.
+typedef struct
+{
+    volatile long lock;
+    int top;
+    int bottom;
+    job jobs[JOB_DEQUE_CAPACITY];
+} job_deque;
+
+typedef struct job_system job_system;
+
+typedef struct
+{
+    job_system *system;
+    int index;
+} job_worker;
+
+struct job_system
+{
+    int thread_count; // With the thread that calls job_parallel_for(), which has deque 0.
+    job_deque *deques;
+    job_worker workers[JOB_MAX_THREADS];
+
+    volatile long queued; // Tiles in the deques, the idle threads only look into them if there are any.
+    volatile long remaining; // Tiles of the current parallel for that are not done yet.
+
+    // A worker sleeps until the generation changes, every parallel for starts a new one.
+    long generation;
+    int sleeping;
+    bool stopping;
+
+#if defined(_WIN32)
+    HANDLE threads[JOB_MAX_THREADS];
+    CRITICAL_SECTION lock;
+    CONDITION_VARIABLE wake;
+#elif defined(__linux__)
+    pthread_t threads[JOB_MAX_THREADS];
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+#endif
+};
+
+int job_get_processor_count(void)
+{
+#if defined(_WIN32)
+    SYSTEM_INFO system_info;
+    GetSystemInfo(&system_info);
+    int count = (int)system_info.dwNumberOfProcessors;
+#elif defined(__linux__)
+    int count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    if(count < 1) count = 1;
+    if(count > JOB_MAX_THREADS) count = JOB_MAX_THREADS;
+    return(count);
+}
+
+static void job_deque_lock(job_deque *deque)
+{
+    while(job_atomic_exchange(&deque->lock, 1))
+    {
+        while(job_atomic_load(&deque->lock))
+        {
+            job_pause();
+        }
+    }
+}
+
+static void job_deque_unlock(job_deque *deque)
+{
+    job_atomic_store(&deque->lock, 0);
+}
+
+// Takes the last job of the own deque or, if there is none, the first one of another.
+static bool job_take(job_system *system, int index, job *taken)
+{
+    for(int i = 0; i < system->thread_count; ++i)
+    {
+        job_deque *deque = system->deques + (index + i) % system->thread_count;
+
+        job_deque_lock(deque);
+        bool found = (deque->top < deque->bottom);
+        if(found)
+        {
+            *taken = (i == 0) ? deque->jobs[--deque->bottom] : deque->jobs[deque->top++];
+        }
+        job_deque_unlock(deque);
+
+        if(found)
+        {
+            job_atomic_decrement(&system->queued);
+            return(true);
+        }
+    }
+    return(false);
+}
+
+static void job_run(job_system *system, job *taken)
+{
+    taken->function(taken->data, taken->begin, taken->end);
+    job_atomic_decrement(&system->remaining);
+}
+
+static void job_worker_loop(job_worker *worker)
+{
+    job_system *system = worker->system;
+    long generation = 0;
+    int idle = 0;
+
+    for(;;)
+    {
+        job taken;
+        if(job_atomic_load(&system->queued) > 0 && job_take(system, worker->index, &taken))
+        {
+            job_run(system, &taken);
+            idle = 0;
+            continue;
+        }
+
+        if(++idle < JOB_SPIN_COUNT)
+        {
+            job_pause();
+            continue;
+        }
+        idle = 0;
+
+        // The tiles are in the deques before the generation changes, so a worker that saw the generation it slept on
+        // last time and still found nothing can sleep without missing any.
+#if defined(_WIN32)
+        EnterCriticalSection(&system->lock);
+        ++system->sleeping;
+        while(system->generation == generation && !system->stopping)
+        {
+            SleepConditionVariableCS(&system->wake, &system->lock, INFINITE);
+        }
+        --system->sleeping;
+        generation = system->generation;
+        bool stopping = system->stopping;
+        LeaveCriticalSection(&system->lock);
+#elif defined(__linux__)
+        pthread_mutex_lock(&system->lock);
+        ++system->sleeping;
+        while(system->generation == generation && !system->stopping)
+        {
+            pthread_cond_wait(&system->wake, &system->lock);
+        }
+        --system->sleeping;
+        generation = system->generation;
+        bool stopping = system->stopping;
+        pthread_mutex_unlock(&system->lock);
+#endif
+
+        if(stopping)
+        {
+            return;
+        }
+    }
+}
+
+#if defined(_WIN32)
+static DWORD WINAPI job_worker_thread_proc(LPVOID param)
+#elif defined(__linux__)
+static void *job_worker_thread_proc(void *param)
+#endif
+{
+    job_worker_loop((job_worker *)param);
+    return(0);
+}
+
+// Starts thread_count - 1 workers, the calling thread is the last one. With 0 there is a thread per core.
+job_system *job_system_create(int thread_count)
+{
+    if(thread_count <= 0) thread_count = job_get_processor_count();
+    if(thread_count > JOB_MAX_THREADS) thread_count = JOB_MAX_THREADS;
+
+    job_system *system = (job_system *)calloc(1, sizeof(job_system));
+    assert(system);
+    system->thread_count = thread_count;
+    system->deques = (job_deque *)calloc((size_t)thread_count, sizeof(job_deque));
+    assert(system->deques);
+
+#if defined(_WIN32)
+    InitializeCriticalSection(&system->lock);
+    InitializeConditionVariable(&system->wake);
+#elif defined(__linux__)
+    pthread_mutex_init(&system->lock, NULL);
+    pthread_cond_init(&system->wake, NULL);
+#endif
+
+    for(int i = 1; i < thread_count; ++i)
+    {
+        system->workers[i].system = system;
+        system->workers[i].index = i;
+#if defined(_WIN32)
+        system->threads[i] = CreateThread(NULL, 0, job_worker_thread_proc, &system->workers[i], 0, NULL);
+#elif defined(__linux__)
+        pthread_create(&system->threads[i], NULL, job_worker_thread_proc, &system->workers[i]);
+#endif
+    }
+
+    return(system);
+}
+
+void job_system_destroy(job_system *system)
+{
+#if defined(_WIN32)
+    EnterCriticalSection(&system->lock);
+    system->stopping = true;
+    WakeAllConditionVariable(&system->wake);
+    LeaveCriticalSection(&system->lock);
+
+    for(int i = 1; i < system->thread_count; ++i)
+    {
+        WaitForSingleObject(system->threads[i], INFINITE);
+        CloseHandle(system->threads[i]);
+    }
+    DeleteCriticalSection(&system->lock);
+#elif defined(__linux__)
+    pthread_mutex_lock(&system->lock);
+    system->stopping = true;
+    pthread_cond_broadcast(&system->wake);
+    pthread_mutex_unlock(&system->lock);
+
+    for(int i = 1; i < system->thread_count; ++i)
+    {
+        pthread_join(system->threads[i], NULL);
+    }
+    pthread_mutex_destroy(&system->lock);
+    pthread_cond_destroy(&system->wake);
+#endif
+
+    free(system->deques);
+    free(system);
+}
+
+// Calls function for [0, count) in tiles of grain items on all threads and returns when it is done with all of them.
+// With one thread, or only one tile, it is a plain call.
+void job_parallel_for(job_system *system, int count, int grain, job_function *function, void *data)
+{
+    if(count <= 0)
+    {
+        return;
+    }
+
+    if(grain < 1) grain = 1;
+    if((count + grain - 1) / grain > JOB_DEQUE_CAPACITY)
+    {
+        grain = (count + JOB_DEQUE_CAPACITY - 1) / JOB_DEQUE_CAPACITY;
+    }
+    int tile_count = (count + grain - 1) / grain;
+
+    if(system->thread_count == 1 || tile_count == 1)
+    {
+        function(data, 0, count);
+        return;
+    }
+
+    // The deques are all empty, the last parallel for only returned when every tile was done.
+    job_atomic_store(&system->remaining, tile_count);
+    job_atomic_store(&system->queued, tile_count);
+    for(int i = 0; i < system->thread_count; ++i)
+    {
+        int first = tile_count * i / system->thread_count;
+        int last = tile_count * (i + 1) / system->thread_count;
+
+        job_deque *deque = system->deques + i;
+        job_deque_lock(deque);
+        deque->top = 0;
+        deque->bottom = 0;
+        for(int tile = first; tile < last; ++tile)
+        {
+            job *added = deque->jobs + deque->bottom++;
+            added->function = function;
+            added->data = data;
+            added->begin = tile * grain;
+            added->end = (tile + 1) * grain < count ? (tile + 1) * grain : count;
+        }
+        job_deque_unlock(deque);
+    }
+
+#if defined(_WIN32)
+    EnterCriticalSection(&system->lock);
+    ++system->generation;
+    if(system->sleeping) WakeAllConditionVariable(&system->wake);
+    LeaveCriticalSection(&system->lock);
+#elif defined(__linux__)
+    pthread_mutex_lock(&system->lock);
+    ++system->generation;
+    if(system->sleeping) pthread_cond_broadcast(&system->wake);
+    pthread_mutex_unlock(&system->lock);
+#endif
+
+    int idle = 0;
+    while(job_atomic_load(&system->remaining) > 0)
+    {
+        job taken;
+        if(job_atomic_load(&system->queued) > 0 && job_take(system, 0, &taken))
+        {
+            job_run(system, &taken);
+            idle = 0;
+        }
+        else if(++idle < JOB_SPIN_COUNT)
+        {
+            job_pause();
+        }
+        else
+        {
+            job_yield();
+        }
+    }
+}
@@ -1,3 +1,4 @@
+#define _CRT_SECURE_NO_WARNINGS
 #include <stdint.h>
 #include <stddef.h>
 #include <stdbool.h>
@@ -6,11 +7,17 @@
 
 #include <GLFW/glfw3.h>
 
+#include "colormap.c"
 #include "opengl_renderer.c"
 #include "network.c"
+#include "rvl.c"
+#include "recording.c"
+#include "depth_source.c"
+#include "job_system.c"
 
 #include "linalg.h"
 #include "opengl_renderer.h"
+#include "point_cloud.c"
 
 struct scroll_update { 
     double yoffset;
@@ -19,6 +26,13 @@ struct scroll_update {
 // NOTE: this has to be a global since we can only retrieve the scroll offset in the callback
 static struct scroll_update global_scroll_update;
 
+struct colormap_update {
+    colormap_kind kind;
+    int           updated;
+};
+// NOTE: set in the key callback, the renderer is only changed from the main loop
+static struct colormap_update global_colormap_update;
+
 void handle_input(GLFWwindow *window, view_control *control, float delta_time)
 {
     //
@@ -109,73 +123,24 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
     global_scroll_update.updated = 1;
 }
 
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+    // M switches to the next colormap, see colormap.c.
+    if(key == GLFW_KEY_M && action == GLFW_PRESS)
+    {
+        global_colormap_update.kind = (colormap_kind)((global_colormap_update.kind + 1) % COLORMAP_COUNT);
+        global_colormap_update.updated = 1;
+    }
+}
+
 void glfw_error_callback(int error, const char* description)
 {
     fprintf(stderr, "Error: %s\n", description);
 }
 
-void calculate_point_cloud(opengl_frame *frame, int *depth_map, int depth_map_width, int depth_map_height)
+void calculate_point_cloud(opengl_frame *frame, job_system *jobs, packed_point *scratch, float *history, ray_table *rays, depth_sample *depth_map)
 {
-    int insert_index = 0;
-    int depth_map_count = depth_map_width * depth_map_height;
-    for(int i = 0; i < depth_map_count; ++i)
-    {
-        int pixel[2] = { i % depth_map_width, i / depth_map_width };
-        int principal_point[2] = { depth_map_width / 2, depth_map_height / 2 };
-        
-        int d0 = (depth_map[i + depth_map_count * 0] & 0xFFF) - 2048;
-        int d1 = (depth_map[i + depth_map_count * 1] & 0xFFF) - 2048;
-        int d2 = (depth_map[i + depth_map_count * 2] & 0xFFF) - 2048;
-        int d3 = (depth_map[i + depth_map_count * 3] & 0xFFF) - 2048;
-        
-        float diff0 = (float)(d3 - d1);
-        float diff1 = (float)(d2 - d0);
-
-        float c = 300000000.0f;
-        float f = 12000000.0f;
-        float pi = 3.1416f;
-
-        float depth = (c / 2) * (1 / (2 * pi * f)) * (pi + atan2f(diff0, diff1));
-
-        float focal_length = 50.0f * 3.7f; // pixels per mm * focal length [mm]
-
-        float x = (pixel[0] - principal_point[0]) / focal_length;
-        float y = (pixel[1] - principal_point[1]) / focal_length;
-
-        float z = depth / sqrtf(x * x + y * y + 1);
-
-        color_point point;
-        point.xyz[0] = x * z;
-        point.xyz[1] = y * z;
-        point.xyz[2] = -z;
-        
-        float min_z = 0.0f;
-        float max_z = 12.5f;
-        
-        if(z != 0.0f && z >= min_z && z <= max_z)
-        {
-            // interpolate
-
-    #define clamp(x, low, high) (x) < (low) ? (low) : ((x) > (high) ? (high) : (x))
-            
-            float hue = (-point.xyz[2] - min_z) / (max_z - min_z);
-            hue = clamp(hue, 0.0f, 1.0f);
-
-            // the hue of the hsv color goes from red to red so we want to scale with 2/3 which is blue
-            float range = 2.0f / 3.0f;
-            
-            hue *= range;
-            hue = range - hue;
-
-            point.rgb[0] = hue;
-            point.rgb[1] = 1.0f;
-            point.rgb[2] = 1.0f;
-
-            frame->vertex_array[insert_index++] = point;
-        }
-    }
-
-    frame->vertex_count = insert_index;
+    frame->vertex_count = ComputePointCloud(jobs, frame->vertex_array, scratch, rays, depth_map, history);
 }
 
 static void PrintFPS(float DeltaTime)
@@ -210,42 +175,7 @@ static void PrintFPS(float DeltaTime)
     }
 }
 
-void to_proper_layout(uint8_t *depth_map, size_t depth_map_size, size_t single_image_size, int width, int height, uint8_t *scratch_memory)
-{
-    memcpy(scratch_memory, depth_map, depth_map_size);
-
-    size_t row_size = width * sizeof(int);
-
-    int k = 0;
-    for(int i = 0; i < 4; ++i)
-    {
-        uint8_t *scratch_image = scratch_memory + i * single_image_size;
-
-        // go through image by 2 rows starting at the end and going to 1
-        for(int j = height - 2; j >= 0; j -= 2)
-        {
-            uint8_t *scratch_row = scratch_image + j * row_size;
-            uint8_t *row = depth_map + k * row_size;
-
-            memcpy(row, scratch_row, row_size);
-
-            ++k;
-        }
-
-        // go through image by 2 rows starting at beginning going to end
-        for(int j = 1; j < height; j += 2)
-        {
-            uint8_t *scratch_row = scratch_image + j * row_size;
-            uint8_t *row = depth_map + k * row_size;
-
-            memcpy(row, scratch_row, row_size);
-        
-            ++k;
-        }
-    }
-}
-
-int main(void)
+int main(int ArgumentCount, char **Arguments)
 {    
     if(glfwInit())
     {
@@ -264,52 +194,30 @@ int main(void)
             
             glfwSetMouseButtonCallback(window, mouse_button_callback);
             glfwSetScrollCallback(window, scroll_callback);
+            glfwSetKeyCallback(window, key_callback);
             
-            connection Connection =
-            {
-                INVALID_SOCKET,
-                INVALID_SOCKET
-            };
+            // The camera, a recording or a synthetic scene, see depth_source.c for the arguments. For the camera this waits
+            // until it connected and starts the "producer" thread that gets the data from it.
+            depth_source Source_;
+            depth_source *Source = &Source_;
 
-            // This will create a socket, bind it, listen and accept when a connection comes in.
-            int Connected = Connect(&Connection);
-            if(0 == Connected)
+            if(OpenDepthSource(Source, ArgumentCount, Arguments))
             {
-                uint32_t depth_map_width = 320;
-                uint32_t depth_map_height = 240;
-                uint32_t depth_image_size = 307200;
-
-                uint32_t depth_map_size = depth_image_size * 4;
-
-                uint8_t *depth_map = (uint8_t *)malloc(depth_map_size);
-                if(NULL == depth_map)
-                {
-                    fprintf(stderr, "Not enough memory available to run this process.\n");
-                    exit(-1);
-                }
-
-                // Allocate memory to temporarily operate in when laying out memory properly.
-                uint8_t *scratch_memory = (uint8_t *)malloc(depth_map_size);
-                if(NULL == scratch_memory)
-                {
-                    fprintf(stderr, "Not enough memory available to run.\n");
-                    exit(-1);
-                }
-
-                // This all relevant data the thread functions needs. (Kinda like normal function parameters.)
-                get_depth_image_data ThreadDataIn = 
-                {
-                    Connection.Client,
-                    depth_map,
-                    depth_map_size,
-                    depth_image_size
-                };
-
-                // Starts a producer thread that gets the data from the ToF-camera and puts it into depth_map.
-                CreateMyThread(&ThreadDataIn);
+                uint32_t depth_map_width = Source->Width;
+                uint32_t depth_map_height = Source->Height;
                 
                 depth_image_dimension dim = { depth_map_width, depth_map_height };
                 open_gl *opengl = opengl_init(&dim);
+
+                depth_source_intrinsics intrinsics;
+                GetDepthSourceIntrinsics(Source, &intrinsics);
+                ray_table rays = CreateRayTable(&intrinsics, Source->MinAmplitude, Source->Filter, false);
+
+                // The point cloud is computed in tiles of rows on every core, see point_cloud.c.
+                job_system *jobs = job_system_create(0);
+                packed_point *scratch = (packed_point *)malloc(rays.PixelCount * sizeof(packed_point));
+                // The distance of every pixel after the temporal filter in the last frame, all 0 before the first one.
+                float *history = Source->Temporal ? (float *)calloc(rays.PixelCount, sizeof(float)) : NULL;
                 
                 view_control control_ = {
                     .model = mat4_identity(),
@@ -329,21 +237,26 @@ int main(void)
                     double frame_time_start = glfwGetTime();
                     
                     handle_input(window, control, delta_time);
+
+                    if(global_colormap_update.updated)
+                    {
+                        opengl_set_colormap(opengl, global_colormap_update.kind);
+                        printf("Colormap: %s\n", colormap_name(global_colormap_update.kind));
+                        global_colormap_update.updated = 0;
+                    }
                     
                     v2u render_dim;
                     glfwGetFramebufferSize(window, (int *)&render_dim.x, (int *)&render_dim.y);
                     
                     opengl_frame *frame = opengl_begin_frame(opengl, render_dim);
                                        
-                    // Here we are waiting for the producer thread to signal that the Buffer is full. We time out at 5ms which is ~200 Hz.
-                    if(WaitForOtherThread(5))
+                    // Here we pick up the newest frame the producer thread has finished. If there is none yet we wait for one
+                    // but time out at 5ms which is ~200 Hz. The producer keeps receiving into another slot in the meantime.
+                    depth_sample *depth_map = NextDepthFrame(Source, 5);
+                    if(depth_map)
                     {
-                        // to_proper_layout() lays the depth data out in 4 consecutive images. Here we use the extra memory we allocated earlier.
-                        to_proper_layout(depth_map, depth_map_size, depth_image_size, depth_map_width, depth_map_height, scratch_memory);
-                        calculate_point_cloud(frame, (int *)depth_map, depth_map_width, depth_map_height);
-                        
-                        // Signal that the buffer was read so that the producer thread can start filling in the depth buffer.
-                        SignalOtherThread();
+                        calculate_point_cloud(frame, jobs, scratch, history, &rays, depth_map);
+                        ReleaseDepthFrame(Source, depth_map);
                     }
                     
                     opengl_end_frame(opengl, frame, control);
@@ -356,16 +269,15 @@ int main(void)
                     PrintFPS(delta_time);
                 }
 
-                free(scratch_memory);
-                free(depth_map);
-
-                TerminateMyThread();
-
-                Disconnect(Connection.Host);
+                free(history);
+                free(scratch);
+                job_system_destroy(jobs);
+                FreeRayTable(&rays);
+                CloseDepthSource(Source);
             }
             else
             {
-                fprintf(stderr, "Could not establish a connection.\n");
+                fprintf(stderr, "Could not open the depth source.\n");
             }
             
             glfwDestroyWindow(window);
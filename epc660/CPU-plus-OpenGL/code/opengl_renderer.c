@@ -59,7 +59,7 @@ typedef struct
 
 typedef struct
 {
-    color_point *vertex_array;
+    packed_point *vertex_array;
     uint32_t max_vertex_count;
     uint32_t vertex_count;
     
@@ -73,8 +73,9 @@ typedef struct
     GLuint default_program;
     
     GLuint vertex_buffer;
+    GLuint colormap_texture;
     
-    color_point *vertex_array;
+    packed_point *vertex_array;
     uint32_t max_vertex_count;
     
     uint32_t depth_image_width;
@@ -198,16 +199,18 @@ opengl_debug_message_callback(GLenum source, GLenum type, GLuint id, GLenum seve
 static void compile_default_program(open_gl *opengl)
 {
     GLuint vertex_shader = opengl->glCreateShader(GL_VERTEX_SHADER);
+    // The position is in millimeters and the hue normalized to 0..1, see packed_point.
     char *vertex_code = GLSL(layout(location = 0) in vec3 a_position;
-                             layout(location = 1) in vec3 a_color;
+                             layout(location = 1) in float a_hue;
                              
                              layout(location = 0) uniform mat4 mvp;
+                             layout(binding = 0) uniform sampler1D colormap;
                              
                              out vec3 color;
                              
                              void main() {
-                                 color = a_color;
-                                 gl_Position = mvp * vec4(a_position, 1.0);
+                                 color = texture(colormap, a_hue).rgb;
+                                 gl_Position = mvp * vec4(a_position * 0.001, 1.0);
                                  gl_PointSize = 1.0;
                              }
                              );
@@ -220,11 +223,7 @@ static void compile_default_program(open_gl *opengl)
                                layout(location = 0) out vec4 frag_color;
                                
                                void main() {
-                                   // converting from hsv to rgb below
-                                   vec4 k = vec4(1.0, 2.0 / 3.0, 1.0 / 3.0, 3.0);
-                                   vec3 p = abs(fract(color.xxx + k.xyz) * 6.0 - k.www);
-                                   vec3 color_rgb = color.z * mix(k.xxx, clamp(p - k.xxx, 0.0, 1.0), color.y);
-                                   frag_color = vec4(color_rgb.rgb, 1.0);
+                                   frag_color = vec4(color, 1.0);
                                }
                                );
     opengl->glShaderSource(fragment_shader, 1, &fragment_code, NULL);
@@ -258,6 +257,16 @@ static void compile_default_program(open_gl *opengl)
     opengl->default_program = program;
 }
 
+void opengl_set_colormap(open_gl *opengl, colormap_kind kind)
+{
+    uint8_t colormap[COLORMAP_SIZE * 4];
+    colormap_build(kind, colormap);
+
+    opengl->glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_1D, opengl->colormap_texture);
+    glTexSubImage1D(GL_TEXTURE_1D, 0, 0, COLORMAP_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, colormap);
+}
+
 open_gl *opengl_init(depth_image_dimension *dim)
 {
     open_gl *opengl = (open_gl *)malloc(sizeof(open_gl));
@@ -266,7 +275,7 @@ open_gl *opengl_init(depth_image_dimension *dim)
     opengl->depth_image_height = dim->h;
     
     uint32_t max_vertex_count = dim->w * dim->h;
-    opengl->vertex_array = (color_point *)malloc(sizeof(color_point) * max_vertex_count);
+    opengl->vertex_array = (packed_point *)malloc(sizeof(packed_point) * max_vertex_count);
     opengl->max_vertex_count = max_vertex_count;
     
 #define get_opengl_function(name) opengl->name = (type_##name *)glfwGetProcAddress(#name);
@@ -328,6 +337,16 @@ open_gl *opengl_init(depth_image_dimension *dim)
     
     opengl->glGenBuffers(1, &opengl->vertex_buffer);
     opengl->glBindBuffer(GL_ARRAY_BUFFER, opengl->vertex_buffer);
+
+    // The colors of the hues, see colormap.c. Filtering blends neighboring entries like the conversion from HSV did.
+    glGenTextures(1, &opengl->colormap_texture);
+    opengl->glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_1D, opengl->colormap_texture);
+    glTexImage1D(GL_TEXTURE_1D, 0, GL_RGBA8, COLORMAP_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    opengl_set_colormap(opengl, COLORMAP_HUE);
     
     return(opengl);
 }
@@ -355,14 +374,17 @@ void opengl_end_frame(open_gl *opengl, opengl_frame *frame, view_control *contro
     
     //
     // Draw the point cloud.
-    opengl->glNamedBufferData(opengl->vertex_buffer, frame->vertex_count * sizeof(color_point), frame->vertex_array, GL_STATIC_DRAW);
+    opengl->glNamedBufferData(opengl->vertex_buffer, frame->vertex_count * sizeof(packed_point), frame->vertex_array, GL_STATIC_DRAW);
     
-    opengl->glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(color_point), (void *)offsetof(color_point, xyz));
-    opengl->glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(color_point), (void *)offsetof(color_point, rgb));
+    opengl->glVertexAttribPointer(0, 3, GL_SHORT, GL_FALSE, sizeof(packed_point), (void *)offsetof(packed_point, x));
+    opengl->glVertexAttribPointer(1, 1, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(packed_point), (void *)offsetof(packed_point, hue));
     opengl->glEnableVertexAttribArray(0);
     opengl->glEnableVertexAttribArray(1);
     
     opengl->glUseProgram(opengl->default_program);
+
+    opengl->glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_1D, opengl->colormap_texture);
     
     uint32_t render_width = frame->render_dim.x;
     uint32_t render_height = frame->render_dim.y;
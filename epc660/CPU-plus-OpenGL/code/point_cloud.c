@@ -0,0 +1,1212 @@
+// Turns the phase images of a frame into the points of the visualizers that compute the point cloud on the CPU.
+//
+// The phase of a pixel is atan2(D3 - D1, D2 - D0) of its 4 samples, the distance along its ray is that phase as a
+// fraction of the unambiguous range c / (2 * modulation frequency). The rays only depend on the lens, so their
+// directions are computed once into a ray_table (with the distortion of the lens removed, see ComputePixelRays()) and
+// a frame costs a division, a polynomial and a few multiplies per pixel instead of atan2f(), sqrtf() and the divisions
+// by the focal length.
+//
+// atan2 is approximated with the minimax polynomial of Abramowitz & Stegun 4.4.49 on [0, 1] and the octant is
+// restored from the signs and the order of the arguments. Its error is below 1.2e-5 radians in float, which is less
+// than 0.025 mm at the 12 MHz of the epc660 (range / 2pi = 1.99 m per radian). point_cloud_benchmark measures it over
+// every pair of sample differences the camera can deliver.
+//
+// The sample differences also give the amplitude of the modulated light for a multiply and an add. Pixels below the
+// lowest amplitude of the depth_source are dropped before their phase is computed, which saves the atan2 for the
+// background. The vector kernels skip it when none of their pixels has enough signal.
+//
+// Frames of two modulation frequencies have 4 more images. Their pixels take the phase of both frequencies and unwrap
+// them with the lookup of phase_unwrapping (see depth_source.c), which is a rounding, a byte shuffle and a few
+// multiplies per vector on top of the second atan2, with no branch either.
+//
+// There is a kernel for AVX2 (8 pixels at a time), one for SSE4.1 (4 pixels at a time) and a scalar one. The vector
+// kernels leave out the pixels without a valid depth with a lookup table that moves the valid lanes to the front, so
+// there is no branch per pixel. Which one runs is decided at runtime from what the CPU supports. All of them produce
+// exactly the same points.
+//
+// With the temporal filter (DEPTH_TEMPORAL_WEIGHT) the kernels also take a history, a float per pixel that holds its
+// distance along the ray after the filter in the last frame. It is read and written by the same kernel that computes
+// the point, between the phase and the multiplies with the ray, and it is the only state kept from one frame to the
+// next. Dropped pixels write a history of 0.
+//
+// With the spatial filter (DEPTH_FILTER_TOLERANCE) the kernels work a row at a time and keep the distances of 3 rows,
+// the row and those above and below it. A row is decoded once into them and filtered when the row below it is there,
+// so the filtered distances take no pass over the frame of their own and are never written to memory. The vector
+// kernels compare and sum 4 or 8 neighbors at a time in the same order as the scalar one, which keeps the points the
+// same as well.
+//
+// The points are packed_points of 8 bytes: the position in millimeters as 16 bit integers, which covers 32.7 m in
+// every direction, more than the range of the camera, and the hue in 1/65535. A point is a third of what it was with
+// floats, for the upload to the GPU as much as for the caches.
+//
+// ComputePointCloud() splits the frame into tiles of rows that are computed on all threads of a job_system, see
+// ComputePointCloudParallel().
+//
+// packed_point has to be defined and depth_source.c and job_system.c included before this file is included.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define POINT_CLOUD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define POINT_CLOUD_TARGET(Features)
+#else
+#define POINT_CLOUD_TARGET(Features) __attribute__((target(Features)))
+#endif
+#endif
+
+#define POINT_CLOUD_PI 3.14159265f
+
+// atan(T) for T in [0, 1] = T * (A1 + A3 T^2 + A5 T^4 + A7 T^6 + A9 T^8)
+#define ATAN_A1 0.9998660f
+#define ATAN_A3 -0.3302995f
+#define ATAN_A5 0.1801410f
+#define ATAN_A7 -0.0851330f
+#define ATAN_A9 0.0208351f
+
+#define POINT_CLOUD_TURNS_PER_RADIAN (1.0f / (2.0f * POINT_CLOUD_PI))
+
+// The hue of the hsv color goes from red to red so it is scaled with 2/3, which is blue.
+#define POINT_CLOUD_HUE_RANGE (2.0f / 3.0f)
+
+// What a unit of the coordinates and of the hue of a packed_point is. Coordinates are saturated to 16 bits.
+#define POINT_CLOUD_UNITS_PER_METER 1000.0f
+#define POINT_CLOUD_MIN_UNITS -32768.0f
+#define POINT_CLOUD_MAX_UNITS 32767.0f
+#define POINT_CLOUD_HUE_UNITS 65535.0f
+
+// Adding and subtracting 1.5 * 2^23 rounds a float below 2^22 to an integer, to the nearest and ties to even like
+// _mm_cvtps_epi32() does.
+#define POINT_CLOUD_ROUND 12582912.0f
+
+// Rows per tile of ComputePointCloudParallel(), doubled for tall images so there are never more tiles than fit.
+#define POINT_CLOUD_TILE_ROWS 8
+#define POINT_CLOUD_MAX_TILES 256
+
+// The widest image the spatial filter keeps the rows of.
+#define POINT_CLOUD_MAX_WIDTH 1024
+
+typedef enum
+{
+    PointCloudKernel_Scalar,
+    PointCloudKernel_SSE41,
+    PointCloudKernel_AVX2,
+    PointCloudKernel_Count
+}
+point_cloud_kernel;
+
+static const char *PointCloudKernelNames[PointCloudKernel_Count] = { "scalar", "SSE4.1", "AVX2" };
+
+// The direction of the ray through every pixel, normalized so that distance * direction is the point.
+typedef struct
+{
+    float *X;
+    float *Y;
+    float *Z;
+    int Width;
+    int PixelCount; // Of one of the images.
+    float Range; // The unambiguous range in meters, the largest distance a phase can stand for.
+    float InverseRange; // 1 / Range, for the hues.
+    float DepthPerRadian; // Range / 2pi, for frames of one modulation frequency.
+    float MaxDepth; // Points farther away are dropped. Range, but no more than a packed_point can hold.
+    float MinSignal; // (2 * lowest amplitude)^2, what the squared length of the sample differences has to reach.
+    phase_unwrapping Unwrap; // For frames of two modulation frequencies.
+    uint8_t UnwrapOffsets[PHASE_UNWRAP_MAX_OFFSETS]; // Unwrap.Offsets as bytes, for _mm_shuffle_epi8().
+    bool Filter; // The distances are filtered before the points are computed, see DEPTH_FILTER_TOLERANCE.
+}
+ray_table;
+
+// Pixels with less than MinAmplitude are dropped, see depth_source.MinAmplitude. With Filter the distances of the
+// pixels are filtered first, see depth_source.Filter. FlipY makes y point up in the image instead of down.
+ray_table CreateRayTable(const depth_source_intrinsics *Intrinsics, float MinAmplitude, bool Filter, bool FlipY)
+{
+    ray_table Rays = {0};
+    Rays.Width = Intrinsics->Width;
+    Rays.Filter = Filter;
+    assert(!Filter || Rays.Width <= POINT_CLOUD_MAX_WIDTH);
+    Rays.PixelCount = Intrinsics->Width * Intrinsics->Height;
+
+    GetPhaseUnwrapping(Intrinsics, &Rays.Unwrap);
+    Rays.Range = Rays.Unwrap.Range;
+    Rays.InverseRange = 1.0f / Rays.Range;
+    Rays.DepthPerRadian = Rays.Range / (2.0f * POINT_CLOUD_PI);
+    Rays.MaxDepth = Rays.Range;
+    if(Rays.MaxDepth > POINT_CLOUD_MAX_UNITS / POINT_CLOUD_UNITS_PER_METER)
+    {
+        Rays.MaxDepth = POINT_CLOUD_MAX_UNITS / POINT_CLOUD_UNITS_PER_METER;
+    }
+    Rays.MinSignal = 4.0f * MinAmplitude * MinAmplitude;
+    for(int Index = 0; Index < PHASE_UNWRAP_MAX_OFFSETS; ++Index)
+    {
+        Rays.UnwrapOffsets[Index] = (uint8_t)Rays.Unwrap.Offsets[Index];
+    }
+
+    Rays.X = (float *)malloc(3 * (size_t)Rays.PixelCount * sizeof(float));
+    assert(Rays.X);
+    Rays.Y = Rays.X + Rays.PixelCount;
+    Rays.Z = Rays.Y + Rays.PixelCount;
+
+    ComputePixelRays(Intrinsics, Rays.X, Rays.Y, Rays.Z, 1);
+    for(int Index = 0; FlipY && Index < Rays.PixelCount; ++Index)
+    {
+        Rays.Y[Index] = -Rays.Y[Index];
+    }
+
+    return(Rays);
+}
+
+void FreeRayTable(ray_table *Rays)
+{
+    free(Rays->X);
+    memset(Rays, 0, sizeof(ray_table));
+}
+
+// Every kernel does the same float operations in the same order, so the compiler must not fuse a multiply and an add
+// in one of them only. None of the targets below enables FMA for that reason.
+static float FastAtan2(float Y, float X)
+{
+    float AbsoluteX = fabsf(X);
+    float AbsoluteY = fabsf(Y);
+    float Max = AbsoluteX > AbsoluteY ? AbsoluteX : AbsoluteY;
+    float Min = AbsoluteX < AbsoluteY ? AbsoluteX : AbsoluteY;
+    float T = Min / (Max > 1e-30f ? Max : 1e-30f);
+    float T2 = T * T;
+
+    float Angle = ((((ATAN_A9 * T2 + ATAN_A7) * T2 + ATAN_A5) * T2 + ATAN_A3) * T2 + ATAN_A1) * T;
+    Angle = (AbsoluteY > AbsoluteX) ? 0.5f * POINT_CLOUD_PI - Angle : Angle;
+    Angle = (X < 0.0f) ? POINT_CLOUD_PI - Angle : Angle;
+    return(signbit(Y) ? -Angle : Angle);
+}
+
+static int16_t PackCoordinate(float Meters)
+{
+    float Units = Meters * POINT_CLOUD_UNITS_PER_METER;
+    Units = Units > POINT_CLOUD_MIN_UNITS ? Units : POINT_CLOUD_MIN_UNITS;
+    Units = Units < POINT_CLOUD_MAX_UNITS ? Units : POINT_CLOUD_MAX_UNITS;
+    return((int16_t)((Units + POINT_CLOUD_ROUND) - POINT_CLOUD_ROUND));
+}
+
+static uint16_t PackHue(float Hue)
+{
+    return((uint16_t)((Hue * POINT_CLOUD_HUE_UNITS + POINT_CLOUD_ROUND) - POINT_CLOUD_ROUND));
+}
+
+// The sample differences D3 - D1 and D2 - D0 of pixel i of the 4 Images of one modulation frequency, the offset of 2048
+// of the samples cancels out. Returns their squared length, which is 4 times the squared amplitude.
+static float LoadDifferences(const depth_sample *Images, int i, int PixelCount, float *Difference0, float *Difference1)
+{
+    *Difference0 = (float)((int)Images[i + PixelCount * 3] - (int)Images[i + PixelCount * 1]);
+    *Difference1 = (float)((int)Images[i + PixelCount * 2] - (int)Images[i + PixelCount * 0]);
+    return(*Difference0 * *Difference0 + *Difference1 * *Difference1);
+}
+
+// The phase of the sample differences in turns, from 0 to 1.
+static float PhaseTurns(float Difference0, float Difference1)
+{
+    return((FastAtan2(Difference0, Difference1) + POINT_CLOUD_PI) * POINT_CLOUD_TURNS_PER_RADIAN);
+}
+
+// The distance along the ray of a pixel of a frame of two modulation frequencies from the sample differences of both,
+// see phase_unwrapping. *Valid is cleared where the phases of the frequencies disagree.
+static float UnwrapPhases(const ray_table *Rays, const float *Differences, bool *Valid)
+{
+    const phase_unwrapping *Unwrap = &Rays->Unwrap;
+    float M0 = (float)Unwrap->Multiple[0];
+    float M1 = (float)Unwrap->Multiple[1];
+    float Turns0 = PhaseTurns(Differences[0], Differences[1]);
+    float Turns1 = PhaseTurns(Differences[2], Differences[3]);
+
+    float Wraps = Turns0 * M1 - Turns1 * M0;
+    float Rounded = (Wraps + POINT_CLOUD_ROUND) - POINT_CLOUD_ROUND;
+    int Index = (int)Rounded + Unwrap->Multiple[0] - 1;
+    int LastIndex = Unwrap->Multiple[0] + Unwrap->Multiple[1] - 2;
+    Index = Index > 0 ? (Index < LastIndex ? Index : LastIndex) : 0;
+
+    *Valid = *Valid && fabsf(Wraps - Rounded) <= PHASE_UNWRAP_TOLERANCE;
+    return(((Turns0 * M0 + Turns1 * M1) + (float)Rays->UnwrapOffsets[Index]) * Unwrap->DistancePerTurn);
+}
+
+// The distance of a pixel after the temporal filter, which is its new history too. Nothing is special about a pixel
+// without a history or a dropped one: a history of 0 is never close to a distance, and a distance of 0 is close to no
+// history but 0, so both start over from the distance.
+static inline float TemporalFilter(float *History, float Distance)
+{
+    float H = *History;
+    float Difference = Distance - H;
+    bool SameSurface = fabsf(Difference) <= Distance * DEPTH_TEMPORAL_TOLERANCE;
+    // The multiply by a power of two is exact, fused with the add or not.
+    H = SameSurface ? H + Difference * DEPTH_TEMPORAL_WEIGHT : Distance;
+    *History = H;
+    return(H);
+}
+
+// The distance along the ray of pixel i of Frame. *Valid is cleared where there is too little signal for a phase, which
+// is not computed then, and where the phases of two modulation frequencies disagree.
+static inline float DecodeDistance(const ray_table *Rays, const depth_sample *Frame, int i, bool *Valid)
+{
+    int PixelCount = Rays->PixelCount;
+    bool Unwrap = (Rays->Unwrap.FrequencyCount == 2);
+
+    float Differences[4];
+    float Signal = LoadDifferences(Frame, i, PixelCount, &Differences[0], &Differences[1]);
+    *Valid = (Signal >= Rays->MinSignal);
+    if(Unwrap)
+    {
+        Signal = LoadDifferences(Frame + 4 * PixelCount, i, PixelCount, &Differences[2], &Differences[3]);
+        *Valid = *Valid && (Signal >= Rays->MinSignal);
+    }
+
+    // Too little signal for a phase, most of these pixels are background.
+    if(!*Valid)
+    {
+        return(0.0f);
+    }
+
+    if(Unwrap)
+    {
+        return(UnwrapPhases(Rays, Differences, Valid));
+    }
+    return((FastAtan2(Differences[0], Differences[1]) + POINT_CLOUD_PI) * Rays->DepthPerRadian);
+}
+
+// Writes the point of pixel i at Distance along its ray to Point and returns 1 if it is in range, 0 if it is not kept.
+static inline uint32_t ProjectPoint(packed_point *Point, const ray_table *Rays, int i, float Distance)
+{
+    float Z = Distance * Rays->Z[i];
+    float Hue = Z * Rays->InverseRange;
+    Hue = Hue < 0.0f ? 0.0f : (Hue > 1.0f ? 1.0f : Hue);
+    Hue = (1.0f - Hue) * POINT_CLOUD_HUE_RANGE;
+
+    Point->x = PackCoordinate(Distance * Rays->X[i]);
+    Point->y = PackCoordinate(Distance * Rays->Y[i]);
+    Point->z = PackCoordinate(-Z);
+    Point->hue = PackHue(Hue);
+
+    return(Z > 0.0f && Z <= Rays->MaxDepth);
+}
+
+// The kernels compute the pixels [Begin, End) and write their points to Points from the start. History is indexed by
+// the pixel like Frame, or NULL without the temporal filter.
+static uint32_t ComputePointCloudScalar(packed_point *Points, const ray_table *Rays, const depth_sample *Frame, float *History, int Begin, int End, uint32_t PointCount)
+{
+    for(int i = Begin; i < End; ++i)
+    {
+        bool Valid;
+        float Distance = DecodeDistance(Rays, Frame, i, &Valid);
+        if(!Valid)
+        {
+            if(History)
+            {
+                History[i] = 0.0f;
+            }
+            continue;
+        }
+
+        if(History)
+        {
+            Distance = TemporalFilter(History + i, Distance);
+        }
+
+        // Written for every pixel and kept only if it is in range.
+        PointCount += ProjectPoint(Points + PointCount, Rays, i, Distance);
+    }
+
+    return(PointCount);
+}
+
+// The spatial filter of the distances (DEPTH_FILTER_TOLERANCE) works on a row at a time. The distances of the row and
+// of the rows above and below it are decoded into FilterRows, which hold a distance of 0 left and right of the image,
+// and each is decoded once per range of rows. Since the rows are reused for the next row the filtered distances are
+// never written for the whole frame, only the 3 rows have to stay in the cache.
+typedef struct
+{
+    float *Above;
+    float *Center;
+    float *Below;
+}
+filter_rows;
+
+// DecodeDistance() of the row from Frame into Distances + 1, 0 for the pixels that are not valid.
+static void DecodeRowScalar(const ray_table *Rays, const depth_sample *Frame, int Row, int Begin, float *Distances)
+{
+    for(int x = Begin; x < Rays->Width; ++x)
+    {
+        bool Valid;
+        float Distance = DecodeDistance(Rays, Frame, Row * Rays->Width + x, &Valid);
+        Distances[x + 1] = Valid ? Distance : 0.0f;
+    }
+}
+
+// The distance of pixel x of the center row after the spatial filter. The neighbors are summed in the same order in
+// every kernel, so all of them give the same mean.
+static inline float FilterDistance(const filter_rows *Rows, int x)
+{
+    float Distance = Rows->Center[x + 1];
+    float Tolerance = Distance * DEPTH_FILTER_TOLERANCE;
+    const float *Neighbors[3] = { Rows->Above + x, Rows->Center + x, Rows->Below + x };
+
+    float Sum = 0.0f;
+    int Count = 0;
+    for(int Y = 0; Y < 3; ++Y)
+    {
+        for(int X = 0; X < 3; ++X)
+        {
+            float Neighbor = Neighbors[Y][X];
+            bool SameSurface = fabsf(Neighbor - Distance) <= Tolerance;
+            Sum += SameSurface ? Neighbor : 0.0f;
+            Count += SameSurface;
+        }
+    }
+
+    // The pixel itself is one of them, so there is always one.
+    bool Keep = Distance != 0.0f && Count > DEPTH_FILTER_MIN_NEIGHBORS;
+    return(Keep ? Sum / (float)Count : 0.0f);
+}
+
+// Filters the pixels from Begin on of the center row, which is Row, and writes their points to Points + PointCount.
+static uint32_t FilterRowScalar(packed_point *Points, const ray_table *Rays, const filter_rows *Rows, float *History, int Row, int Begin, uint32_t PointCount)
+{
+    for(int x = Begin; x < Rays->Width; ++x)
+    {
+        int i = Row * Rays->Width + x;
+        float Distance = FilterDistance(Rows, x);
+        if(History)
+        {
+            Distance = TemporalFilter(History + i, Distance);
+        }
+
+        // A dropped pixel has a distance of 0 and is not kept either.
+        PointCount += ProjectPoint(Points + PointCount, Rays, i, Distance);
+    }
+
+    return(PointCount);
+}
+
+#if defined(POINT_CLOUD_X86)
+
+// For every mask of valid lanes the lanes that are moved to the front, in order.
+static uint64_t CompactLanesAVX2[256]; // 8 lanes, 1 byte each.
+static uint8_t CompactLanesSSE41[16][16]; // 4 lanes, the 4 bytes of each for _mm_shuffle_epi8().
+
+static void InitCompactTables(void)
+{
+    for(int Mask = 0; Mask < 256; ++Mask)
+    {
+        uint64_t Lanes = 0;
+        int Count = 0;
+        for(int Lane = 0; Lane < 8; ++Lane)
+        {
+            if(Mask & (1 << Lane))
+            {
+                Lanes |= (uint64_t)Lane << (8 * Count++);
+            }
+        }
+        CompactLanesAVX2[Mask] = Lanes;
+    }
+
+    for(int Mask = 0; Mask < 16; ++Mask)
+    {
+        int Count = 0;
+        memset(CompactLanesSSE41[Mask], 0x80, 16);
+        for(int Lane = 0; Lane < 4; ++Lane)
+        {
+            if(Mask & (1 << Lane))
+            {
+                for(int Byte = 0; Byte < 4; ++Byte)
+                {
+                    CompactLanesSSE41[Mask][4 * Count + Byte] = (uint8_t)(4 * Lane + Byte);
+                }
+                ++Count;
+            }
+        }
+    }
+}
+
+POINT_CLOUD_TARGET("sse4.1,popcnt")
+static inline __m128 FastAtan2SSE41(__m128 Y, __m128 X)
+{
+    const __m128 Sign = _mm_set1_ps(-0.0f);
+    __m128 AbsoluteX = _mm_andnot_ps(Sign, X);
+    __m128 AbsoluteY = _mm_andnot_ps(Sign, Y);
+    __m128 Max = _mm_max_ps(AbsoluteX, AbsoluteY);
+    __m128 Min = _mm_min_ps(AbsoluteX, AbsoluteY);
+    __m128 T = _mm_div_ps(Min, _mm_max_ps(Max, _mm_set1_ps(1e-30f)));
+    __m128 T2 = _mm_mul_ps(T, T);
+
+    __m128 Angle = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(ATAN_A9), T2), _mm_set1_ps(ATAN_A7));
+    Angle = _mm_add_ps(_mm_mul_ps(Angle, T2), _mm_set1_ps(ATAN_A5));
+    Angle = _mm_add_ps(_mm_mul_ps(Angle, T2), _mm_set1_ps(ATAN_A3));
+    Angle = _mm_add_ps(_mm_mul_ps(Angle, T2), _mm_set1_ps(ATAN_A1));
+    Angle = _mm_mul_ps(Angle, T);
+
+    Angle = _mm_blendv_ps(Angle, _mm_sub_ps(_mm_set1_ps(0.5f * POINT_CLOUD_PI), Angle), _mm_cmpgt_ps(AbsoluteY, AbsoluteX));
+    Angle = _mm_blendv_ps(Angle, _mm_sub_ps(_mm_set1_ps(POINT_CLOUD_PI), Angle), _mm_cmplt_ps(X, _mm_setzero_ps()));
+    return(_mm_xor_ps(Angle, _mm_and_ps(Y, Sign)));
+}
+
+POINT_CLOUD_TARGET("avx2,popcnt")
+static inline __m256 FastAtan2AVX2(__m256 Y, __m256 X)
+{
+    const __m256 Sign = _mm256_set1_ps(-0.0f);
+    __m256 AbsoluteX = _mm256_andnot_ps(Sign, X);
+    __m256 AbsoluteY = _mm256_andnot_ps(Sign, Y);
+    __m256 Max = _mm256_max_ps(AbsoluteX, AbsoluteY);
+    __m256 Min = _mm256_min_ps(AbsoluteX, AbsoluteY);
+    __m256 T = _mm256_div_ps(Min, _mm256_max_ps(Max, _mm256_set1_ps(1e-30f)));
+    __m256 T2 = _mm256_mul_ps(T, T);
+
+    __m256 Angle = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(ATAN_A9), T2), _mm256_set1_ps(ATAN_A7));
+    Angle = _mm256_add_ps(_mm256_mul_ps(Angle, T2), _mm256_set1_ps(ATAN_A5));
+    Angle = _mm256_add_ps(_mm256_mul_ps(Angle, T2), _mm256_set1_ps(ATAN_A3));
+    Angle = _mm256_add_ps(_mm256_mul_ps(Angle, T2), _mm256_set1_ps(ATAN_A1));
+    Angle = _mm256_mul_ps(Angle, T);
+
+    Angle = _mm256_blendv_ps(Angle, _mm256_sub_ps(_mm256_set1_ps(0.5f * POINT_CLOUD_PI), Angle), _mm256_cmp_ps(AbsoluteY, AbsoluteX, _CMP_GT_OQ));
+    Angle = _mm256_blendv_ps(Angle, _mm256_sub_ps(_mm256_set1_ps(POINT_CLOUD_PI), Angle), _mm256_cmp_ps(X, _mm256_setzero_ps(), _CMP_LT_OQ));
+    return(_mm256_xor_ps(Angle, _mm256_and_ps(Y, Sign)));
+}
+
+// TemporalFilter() of 4 pixels with the history from History on.
+POINT_CLOUD_TARGET("sse4.1,popcnt")
+static inline __m128 TemporalFilterSSE41(float *History, __m128 Distance)
+{
+    __m128 OldH = _mm_loadu_ps(History);
+    __m128 Difference = _mm_sub_ps(Distance, OldH);
+    __m128 Tolerance = _mm_mul_ps(Distance, _mm_set1_ps(DEPTH_TEMPORAL_TOLERANCE));
+    __m128 SameSurface = _mm_cmple_ps(_mm_andnot_ps(_mm_set1_ps(-0.0f), Difference), Tolerance);
+    __m128 Average = _mm_add_ps(OldH, _mm_mul_ps(Difference, _mm_set1_ps(DEPTH_TEMPORAL_WEIGHT)));
+    __m128 H = _mm_blendv_ps(Distance, Average, SameSurface);
+    _mm_storeu_ps(History, H);
+    return(H);
+}
+
+// Packs and writes 4 points, of which the first ones are the valid ones. The ones after them are overwritten by the
+// next call.
+POINT_CLOUD_TARGET("sse4.1,popcnt")
+static inline void StorePoints4(packed_point *Points, __m128 X, __m128 Y, __m128 Z, __m128 Hue)
+{
+    const __m128 Scale = _mm_set1_ps(POINT_CLOUD_UNITS_PER_METER);
+    const __m128 MinUnits = _mm_set1_ps(POINT_CLOUD_MIN_UNITS);
+    const __m128 MaxUnits = _mm_set1_ps(POINT_CLOUD_MAX_UNITS);
+
+    __m128i XUnits = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(X, Scale), MinUnits), MaxUnits));
+    __m128i YUnits = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(Y, Scale), MinUnits), MaxUnits));
+    __m128i ZUnits = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(Z, Scale), MinUnits), MaxUnits));
+    __m128i HueUnits = _mm_cvtps_epi32(_mm_mul_ps(Hue, _mm_set1_ps(POINT_CLOUD_HUE_UNITS)));
+
+    // x0 x1 x2 x3 y0 y1 y2 y3 and z0 z1 z2 z3 h0 h1 h2 h3, interleaved twice to x0 y0 z0 h0 x1 y1 z1 h1 ...
+    __m128i XY = _mm_packs_epi32(XUnits, YUnits);
+    __m128i ZHue = _mm_blend_epi16(_mm_packs_epi32(ZUnits, ZUnits), _mm_packus_epi32(HueUnits, HueUnits), 0xF0);
+    __m128i XZ = _mm_unpacklo_epi16(XY, ZHue);
+    __m128i YHue = _mm_unpackhi_epi16(XY, ZHue);
+    _mm_storeu_si128((__m128i *)(Points + 0), _mm_unpacklo_epi16(XZ, YHue));
+    _mm_storeu_si128((__m128i *)(Points + 2), _mm_unpackhi_epi16(XZ, YHue));
+}
+
+POINT_CLOUD_TARGET("sse4.1,popcnt")
+static inline __m128 LoadDifferenceSSE41(const depth_sample *A, const depth_sample *B)
+{
+    __m128i SamplesA = _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i *)A));
+    __m128i SamplesB = _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i *)B));
+    return(_mm_cvtepi32_ps(_mm_sub_epi32(SamplesA, SamplesB)));
+}
+
+// LoadDifferences() of 4 pixels.
+POINT_CLOUD_TARGET("sse4.1,popcnt")
+static inline __m128 LoadDifferencesSSE41(const depth_sample *Images, int PixelCount, __m128 *Difference0, __m128 *Difference1)
+{
+    *Difference0 = LoadDifferenceSSE41(Images + PixelCount * 3, Images + PixelCount * 1);
+    *Difference1 = LoadDifferenceSSE41(Images + PixelCount * 2, Images + PixelCount * 0);
+    return(_mm_add_ps(_mm_mul_ps(*Difference0, *Difference0), _mm_mul_ps(*Difference1, *Difference1)));
+}
+
+POINT_CLOUD_TARGET("sse4.1,popcnt")
+static inline __m128 PhaseTurnsSSE41(__m128 Difference0, __m128 Difference1)
+{
+    __m128 Angle = _mm_add_ps(FastAtan2SSE41(Difference0, Difference1), _mm_set1_ps(POINT_CLOUD_PI));
+    return(_mm_mul_ps(Angle, _mm_set1_ps(POINT_CLOUD_TURNS_PER_RADIAN)));
+}
+
+// UnwrapPhases() of 4 pixels. The lookup is a byte shuffle of UnwrapOffsets: the lowest byte of every lane is its
+// index, the 3 others are 0x80, which zeroes them.
+POINT_CLOUD_TARGET("sse4.1,popcnt")
+static inline __m128 UnwrapPhasesSSE41(const ray_table *Rays, const __m128 *Differences, __m128 *Valid)
+{
+    const phase_unwrapping *Unwrap = &Rays->Unwrap;
+    __m128 M0 = _mm_set1_ps((float)Unwrap->Multiple[0]);
+    __m128 M1 = _mm_set1_ps((float)Unwrap->Multiple[1]);
+    __m128 Turns0 = PhaseTurnsSSE41(Differences[0], Differences[1]);
+    __m128 Turns1 = PhaseTurnsSSE41(Differences[2], Differences[3]);
+
+    __m128 Wraps = _mm_sub_ps(_mm_mul_ps(Turns0, M1), _mm_mul_ps(Turns1, M0));
+    __m128 Rounded = _mm_round_ps(Wraps, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m128i Index = _mm_add_epi32(_mm_cvtps_epi32(Rounded), _mm_set1_epi32(Unwrap->Multiple[0] - 1));
+    Index = _mm_max_epi32(Index, _mm_setzero_si128());
+    Index = _mm_min_epi32(Index, _mm_set1_epi32(Unwrap->Multiple[0] + Unwrap->Multiple[1] - 2));
+
+    __m128i Offsets = _mm_loadu_si128((const __m128i *)Rays->UnwrapOffsets);
+    __m128i Offset = _mm_shuffle_epi8(Offsets, _mm_or_si128(Index, _mm_set1_epi32((int)0x80808000)));
+
+    __m128 Deviation = _mm_andnot_ps(_mm_set1_ps(-0.0f), _mm_sub_ps(Wraps, Rounded));
+    *Valid = _mm_and_ps(*Valid, _mm_cmple_ps(Deviation, _mm_set1_ps(PHASE_UNWRAP_TOLERANCE)));
+
+    __m128 Turns = _mm_add_ps(_mm_add_ps(_mm_mul_ps(Turns0, M0), _mm_mul_ps(Turns1, M1)), _mm_cvtepi32_ps(Offset));
+    return(_mm_mul_ps(Turns, _mm_set1_ps(Unwrap->DistancePerTurn)));
+}
+
+// DecodeDistance() of the 4 pixels from i on. Returns 0 without computing their phase if none of them has enough
+// signal.
+POINT_CLOUD_TARGET("sse4.1,popcnt")
+static inline __m128 DecodeDistancesSSE41(const ray_table *Rays, const depth_sample *Frame, int i, __m128 *Valid)
+{
+    const __m128 MinSignal = _mm_set1_ps(Rays->MinSignal);
+    int PixelCount = Rays->PixelCount;
+    bool Unwrap = (Rays->Unwrap.FrequencyCount == 2);
+
+    __m128 Differences[4];
+    __m128 Signal = LoadDifferencesSSE41(Frame + i, PixelCount, &Differences[0], &Differences[1]);
+    *Valid = _mm_cmpge_ps(Signal, MinSignal);
+    if(Unwrap)
+    {
+        Signal = LoadDifferencesSSE41(Frame + 4 * PixelCount + i, PixelCount, &Differences[2], &Differences[3]);
+        *Valid = _mm_and_ps(*Valid, _mm_cmpge_ps(Signal, MinSignal));
+    }
+
+    // None of the 4 pixels has enough signal for a phase.
+    if(0 == _mm_movemask_ps(*Valid))
+    {
+        return(_mm_setzero_ps());
+    }
+
+    if(Unwrap)
+    {
+        return(UnwrapPhasesSSE41(Rays, Differences, Valid));
+    }
+    __m128 Angle = _mm_add_ps(FastAtan2SSE41(Differences[0], Differences[1]), _mm_set1_ps(POINT_CLOUD_PI));
+    return(_mm_mul_ps(Angle, _mm_set1_ps(Rays->DepthPerRadian)));
+}
+
+// Writes the points of the 4 pixels from i on at Distance along their rays to Points, the valid ones that are in range
+// first, and returns how many of them there are.
+POINT_CLOUD_TARGET("sse4.1,popcnt")
+static inline uint32_t ProjectPointsSSE41(packed_point *Points, const ray_table *Rays, int i, __m128 Distance, __m128 Valid)
+{
+    const __m128 Zero = _mm_setzero_ps();
+    const __m128 One = _mm_set1_ps(1.0f);
+
+    __m128 X = _mm_mul_ps(Distance, _mm_loadu_ps(Rays->X + i));
+    __m128 Y = _mm_mul_ps(Distance, _mm_loadu_ps(Rays->Y + i));
+    __m128 Z = _mm_mul_ps(Distance, _mm_loadu_ps(Rays->Z + i));
+
+    __m128 Hue = _mm_min_ps(_mm_max_ps(_mm_mul_ps(Z, _mm_set1_ps(Rays->InverseRange)), Zero), One);
+    Hue = _mm_mul_ps(_mm_sub_ps(One, Hue), _mm_set1_ps(POINT_CLOUD_HUE_RANGE));
+
+    Valid = _mm_and_ps(Valid, _mm_and_ps(_mm_cmpgt_ps(Z, Zero), _mm_cmple_ps(Z, _mm_set1_ps(Rays->MaxDepth))));
+    int Mask = _mm_movemask_ps(Valid);
+    __m128i Lanes = _mm_loadu_si128((const __m128i *)CompactLanesSSE41[Mask]);
+    X = _mm_castsi128_ps(_mm_shuffle_epi8(_mm_castps_si128(X), Lanes));
+    Y = _mm_castsi128_ps(_mm_shuffle_epi8(_mm_castps_si128(Y), Lanes));
+    Z = _mm_castsi128_ps(_mm_shuffle_epi8(_mm_castps_si128(_mm_xor_ps(Z, _mm_set1_ps(-0.0f))), Lanes));
+    Hue = _mm_castsi128_ps(_mm_shuffle_epi8(_mm_castps_si128(Hue), Lanes));
+
+    // There are never more points than pixels before them, so all 4 fit.
+    StorePoints4(Points, X, Y, Z, Hue);
+    return(_mm_popcnt_u32((unsigned int)Mask));
+}
+
+POINT_CLOUD_TARGET("sse4.1,popcnt")
+static uint32_t ComputePointCloudSSE41(packed_point *Points, const ray_table *Table, const depth_sample *Frame, float *History, int Begin, int End)
+{
+    // The stores of the points and distances could alias the fields of the ray table, a copy of it they cannot alias.
+    // That keeps its fields in registers for the whole loop.
+    ray_table Copy = *Table;
+    const ray_table *Rays = &Copy;
+
+    uint32_t PointCount = 0;
+    int i = Begin;
+    for(; i + 4 <= End; i += 4)
+    {
+        __m128 Valid;
+        __m128 Distance = DecodeDistancesSSE41(Rays, Frame, i, &Valid);
+        if(0 == _mm_movemask_ps(Valid))
+        {
+            if(History)
+            {
+                _mm_storeu_ps(History + i, _mm_setzero_ps());
+            }
+            continue;
+        }
+
+        if(History)
+        {
+            Distance = TemporalFilterSSE41(History + i, _mm_and_ps(Distance, Valid));
+        }
+        PointCount += ProjectPointsSSE41(Points + PointCount, Rays, i, Distance, Valid);
+    }
+
+    return(ComputePointCloudScalar(Points, Rays, Frame, History, i, End, PointCount));
+}
+
+// DecodeRowScalar() of 4 pixels at a time.
+POINT_CLOUD_TARGET("sse4.1,popcnt")
+static void DecodeRowSSE41(const ray_table *Table, const depth_sample *Frame, int Row, float *Distances)
+{
+    // See ComputePointCloudSSE41().
+    ray_table Copy = *Table;
+    const ray_table *Rays = &Copy;
+
+    int x = 0;
+    for(; x + 4 <= Rays->Width; x += 4)
+    {
+        __m128 Valid;
+        __m128 Distance = DecodeDistancesSSE41(Rays, Frame, Row * Rays->Width + x, &Valid);
+        _mm_storeu_ps(Distances + x + 1, _mm_and_ps(Distance, Valid));
+    }
+    DecodeRowScalar(Rays, Frame, Row, x, Distances);
+}
+
+// FilterDistance() of the 4 pixels from x on. *Keep is set for those that are not dropped.
+POINT_CLOUD_TARGET("sse4.1,popcnt")
+static inline __m128 FilterDistancesSSE41(const filter_rows *Rows, int x, __m128 *Keep)
+{
+    const __m128 Sign = _mm_set1_ps(-0.0f);
+    const __m128 One = _mm_set1_ps(1.0f);
+    __m128 Distance = _mm_loadu_ps(Rows->Center + x + 1);
+    __m128 Tolerance = _mm_mul_ps(Distance, _mm_set1_ps(DEPTH_FILTER_TOLERANCE));
+    const float *Neighbors[3] = { Rows->Above + x, Rows->Center + x, Rows->Below + x };
+
+    __m128 Sum = _mm_setzero_ps();
+    __m128 Count = _mm_setzero_ps();
+    for(int Y = 0; Y < 3; ++Y)
+    {
+        for(int X = 0; X < 3; ++X)
+        {
+            __m128 Neighbor = _mm_loadu_ps(Neighbors[Y] + X);
+            __m128 SameSurface = _mm_cmple_ps(_mm_andnot_ps(Sign, _mm_sub_ps(Neighbor, Distance)), Tolerance);
+            Sum = _mm_add_ps(Sum, _mm_and_ps(Neighbor, SameSurface));
+            Count = _mm_add_ps(Count, _mm_and_ps(One, SameSurface));
+        }
+    }
+
+    __m128 HasDistance = _mm_cmpneq_ps(Distance, _mm_setzero_ps());
+    *Keep = _mm_and_ps(HasDistance, _mm_cmpgt_ps(Count, _mm_set1_ps((float)DEPTH_FILTER_MIN_NEIGHBORS)));
+    return(_mm_and_ps(_mm_div_ps(Sum, Count), *Keep));
+}
+
+// FilterRowScalar() of 4 pixels at a time.
+POINT_CLOUD_TARGET("sse4.1,popcnt")
+static uint32_t FilterRowSSE41(packed_point *Points, const ray_table *Table, const filter_rows *Rows, float *History, int Row, uint32_t PointCount)
+{
+    // See ComputePointCloudSSE41().
+    ray_table Copy = *Table;
+    const ray_table *Rays = &Copy;
+
+    int x = 0;
+    for(; x + 4 <= Rays->Width; x += 4)
+    {
+        int i = Row * Rays->Width + x;
+        __m128 Keep;
+        __m128 Distance = FilterDistancesSSE41(Rows, x, &Keep);
+        if(History)
+        {
+            Distance = TemporalFilterSSE41(History + i, Distance);
+        }
+        PointCount += ProjectPointsSSE41(Points + PointCount, Rays, i, Distance, Keep);
+    }
+
+    return(FilterRowScalar(Points, Rays, Rows, History, Row, x, PointCount));
+}
+
+POINT_CLOUD_TARGET("avx2,popcnt")
+static inline __m256 LoadDifferenceAVX2(const depth_sample *A, const depth_sample *B)
+{
+    __m256i SamplesA = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)A));
+    __m256i SamplesB = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)B));
+    return(_mm256_cvtepi32_ps(_mm256_sub_epi32(SamplesA, SamplesB)));
+}
+
+// LoadDifferences() of 8 pixels.
+POINT_CLOUD_TARGET("avx2,popcnt")
+static inline __m256 LoadDifferencesAVX2(const depth_sample *Images, int PixelCount, __m256 *Difference0, __m256 *Difference1)
+{
+    *Difference0 = LoadDifferenceAVX2(Images + PixelCount * 3, Images + PixelCount * 1);
+    *Difference1 = LoadDifferenceAVX2(Images + PixelCount * 2, Images + PixelCount * 0);
+    return(_mm256_add_ps(_mm256_mul_ps(*Difference0, *Difference0), _mm256_mul_ps(*Difference1, *Difference1)));
+}
+
+POINT_CLOUD_TARGET("avx2,popcnt")
+static inline __m256 PhaseTurnsAVX2(__m256 Difference0, __m256 Difference1)
+{
+    __m256 Angle = _mm256_add_ps(FastAtan2AVX2(Difference0, Difference1), _mm256_set1_ps(POINT_CLOUD_PI));
+    return(_mm256_mul_ps(Angle, _mm256_set1_ps(POINT_CLOUD_TURNS_PER_RADIAN)));
+}
+
+// Like UnwrapPhasesSSE41() for 8 pixels. The byte shuffle stays within the 128 bit halves, both get the table.
+POINT_CLOUD_TARGET("avx2,popcnt")
+static inline __m256 UnwrapPhasesAVX2(const ray_table *Rays, const __m256 *Differences, __m256 *Valid)
+{
+    const phase_unwrapping *Unwrap = &Rays->Unwrap;
+    __m256 M0 = _mm256_set1_ps((float)Unwrap->Multiple[0]);
+    __m256 M1 = _mm256_set1_ps((float)Unwrap->Multiple[1]);
+    __m256 Turns0 = PhaseTurnsAVX2(Differences[0], Differences[1]);
+    __m256 Turns1 = PhaseTurnsAVX2(Differences[2], Differences[3]);
+
+    __m256 Wraps = _mm256_sub_ps(_mm256_mul_ps(Turns0, M1), _mm256_mul_ps(Turns1, M0));
+    __m256 Rounded = _mm256_round_ps(Wraps, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256i Index = _mm256_add_epi32(_mm256_cvtps_epi32(Rounded), _mm256_set1_epi32(Unwrap->Multiple[0] - 1));
+    Index = _mm256_max_epi32(Index, _mm256_setzero_si256());
+    Index = _mm256_min_epi32(Index, _mm256_set1_epi32(Unwrap->Multiple[0] + Unwrap->Multiple[1] - 2));
+
+    __m256i Offsets = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)Rays->UnwrapOffsets));
+    __m256i Offset = _mm256_shuffle_epi8(Offsets, _mm256_or_si256(Index, _mm256_set1_epi32((int)0x80808000)));
+
+    __m256 Deviation = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), _mm256_sub_ps(Wraps, Rounded));
+    *Valid = _mm256_and_ps(*Valid, _mm256_cmp_ps(Deviation, _mm256_set1_ps(PHASE_UNWRAP_TOLERANCE), _CMP_LE_OQ));
+
+    __m256 Turns = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(Turns0, M0), _mm256_mul_ps(Turns1, M1)), _mm256_cvtepi32_ps(Offset));
+    return(_mm256_mul_ps(Turns, _mm256_set1_ps(Unwrap->DistancePerTurn)));
+}
+
+// Like TemporalFilterSSE41() for 8 pixels.
+POINT_CLOUD_TARGET("avx2,popcnt")
+static inline __m256 TemporalFilterAVX2(float *History, __m256 Distance)
+{
+    __m256 OldH = _mm256_loadu_ps(History);
+    __m256 Difference = _mm256_sub_ps(Distance, OldH);
+    __m256 Tolerance = _mm256_mul_ps(Distance, _mm256_set1_ps(DEPTH_TEMPORAL_TOLERANCE));
+    __m256 SameSurface = _mm256_cmp_ps(_mm256_andnot_ps(_mm256_set1_ps(-0.0f), Difference), Tolerance, _CMP_LE_OQ);
+    __m256 Average = _mm256_add_ps(OldH, _mm256_mul_ps(Difference, _mm256_set1_ps(DEPTH_TEMPORAL_WEIGHT)));
+    __m256 H = _mm256_blendv_ps(Distance, Average, SameSurface);
+    _mm256_storeu_ps(History, H);
+    return(H);
+}
+
+// Like StorePoints4() for 8 points.
+POINT_CLOUD_TARGET("avx2,popcnt")
+static inline void StorePoints8(packed_point *Points, __m256 X, __m256 Y, __m256 Z, __m256 Hue)
+{
+    const __m256 Scale = _mm256_set1_ps(POINT_CLOUD_UNITS_PER_METER);
+    const __m256 MinUnits = _mm256_set1_ps(POINT_CLOUD_MIN_UNITS);
+    const __m256 MaxUnits = _mm256_set1_ps(POINT_CLOUD_MAX_UNITS);
+
+    __m256i XUnits = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(X, Scale), MinUnits), MaxUnits));
+    __m256i YUnits = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(Y, Scale), MinUnits), MaxUnits));
+    __m256i ZUnits = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(Z, Scale), MinUnits), MaxUnits));
+    __m256i HueUnits = _mm256_cvtps_epi32(_mm256_mul_ps(Hue, _mm256_set1_ps(POINT_CLOUD_HUE_UNITS)));
+
+    // The same as in StorePoints4() in both 128 bit halves, which hold points 0 to 3 and 4 to 7.
+    __m256i XY = _mm256_packs_epi32(XUnits, YUnits);
+    __m256i ZHue = _mm256_blend_epi16(_mm256_packs_epi32(ZUnits, ZUnits), _mm256_packus_epi32(HueUnits, HueUnits), 0xF0);
+    __m256i XZ = _mm256_unpacklo_epi16(XY, ZHue);
+    __m256i YHue = _mm256_unpackhi_epi16(XY, ZHue);
+    __m256i Points0145 = _mm256_unpacklo_epi16(XZ, YHue);
+    __m256i Points2367 = _mm256_unpackhi_epi16(XZ, YHue);
+    _mm256_storeu_si256((__m256i *)(Points + 0), _mm256_permute2x128_si256(Points0145, Points2367, 0x20));
+    _mm256_storeu_si256((__m256i *)(Points + 4), _mm256_permute2x128_si256(Points0145, Points2367, 0x31));
+}
+
+// Like DecodeDistancesSSE41() for 8 pixels.
+POINT_CLOUD_TARGET("avx2,popcnt")
+static inline __m256 DecodeDistancesAVX2(const ray_table *Rays, const depth_sample *Frame, int i, __m256 *Valid)
+{
+    const __m256 MinSignal = _mm256_set1_ps(Rays->MinSignal);
+    int PixelCount = Rays->PixelCount;
+    bool Unwrap = (Rays->Unwrap.FrequencyCount == 2);
+
+    __m256 Differences[4];
+    __m256 Signal = LoadDifferencesAVX2(Frame + i, PixelCount, &Differences[0], &Differences[1]);
+    *Valid = _mm256_cmp_ps(Signal, MinSignal, _CMP_GE_OQ);
+    if(Unwrap)
+    {
+        Signal = LoadDifferencesAVX2(Frame + 4 * PixelCount + i, PixelCount, &Differences[2], &Differences[3]);
+        *Valid = _mm256_and_ps(*Valid, _mm256_cmp_ps(Signal, MinSignal, _CMP_GE_OQ));
+    }
+
+    // None of the 8 pixels has enough signal for a phase.
+    if(0 == _mm256_movemask_ps(*Valid))
+    {
+        return(_mm256_setzero_ps());
+    }
+
+    if(Unwrap)
+    {
+        return(UnwrapPhasesAVX2(Rays, Differences, Valid));
+    }
+    __m256 Angle = _mm256_add_ps(FastAtan2AVX2(Differences[0], Differences[1]), _mm256_set1_ps(POINT_CLOUD_PI));
+    return(_mm256_mul_ps(Angle, _mm256_set1_ps(Rays->DepthPerRadian)));
+}
+
+// Like ProjectPointsSSE41() for 8 pixels.
+POINT_CLOUD_TARGET("avx2,popcnt")
+static inline uint32_t ProjectPointsAVX2(packed_point *Points, const ray_table *Rays, int i, __m256 Distance, __m256 Valid)
+{
+    const __m256 Zero = _mm256_setzero_ps();
+    const __m256 One = _mm256_set1_ps(1.0f);
+
+    __m256 X = _mm256_mul_ps(Distance, _mm256_loadu_ps(Rays->X + i));
+    __m256 Y = _mm256_mul_ps(Distance, _mm256_loadu_ps(Rays->Y + i));
+    __m256 Z = _mm256_mul_ps(Distance, _mm256_loadu_ps(Rays->Z + i));
+
+    __m256 Hue = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(Z, _mm256_set1_ps(Rays->InverseRange)), Zero), One);
+    Hue = _mm256_mul_ps(_mm256_sub_ps(One, Hue), _mm256_set1_ps(POINT_CLOUD_HUE_RANGE));
+
+    Valid = _mm256_and_ps(Valid, _mm256_and_ps(_mm256_cmp_ps(Z, Zero, _CMP_GT_OQ), _mm256_cmp_ps(Z, _mm256_set1_ps(Rays->MaxDepth), _CMP_LE_OQ)));
+    int Mask = _mm256_movemask_ps(Valid);
+    __m256i Lanes = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(CompactLanesAVX2 + Mask)));
+    X = _mm256_permutevar8x32_ps(X, Lanes);
+    Y = _mm256_permutevar8x32_ps(Y, Lanes);
+    Z = _mm256_permutevar8x32_ps(_mm256_xor_ps(Z, _mm256_set1_ps(-0.0f)), Lanes);
+    Hue = _mm256_permutevar8x32_ps(Hue, Lanes);
+
+    // There are never more points than pixels before them, so all 8 fit.
+    StorePoints8(Points, X, Y, Z, Hue);
+    return(_mm_popcnt_u32((unsigned int)Mask));
+}
+
+POINT_CLOUD_TARGET("avx2,popcnt")
+static uint32_t ComputePointCloudAVX2(packed_point *Points, const ray_table *Table, const depth_sample *Frame, float *History, int Begin, int End)
+{
+    // See ComputePointCloudSSE41().
+    ray_table Copy = *Table;
+    const ray_table *Rays = &Copy;
+
+    uint32_t PointCount = 0;
+    int i = Begin;
+    for(; i + 8 <= End; i += 8)
+    {
+        __m256 Valid;
+        __m256 Distance = DecodeDistancesAVX2(Rays, Frame, i, &Valid);
+        if(0 == _mm256_movemask_ps(Valid))
+        {
+            if(History)
+            {
+                _mm256_storeu_ps(History + i, _mm256_setzero_ps());
+            }
+            continue;
+        }
+
+        if(History)
+        {
+            Distance = TemporalFilterAVX2(History + i, _mm256_and_ps(Distance, Valid));
+        }
+        PointCount += ProjectPointsAVX2(Points + PointCount, Rays, i, Distance, Valid);
+    }
+
+    return(ComputePointCloudScalar(Points, Rays, Frame, History, i, End, PointCount));
+}
+
+// DecodeRowScalar() of 8 pixels at a time.
+POINT_CLOUD_TARGET("avx2,popcnt")
+static void DecodeRowAVX2(const ray_table *Table, const depth_sample *Frame, int Row, float *Distances)
+{
+    // See ComputePointCloudSSE41().
+    ray_table Copy = *Table;
+    const ray_table *Rays = &Copy;
+
+    int x = 0;
+    for(; x + 8 <= Rays->Width; x += 8)
+    {
+        __m256 Valid;
+        __m256 Distance = DecodeDistancesAVX2(Rays, Frame, Row * Rays->Width + x, &Valid);
+        _mm256_storeu_ps(Distances + x + 1, _mm256_and_ps(Distance, Valid));
+    }
+    DecodeRowScalar(Rays, Frame, Row, x, Distances);
+}
+
+// Like FilterDistancesSSE41() for 8 pixels.
+POINT_CLOUD_TARGET("avx2,popcnt")
+static inline __m256 FilterDistancesAVX2(const filter_rows *Rows, int x, __m256 *Keep)
+{
+    const __m256 Sign = _mm256_set1_ps(-0.0f);
+    const __m256 One = _mm256_set1_ps(1.0f);
+    __m256 Distance = _mm256_loadu_ps(Rows->Center + x + 1);
+    __m256 Tolerance = _mm256_mul_ps(Distance, _mm256_set1_ps(DEPTH_FILTER_TOLERANCE));
+    const float *Neighbors[3] = { Rows->Above + x, Rows->Center + x, Rows->Below + x };
+
+    __m256 Sum = _mm256_setzero_ps();
+    __m256 Count = _mm256_setzero_ps();
+    for(int Y = 0; Y < 3; ++Y)
+    {
+        for(int X = 0; X < 3; ++X)
+        {
+            __m256 Neighbor = _mm256_loadu_ps(Neighbors[Y] + X);
+            __m256 SameSurface = _mm256_cmp_ps(_mm256_andnot_ps(Sign, _mm256_sub_ps(Neighbor, Distance)), Tolerance, _CMP_LE_OQ);
+            Sum = _mm256_add_ps(Sum, _mm256_and_ps(Neighbor, SameSurface));
+            Count = _mm256_add_ps(Count, _mm256_and_ps(One, SameSurface));
+        }
+    }
+
+    __m256 HasDistance = _mm256_cmp_ps(Distance, _mm256_setzero_ps(), _CMP_NEQ_OQ);
+    *Keep = _mm256_and_ps(HasDistance, _mm256_cmp_ps(Count, _mm256_set1_ps((float)DEPTH_FILTER_MIN_NEIGHBORS), _CMP_GT_OQ));
+    return(_mm256_and_ps(_mm256_div_ps(Sum, Count), *Keep));
+}
+
+// FilterRowScalar() of 8 pixels at a time.
+POINT_CLOUD_TARGET("avx2,popcnt")
+static uint32_t FilterRowAVX2(packed_point *Points, const ray_table *Table, const filter_rows *Rows, float *History, int Row, uint32_t PointCount)
+{
+    // See ComputePointCloudSSE41().
+    ray_table Copy = *Table;
+    const ray_table *Rays = &Copy;
+
+    int x = 0;
+    for(; x + 8 <= Rays->Width; x += 8)
+    {
+        int i = Row * Rays->Width + x;
+        __m256 Keep;
+        __m256 Distance = FilterDistancesAVX2(Rows, x, &Keep);
+        if(History)
+        {
+            Distance = TemporalFilterAVX2(History + i, Distance);
+        }
+        PointCount += ProjectPointsAVX2(Points + PointCount, Rays, i, Distance, Keep);
+    }
+
+    return(FilterRowScalar(Points, Rays, Rows, History, Row, x, PointCount));
+}
+
+static bool HasSSE41(void)
+{
+#if defined(_MSC_VER)
+    int Info[4];
+    __cpuid(Info, 1);
+    return((Info[2] & (1 << 19)) && (Info[2] & (1 << 23))); // SSE4.1 and POPCNT
+#else
+    return(__builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("popcnt"));
+#endif
+}
+
+static bool HasAVX2(void)
+{
+#if defined(_MSC_VER)
+    int Info[4];
+    __cpuid(Info, 1);
+    bool OSSavesYMM = (Info[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6; // OSXSAVE, then XMM and YMM state enabled
+    __cpuid(Info, 0);
+    if(!OSSavesYMM || Info[0] < 7)
+    {
+        return(false);
+    }
+    __cpuidex(Info, 7, 0);
+    return((Info[1] & (1 << 5)) != 0);
+#else
+    return(__builtin_cpu_supports("avx2"));
+#endif
+}
+
+#endif
+
+// The best kernel the CPU can run.
+point_cloud_kernel GetBestPointCloudKernel(void)
+{
+#if defined(POINT_CLOUD_X86)
+    if(HasAVX2() && HasSSE41())
+    {
+        return(PointCloudKernel_AVX2);
+    }
+    if(HasSSE41())
+    {
+        return(PointCloudKernel_SSE41);
+    }
+#endif
+    return(PointCloudKernel_Scalar);
+}
+
+// Has to be called before any kernel runs, on one thread.
+static void PreparePointCloudKernels(void)
+{
+#if defined(POINT_CLOUD_X86)
+    static bool TablesInitialized = false;
+    if(!TablesInitialized)
+    {
+        InitCompactTables();
+        TablesInitialized = true;
+    }
+#endif
+}
+
+// DecodeRowScalar() of the whole row with Kernel. Rows outside of the image have no distances.
+static void DecodeRow(point_cloud_kernel Kernel, const ray_table *Rays, const depth_sample *Frame, int Row, float *Distances)
+{
+    int Height = Rays->PixelCount / Rays->Width;
+    if(Row < 0 || Row >= Height)
+    {
+        memset(Distances + 1, 0, Rays->Width * sizeof(float));
+        return;
+    }
+
+#if defined(POINT_CLOUD_X86)
+    switch(Kernel)
+    {
+        case PointCloudKernel_AVX2: DecodeRowAVX2(Rays, Frame, Row, Distances); return;
+        case PointCloudKernel_SSE41: DecodeRowSSE41(Rays, Frame, Row, Distances); return;
+        default: break;
+    }
+#endif
+    DecodeRowScalar(Rays, Frame, Row, 0, Distances);
+}
+
+// FilterRowScalar() of the whole row with Kernel.
+static uint32_t FilterRow(point_cloud_kernel Kernel, packed_point *Points, const ray_table *Rays, const filter_rows *Rows, float *History, int Row, uint32_t PointCount)
+{
+#if defined(POINT_CLOUD_X86)
+    switch(Kernel)
+    {
+        case PointCloudKernel_AVX2: return(FilterRowAVX2(Points, Rays, Rows, History, Row, PointCount));
+        case PointCloudKernel_SSE41: return(FilterRowSSE41(Points, Rays, Rows, History, Row, PointCount));
+        default: break;
+    }
+#endif
+    return(FilterRowScalar(Points, Rays, Rows, History, Row, 0, PointCount));
+}
+
+// Like the kernels with the spatial filter for the rows [BeginRow, EndRow). The rows above and below them are decoded
+// too, so a range of rows filters the same as the whole frame.
+static uint32_t ComputeFilteredPointCloud(point_cloud_kernel Kernel, packed_point *Points, const ray_table *Rays, const depth_sample *Frame, float *History, int BeginRow, int EndRow)
+{
+    // Row r is decoded into Distances[(r + 1) % 3], from index 1 on.
+    float Distances[3][POINT_CLOUD_MAX_WIDTH + 2];
+    for(int Slot = 0; Slot < 3; ++Slot)
+    {
+        Distances[Slot][0] = 0.0f;
+        Distances[Slot][Rays->Width + 1] = 0.0f;
+    }
+    DecodeRow(Kernel, Rays, Frame, BeginRow - 1, Distances[BeginRow % 3]);
+    DecodeRow(Kernel, Rays, Frame, BeginRow, Distances[(BeginRow + 1) % 3]);
+
+    uint32_t PointCount = 0;
+    for(int Row = BeginRow; Row < EndRow; ++Row)
+    {
+        DecodeRow(Kernel, Rays, Frame, Row + 1, Distances[(Row + 2) % 3]);
+
+        filter_rows Rows = { Distances[Row % 3], Distances[(Row + 1) % 3], Distances[(Row + 2) % 3] };
+        PointCount = FilterRow(Kernel, Points, Rays, &Rows, History, Row, PointCount);
+    }
+
+    return(PointCount);
+}
+
+static uint32_t ComputePointCloudRange(point_cloud_kernel Kernel, packed_point *Points, const ray_table *Rays, const depth_sample *Frame, float *History, int Begin, int End)
+{
+    if(Rays->Filter)
+    {
+        // The tiles are whole rows.
+        return(ComputeFilteredPointCloud(Kernel, Points, Rays, Frame, History, Begin / Rays->Width, End / Rays->Width));
+    }
+
+#if defined(POINT_CLOUD_X86)
+    switch(Kernel)
+    {
+        case PointCloudKernel_AVX2: return(ComputePointCloudAVX2(Points, Rays, Frame, History, Begin, End));
+        case PointCloudKernel_SSE41: return(ComputePointCloudSSE41(Points, Rays, Frame, History, Begin, End));
+        default: break;
+    }
+#endif
+    return(ComputePointCloudScalar(Points, Rays, Frame, History, Begin, End, 0));
+}
+
+// Computes the points of all valid pixels of the frame with Kernel, which the CPU has to support, and returns how many
+// there are. Points needs room for Rays->PixelCount of them. History has a float per pixel for the temporal filter, see
+// DEPTH_TEMPORAL_WEIGHT, all 0 before the first frame, or is NULL to leave it out.
+uint32_t ComputePointCloudWith(point_cloud_kernel Kernel, packed_point *Points, const ray_table *Rays, const depth_sample *Frame, float *History)
+{
+    PreparePointCloudKernels();
+    return(ComputePointCloudRange(Kernel, Points, Rays, Frame, History, 0, Rays->PixelCount));
+}
+
+typedef struct
+{
+    point_cloud_kernel Kernel;
+    packed_point *Points;
+    packed_point *Scratch;
+    const ray_table *Rays;
+    const depth_sample *Frame;
+    float *History;
+    int TileSize; // In pixels.
+    uint32_t Counts[POINT_CLOUD_MAX_TILES];
+    uint32_t Offsets[POINT_CLOUD_MAX_TILES];
+}
+point_cloud_tiles;
+
+static void ComputePointCloudTiles(void *Data, int Begin, int End)
+{
+    point_cloud_tiles *Tiles = (point_cloud_tiles *)Data;
+    for(int Tile = Begin; Tile < End; ++Tile)
+    {
+        int First = Tile * Tiles->TileSize;
+        int Last = (First + Tiles->TileSize < Tiles->Rays->PixelCount) ? First + Tiles->TileSize : Tiles->Rays->PixelCount;
+        Tiles->Counts[Tile] = ComputePointCloudRange(Tiles->Kernel, Tiles->Scratch + First, Tiles->Rays, Tiles->Frame, Tiles->History, First, Last);
+    }
+}
+
+static void GatherPointCloudTiles(void *Data, int Begin, int End)
+{
+    point_cloud_tiles *Tiles = (point_cloud_tiles *)Data;
+    for(int Tile = Begin; Tile < End; ++Tile)
+    {
+        memcpy(Tiles->Points + Tiles->Offsets[Tile], Tiles->Scratch + Tile * Tiles->TileSize,
+               Tiles->Counts[Tile] * sizeof(packed_point));
+    }
+}
+
+// Like ComputePointCloudWith() on all threads of Jobs. Every tile of rows writes its points to Scratch, starting at its
+// first pixel, and the prefix sum of the point counts of the tiles says where they go in Points. So the points are in
+// the same order as from ComputePointCloudWith(), whichever thread computed which tile. Scratch needs room for
+// Rays->PixelCount points too. The tiles write the history of their own pixels only.
+uint32_t ComputePointCloudParallel(job_system *Jobs, point_cloud_kernel Kernel, packed_point *Points, packed_point *Scratch, const ray_table *Rays, const depth_sample *Frame, float *History)
+{
+    if(Jobs->thread_count == 1)
+    {
+        return(ComputePointCloudWith(Kernel, Points, Rays, Frame, History));
+    }
+
+    PreparePointCloudKernels();
+
+    int Height = Rays->PixelCount / Rays->Width;
+    int TileRows = POINT_CLOUD_TILE_ROWS;
+    while((Height + TileRows - 1) / TileRows > POINT_CLOUD_MAX_TILES)
+    {
+        TileRows *= 2;
+    }
+    int TileCount = (Height + TileRows - 1) / TileRows;
+
+    point_cloud_tiles Tiles;
+    Tiles.Kernel = Kernel;
+    Tiles.Points = Points;
+    Tiles.Scratch = Scratch;
+    Tiles.Rays = Rays;
+    Tiles.Frame = Frame;
+    Tiles.History = History;
+    Tiles.TileSize = TileRows * Rays->Width;
+
+    job_parallel_for(Jobs, TileCount, 1, ComputePointCloudTiles, &Tiles);
+
+    uint32_t PointCount = 0;
+    for(int Tile = 0; Tile < TileCount; ++Tile)
+    {
+        Tiles.Offsets[Tile] = PointCount;
+        PointCount += Tiles.Counts[Tile];
+    }
+
+    job_parallel_for(Jobs, TileCount, 1, GatherPointCloudTiles, &Tiles);
+    return(PointCount);
+}
+
+// Like ComputePointCloudParallel() with the best kernel the CPU can run.
+uint32_t ComputePointCloud(job_system *Jobs, packed_point *Points, packed_point *Scratch, const ray_table *Rays, const depth_sample *Frame, float *History)
+{
+    static int Kernel = -1;
+    if(Kernel < 0)
+    {
+        Kernel = (int)GetBestPointCloudKernel();
+        printf("Computing the point cloud with %s on %d threads%s%s.\n", PointCloudKernelNames[Kernel], Jobs->thread_count,
+               Rays->Filter ? ", filtering the distances" : "", History ? ", averaging the depth over time" : "");
+    }
+    return(ComputePointCloudParallel(Jobs, (point_cloud_kernel)Kernel, Points, Scratch, Rays, Frame, History));
+}
@@ -1,3 +1,4 @@
+#define _CRT_SECURE_NO_WARNINGS
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdint.h>
@@ -31,10 +32,14 @@
 
 #include "linalg.h"
 #include "types.h"
+#include "network.c"
+#include "rvl.c"
+#include "recording.c"
+#include "depth_source.c"
 #include "opengl.c"
+#include "colormap.c"
 #include "opencl.c"
 #include "opencl_opengl.c"
-#include "network.c"
 
 struct scroll_update { 
     double yoffset;
@@ -43,6 +48,13 @@ struct scroll_update {
 
 static struct scroll_update global_scroll_update;
 
+struct colormap_update {
+    colormap_kind kind;
+    int           updated;
+};
+// NOTE: set in the key callback, the renderer is only changed from the main loop
+static struct colormap_update global_colormap_update;
+
 void handle_input(GLFWwindow *Window, view_control *control, float delta_time)
 {
     //
@@ -133,6 +145,16 @@ void scroll_callback(GLFWwindow* Window, double xoffset, double yoffset)
     global_scroll_update.updated = 1;
 }
 
+void key_callback(GLFWwindow* Window, int key, int scancode, int action, int mods)
+{
+    // M switches to the next colormap, see colormap.c.
+    if(key == GLFW_KEY_M && action == GLFW_PRESS)
+    {
+        global_colormap_update.kind = (colormap_kind)((global_colormap_update.kind + 1) % COLORMAP_COUNT);
+        global_colormap_update.updated = 1;
+    }
+}
+
 void glfw_error_callback(int error, const char* description)
 {
     fprintf(stderr, "Error: %s\n", description);
@@ -170,42 +192,7 @@ static void PrintFPS(float DeltaTime)
     }
 }
 
-void to_proper_layout(uint8_t *depth_map, size_t depth_map_size, size_t single_image_size, int width, int height, uint8_t *scratch_memory)
-{
-    memcpy(scratch_memory, depth_map, depth_map_size);
-
-    size_t row_size = width * sizeof(int);
-
-    int k = 0;
-    for(int i = 0; i < 4; ++i)
-    {
-        uint8_t *scratch_image = scratch_memory + i * single_image_size;
-
-        // go through image by 2 rows starting at the end and going to 1
-        for(int j = height - 2; j >= 0; j -= 2)
-        {
-            uint8_t *scratch_row = scratch_image + j * row_size;
-            uint8_t *row = depth_map + k * row_size;
-
-            memcpy(row, scratch_row, row_size);
-
-            ++k;
-        }
-
-        // go through image by 2 rows starting at beginning going to end
-        for(int j = 1; j < height; j += 2)
-        {
-            uint8_t *scratch_row = scratch_image + j * row_size;
-            uint8_t *row = depth_map + k * row_size;
-
-            memcpy(row, scratch_row, row_size);
-        
-            ++k;
-        }
-    }
-}
-
-int main(void)
+int main(int ArgumentCount, char **Arguments)
 {
 	int ExitCode = 0;
 	
@@ -229,49 +216,17 @@ int main(void)
 			
 			glfwSetMouseButtonCallback(Window, mouse_button_callback);
 			glfwSetScrollCallback(Window, scroll_callback);
+			glfwSetKeyCallback(Window, key_callback);
 			
-			connection Connection =
-            {
-                INVALID_SOCKET,
-                INVALID_SOCKET
-            };
+            // The camera, a recording or a synthetic scene, see depth_source.c for the arguments. For the camera this waits
+            // until it connected and starts the "producer" thread that gets the data from it.
+            depth_source Source_;
+            depth_source *Source = &Source_;
 
-            // This will create a socket, bind it, listen and accept when a connection comes in.
-            int Connected = Connect(&Connection);
-            if(0 == Connected)
-			{
-				uint32_t depth_map_width = 320;
-                uint32_t depth_map_height = 240;
-                uint32_t depth_image_size = 307200;
-
-                uint32_t depth_map_size = depth_image_size * 4;
-
-                uint8_t *depth_map = (uint8_t *)malloc(depth_map_size);
-                if(NULL == depth_map)
-                {
-                    fprintf(stderr, "Not enough memory available to run this process.\n");
-                    exit(-1);
-                }
-
-                // Allocate memory to temporarily operate in when laying out memory properly.
-                uint8_t *scratch_memory = (uint8_t *)malloc(depth_map_size);
-                if(NULL == scratch_memory)
-                {
-                    fprintf(stderr, "Not enough memory available to run.\n");
-                    exit(-1);
-                }
-
-                // This all relevant data the thread functions needs. (Kinda like normal function parameters.)
-                get_depth_image_data ThreadDataIn = 
-                {
-                    Connection.Client,
-                    depth_map,
-                    depth_map_size,
-                    depth_image_size
-                };
-
-                // Starts a producer thread that gets the data from the ToF-camera and puts it into depth_map.
-                CreateMyThread(&ThreadDataIn);
+            if(OpenDepthSource(Source, ArgumentCount, Arguments))
+            {
+                uint32_t depth_map_width = Source->Width;
+                uint32_t depth_map_height = Source->Height;
 				
 				open_gl *OpenGL = OpenGLInit(WindowWidth, WindowHeight);
 				
@@ -286,7 +241,18 @@ int main(void)
 				#endif
 				};
 				
-				open_cl *OpenCL = OpenCLInit(depth_map_width, depth_map_height, WindowWidth, WindowHeight, (int *)depth_map, &OS, OpenGL->framebuffer_texture);
+				// The direction of the ray through every pixel, from the calibration of the lens.
+				depth_source_intrinsics Intrinsics;
+				GetDepthSourceIntrinsics(Source, &Intrinsics);
+				float *Rays = (float *)calloc(4 * (size_t)depth_map_width * depth_map_height, sizeof(float));
+				assert(Rays);
+				ComputePixelRays(&Intrinsics, Rays + 0, Rays + 1, Rays + 2, 4);
+				
+				phase_unwrapping Unwrap;
+				GetPhaseUnwrapping(&Intrinsics, &Unwrap);
+				
+				open_cl *OpenCL = OpenCLInit(depth_map_width, depth_map_height, WindowWidth, WindowHeight, NULL, Rays, &Unwrap, Source->MinAmplitude, Source->Temporal, Source->Filter, &OS, OpenGL->framebuffer_texture);
+				free(Rays);
                 
                 view_control Control_ = {
                     .model = mat4_identity(),
@@ -308,6 +274,13 @@ int main(void)
 					double FrameTimeStart = glfwGetTime();
 					
 					handle_input(Window, Control, DeltaTime);
+
+					if(global_colormap_update.updated)
+					{
+						OpenCLSetColormap(OpenCL, global_colormap_update.kind);
+						printf("Colormap: %s\n", colormap_name(global_colormap_update.kind));
+						global_colormap_update.updated = 0;
+					}
 					
 					uint32_t RenderWidth;
 					uint32_t RenderHeight;
@@ -319,15 +292,13 @@ int main(void)
 						CLGLUpdateSettings(OpenCL, OpenGL, RenderWidth, RenderHeight);
 					}
 
-                    // Here we are waiting for the producer thread to signal that the Buffer is full. We time out at 5ms which is ~200 Hz.
-                    if(WaitForOtherThread(5))
+                    // Here we pick up the newest frame the producer thread has finished. If there is none yet we wait for one
+                    // but time out at 5ms which is ~200 Hz. The producer keeps receiving into another slot in the meantime.
+                    depth_sample *depth_map = NextDepthFrame(Source, 5);
+                    if(depth_map)
                     {
-                        // to_proper_layout() lays the depth data out in 4 consecutive images. Here we use the extra memory we allocated earlier.
-                        to_proper_layout(depth_map, depth_map_size, depth_image_size, depth_map_width, depth_map_height, scratch_memory);
-    					OpenCLRenderToTexture(OpenCL, (int *)depth_map, depth_map_width, depth_map_height, Control);
-                        
-                        // Signal that the buffer was read so that the producer thread can start filling in the depth buffer.
-                        SignalOtherThread();
+    					OpenCLRenderToTexture(OpenCL, depth_map, depth_map_width, depth_map_height, Control);
+                        ReleaseDepthFrame(Source, depth_map);
                     }
 					
 					OpenGLRenderToScreen(OpenGL, RenderWidth, RenderHeight);
@@ -341,16 +312,11 @@ int main(void)
 					PrintFPS(DeltaTime);
 				}
                 
-				free(scratch_memory);
-                free(depth_map);
-
-                TerminateMyThread();
-
-                Disconnect(Connection.Host);
+                CloseDepthSource(Source);
 			}
 			else
 			{
-				fprintf(stderr, "Could not establish a connection.\n");
+				fprintf(stderr, "Could not open the depth source.\n");
 				ExitCode = -3;
 			}
 			
@@ -4,6 +4,10 @@ typedef cl_int (*clGetGLContextInfoKHR_fn)(const cl_context_properties* properti
 
 #include "limits.h"
 
+// The compute kernel works on tiles of COMPUTE_TILE_SIZE x COMPUTE_TILE_SIZE pixels, it has to be the
+// reqd_work_group_size of the kernel.
+#define COMPUTE_TILE_SIZE 16
+
 typedef struct
 {
     cl_platform_id Platform;
@@ -24,6 +28,14 @@ typedef struct
     cl_mem DepthMapImage;
     cl_mem PositionImage;
     cl_mem ColorImage;
+    cl_mem ColormapImage;
+    cl_mem RayImage;
+    cl_mem History; // The distance of every pixel in the last frame for the temporal filter, NULL without it.
+    cl_int SpatialFilter; // The compute kernel filters the distances first, see DEPTH_FILTER_TOLERANCE.
+    
+    phase_unwrapping Unwrap;
+    int ImageCount; // Per frame, 4 or 8 for two modulation frequencies.
+    float MinSignal; // (2 * lowest amplitude)^2, see depth_source.MinAmplitude.
     
     bool SupportsGLContextSharing;
     
@@ -42,85 +54,205 @@ void BuildPointCloudComputeProgram(open_cl *OpenCL)
 {
     // Compiling the compute program.
     char *ComputeSource = 
-    "float3 HSVToRGB(float3 HSV)                                                         \n"
+    "// The colors of the hues, see colormap.c.                                          \n"
+    "__constant sampler_t ColormapSampler = CLK_NORMALIZED_COORDS_TRUE |                 \n"
+    "                                       CLK_ADDRESS_CLAMP_TO_EDGE |                  \n"
+    "                                       CLK_FILTER_LINEAR;                           \n"
+    "                                                                                    \n"
+    "// The sample differences of pixel in the 4 images of one modulation frequency      \n"
+    "// whose top left corner in DepthImage is corner.                                   \n"
+    "float2 LoadDifferences(__read_only image2d_t DepthImage, int2 corner, int2 pixel,   \n"
+    "                       int width, int height)                                       \n"
     "{                                                                                   \n"
-    "    float3 RGB;                                                                     \n"
+    "    int2 pixel0 = corner + pixel;                                                   \n"
+    "    int2 pixel1 = pixel0 + (int2){ width, 0 };                                      \n"
+    "    int2 pixel2 = pixel0 + (int2){ 0, height };                                     \n"
+    "    int2 pixel3 = pixel0 + (int2){ width, height };                                 \n"
     "                                                                                    \n"
-    "    int I;                                                                          \n"
-    "    float F, P, Q, T;                                                               \n"
+    "    int depth0 = (int)read_imageui(DepthImage, pixel0).x - 2048;                    \n"
+    "    int depth1 = (int)read_imageui(DepthImage, pixel1).x - 2048;                    \n"
+    "    int depth2 = (int)read_imageui(DepthImage, pixel2).x - 2048;                    \n"
+    "    int depth3 = (int)read_imageui(DepthImage, pixel3).x - 2048;                    \n"
     "                                                                                    \n"
-    "    float H = HSV.x;                                                                \n"
-    "    float S = HSV.y;                                                                \n"
-    "    float V = HSV.z;                                                                \n"
+    "    return (float2){ (float)(depth3 - depth1), (float)(depth2 - depth0) };          \n"
+    "}                                                                                   \n"
+    "                                                                                    \n"
+    "// The phase of the sample differences in turns from 0 to 1.                        \n"
+    "float PhaseTurns(float2 diff)                                                       \n"
+    "{                                                                                   \n"
+    "    float pi = 3.14159265f;                                                         \n"
     "                                                                                    \n"
-    "    if(S == 0)                                                                      \n"
+    "    return (pi + atan2(diff.x, diff.y)) / (2 * pi);                                 \n"
+    "}                                                                                   \n"
+    "                                                                                    \n"
+    "// The distance along the ray through pixel, 0 for a pixel without one. The images  \n"
+    "// of a second frequency are right of those of the first. FrequencyCount to         \n"
+    "// UnwrapOffsets are those of phase_unwrapping, Multiples holds its Multiple[0] and \n"
+    "// Multiple[1]. The squared length of the sample differences of a pixel has to      \n"
+    "// reach MinSignal, which is 4 times the squared amplitude.                         \n"
+    "float DecodeDistance(__read_only image2d_t DepthImage, int2 pixel, int width,       \n"
+    "                     int height, int FrequencyCount, float2 Multiples,              \n"
+    "                     float DistancePerTurn, float UnwrapTolerance,                  \n"
+    "                     float16 UnwrapOffsets, float MinSignal)                        \n"
+    "{                                                                                   \n"
+    "    float2 diff0 = LoadDifferences(DepthImage, (int2){ 0, 0 }, pixel, width,        \n"
+    "                                   height);                                         \n"
+    "    float2 diff1 = diff0;                                                           \n"
+    "    if(FrequencyCount == 2)                                                         \n"
     "    {                                                                               \n"
-    "        RGB = (float3){V, V, V};                                                    \n"
+    "        diff1 = LoadDifferences(DepthImage, (int2){ 2 * width, 0 }, pixel, width,   \n"
+    "                                height);                                            \n"
     "    }                                                                               \n"
-    "    else                                                                            \n"
+    "                                                                                    \n"
+    "    // Too little signal for a phase, most of these pixels are background.          \n"
+    "    float signal = min(dot(diff0, diff0), dot(diff1, diff1));                       \n"
+    "    if(signal < MinSignal)                                                          \n"
+    "    {                                                                               \n"
+    "        return 0.0f;                                                                \n"
+    "    }                                                                               \n"
+    "                                                                                    \n"
+    "    if(FrequencyCount == 2)                                                         \n"
+    "    {                                                                               \n"
+    "        float turns0 = PhaseTurns(diff0);                                           \n"
+    "        float turns1 = PhaseTurns(diff1);                                           \n"
+    "                                                                                    \n"
+    "        float wraps = turns0 * Multiples.y - turns1 * Multiples.x;                  \n"
+    "        float rounded = rint(wraps);                                                \n"
+    "        int last_index = (int)(Multiples.x + Multiples.y) - 2;                      \n"
+    "        int index = clamp((int)rounded + (int)Multiples.x - 1, 0, last_index);      \n"
+    "                                                                                    \n"
+    "        // The phases disagree, no distance fits both frequencies.                  \n"
+    "        if(fabs(wraps - rounded) > UnwrapTolerance)                                 \n"
+    "        {                                                                           \n"
+    "            return 0.0f;                                                            \n"
+    "        }                                                                           \n"
+    "                                                                                    \n"
+    "        float Offsets[16];                                                          \n"
+    "        vstore16(UnwrapOffsets, 0, Offsets);                                        \n"
+    "        float turns = turns0 * Multiples.x + turns1 * Multiples.y;                  \n"
+    "        turns += Offsets[index];                                                    \n"
+    "        return turns * DistancePerTurn;                                             \n"
+    "    }                                                                               \n"
+    "    return PhaseTurns(diff0) * DistancePerTurn;                                     \n"
+    "}                                                                                   \n"
+    "                                                                                    \n"
+    "// The mean distance of the neighbors of the pixel at Local (+ 1 in DistanceTile)   \n"
+    "// on its surface, 0 for a pixel without a distance or with too few of them (a      \n"
+    "// flying pixel). DEPTH_FILTER_TOLERANCE and DEPTH_FILTER_MIN_NEIGHBORS come from   \n"
+    "// depth_source.c.                                                                  \n"
+    "float FilterDistance(__local float DistanceTile[18][18], int2 Local)                \n"
+    "{                                                                                   \n"
+    "    float Distance = DistanceTile[Local.y + 1][Local.x + 1];                        \n"
+    "    float Tolerance = Distance * DEPTH_FILTER_TOLERANCE;                            \n"
+    "                                                                                    \n"
+    "    float Sum = 0.0f;                                                               \n"
+    "    int Count = 0;                                                                  \n"
+    "    for(int Y = Local.y; Y <= Local.y + 2; ++Y)                                     \n"
     "    {                                                                               \n"
-    "        H *= 6;                                                                     \n"
-    "        I = (int)H;                                                                 \n"
-    "        F = H - I;                                                                  \n"
-    "        P = V * (1 - S);                                                            \n"
-    "        Q = V * (1 - S * F);                                                        \n"
-    "        T = V * (1 - S * (1 - F));                                                  \n"
-    "        switch (I)                                                                  \n"
+    "        for(int X = Local.x; X <= Local.x + 2; ++X)                                 \n"
     "        {                                                                           \n"
-    "            case 1:  RGB = (float3){Q, V, P}; break;                                \n"
-    "            case 0:  RGB = (float3){V, T, P}; break;                                \n"
-    "            case 2:  RGB = (float3){P, V, T}; break;                                \n"
-    "            case 3:  RGB = (float3){P, Q, V}; break;                                \n"
-    "            case 4:  RGB = (float3){T, P, V}; break;                                \n"
-    "            default: RGB = (float3){V, P, Q}; break;                                \n"
+    "            float Neighbor = DistanceTile[Y][X];                                    \n"
+    "            if(fabs(Neighbor - Distance) <= Tolerance)                              \n"
+    "            {                                                                       \n"
+    "                Sum += Neighbor;                                                    \n"
+    "                ++Count;                                                            \n"
+    "            }                                                                       \n"
     "        }                                                                           \n"
     "    }                                                                               \n"
     "                                                                                    \n"
-    "    return(RGB);                                                                    \n"
+    "    // The pixel itself is one of them.                                             \n"
+    "    bool Keep = Distance != 0.0f && Count > DEPTH_FILTER_MIN_NEIGHBORS;             \n"
+    "    return Keep ? Sum / Count : 0.0f;                                               \n"
     "}                                                                                   \n"
     "                                                                                    \n"
-    "__kernel void ComputeKernel(__read_only  image2d_t DepthImage,                      \n"
-    "                            __write_only image2d_t PositionImage,                   \n"
-    "                            __write_only image2d_t ColorImage,                      \n"
-    "                            float min_depth,                                        \n"
-    "                            float max_depth,                                        \n"
-    "                            float focal_length_mm,                                  \n"
-    "                            float pixels_per_mm)                                    \n"
+    "// Works on tiles of 16x16 pixels, see COMPUTE_TILE_SIZE. FrequencyCount to         \n"
+    "// MinSignal are those of DecodeDistance(). History has the distance of every pixel \n"
+    "// along its ray in the last frame for the temporal filter (DEPTH_TEMPORAL_WEIGHT   \n"
+    "// in depth_source.c), NULL without it. With SpatialFilter the distances are        \n"
+    "// filtered first, see DEPTH_FILTER_TOLERANCE.                                      \n"
+    "__kernel __attribute__((reqd_work_group_size(16, 16, 1)))                           \n"
+    "void ComputeKernel(__read_only  image2d_t DepthImage,                               \n"
+    "                   __write_only image2d_t PositionImage,                            \n"
+    "                   __write_only image2d_t ColorImage,                               \n"
+    "                   float min_depth,                                                 \n"
+    "                   float max_depth,                                                 \n"
+    "                   __read_only  image2d_t Rays,                                     \n"
+    "                   __read_only  image1d_t Colormap,                                 \n"
+    "                   int FrequencyCount,                                              \n"
+    "                   float2 Multiples,                                                \n"
+    "                   float DistancePerTurn,                                           \n"
+    "                   float UnwrapTolerance,                                           \n"
+    "                   float16 UnwrapOffsets,                                           \n"
+    "                   float MinSignal,                                                 \n"
+    "                   __global float *History,                                         \n"
+    "                   int SpatialFilter)                                               \n"
     "{                                                                                   \n"
     "    int width = get_image_width(PositionImage);                                     \n"
     "    int height = get_image_height(PositionImage);                                   \n"
     "                                                                                    \n"
-    "    int2 principal_point = { width / 2, height / 2 };                               \n"
-    "                                                                                    \n"
     "    int2 pixel = { get_global_id(0), get_global_id(1) };                            \n"
-    "    int2 pixel1 = pixel + (int2){ width, 0 };                                       \n"
-    "    int2 pixel2 = pixel + (int2){ 0, height };                                      \n"
-    "    int2 pixel3 = pixel + (int2){ width, height };                                  \n"
+    "    int2 Local = { get_local_id(0), get_local_id(1) };                              \n"
+    "    int index = pixel.y * width + pixel.x;                                          \n"
     "                                                                                    \n"
-    "    int depth0 = (read_imagei(DepthImage, pixel).x & 0xFFF) - 2048;                 \n"
-    "    int depth1 = (read_imagei(DepthImage, pixel1).x & 0xFFF) - 2048;                \n"
-    "    int depth2 = (read_imagei(DepthImage, pixel2).x & 0xFFF) - 2048;                \n"
-    "    int depth3 = (read_imagei(DepthImage, pixel3).x & 0xFFF) - 2048;                \n"
-    "                                                                                    \n"
-    "    float diff0 = (float)(depth3 - depth1);                                         \n"
-    "    float diff1 = (float)(depth2 - depth0);                                         \n"
-    "                                                                                    \n"
-    "    float c = 300000000.0;                                                          \n"
-    "    float f = 12000000.0;                                                           \n"
-    "    float pi = 3.1416; // 3.1415926535897932384626433832795                         \n"
+    "    // The distances of the tile and the pixels around it, each decoded once for all\n"
+    "    // the work items that need it. Outside of the image there is no distance.      \n"
+    "    __local float DistanceTile[18][18];                                             \n"
+    "    if(SpatialFilter)                                                               \n"
+    "    {                                                                               \n"
+    "        int2 Corner = { (int)get_group_id(0) * 16 - 1,                              \n"
+    "                        (int)get_group_id(1) * 16 - 1 };                            \n"
+    "        for(int I = Local.y * 16 + Local.x; I < 18 * 18; I += 16 * 16)              \n"
+    "        {                                                                           \n"
+    "            int2 Texel = Corner + (int2){ I % 18, I / 18 };                         \n"
+    "            float Neighbor = 0.0f;                                                  \n"
+    "            if(Texel.x >= 0 && Texel.y >= 0 && Texel.x < width && Texel.y < height) \n"
+    "            {                                                                       \n"
+    "                Neighbor = DecodeDistance(DepthImage, Texel, width, height,         \n"
+    "                                          FrequencyCount, Multiples,                \n"
+    "                                          DistancePerTurn, UnwrapTolerance,         \n"
+    "                                          UnwrapOffsets, MinSignal);                \n"
+    "            }                                                                       \n"
+    "            DistanceTile[I / 18][I % 18] = Neighbor;                                \n"
+    "        }                                                                           \n"
+    "    }                                                                               \n"
+    "    barrier(CLK_LOCAL_MEM_FENCE);                                                   \n"
     "                                                                                    \n"
-    "    float depth = (c / 2) * (1 / (2 * pi * f)) * (pi + atan2(diff0, diff1));         \n"
+    "    // The image does not have to be a multiple of the tile size.                   \n"
+    "    if(pixel.x >= width || pixel.y >= height)                                       \n"
+    "    {                                                                               \n"
+    "        return;                                                                     \n"
+    "    }                                                                               \n"
     "                                                                                    \n"
-    "    float focal_length = pixels_per_mm * focal_length_mm;                           \n"
+    "    float depth;                                                                    \n"
+    "    if(SpatialFilter)                                                               \n"
+    "    {                                                                               \n"
+    "        depth = FilterDistance(DistanceTile, Local);                                \n"
+    "    }                                                                               \n"
+    "    else                                                                            \n"
+    "    {                                                                               \n"
+    "        depth = DecodeDistance(DepthImage, pixel, width, height, FrequencyCount,    \n"
+    "                               Multiples, DistancePerTurn, UnwrapTolerance,         \n"
+    "                               UnwrapOffsets, MinSignal);                           \n"
+    "    }                                                                               \n"
     "                                                                                    \n"
-    "    float x = (pixel.x - principal_point.x) / focal_length;                         \n"
-    "    float y = (pixel.y - principal_point.y) / focal_length;                         \n"
-    "    float z = depth / sqrt(x * x + y * y + 1);                                      \n"
+    "    // The temporal filter, a dropped pixel has a distance of 0 and no history.     \n"
+    "    if(History)                                                                     \n"
+    "    {                                                                               \n"
+    "        float difference = depth - History[index];                                  \n"
+    "        if(fabs(difference) <= depth * DEPTH_TEMPORAL_TOLERANCE)                    \n"
+    "        {                                                                           \n"
+    "            depth = History[index] + difference * DEPTH_TEMPORAL_WEIGHT;            \n"
+    "        }                                                                           \n"
+    "        History[index] = depth;                                                     \n"
+    "    }                                                                               \n"
+    "    // The distance along the ray through the pixel, see ComputePixelRays().        \n"
+    "    float3 ray = read_imagef(Rays, pixel).xyz;                                      \n"
+    "    float z = depth * ray.z;                                                        \n"
     "                                                                                    \n"
     "    float w = 1.0f;                                                                 \n"
     "    if(z < min_depth || z > max_depth || z == 0.0f) w = 0.0f;                       \n"
     "                                                                                    \n"
-    "    float3 Position = { x * z, y * z, -z };                                         \n"
+    "    float3 Position = { depth * ray.x, depth * ray.y, -z };                         \n"
     "                                                                                    \n"
     "    float Hue = (z - min_depth) / (max_depth - min_depth);                          \n"
     "    Hue = clamp(Hue, 0.0f, 1.0f);                                                   \n"
@@ -130,7 +262,7 @@ void BuildPointCloudComputeProgram(open_cl *OpenCL)
     "    Hue *= Range;                                                                   \n"
     "    Hue = Range - Hue;                                                              \n"
     "                                                                                    \n"
-    "    float3 Color = HSVToRGB((float3){ Hue, 1.0f, 1.0f });                           \n"
+    "    float3 Color = read_imagef(Colormap, ColormapSampler, Hue).xyz;                 \n"
     "                                                                                    \n"
     "    write_imagef(PositionImage, pixel, (float4){ Position, w });                    \n"
     "    write_imagef(ColorImage, pixel, (float4){ Color, w });                          \n"
@@ -141,10 +273,13 @@ void BuildPointCloudComputeProgram(open_cl *OpenCL)
     assert(Result == CL_SUCCESS);
     
     #if defined(NDEBUG)
-    char *Flags = "-cl-std=CL2.0";
+    char *BaseFlags = "-cl-std=CL2.0";
     #else // DEBUG
-    char *Flags = "-g -Werror -cl-std=CL2.0";
+    char *BaseFlags = "-g -Werror -cl-std=CL2.0";
     #endif
+    char Flags[256];
+    snprintf(Flags, sizeof(Flags), "%s -D DEPTH_TEMPORAL_WEIGHT=%.9gf -D DEPTH_TEMPORAL_TOLERANCE=%.9gf -D DEPTH_FILTER_TOLERANCE=%.9gf -D DEPTH_FILTER_MIN_NEIGHBORS=%d",
+             BaseFlags, DEPTH_TEMPORAL_WEIGHT, DEPTH_TEMPORAL_TOLERANCE, DEPTH_FILTER_TOLERANCE, DEPTH_FILTER_MIN_NEIGHBORS);
     clBuildProgram(Program, 0, NULL, Flags, NULL, NULL);
     
     cl_build_status BuildStatus;
@@ -298,6 +433,17 @@ void BuildPipelineProgram(open_cl *OpenCL)
     OpenCL->PipelineProgram = Program;
 }
 
+void OpenCLSetColormap(open_cl *OpenCL, colormap_kind Kind)
+{
+    uint8_t Colormap[COLORMAP_SIZE * 4];
+    colormap_build(Kind, Colormap);
+    
+    size_t Origin[] = { 0, 0, 0 };
+    size_t Region[] = { COLORMAP_SIZE, 1, 1 };
+    cl_int Result = clEnqueueWriteImage(OpenCL->CommandQueue, OpenCL->ColormapImage, CL_TRUE, Origin, Region, 0, 0, Colormap, 0, NULL, NULL);
+    assert(Result == CL_SUCCESS);
+}
+
 bool StringsAreEqual(size_t ALength, char *A, char *B)
 {
     bool Result = false;
@@ -323,9 +469,18 @@ bool StringsAreEqual(size_t ALength, char *A, char *B)
     return(Result);
 }
 
-open_cl *OpenCLInit(uint32_t DepthMapWidth, uint32_t DepthMapHeight, uint32_t WindowWidth, uint32_t WindowHeight, int *DepthMap, os_specifics *OS, cl_GLuint GLFramebuffer)
+// Rays is the direction of the ray through every pixel of a depth map, 4 floats per pixel of which the first 3 are
+// used, see ComputePixelRays(). Unwrap says how many modulation frequencies a frame has, see GetPhaseUnwrapping().
+// Pixels with less than MinAmplitude are dropped. With TemporalFilter the distances are averaged over time, see
+// DEPTH_TEMPORAL_WEIGHT, with SpatialFilter they are filtered first, see DEPTH_FILTER_TOLERANCE.
+open_cl *OpenCLInit(uint32_t DepthMapWidth, uint32_t DepthMapHeight, uint32_t WindowWidth, uint32_t WindowHeight, uint16_t *DepthMap, float *Rays, const phase_unwrapping *Unwrap, float MinAmplitude, bool TemporalFilter, bool SpatialFilter, os_specifics *OS, cl_GLuint GLFramebuffer)
 {
     open_cl *OpenCL = (open_cl *)malloc(sizeof(open_cl));
+    OpenCL->Unwrap = *Unwrap;
+    OpenCL->ImageCount = 4 * Unwrap->FrequencyCount;
+    OpenCL->MinSignal = 4.0f * MinAmplitude * MinAmplitude;
+    OpenCL->History = NULL;
+    OpenCL->SpatialFilter = SpatialFilter;
     
     cl_int Result;
     
@@ -462,14 +617,27 @@ PlatformFound:
             // Creating the depth buffer.
             OpenCL->DepthBuffer = clCreateBuffer(OpenCL->Context, CL_MEM_READ_WRITE, WindowWidth * WindowHeight * sizeof(unsigned int) * 2, NULL, &Result);
             assert(Result == CL_SUCCESS);
+
+            // Creating the history of the temporal filter, which never leaves the device. No pixel has one yet.
+            if(TemporalFilter)
+            {
+                size_t HistorySize = (size_t)DepthMapWidth * DepthMapHeight * sizeof(float);
+                OpenCL->History = clCreateBuffer(OpenCL->Context, CL_MEM_READ_WRITE, HistorySize, NULL, &Result);
+                assert(Result == CL_SUCCESS);
+                float Zero = 0.0f;
+                Result = clEnqueueFillBuffer(OpenCL->CommandQueue, OpenCL->History, &Zero, sizeof(Zero), 0, HistorySize, 0, NULL, NULL);
+                assert(Result == CL_SUCCESS);
+            }
             
-            // Creating the depth map image.
+            // Creating the depth map image. It holds the 4 images of a modulation frequency in its quarters, those of a
+            // second frequency are right of them.
             cl_image_desc DepthMapImageDescriptor = {0};
             DepthMapImageDescriptor.image_type = CL_MEM_OBJECT_IMAGE2D;
-            DepthMapImageDescriptor.image_width = DepthMapWidth * 2;
+            DepthMapImageDescriptor.image_width = DepthMapWidth * 2 * Unwrap->FrequencyCount;
             DepthMapImageDescriptor.image_height = DepthMapHeight * 2;
             
-            cl_image_format DepthMapImageFormat = { CL_R, CL_SIGNED_INT32 };
+            // The samples only hold the 12 bits of the phase, they are packed to 16 bits while receiving them.
+            cl_image_format DepthMapImageFormat = { CL_R, CL_UNSIGNED_INT16 };
             
             OpenCL->DepthMapImage = clCreateImage(OpenCL->Context, CL_MEM_READ_WRITE, &DepthMapImageFormat, &DepthMapImageDescriptor, NULL, &Result);
             assert(Result == CL_SUCCESS);
@@ -495,6 +663,28 @@ PlatformFound:
             
             OpenCL->ColorImage = clCreateImage(OpenCL->Context, CL_MEM_READ_WRITE, &ColorImageFormat, &ColorImageDescriptor, NULL, &Result);
             assert(Result == CL_SUCCESS);
+
+            // Creating the colormap image, the colors of the hues (see colormap.c).
+            cl_image_desc ColormapImageDescriptor = {0};
+            ColormapImageDescriptor.image_type = CL_MEM_OBJECT_IMAGE1D;
+            ColormapImageDescriptor.image_width = COLORMAP_SIZE;
+            
+            cl_image_format ColormapImageFormat = { CL_RGBA, CL_UNORM_INT8 };
+            
+            OpenCL->ColormapImage = clCreateImage(OpenCL->Context, CL_MEM_READ_ONLY, &ColormapImageFormat, &ColormapImageDescriptor, NULL, &Result);
+            assert(Result == CL_SUCCESS);
+            OpenCLSetColormap(OpenCL, COLORMAP_HUE);
+
+            // Creating the ray image. The rays only depend on the lens so they are copied once.
+            cl_image_desc RayImageDescriptor = {0};
+            RayImageDescriptor.image_type = CL_MEM_OBJECT_IMAGE2D;
+            RayImageDescriptor.image_width = DepthMapWidth;
+            RayImageDescriptor.image_height = DepthMapHeight;
+            
+            cl_image_format RayImageFormat = { CL_RGBA, CL_FLOAT };
+            
+            OpenCL->RayImage = clCreateImage(OpenCL->Context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, &RayImageFormat, &RayImageDescriptor, Rays, &Result);
+            assert(Result == CL_SUCCESS);
         }
     }
     
@@ -507,6 +697,12 @@ void OpenCLRelease(open_cl *OpenCL)
 
     clReleaseProgram(OpenCL->PointCloudComputeProgram);
     
+    clReleaseMemObject(OpenCL->RayImage);
+    if(OpenCL->History)
+    {
+        clReleaseMemObject(OpenCL->History);
+    }
+    clReleaseMemObject(OpenCL->ColormapImage);
     clReleaseMemObject(OpenCL->ColorImage);
     clReleaseMemObject(OpenCL->PositionImage);
     clReleaseMemObject(OpenCL->DepthMapImage);
@@ -518,7 +714,7 @@ void OpenCLRelease(open_cl *OpenCL)
     clReleaseContext(OpenCL->Context);
 }
 
-void OpenCLRenderToTexture(open_cl *OpenCL, int *DepthMap, uint32_t DepthMapWidth, uint32_t DepthMapHeight, view_control *Control)
+void OpenCLRenderToTexture(open_cl *OpenCL, uint16_t *DepthMap, uint32_t DepthMapWidth, uint32_t DepthMapHeight, view_control *Control)
 {
     cl_int Result = 0;
     
@@ -527,62 +723,33 @@ void OpenCLRenderToTexture(open_cl *OpenCL, int *DepthMap, uint32_t DepthMapWidt
     
     uint32_t single_depth_image_size = DepthMapWidth * DepthMapHeight;
 
-    cl_event depth_image_written[4];
-
-    // Writing the depth map data to the opencl image.
-    Result = clEnqueueWriteImage(
-        OpenCL->CommandQueue, 
-        OpenCL->DepthMapImage, 
-        CL_FALSE, 
-        Origin, DepthMapRegion, 
-        DepthMapWidth * sizeof(DepthMap[0]), 0, 
-        DepthMap + 0 * single_depth_image_size, 
-        0, NULL, &depth_image_written[0]);
-    assert(Result == CL_SUCCESS);
-
-    Origin[0] = DepthMapWidth;
-    Origin[1] = 0;
+    cl_event depth_image_written[8];
 
-    Result = clEnqueueWriteImage(
-        OpenCL->CommandQueue, 
-        OpenCL->DepthMapImage, 
-        CL_FALSE, 
-        Origin, DepthMapRegion, 
-        DepthMapWidth * sizeof(DepthMap[0]), 0, 
-        DepthMap + 1 * single_depth_image_size, 
-        0, NULL, &depth_image_written[1]);
-    assert(Result == CL_SUCCESS);
-
-    Origin[0] = 0;
-    Origin[1] = DepthMapHeight;
-
-    Result = clEnqueueWriteImage(
-        OpenCL->CommandQueue, 
-        OpenCL->DepthMapImage, 
-        CL_FALSE, 
-        Origin, DepthMapRegion, 
-        DepthMapWidth * sizeof(DepthMap[0]), 0, 
-        DepthMap + 2 * single_depth_image_size, 
-        0, NULL, &depth_image_written[2]);
-    assert(Result == CL_SUCCESS);
-
-    Origin[0] = DepthMapWidth;
-    Origin[1] = DepthMapHeight;
+    // Writing the depth map data to the opencl image. Image 0 goes to the top left, 1 to the top right, 2 to the
+    // bottom left and 3 to the bottom right, the 4 images of a second modulation frequency right of them.
+    for(int Image = 0; Image < OpenCL->ImageCount; ++Image)
+    {
+        Origin[0] = ((Image & 1) ? DepthMapWidth : 0) + (Image >> 2) * 2 * DepthMapWidth;
+        Origin[1] = (Image & 2) ? DepthMapHeight : 0;
 
-    Result = clEnqueueWriteImage(
-        OpenCL->CommandQueue, 
-        OpenCL->DepthMapImage, 
-        CL_FALSE, 
-        Origin, DepthMapRegion, 
-        DepthMapWidth * sizeof(DepthMap[0]), 0, 
-        DepthMap + 3 * single_depth_image_size, 
-        0, NULL, &depth_image_written[3]);
-    assert(Result == CL_SUCCESS);
+        Result = clEnqueueWriteImage(
+            OpenCL->CommandQueue, 
+            OpenCL->DepthMapImage, 
+            CL_FALSE, 
+            Origin, DepthMapRegion, 
+            DepthMapWidth * sizeof(DepthMap[0]), 0, 
+            DepthMap + Image * single_depth_image_size, 
+            0, NULL, &depth_image_written[Image]);
+        assert(Result == CL_SUCCESS);
+    }
     
+    phase_unwrapping *Unwrap = &OpenCL->Unwrap;
     float min_depth = 0.0f;
-    float max_depth = 12.5f;
-    float pixels_per_mm = 50.0f;
-    float focal_length_mm = 3.7f;
+    float max_depth = Unwrap->Range;
+    cl_float2 Multiples = {{ (float)Unwrap->Multiple[0], (float)Unwrap->Multiple[1] }};
+    float UnwrapTolerance = PHASE_UNWRAP_TOLERANCE;
+    cl_float16 UnwrapOffsets;
+    memcpy(UnwrapOffsets.s, Unwrap->Offsets, sizeof(UnwrapOffsets.s));
 
     // Set Kernel Arguments and Enqueue the Kernel in the command queue.
     Result = 0;
@@ -591,20 +758,36 @@ void OpenCLRenderToTexture(open_cl *OpenCL, int *DepthMap, uint32_t DepthMapWidt
     Result |= clSetKernelArg(OpenCL->PointCloudComputeKernel, 2, sizeof(cl_mem), &OpenCL->ColorImage);
     Result |= clSetKernelArg(OpenCL->PointCloudComputeKernel, 3, sizeof(float), &min_depth);
     Result |= clSetKernelArg(OpenCL->PointCloudComputeKernel, 4, sizeof(float), &max_depth);
-    Result |= clSetKernelArg(OpenCL->PointCloudComputeKernel, 5, sizeof(float), &pixels_per_mm);
-    Result |= clSetKernelArg(OpenCL->PointCloudComputeKernel, 6, sizeof(float), &focal_length_mm);
+    Result |= clSetKernelArg(OpenCL->PointCloudComputeKernel, 5, sizeof(cl_mem), &OpenCL->RayImage);
+    Result |= clSetKernelArg(OpenCL->PointCloudComputeKernel, 6, sizeof(cl_mem), &OpenCL->ColormapImage);
+    Result |= clSetKernelArg(OpenCL->PointCloudComputeKernel, 7, sizeof(int), &Unwrap->FrequencyCount);
+    Result |= clSetKernelArg(OpenCL->PointCloudComputeKernel, 8, sizeof(cl_float2), &Multiples);
+    Result |= clSetKernelArg(OpenCL->PointCloudComputeKernel, 9, sizeof(float), &Unwrap->DistancePerTurn);
+    Result |= clSetKernelArg(OpenCL->PointCloudComputeKernel, 10, sizeof(float), &UnwrapTolerance);
+    Result |= clSetKernelArg(OpenCL->PointCloudComputeKernel, 11, sizeof(cl_float16), &UnwrapOffsets);
+    Result |= clSetKernelArg(OpenCL->PointCloudComputeKernel, 12, sizeof(float), &OpenCL->MinSignal);
+    Result |= clSetKernelArg(OpenCL->PointCloudComputeKernel, 13, sizeof(cl_mem), OpenCL->History ? &OpenCL->History : NULL);
+    Result |= clSetKernelArg(OpenCL->PointCloudComputeKernel, 14, sizeof(cl_int), &OpenCL->SpatialFilter);
     assert(Result == CL_SUCCESS);
     
     size_t GlobalWorkSize[] = { DepthMapWidth, DepthMapHeight };
     size_t *LocalWorkSize = NULL;
+
+    // The compute kernel works on whole tiles.
+    size_t ComputeLocalWorkSize[] = { COMPUTE_TILE_SIZE, COMPUTE_TILE_SIZE };
+    size_t ComputeGlobalWorkSize[] =
+    {
+        (DepthMapWidth + COMPUTE_TILE_SIZE - 1) / COMPUTE_TILE_SIZE * COMPUTE_TILE_SIZE,
+        (DepthMapHeight + COMPUTE_TILE_SIZE - 1) / COMPUTE_TILE_SIZE * COMPUTE_TILE_SIZE
+    };
     
     cl_event ComputedPointCloud;
     Result = clEnqueueNDRangeKernel(
         OpenCL->CommandQueue, 
         OpenCL->PointCloudComputeKernel, 
         2, 
-        NULL, GlobalWorkSize, LocalWorkSize, 
-        4, depth_image_written, 
+        NULL, ComputeGlobalWorkSize, ComputeLocalWorkSize, 
+        OpenCL->ImageCount, depth_image_written, 
         &ComputedPointCloud);
     assert(Result == CL_SUCCESS);
 
@@ -0,0 +1,125 @@
+// The colors of the points. All visualizers give a point the hue of the HSV color (hue, 1, 1) from its depth, going
+// from 2/3 (blue) close to the camera to 0 (red) far away, and look its color up in a table indexed by that hue
+// instead of converting HSV to RGB for every point or fragment, which is branchy and takes more instructions than the
+// rest of the shading. The hue itself is computed the way it always was.
+//
+// The table has COLORMAP_SIZE colors of 8 bit RGBA, entry i is the color of the hues from i / COLORMAP_SIZE to
+// (i + 1) / COLORMAP_SIZE. The same table works as a 1D texture sampled at the hue, the middle of texel i is the hue
+// (i + 0.5) / COLORMAP_SIZE the entry was computed for.
+//
+//   hue        The HSV colors, what the visualizers always showed (default).
+//   turbo      Turbo (Mikhailov, 2019), from dark blue close to the camera to dark red far away.
+//   grayscale  From white close to the camera to black far away.
+//
+// The hues above 2/3 never occur, turbo and grayscale repeat the color of 2/3 there.
+
+#include <stdint.h>
+
+#define COLORMAP_SIZE 1024
+#define COLORMAP_HUE_RANGE (2.0f / 3.0f)
+
+typedef enum
+{
+    COLORMAP_HUE,
+    COLORMAP_TURBO,
+    COLORMAP_GRAYSCALE,
+    COLORMAP_COUNT
+} colormap_kind;
+
+const char *colormap_name(colormap_kind kind)
+{
+    switch(kind)
+    {
+        case COLORMAP_TURBO: return("turbo");
+        case COLORMAP_GRAYSCALE: return("grayscale");
+        default: return("hue");
+    }
+}
+
+// The entry of hue, which is 0 to 1.
+static inline int colormap_index(float hue)
+{
+    int index = (int)(hue * COLORMAP_SIZE);
+    return(index < COLORMAP_SIZE - 1 ? index : COLORMAP_SIZE - 1);
+}
+
+// The entry of a hue in 1/65535, as a packed_point has it.
+static inline int colormap_index_16(uint16_t hue)
+{
+    return((int)(((uint32_t)hue * COLORMAP_SIZE) >> 16));
+}
+
+static void colormap_hsv_to_rgb(float hue, float *rgb)
+{
+    // Saturation and value are 1.
+    float h = hue * 6.0f;
+    int sector = (int)h;
+    float f = h - (float)sector;
+    float q = 1.0f - f;
+    switch(sector)
+    {
+        case 0:  rgb[0] = 1.0f; rgb[1] = f;    rgb[2] = 0.0f; break;
+        case 1:  rgb[0] = q;    rgb[1] = 1.0f; rgb[2] = 0.0f; break;
+        case 2:  rgb[0] = 0.0f; rgb[1] = 1.0f; rgb[2] = f;    break;
+        case 3:  rgb[0] = 0.0f; rgb[1] = q;    rgb[2] = 1.0f; break;
+        case 4:  rgb[0] = f;    rgb[1] = 0.0f; rgb[2] = 1.0f; break;
+        default: rgb[0] = 1.0f; rgb[1] = 0.0f; rgb[2] = q;    break;
+    }
+}
+
+// The polynomial approximation of Turbo, t from 0 (dark blue) to 1 (dark red).
+static void colormap_turbo(float t, float *rgb)
+{
+    static const float coefficients[3][6] =
+    {
+        {0.13572138f, 4.61539260f, -42.66032258f, 132.13108234f, -152.94239396f, 59.28637943f},
+        {0.09140261f, 2.19418839f, 4.84296658f, -14.18503333f, 4.27729857f, 2.82956604f},
+        {0.10667330f, 12.64194608f, -60.58204836f, 110.36276771f, -89.90310912f, 27.34824973f},
+    };
+
+    for(int channel = 0; channel < 3; ++channel)
+    {
+        const float *c = coefficients[channel];
+        float value = c[0] + t * (c[1] + t * (c[2] + t * (c[3] + t * (c[4] + t * c[5]))));
+        rgb[channel] = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+    }
+}
+
+// Fills rgba with the COLORMAP_SIZE * 4 bytes of the table of kind.
+void colormap_build(colormap_kind kind, uint8_t *rgba)
+{
+    for(int i = 0; i < COLORMAP_SIZE; ++i)
+    {
+        float hue = ((float)i + 0.5f) / COLORMAP_SIZE;
+
+        // How far from the camera the hue is, 0 closest and 1 farthest.
+        float t = 1.0f - hue / COLORMAP_HUE_RANGE;
+        t = t < 0.0f ? 0.0f : t;
+
+        float rgb[3];
+        switch(kind)
+        {
+            case COLORMAP_TURBO:
+            {
+                colormap_turbo(t, rgb);
+                break;
+            }
+            case COLORMAP_GRAYSCALE:
+            {
+                rgb[0] = rgb[1] = rgb[2] = 1.0f - t;
+                break;
+            }
+            default:
+            {
+                colormap_hsv_to_rgb(hue, rgb);
+                break;
+            }
+        }
+
+        for(int channel = 0; channel < 3; ++channel)
+        {
+            rgba[i * 4 + channel] = (uint8_t)(rgb[channel] * 255.0f + 0.5f);
+        }
+        rgba[i * 4 + 3] = 255;
+    }
+}
@@ -0,0 +1,1048 @@
+// Where the depth frames come from. The visualizers only talk to a depth_source so they run the same against the
+// camera, a recording or a synthetic scene, which is what makes runs on machines without a camera reproducible.
+//
+// Every source hands out frames the way the receiver thread does: the images one after another, every one of them
+// Width * Height depth_samples with the rows in their proper order. A frame is 4 images, or 8 when the camera runs
+// sequences of two modulation frequencies (see Phase unwrapping below).
+//
+//   live                       The epc660 (default). Waits for the camera to connect.
+//   replay <recording> [fast]  A recording (recording.c) played in a loop, at the pace it was recorded at or with
+//                              'fast' every frame in order as fast as the visualizer takes them.
+//   replay <dump file>         The bytes exactly as the camera sends them (for example recorded with
+//                              'nc -l 10002 > dump'), played in a loop as fast as the visualizer takes them.
+//   synthetic [dual]           A generated scene with a sphere moving in front of a wall, with 'dual' in frames of
+//                              two modulation frequencies and the wall farther away than one of them can measure.
+//                              Above the wall nothing reflects the light, those pixels only have the offset.
+//
+// Any of them can be followed by 'record <recording> [rvl]' to write the frames that are handed out into a recording,
+// with 'rvl' compressed (rvl.c) to about a third of the size at the cost of decoding them again on replay, and by
+// 'calibration <file>' to use the lens parameters and modulation frequencies of a calibration file (see Calibration
+// below) instead of the nominal ones, by 'amplitude <threshold>' to drop the pixels whose modulation amplitude is lower
+// than that (see EPC660_MIN_AMPLITUDE), 0 keeps all of them, by 'temporal' to have the visualizers average the depth
+// over the last frames, see DEPTH_TEMPORAL_WEIGHT, and by 'filter' to have them filter the distances of a frame before
+// they compute the points, see DEPTH_FILTER_TOLERANCE.
+
+#include <math.h>
+#include <string.h>
+
+// What the visualizers assume about the camera. The samples of one quad take 4 bytes on the wire.
+#define EPC660_WIDTH 320
+#define EPC660_HEIGHT 240
+#define EPC660_IMAGE_SIZE (EPC660_WIDTH * EPC660_HEIGHT * 4)
+#define EPC660_MODULATION_FREQUENCY 12000000.0f
+#define EPC660_SECOND_MODULATION_FREQUENCY 8000000.0f // Of the sequences of two frequencies, unless calibrated.
+#define EPC660_FOCAL_LENGTH (50.0f * 3.7f) // pixels per mm * focal length [mm]
+
+// The amplitude of the modulated light a pixel received is sqrt((D3 - D1)^2 + (D2 - D0)^2) / 2 of its 4 samples, in the
+// units of the samples. Background, pixels too dark to measure and most of the noise stay below this by default, their
+// phase is meaningless and they are dropped before a point is made from them.
+#define EPC660_MIN_AMPLITUDE 20.0f
+#define SPEED_OF_LIGHT 300000000.0f
+
+// Newton iterations of UndistortPixel(), it usually converges in less than 5.
+#define CALIBRATION_UNDISTORT_ITERATIONS 20
+
+// The entries of phase_unwrapping.Offsets, which limits the ratios of the two modulation frequencies it can unwrap.
+#define PHASE_UNWRAP_MAX_OFFSETS 16
+
+// How far from a whole number of turns the phases of the two frequencies may disagree before the pixel is dropped.
+#define PHASE_UNWRAP_TOLERANCE 0.25f
+
+// The temporal filter of the visualizers, in the same pass as the points. Every pixel keeps the distance along its ray
+// of the last frame, its history, and moves it DEPTH_TEMPORAL_WEIGHT of the way to its new distance, which averages the
+// phase noise of a static scene over about 1 / DEPTH_TEMPORAL_WEIGHT frames. A new distance more than
+// DEPTH_TEMPORAL_TOLERANCE of it away from the history is something that moved (or a pixel that unwrapped to another
+// turn), the pixel starts over from it so moving surfaces do not leave a trail. A dropped pixel has no history. The
+// weight is a power of two so every visualizer computes the same average.
+#define DEPTH_TEMPORAL_WEIGHT 0.25f
+#define DEPTH_TEMPORAL_TOLERANCE 0.05f
+
+// The spatial filter of the visualizers, also in the same pass as the points and before the temporal filter. Of the 3x3
+// pixels around a pixel (itself included) those whose distance along the ray is at most DEPTH_FILTER_TOLERANCE of its
+// distance away are on its surface. With fewer than DEPTH_FILTER_MIN_NEIGHBORS others on it the pixel is a flying
+// pixel, a mix of the foreground and the background at an edge, and is dropped. The others get the mean distance of
+// the pixels on their surface, which smooths the phase noise without blurring the edges. Dropped pixels and those
+// outside of the image have no distance.
+#define DEPTH_FILTER_TOLERANCE 0.03f
+#define DEPTH_FILTER_MIN_NEIGHBORS 3
+
+typedef struct depth_source depth_source;
+
+// The camera model is a pinhole camera with the radial and tangential lens distortion of the Brown-Conrady model, the
+// parameters are the ones OpenCV's calibrateCamera() reports. Pixel coordinates have the center of the top left pixel
+// at (0, 0).
+typedef struct
+{
+    int Width; // Of one of the 4 images.
+    int Height;
+    float FocalLengthX; // In pixels.
+    float ModulationFrequency; // In Hz.
+
+    // Recordings made before the lens could be calibrated end here, see RecordingGetIntrinsics().
+    float FocalLengthY;
+    float PrincipalPointX; // In pixels.
+    float PrincipalPointY;
+    float K1, K2, K3; // Radial distortion.
+    float P1, P2; // Tangential distortion.
+
+    // Recordings made before there were frames of two modulation frequencies end here.
+    float SecondModulationFrequency; // In Hz, 0 when a frame only has the 4 images of ModulationFrequency.
+}
+depth_source_intrinsics;
+
+typedef struct
+{
+    bool (*Open)(depth_source *Source, int ArgumentCount, char **Arguments);
+    // Waits at most TimeoutInMilliseconds for a frame. Returns NULL if there is no new one since the last call.
+    depth_sample *(*NextFrame)(depth_source *Source, int TimeoutInMilliseconds);
+    void (*ReleaseFrame)(depth_source *Source, depth_sample *Frame);
+    void (*GetIntrinsics)(depth_source *Source, depth_source_intrinsics *Intrinsics);
+    void (*Close)(depth_source *Source);
+}
+depth_source_functions;
+
+struct depth_source
+{
+    const depth_source_functions *Functions;
+    const char *Name;
+    int Width;
+    int Height;
+    int PackedImageSize; // Bytes of one of the images.
+    int ImageCount; // Per frame, 4 or 8 for two modulation frequencies.
+    void *State;
+    recording_writer *Recording; // NULL when not recording.
+    depth_source_intrinsics Intrinsics; // Of the camera, nominal or from the calibration file.
+    bool Calibrated; // Whether there was a calibration file, it overrides the lens of a recording.
+    float SecondModulationFrequency; // In Hz, what the camera runs at in the frames of two modulation frequencies.
+    float MinAmplitude; // Pixels with less are dropped, see EPC660_MIN_AMPLITUDE.
+    bool Temporal; // The visualizers average the depth over time, see DEPTH_TEMPORAL_WEIGHT.
+    bool Filter; // The visualizers filter the distances of a frame, see DEPTH_FILTER_TOLERANCE.
+};
+
+// A frame stays valid until the next call of NextFrame().
+
+//
+// Calibration
+
+// What the visualizers assumed before the lens could be calibrated: the nominal focal length, the principal point in
+// the middle of the image and no distortion.
+static void GetNominalEPC660Intrinsics(depth_source_intrinsics *Intrinsics)
+{
+    memset(Intrinsics, 0, sizeof(depth_source_intrinsics));
+    Intrinsics->Width = EPC660_WIDTH;
+    Intrinsics->Height = EPC660_HEIGHT;
+    Intrinsics->FocalLengthX = EPC660_FOCAL_LENGTH;
+    Intrinsics->FocalLengthY = EPC660_FOCAL_LENGTH;
+    Intrinsics->PrincipalPointX = (float)(EPC660_WIDTH / 2);
+    Intrinsics->PrincipalPointY = (float)(EPC660_HEIGHT / 2);
+    Intrinsics->ModulationFrequency = EPC660_MODULATION_FREQUENCY;
+}
+
+// Reads the lens parameters from a calibration file with one 'name value' per line, the names are fx, fy, cx, cy, k1,
+// k2, k3, p1 and p2 like OpenCV calls them. f1 and f2 are the modulation frequencies in Hz the camera is set up for, f2
+// the second one of the frames of two frequencies. What the file leaves out keeps its value, '#' starts a comment.
+static bool LoadCalibration(const char *Path, depth_source_intrinsics *Intrinsics, float *SecondModulationFrequency)
+{
+    FILE *File = fopen(Path, "r");
+    if(NULL == File)
+    {
+        fprintf(stderr, "Could not open the calibration file %s.\n", Path);
+        return(false);
+    }
+
+    struct
+    {
+        const char *Name;
+        float *Value;
+    }
+    Parameters[] =
+    {
+        { "fx", &Intrinsics->FocalLengthX },
+        { "fy", &Intrinsics->FocalLengthY },
+        { "cx", &Intrinsics->PrincipalPointX },
+        { "cy", &Intrinsics->PrincipalPointY },
+        { "k1", &Intrinsics->K1 },
+        { "k2", &Intrinsics->K2 },
+        { "k3", &Intrinsics->K3 },
+        { "p1", &Intrinsics->P1 },
+        { "p2", &Intrinsics->P2 },
+        { "f1", &Intrinsics->ModulationFrequency },
+        { "f2", SecondModulationFrequency },
+    };
+    int ParameterCount = (int)(sizeof(Parameters) / sizeof(Parameters[0]));
+
+    bool Valid = true;
+    char Line[256];
+    for(int LineNumber = 1; Valid && fgets(Line, sizeof(Line), File); ++LineNumber)
+    {
+        char *Comment = strchr(Line, '#');
+        if(Comment)
+        {
+            *Comment = '\0';
+        }
+
+        char Name[32];
+        float Value;
+        int Fields = sscanf(Line, "%31s %f", Name, &Value);
+        if(Fields <= 0)
+        {
+            continue; // An empty line.
+        }
+
+        int Index = 0;
+        while(Index < ParameterCount && 0 != strcmp(Parameters[Index].Name, Name))
+        {
+            ++Index;
+        }
+
+        if(Fields != 2 || Index == ParameterCount)
+        {
+            fprintf(stderr, "%s:%d: Expected one of fx, fy, cx, cy, k1, k2, k3, p1, p2, f1 or f2 and its value.\n",
+                    Path, LineNumber);
+            Valid = false;
+        }
+        else
+        {
+            *Parameters[Index].Value = Value;
+        }
+    }
+    fclose(File);
+
+    if(Valid && !(Intrinsics->FocalLengthX > 0.0f && Intrinsics->FocalLengthY > 0.0f))
+    {
+        fprintf(stderr, "%s: The focal lengths have to be positive.\n", Path);
+        Valid = false;
+    }
+
+    if(Valid && !(Intrinsics->ModulationFrequency > 0.0f && *SecondModulationFrequency > 0.0f))
+    {
+        fprintf(stderr, "%s: The modulation frequencies have to be positive.\n", Path);
+        Valid = false;
+    }
+
+    return(Valid);
+}
+
+// The point on the plane z = 1 in front of the camera that pixel (i, j) sees. The lens model maps that point to the
+// pixel, it is inverted with Newton's method starting at the pixel without distortion. Returns false where it does not
+// converge to a hundredth of a pixel, which happens where the polynomial of a strong distortion folds over, in the
+// corners of the image.
+static bool UndistortPixel(const depth_source_intrinsics *Intrinsics, int i, int j, float *X, float *Y)
+{
+    double DistortedX = ((double)i - Intrinsics->PrincipalPointX) / Intrinsics->FocalLengthX;
+    double DistortedY = ((double)j - Intrinsics->PrincipalPointY) / Intrinsics->FocalLengthY;
+    double K1 = Intrinsics->K1, K2 = Intrinsics->K2, K3 = Intrinsics->K3;
+    double P1 = Intrinsics->P1, P2 = Intrinsics->P2;
+
+    double UndistortedX = DistortedX;
+    double UndistortedY = DistortedY;
+    double ErrorX = 0.0, ErrorY = 0.0;
+    for(int Iteration = 0; Iteration < CALIBRATION_UNDISTORT_ITERATIONS; ++Iteration)
+    {
+        double x = UndistortedX, y = UndistortedY;
+        double R2 = x * x + y * y;
+        double Radial = 1.0 + R2 * (K1 + R2 * (K2 + R2 * K3));
+        double RadialSlope = K1 + R2 * (2.0 * K2 + R2 * 3.0 * K3); // d Radial / d R2
+
+        ErrorX = x * Radial + 2.0 * P1 * x * y + P2 * (R2 + 2.0 * x * x) - DistortedX;
+        ErrorY = y * Radial + P1 * (R2 + 2.0 * y * y) + 2.0 * P2 * x * y - DistortedY;
+
+        // The Jacobian of the lens model.
+        double XX = Radial + 2.0 * x * x * RadialSlope + 2.0 * P1 * y + 6.0 * P2 * x;
+        double XY = 2.0 * x * y * RadialSlope + 2.0 * P1 * x + 2.0 * P2 * y;
+        double YY = Radial + 2.0 * y * y * RadialSlope + 6.0 * P1 * y + 2.0 * P2 * x;
+        double Determinant = XX * YY - XY * XY;
+        if(fabs(Determinant) < 1e-12)
+        {
+            break;
+        }
+
+        UndistortedX -= (YY * ErrorX - XY * ErrorY) / Determinant;
+        UndistortedY -= (XX * ErrorY - XY * ErrorX) / Determinant;
+    }
+
+    *X = (float)UndistortedX;
+    *Y = (float)UndistortedY;
+    return(fabs(ErrorX * Intrinsics->FocalLengthX) < 0.01 && fabs(ErrorY * Intrinsics->FocalLengthY) < 0.01);
+}
+
+// The direction of the ray through every pixel with a length of 1, z pointing away from the camera and y down the
+// image, so a point is its distance times the direction. This is all the visualizers need to know about the lens,
+// they compute it once and look it up per pixel. The pixels the lens model can not be inverted for get (0, 0, 0), their
+// points have a z of 0, which is never valid. Step is the distance between the pixels in floats, 1 for separate arrays
+// of X, Y and Z and 4 for an RGBA texture for example.
+void ComputePixelRays(const depth_source_intrinsics *Intrinsics, float *X, float *Y, float *Z, int Step)
+{
+    for(int j = 0, Index = 0; j < Intrinsics->Height; ++j)
+    {
+        for(int i = 0; i < Intrinsics->Width; ++i, Index += Step)
+        {
+            float RayX, RayY;
+            if(!UndistortPixel(Intrinsics, i, j, &RayX, &RayY))
+            {
+                X[Index] = Y[Index] = Z[Index] = 0.0f;
+                continue;
+            }
+
+            float Length = sqrtf(RayX * RayX + RayY * RayY + 1.0f);
+            X[Index] = RayX / Length;
+            Y[Index] = RayY / Length;
+            Z[Index] = 1.0f / Length;
+        }
+    }
+}
+
+//
+// Phase unwrapping
+
+// One modulation frequency f only measures the distance up to a multiple of its unambiguous range c / (2 f), 12.5 m at
+// the 12 MHz of the epc660. The camera can run sequences of two frequencies instead, 4 quads at each, which together
+// measure up to the range of their greatest common divisor: 37.5 m for 12 and 8 MHz.
+//
+// The frequencies are M0 and M1 times that divisor. A point at the fraction T of the range has the phases P0 and P1 (in
+// turns, from 0 to 1) M0 * T - N0 and M1 * T - N1, with N0 and N1 the whole turns that got lost. M1 * P0 - M0 * P1 is
+// then the whole number M0 * N1 - M1 * N0, which is different for every one of the M0 + M1 - 1 combinations of N0 and
+// N1 a T can have (the chinese remainder theorem), so rounding it and looking it up gives N0 and N1 back without a
+// search. Both phases are averaged with the weights their precision has:
+//
+//   T = (M0 * (P0 + N0) + M1 * (P1 + N1)) / (M0^2 + M1^2)
+//
+// Noise moves M1 * P0 - M0 * P1 away from the whole number, pixels where it is more than PHASE_UNWRAP_TOLERANCE away
+// are dropped since the frequencies disagree about them.
+typedef struct
+{
+    int FrequencyCount; // 1 or 2.
+    float Range; // The unambiguous range in meters, of both frequencies together for 2.
+    float DistancePerTurn; // Range for 1 frequency, Range / (M0^2 + M1^2) for 2.
+    int Multiple[2]; // M0 and M1.
+
+    // M0 * N0 + M1 * N1 for M1 * P0 - M0 * P1 rounded to K at K + M0 - 1, for the M0 + M1 - 1 values K can have.
+    float Offsets[PHASE_UNWRAP_MAX_OFFSETS];
+}
+phase_unwrapping;
+
+// How the distance is computed from the phases of the frames of a source with these intrinsics.
+void GetPhaseUnwrapping(const depth_source_intrinsics *Intrinsics, phase_unwrapping *Unwrap)
+{
+    memset(Unwrap, 0, sizeof(phase_unwrapping));
+    Unwrap->FrequencyCount = 1;
+    Unwrap->Range = SPEED_OF_LIGHT / (2.0f * Intrinsics->ModulationFrequency);
+    Unwrap->DistancePerTurn = Unwrap->Range;
+    Unwrap->Multiple[0] = 1;
+
+    if(Intrinsics->SecondModulationFrequency <= 0.0f)
+    {
+        return;
+    }
+
+    uint32_t Frequency0 = (uint32_t)(Intrinsics->ModulationFrequency + 0.5f);
+    uint32_t Frequency1 = (uint32_t)(Intrinsics->SecondModulationFrequency + 0.5f);
+    uint32_t Divisor = Frequency0, Remainder = Frequency1;
+    while(Remainder)
+    {
+        uint32_t Next = Divisor % Remainder;
+        Divisor = Remainder;
+        Remainder = Next;
+    }
+
+    int M0 = (int)(Frequency0 / Divisor);
+    int M1 = (int)(Frequency1 / Divisor);
+    if(M0 + M1 - 1 > PHASE_UNWRAP_MAX_OFFSETS)
+    {
+        fprintf(stderr, "The modulation frequencies %u and %u Hz are too far from a ratio of small numbers to unwrap "
+                "the phases, only the first one is used.\n", Frequency0, Frequency1);
+        return;
+    }
+
+    Unwrap->FrequencyCount = 2;
+    Unwrap->Range = SPEED_OF_LIGHT / (2.0f * (float)Divisor);
+    Unwrap->DistancePerTurn = Unwrap->Range / (float)(M0 * M0 + M1 * M1);
+    Unwrap->Multiple[0] = M0;
+    Unwrap->Multiple[1] = M1;
+
+    // Of the M0 * M1 combinations only the ones a T can have end up between -(M0 - 1) and M1 - 1.
+    for(int N0 = 0; N0 < M0; ++N0)
+    {
+        for(int N1 = 0; N1 < M1; ++N1)
+        {
+            int K = M0 * N1 - M1 * N0;
+            if(K > -M0 && K < M1)
+            {
+                Unwrap->Offsets[K + M0 - 1] = (float)(M0 * N0 + M1 * N1);
+            }
+        }
+    }
+}
+
+// Frames of two modulation frequencies are 8 images, the 4 of ModulationFrequency followed by the 4 of
+// SecondModulationFrequency.
+static void SetFrequencyCount(depth_source *Source, int FrequencyCount)
+{
+    Source->ImageCount = 4 * FrequencyCount;
+    Source->Intrinsics.SecondModulationFrequency = (FrequencyCount == 2) ? Source->SecondModulationFrequency : 0.0f;
+}
+
+// The frames of a camera or a dump have as many images as the header of their first quad says.
+static bool SetQuadsPerFrame(depth_source *Source, int QuadsPerFrame)
+{
+    if(QuadsPerFrame != 4 && QuadsPerFrame != 8)
+    {
+        fprintf(stderr, "The frames have %d quads, expected 4, or 8 for two modulation frequencies.\n", QuadsPerFrame);
+        return(false);
+    }
+
+    SetFrequencyCount(Source, QuadsPerFrame / 4);
+    return(true);
+}
+
+//
+// Live
+
+typedef struct
+{
+    connection Connection;
+    uint8_t *Slots;
+    depth_receiver *Receiver;
+}
+live_source;
+
+static bool LiveOpen(depth_source *Source, int ArgumentCount, char **Arguments)
+{
+    live_source *Live = (live_source *)calloc(1, sizeof(live_source));
+    Live->Connection.Host = INVALID_SOCKET;
+    Live->Connection.Client[0] = INVALID_SOCKET;
+
+    // A receive buffer that holds a few frames so the camera never has to wait for us. Busy polling is off, setting it
+    // to around 50 microseconds lowers the latency further but keeps a core spinning while waiting for data.
+    receive_settings ReceiveSettings = { 4 * 1024 * 1024, 0 };
+
+    // This will create a socket, bind it, listen and accept when a connection comes in.
+    if(0 != Connect(&Live->Connection, 1, &ReceiveSettings))
+    {
+        free(Live);
+        return(false);
+    }
+    printf("Connected!\n");
+
+    // The camera is set up for one or two modulation frequencies before it connects.
+    if(!SetQuadsPerFrame(Source, PeekQuadsPerFrame(Live->Connection.Client[0])))
+    {
+        Disconnect(Live->Connection.Host);
+        free(Live);
+        return(false);
+    }
+
+    // The receiver thread hands the frames over through a triple buffer so we need room for FRAME_SLOT_COUNT of them.
+    size_t FrameSize = Source->ImageCount * (size_t)Source->PackedImageSize;
+    Live->Slots = (uint8_t *)malloc(FrameSize * FRAME_SLOT_COUNT);
+    if(NULL == Live->Slots)
+    {
+        fprintf(stderr, "Not enough memory available to run this process.\n");
+        Disconnect(Live->Connection.Host);
+        free(Live);
+        return(false);
+    }
+
+    get_depth_image_data ThreadDataIn =
+    {
+        Live->Connection.Client[0],
+        Live->Slots,
+        FrameSize,
+        EPC660_IMAGE_SIZE,
+        EPC660_HEIGHT,
+        Source->ImageCount,
+        IngestBackend_IoUring // Falls back to reading the socket directly where io_uring is not available.
+    };
+
+    // Starts the "producer" thread that gets the data from the ToF-camera and puts it into one of the slots.
+    Live->Receiver = CreateReceiver(&ThreadDataIn, 1);
+    if(NULL == Live->Receiver)
+    {
+        free(Live->Slots);
+        Disconnect(Live->Connection.Host);
+        free(Live);
+        return(false);
+    }
+
+    Source->State = Live;
+    return(true);
+}
+
+static depth_sample *LiveNextFrame(depth_source *Source, int TimeoutInMilliseconds)
+{
+    live_source *Live = (live_source *)Source->State;
+    return((depth_sample *)WaitForNewestFrame(Live->Receiver, 0, TimeoutInMilliseconds));
+}
+
+static void LiveReleaseFrame(depth_source *Source, depth_sample *Frame)
+{
+    // The slot is handed back to the receiver thread by the next WaitForNewestFrame().
+}
+
+static void LiveClose(depth_source *Source)
+{
+    live_source *Live = (live_source *)Source->State;
+    TerminateReceiver(Live->Receiver);
+    free(Live->Slots);
+    Disconnect(Live->Connection.Host);
+    free(Live);
+}
+
+//
+// Synthetic
+
+// The scene is generated once when the source is opened. This many frames are played in a loop, one per call of
+// NextFrame(), so generating it does not show up in any timing.
+#define SYNTHETIC_FRAME_COUNT 30
+
+// The difference of the opposing images the phase is computed from, in 12 bit sample values.
+#define SYNTHETIC_AMPLITUDE 1000.0f
+
+typedef struct
+{
+    depth_sample *Frames;
+    int Next;
+}
+synthetic_source;
+
+// Where the wall is, in frames of one modulation frequency and of two.
+#define SYNTHETIC_WALL_DISTANCE 3.0f
+#define SYNTHETIC_FAR_WALL_DISTANCE 20.0f
+
+// How far the wall reaches above the camera, in meters.
+#define SYNTHETIC_WALL_HEIGHT 1.0f
+
+// The depth (distance along the optical axis) in meters of what the ray (X, Y, 1) hits first: a wall WallDistance away,
+// the floor 1 m below the camera or a sphere circling in front of the camera. 0 if it hits nothing, which is the case
+// above the wall, more than SYNTHETIC_WALL_HEIGHT above the camera.
+static float SyntheticTrace(float X, float Y, float Time, float WallDistance)
+{
+    float Z = (-Y * WallDistance > SYNTHETIC_WALL_HEIGHT) ? INFINITY : WallDistance;
+
+    if(Y > 0.0f && 1.0f / Y < Z)
+    {
+        Z = 1.0f / Y;
+    }
+
+    float Angle = 2.0f * 3.14159265f * Time;
+    float Center[3] = { 0.6f * sinf(Angle), 0.2f, 2.0f + 0.4f * cosf(Angle) };
+    float Radius = 0.35f;
+
+    // |t * (X, Y, 1) - Center|^2 = Radius^2
+    float A = X * X + Y * Y + 1.0f;
+    float B = X * Center[0] + Y * Center[1] + Center[2];
+    float C = Center[0] * Center[0] + Center[1] * Center[1] + Center[2] * Center[2] - Radius * Radius;
+    float Discriminant = B * B - A * C;
+    if(Discriminant >= 0.0f)
+    {
+        float T = (B - sqrtf(Discriminant)) / A;
+        if(T > 0.0f && T < Z)
+        {
+            Z = T;
+        }
+    }
+
+    return(Z < INFINITY ? Z : 0.0f);
+}
+
+static depth_sample SyntheticSample(float Value)
+{
+    return((depth_sample)((int)(2048.0f + Value + 0.5f) & DEPTH_SAMPLE_MASK));
+}
+
+// The inverse of what the visualizers compute: the 4 samples are chosen so that the phase of
+// atan2(d3 - d1, d2 - d0) + pi corresponds to the distance along the ray at the modulation frequency. Amplitude is
+// SYNTHETIC_AMPLITUDE or 0 where no light comes back.
+static void SyntheticPixel(depth_sample *Frame, int Index, int PixelCount, float Distance, float Amplitude, float Frequency)
+{
+    float Phase = Distance * (4.0f * 3.14159265f * Frequency / SPEED_OF_LIGHT) - 3.14159265f;
+    float HalfCosine = 0.5f * Amplitude * cosf(Phase);
+    float HalfSine = 0.5f * Amplitude * sinf(Phase);
+
+    Frame[Index + PixelCount * 0] = SyntheticSample(-HalfCosine);
+    Frame[Index + PixelCount * 1] = SyntheticSample(-HalfSine);
+    Frame[Index + PixelCount * 2] = SyntheticSample(HalfCosine);
+    Frame[Index + PixelCount * 3] = SyntheticSample(HalfSine);
+}
+
+static bool SyntheticOpen(depth_source *Source, int ArgumentCount, char **Arguments)
+{
+    bool Dual = (ArgumentCount > 0 && 0 == strcmp(Arguments[0], "dual"));
+    SetFrequencyCount(Source, Dual ? 2 : 1);
+    float WallDistance = Dual ? SYNTHETIC_FAR_WALL_DISTANCE : SYNTHETIC_WALL_DISTANCE;
+
+    int PixelCount = Source->Width * Source->Height;
+    size_t FrameSamples = (size_t)PixelCount * Source->ImageCount;
+    synthetic_source *Synthetic = (synthetic_source *)calloc(1, sizeof(synthetic_source));
+    Synthetic->Frames = (depth_sample *)malloc(FrameSamples * SYNTHETIC_FRAME_COUNT * sizeof(depth_sample));
+    if(NULL == Synthetic->Frames)
+    {
+        free(Synthetic);
+        return(false);
+    }
+
+    // The scene is seen through the lens of the calibration, so it comes out undistorted with the same calibration.
+    for(int j = 0; j < Source->Height; ++j)
+    {
+        for(int i = 0; i < Source->Width; ++i)
+        {
+            float X, Y;
+            bool Valid = UndistortPixel(&Source->Intrinsics, i, j, &X, &Y);
+            float Length = sqrtf(X * X + Y * Y + 1.0f);
+
+            for(int FrameIndex = 0; FrameIndex < SYNTHETIC_FRAME_COUNT; ++FrameIndex)
+            {
+                depth_sample *Frame = Synthetic->Frames + FrameIndex * FrameSamples;
+                float Time = (float)FrameIndex / (float)SYNTHETIC_FRAME_COUNT;
+                float Distance = Valid ? SyntheticTrace(X, Y, Time, WallDistance) * Length : 0.0f;
+                float Amplitude = (Distance > 0.0f) ? SYNTHETIC_AMPLITUDE : 0.0f;
+
+                int Index = j * Source->Width + i;
+                float Frequency = Source->Intrinsics.ModulationFrequency;
+                SyntheticPixel(Frame, Index, PixelCount, Distance, Amplitude, Frequency);
+                if(Dual)
+                {
+                    Frequency = Source->Intrinsics.SecondModulationFrequency;
+                    SyntheticPixel(Frame + 4 * PixelCount, Index, PixelCount, Distance, Amplitude, Frequency);
+                }
+            }
+        }
+    }
+
+    Source->State = Synthetic;
+    return(true);
+}
+
+static depth_sample *SyntheticNextFrame(depth_source *Source, int TimeoutInMilliseconds)
+{
+    synthetic_source *Synthetic = (synthetic_source *)Source->State;
+    size_t FrameSamples = (size_t)Source->Width * Source->Height * Source->ImageCount;
+    depth_sample *Frame = Synthetic->Frames + Synthetic->Next * FrameSamples;
+    Synthetic->Next = (Synthetic->Next + 1) % SYNTHETIC_FRAME_COUNT;
+    return(Frame);
+}
+
+static void SyntheticReleaseFrame(depth_source *Source, depth_sample *Frame)
+{
+}
+
+static void SyntheticClose(depth_source *Source)
+{
+    synthetic_source *Synthetic = (synthetic_source *)Source->State;
+    free(Synthetic->Frames);
+    free(Synthetic);
+}
+
+//
+// Replay
+
+// How much of the dump is read at a time.
+#define REPLAY_CHUNK_SIZE (64 * 1024)
+
+// The dump is run through the same state machine as the bytes from the socket (ConsumeBytes()), so it may end anywhere and
+// start with any quad of a frame. Like the socket it has to start at the beginning of a quad though.
+typedef struct
+{
+    FILE *File;
+    ingest_stream Stream;
+    uint8_t *Frame;
+    uint8_t *Chunk;
+    int ChunkFill;
+    int ChunkUsed;
+    bool FrameInPass; // Whether a frame was completed since the dump was last started over.
+}
+replay_source;
+
+static bool ReplayOpen(depth_source *Source, int ArgumentCount, char **Arguments)
+{
+    if(ArgumentCount < 1)
+    {
+        fprintf(stderr, "The replay source needs a dump file.\n");
+        return(false);
+    }
+
+    FILE *File = fopen(Arguments[0], "rb");
+    if(NULL == File)
+    {
+        fprintf(stderr, "Could not open the dump file %s.\n", Arguments[0]);
+        return(false);
+    }
+
+    // Like the camera the dump tells in the header of its first quad what a frame is.
+    uint8_t Header[QUAD_HEADER_SIZE];
+    size_t HeaderSize = fread(Header, 1, QUAD_HEADER_SIZE, File);
+    fseek(File, 0, SEEK_SET);
+    if(!SetQuadsPerFrame(Source, (HeaderSize == QUAD_HEADER_SIZE) ? GetQuadsPerFrame(Header + QUAD_PREAMBLE_SIZE) : 0))
+    {
+        fclose(File);
+        return(false);
+    }
+
+    replay_source *Replay = (replay_source *)calloc(1, sizeof(replay_source));
+    Replay->File = File;
+    Replay->Stream = CreateIngestStream(INVALID_SOCKET, EPC660_IMAGE_SIZE, EPC660_HEIGHT, Source->ImageCount,
+                                        IngestBackend_Socket);
+    Replay->Frame = (uint8_t *)malloc(Source->ImageCount * (size_t)Source->PackedImageSize);
+    Replay->Chunk = (uint8_t *)malloc(REPLAY_CHUNK_SIZE);
+    assert(Replay->Frame && Replay->Chunk);
+
+    Source->State = Replay;
+    return(true);
+}
+
+static depth_sample *ReplayNextFrame(depth_source *Source, int TimeoutInMilliseconds)
+{
+    replay_source *Replay = (replay_source *)Source->State;
+
+    while(1)
+    {
+        if(Replay->ChunkUsed == Replay->ChunkFill)
+        {
+            Replay->ChunkUsed = 0;
+            Replay->ChunkFill = (int)fread(Replay->Chunk, 1, REPLAY_CHUNK_SIZE, Replay->File);
+            if(Replay->ChunkFill == 0)
+            {
+                // A dump without a single complete frame in it.
+                if(!Replay->FrameInPass)
+                {
+                    return(NULL);
+                }
+
+                // Starting over. Whatever is left of an incomplete quad at the end is dropped.
+                fseek(Replay->File, 0, SEEK_SET);
+                Replay->Stream.State = IngestState_Header;
+                Replay->Stream.HeaderFill = 0;
+                Replay->FrameInPass = false;
+                continue;
+            }
+        }
+
+        int Consumed;
+        bool FrameDone = ConsumeBytes(&Replay->Stream, Replay->Frame, Replay->Chunk + Replay->ChunkUsed,
+                                      Replay->ChunkFill - Replay->ChunkUsed, &Consumed);
+        Replay->ChunkUsed += Consumed;
+
+        if(FrameDone)
+        {
+            Replay->FrameInPass = true;
+            return((depth_sample *)Replay->Frame);
+        }
+    }
+}
+
+static void ReplayReleaseFrame(depth_source *Source, depth_sample *Frame)
+{
+}
+
+static void ReplayClose(depth_source *Source)
+{
+    replay_source *Replay = (replay_source *)Source->State;
+    fclose(Replay->File);
+    free(Replay->Stream.Layout.DestinationRow);
+    free(Replay->Stream.Staging);
+    free(Replay->Frame);
+    free(Replay->Chunk);
+    free(Replay);
+}
+
+//
+// Recording
+
+// The camera, the dumps and the synthetic scene all deliver what the visualizers were written for, seen through the
+// lens of the calibration.
+static void GetEPC660Intrinsics(depth_source *Source, depth_source_intrinsics *Intrinsics)
+{
+    *Intrinsics = Source->Intrinsics;
+}
+
+static bool RecordingOpen(depth_source *Source, int ArgumentCount, char **Arguments)
+{
+    bool Paced = !(ArgumentCount > 1 && 0 == strcmp(Arguments[1], "fast"));
+
+    recording_player *Player = (recording_player *)calloc(1, sizeof(recording_player));
+    if(!recording_player_open(Player, Arguments[0], Paced))
+    {
+        free(Player);
+        return(false);
+    }
+
+    recording_header *Header = &Player->reader.header;
+    if(Header->device != recording_device_epc660 || Header->width != (uint32_t)Source->Width ||
+       Header->height != (uint32_t)Source->Height || (Header->image_count != 4 && Header->image_count != 8) ||
+       Header->sample_size != sizeof(depth_sample))
+    {
+        fprintf(stderr, "%s is not a recording of the epc660.\n", Arguments[0]);
+        recording_player_close(Player);
+        free(Player);
+        return(false);
+    }
+
+    Source->ImageCount = (int)Header->image_count;
+    Source->State = Player;
+    return(true);
+}
+
+// The frame is handed out straight from the mapped recording or from where the reader decoded it to, it must not be
+// written to.
+static depth_sample *RecordingNextFrame(depth_source *Source, int TimeoutInMilliseconds)
+{
+    recording_player *Player = (recording_player *)Source->State;
+    int64_t Next = recording_player_wait(Player, TimeoutInMilliseconds);
+    if(Next < 0)
+    {
+        return(NULL);
+    }
+
+    return((depth_sample *)recording_reader_get_frame(&Player->reader, (uint64_t)Next));
+}
+
+static void RecordingReleaseFrame(depth_source *Source, depth_sample *Frame)
+{
+}
+
+// The recording holds the depth_source_intrinsics of the source it was made from. What an older recording does not
+// have yet keeps the nominal values of the camera. A calibration file replaces the lens of the recording.
+static void RecordingGetIntrinsics(depth_source *Source, depth_source_intrinsics *Intrinsics)
+{
+    recording_player *Player = (recording_player *)Source->State;
+    GetNominalEPC660Intrinsics(Intrinsics);
+
+    size_t Size = Player->reader.header.intrinsics_size;
+    if(Size > sizeof(depth_source_intrinsics))
+    {
+        Size = sizeof(depth_source_intrinsics);
+    }
+    memcpy(Intrinsics, Player->reader.intrinsics, Size);
+
+    if(Source->Calibrated)
+    {
+        depth_source_intrinsics Recorded = *Intrinsics;
+        *Intrinsics = Source->Intrinsics;
+        Intrinsics->Width = Recorded.Width;
+        Intrinsics->Height = Recorded.Height;
+        Intrinsics->ModulationFrequency = Recorded.ModulationFrequency;
+        Intrinsics->SecondModulationFrequency = Recorded.SecondModulationFrequency;
+    }
+}
+
+static void RecordingClose(depth_source *Source)
+{
+    recording_player *Player = (recording_player *)Source->State;
+    recording_player_close(Player);
+    free(Player);
+}
+
+// Starts writing every frame that is handed out to the visualizer into a recording.
+static bool StartRecording(depth_source *Source, const char *Path, recording_encoding Encoding)
+{
+    depth_source_intrinsics Intrinsics;
+    Source->Functions->GetIntrinsics(Source, &Intrinsics);
+
+    recording_header Format = {0};
+    Format.device = recording_device_epc660;
+    Format.width = Source->Width;
+    Format.height = Source->Height;
+    Format.image_count = Source->ImageCount;
+    Format.sample_size = sizeof(depth_sample);
+    Format.encoding = Encoding;
+
+    Source->Recording = recording_writer_create(Path, &Format, &Intrinsics, sizeof(Intrinsics));
+    return(Source->Recording != NULL);
+}
+
+//
+// Interface
+
+static const depth_source_functions LiveSourceFunctions =
+{
+    LiveOpen, LiveNextFrame, LiveReleaseFrame, GetEPC660Intrinsics, LiveClose
+};
+
+static const depth_source_functions SyntheticSourceFunctions =
+{
+    SyntheticOpen, SyntheticNextFrame, SyntheticReleaseFrame, GetEPC660Intrinsics, SyntheticClose
+};
+
+static const depth_source_functions ReplaySourceFunctions =
+{
+    ReplayOpen, ReplayNextFrame, ReplayReleaseFrame, GetEPC660Intrinsics, ReplayClose
+};
+
+static const depth_source_functions RecordingSourceFunctions =
+{
+    RecordingOpen, RecordingNextFrame, RecordingReleaseFrame, RecordingGetIntrinsics, RecordingClose
+};
+
+// Picks the source from the command line, see the top of this file.
+bool OpenDepthSource(depth_source *Source, int ArgumentCount, char **Arguments)
+{
+    memset(Source, 0, sizeof(depth_source));
+
+    const char *RecordingPath = NULL;
+    const char *CalibrationPath = NULL;
+    float MinAmplitude = EPC660_MIN_AMPLITUDE;
+    bool Temporal = false;
+    bool Filter = false;
+    recording_encoding RecordingEncoding = recording_encoding_raw;
+    int SourceArgumentCount = ArgumentCount;
+    for(int i = 1; i < ArgumentCount; ++i)
+    {
+        if(0 == strcmp(Arguments[i], "record"))
+        {
+            if(i + 1 == ArgumentCount)
+            {
+                fprintf(stderr, "'record' needs the file to record to.\n");
+                return(false);
+            }
+            RecordingPath = Arguments[i + 1];
+            if(i + 2 < ArgumentCount && 0 == strcmp(Arguments[i + 2], "rvl"))
+            {
+                RecordingEncoding = recording_encoding_rvl;
+            }
+        }
+        else if(0 == strcmp(Arguments[i], "calibration"))
+        {
+            if(i + 1 == ArgumentCount)
+            {
+                fprintf(stderr, "'calibration' needs the calibration file.\n");
+                return(false);
+            }
+            CalibrationPath = Arguments[i + 1];
+        }
+        else if(0 == strcmp(Arguments[i], "amplitude"))
+        {
+            if(i + 1 == ArgumentCount)
+            {
+                fprintf(stderr, "'amplitude' needs the lowest amplitude a pixel may have.\n");
+                return(false);
+            }
+            char *End;
+            MinAmplitude = strtof(Arguments[i + 1], &End);
+            if(End == Arguments[i + 1] || *End != '\0' || !(MinAmplitude >= 0.0f))
+            {
+                fprintf(stderr, "'amplitude' needs a number that is 0 or more, '%s' is not.\n", Arguments[i + 1]);
+                return(false);
+            }
+        }
+        else if(0 == strcmp(Arguments[i], "temporal"))
+        {
+            // It has no file to skip.
+            Temporal = true;
+            SourceArgumentCount = (i < SourceArgumentCount) ? i : SourceArgumentCount;
+            continue;
+        }
+        else if(0 == strcmp(Arguments[i], "filter"))
+        {
+            Filter = true;
+            SourceArgumentCount = (i < SourceArgumentCount) ? i : SourceArgumentCount;
+            continue;
+        }
+        else
+        {
+            continue;
+        }
+
+        // Everything in front of the first of them is for the source. The file is skipped so it can have any name.
+        SourceArgumentCount = (i < SourceArgumentCount) ? i : SourceArgumentCount;
+        ++i;
+    }
+    ArgumentCount = SourceArgumentCount;
+
+    Source->Name = (ArgumentCount > 1) ? Arguments[1] : "live";
+    Source->Width = EPC660_WIDTH;
+    Source->Height = EPC660_HEIGHT;
+    Source->PackedImageSize = packed_image_size(EPC660_IMAGE_SIZE);
+    Source->MinAmplitude = MinAmplitude;
+    Source->Temporal = Temporal;
+    Source->Filter = Filter;
+
+    GetNominalEPC660Intrinsics(&Source->Intrinsics);
+    Source->SecondModulationFrequency = EPC660_SECOND_MODULATION_FREQUENCY;
+    SetFrequencyCount(Source, 1);
+    if(CalibrationPath)
+    {
+        if(!LoadCalibration(CalibrationPath, &Source->Intrinsics, &Source->SecondModulationFrequency))
+        {
+            return(false);
+        }
+        Source->Calibrated = true;
+    }
+
+    if(0 == strcmp(Source->Name, "live"))
+    {
+        Source->Functions = &LiveSourceFunctions;
+    }
+    else if(0 == strcmp(Source->Name, "synthetic"))
+    {
+        Source->Functions = &SyntheticSourceFunctions;
+    }
+    else if(0 == strcmp(Source->Name, "replay"))
+    {
+        // Anything that is not a recording is taken for a dump.
+        bool IsRecording = (ArgumentCount > 2 && recording_file_check(Arguments[2]));
+        Source->Functions = IsRecording ? &RecordingSourceFunctions : &ReplaySourceFunctions;
+    }
+    else
+    {
+        fprintf(stderr, "Unknown depth source '%s', expected live, replay or synthetic.\n", Source->Name);
+        return(false);
+    }
+
+    int Skip = (ArgumentCount > 1) ? 2 : 1;
+    if(!Source->Functions->Open(Source, ArgumentCount - Skip, Arguments + Skip))
+    {
+        return(false);
+    }
+
+    if(RecordingPath && !StartRecording(Source, RecordingPath, RecordingEncoding))
+    {
+        Source->Functions->Close(Source);
+        return(false);
+    }
+
+    return(true);
+}
+
+depth_sample *NextDepthFrame(depth_source *Source, int TimeoutInMilliseconds)
+{
+    depth_sample *Frame = Source->Functions->NextFrame(Source, TimeoutInMilliseconds);
+    if(Frame && Source->Recording)
+    {
+        recording_writer_push(Source->Recording, Frame, Source->ImageCount * (uint32_t)Source->PackedImageSize);
+    }
+    return(Frame);
+}
+
+void ReleaseDepthFrame(depth_source *Source, depth_sample *Frame)
+{
+    Source->Functions->ReleaseFrame(Source, Frame);
+}
+
+void GetDepthSourceIntrinsics(depth_source *Source, depth_source_intrinsics *Intrinsics)
+{
+    Source->Functions->GetIntrinsics(Source, Intrinsics);
+}
+
+void CloseDepthSource(depth_source *Source)
+{
+    if(Source->Recording)
+    {
+        recording_writer_close(Source->Recording);
+        Source->Recording = NULL;
+    }
+
+    Source->Functions->Close(Source);
+    Source->State = NULL;
+}
+
+// Only the camera delivers the images one after another. Returns NULL for the other sources, they only hand out
+// whole frames. While recording it returns NULL as well so every frame goes through NextDepthFrame().
+depth_receiver *GetDepthSourceReceiver(depth_source *Source)
+{
+    if(Source->Functions == &LiveSourceFunctions && !Source->Recording)
+    {
+        return(((live_source *)Source->State)->Receiver);
+    }
+
+    return(NULL);
+}
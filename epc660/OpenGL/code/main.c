@@ -1,3 +1,4 @@
+#define _CRT_SECURE_NO_WARNINGS
 #include <stdint.h>
 #include <stddef.h>
 #include <stdbool.h>
@@ -10,6 +11,10 @@
 //#include "testing.c"
 
 #include "network.c"
+#include "rvl.c"
+#include "recording.c"
+#include "depth_source.c"
+#include "colormap.c"
 #include "opengl_renderer.c"
 //#include "write_to_ply.c"
 
@@ -23,6 +28,13 @@ struct scroll_update {
 // NOTE: this has to be a global since we can only retrieve the scroll offset in the callback
 static struct scroll_update global_scroll_update;
 
+struct colormap_update {
+    colormap_kind kind;
+    int           updated;
+};
+// NOTE: set in the key callback, the renderer is only changed from the main loop
+static struct colormap_update global_colormap_update;
+
 void handle_input(GLFWwindow *window, view_control *control, float delta_time)
 {
     //
@@ -113,6 +125,16 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
     global_scroll_update.updated = 1;
 }
 
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+    // M switches to the next colormap, see colormap.c.
+    if(key == GLFW_KEY_M && action == GLFW_PRESS)
+    {
+        global_colormap_update.kind = (colormap_kind)((global_colormap_update.kind + 1) % COLORMAP_COUNT);
+        global_colormap_update.updated = 1;
+    }
+}
+
 void glfw_error_callback(int error, const char* description)
 {
     fprintf(stderr, "Error: %s\n", description);
@@ -150,48 +172,17 @@ static void PrintFPS(float DeltaTime)
     }
 }
 
-void to_proper_layout(uint8_t *depth_map, size_t depth_map_size, size_t single_image_size, int width, int height, uint8_t *scratch_memory)
-{
-    memcpy(scratch_memory, depth_map, depth_map_size);
-
-    size_t row_size = width * sizeof(int);
-
-    int k = 0;
-    for(int i = 0; i < 4; ++i)
-    {
-        uint8_t *scratch_image = scratch_memory + i * single_image_size;
-
-        // go through image by 2 rows starting at the end and going to 1
-        for(int j = height - 2; j >= 0; j -= 2)
-        {
-            uint8_t *scratch_row = scratch_image + j * row_size;
-            uint8_t *row = depth_map + k * row_size;
-
-            memcpy(row, scratch_row, row_size);
-
-            ++k;
-        }
-
-        // go through image by 2 rows starting at beginning going to end
-        for(int j = 1; j < height; j += 2)
-        {
-            uint8_t *scratch_row = scratch_image + j * row_size;
-            uint8_t *row = depth_map + k * row_size;
-
-            memcpy(row, scratch_row, row_size);
-        
-            ++k;
-        }
-    }
-}
-
 /*
-This program works in the following way: We accept the incomming connection from the epc660 camera.
-We then create a producer thread (CreateMyThread()) that runs along this main (consumer) thread 
-that will collect the depth data from the camera. The main thread will then process the depth data. 
-It will first call to_proper_layout() to lay out the memory linearly and then call 
-calculate_point_cloud() to calculate the point cloud from the 4 depth images according to the 
-formula given in the epc660 specification. Finally, the point cloud will be rendered.
+This program works in the following way: We accept the incomming connection from the epc660 camera
+(or play a recording or a synthetic scene instead, see depth_source.c).
+We then create a producer thread (CreateReceiver()) that runs along this main (consumer) thread 
+that will collect the depth data from the camera. One such thread can serve several cameras, it only 
+reads from a camera once its socket has data. The two threads hand the frames over through a triple 
+buffer so neither of them ever waits for the other. The producer thread already puts the rows of the 
+depth images (4, or 8 for two modulation frequencies) in their proper order and packs the samples to 16 bits while receiving them. The main thread will then process the newest 
+depth data. Every one of the depth images is uploaded to the GPU as soon as it arrived (upload_depth_quad())
+and once all of them are there combine_depth_quads() calculates the point cloud from them 
+according to the formula given in the epc660 specification. Finally, the point cloud will be rendered.
 
 This is how everything making use of OpenGL works: 
 point cloud from the depth image I'm using an OpenGL compute shader (a program that runs on the GPU &
@@ -209,7 +200,7 @@ matrix to transform the 3d view space to clip space. OpenGL will take this resul
 the transformations until we finally get screen pixel positions.
 */
 
-int main(void)
+int main(int ArgumentCount, char **Arguments)
 {    
     // Initializing windowing library that works for Linux and Windows.
     if(glfwInit())
@@ -228,53 +219,37 @@ int main(void)
             // Disable vsync.
             glfwSwapInterval(0);
             
-            // Setting up callback functions for mouse buttons and scroll wheel.
+            // Setting up callback functions for mouse buttons, scroll wheel and keys.
             glfwSetMouseButtonCallback(window, mouse_button_callback);
             glfwSetScrollCallback(window, scroll_callback);
+            glfwSetKeyCallback(window, key_callback);
             
-            connection Connection =
-            {
-                INVALID_SOCKET,
-                INVALID_SOCKET
-            };
+            // For the camera this will create a socket, bind it, listen and accept when a connection comes in. Then
+            // it starts the "producer" thread that gets the data from the ToF-camera.
+            depth_source Source_;
+            depth_source *Source = &Source_;
 
-            // This will create a socket, bind it, listen and accept when a connection comes in.
-            int Connected = Connect(&Connection);
-            if(0 == Connected)
+            if(OpenDepthSource(Source, ArgumentCount, Arguments))
             {
-                printf("Connected!\n");
-
-                uint32_t depth_map_width = 320;
-                uint32_t depth_map_height = 240;
-                uint32_t depth_image_size = 307200;
-
-                uint32_t depth_map_size = depth_image_size * 4;
-
-                // Allocating here now so we don't have to malloc and free every time in the main loop.
-                uint8_t *depth_map = (uint8_t *)malloc(depth_map_size);
-                if(NULL == depth_map)
-                {
-                    fprintf(stderr, "Not enough memory available to run this process.\n");
-                    exit(-1);
-                }
+                uint32_t depth_map_width = Source->Width;
+                uint32_t depth_map_height = Source->Height;
 
-                // Allocate memory to temporarily operate in when laying out memory properly.
-                uint8_t *scratch_memory = (uint8_t *)malloc(depth_map_size);
+                // The producer thread packs the 32 bit samples of the camera to 16 bits.
+                uint32_t packed_depth_image_size = Source->PackedImageSize;
 
-                // This all relevant data the thread functions needs. (Kinda like normal function parameters.)
-                get_depth_image_data ThreadDataIn = 
-                {
-                    Connection.Client,
-                    depth_map,
-                    depth_map_size,
-                    depth_image_size
-                };
+                // The direction of the ray through every pixel, from the calibration of the lens.
+                depth_source_intrinsics intrinsics;
+                GetDepthSourceIntrinsics(Source, &intrinsics);
+                float *rays = (float *)calloc(4 * (size_t)depth_map_width * depth_map_height, sizeof(float));
+                assert(rays);
+                ComputePixelRays(&intrinsics, rays + 0, rays + 1, rays + 2, 4);
 
-                // Starts a "producer" thread that gets the data from the ToF-camera and puts it into depth_map.
-                CreateMyThread(&ThreadDataIn);
+                phase_unwrapping unwrap;
+                GetPhaseUnwrapping(&intrinsics, &unwrap);
 
                 dimensions depth_image_dimensions = { depth_map_width, depth_map_height };
-                open_gl *opengl = opengl_init(depth_image_dimensions);
+                open_gl *opengl = opengl_init(depth_image_dimensions, rays, &unwrap, Source->MinAmplitude, Source->Temporal, Source->Filter);
+                free(rays);
                 
                 // view_control is a structure that gets modified in the handle_input() function and is then used to
                 // create / use the appropriate matrices later when rendering in render_point_cloud().
@@ -292,6 +267,13 @@ int main(void)
                 float point_size = 1.0f;
                 
                 float delta_time = 0.0f;
+
+                // With incremental set every depth image is uploaded as soon as it arrived instead of waiting for all of
+                // them, which takes most of the transfer time of a frame off the latency. Only the camera delivers
+                // them one after another.
+                depth_receiver *Receiver = GetDepthSourceReceiver(Source);
+                bool incremental = (Receiver != NULL);
+                quad_cursor cursor = {0};
                 
                 // Starting the main loop.
                 while(!glfwWindowShouldClose(window))
@@ -299,19 +281,47 @@ int main(void)
                     double frame_time_start = glfwGetTime();
                     
                     handle_input(window, control, delta_time);
+
+                    if(global_colormap_update.updated)
+                    {
+                        opengl_set_colormap(opengl, global_colormap_update.kind);
+                        printf("Colormap: %s\n", colormap_name(global_colormap_update.kind));
+                        global_colormap_update.updated = 0;
+                    }
                     
                     dimensions render_dimensions;
                     glfwGetFramebufferSize(window, (int *)&render_dimensions.w, (int *)&render_dimensions.h);
 
-                    // Here we are waiting for the producer thread to signal that the Buffer is full. We time out at 5ms which is ~200 Hz.
-                    if(WaitForOtherThread(5))
+                    if(incremental)
+                    {
+                        // Here we pick up every depth image as soon as the producer thread has it and upload it right away.
+                        // Only the compute shader has to wait for the last of the images. If there is nothing new yet we
+                        // wait but time out at 5ms which is ~200 Hz.
+                        uint8_t *depth_map;
+                        int new_quads = WaitForNewQuads(Receiver, 0, &cursor, 5, &depth_map);
+                        for(int quad = 0; quad < Source->ImageCount; ++quad)
+                        {
+                            if(new_quads & (1 << quad))
+                            {
+                                upload_depth_quad(opengl, depth_map + quad * packed_depth_image_size, quad);
+                            }
+                        }
+
+                        if(new_quads && FinishQuads(Receiver, 0, &cursor, new_quads))
+                        {
+                            combine_depth_quads(opengl);
+                        }
+                    }
+                    else
                     {
-                        // to_proper_layout() lays the depth data out in 4 consecutive images. Here we use the extra memory we allocated earlier.
-                        to_proper_layout(depth_map, depth_map_size, depth_image_size, depth_map_width, depth_map_height, scratch_memory);
-                        calculate_point_cloud(opengl, depth_map, depth_image_size);
-                        
-                        // Signal that the buffer was read so that the producer thread can start filling in the depth buffer.
-                        SignalOtherThread();
+                        // Here we pick up the newest frame the producer thread has finished. If there is none yet we wait for one
+                        // but time out at 5ms which is ~200 Hz. The producer keeps receiving into another slot in the meantime.
+                        depth_sample *depth_map = NextDepthFrame(Source, 5);
+                        if(depth_map)
+                        {
+                            calculate_point_cloud(opengl, (uint8_t *)depth_map, packed_depth_image_size);
+                            ReleaseDepthFrame(Source, depth_map);
+                        }
                     }
 
                     // Using OpenGL to draw to the screen.
@@ -326,20 +336,15 @@ int main(void)
                     PrintFPS(delta_time);
                 }
 
-                free(scratch_memory);
-                free(depth_map);
-
-                TerminateMyThread();
-
                 // I'm intentionally not freeing things religiously since they will get cleaned up by the operating system.
                 // And it would just slow down the closing process for no reason.
                 
-                // Close the connection.
-                Disconnect(Connection.Host);
+                // Stops the producer thread and closes the connection.
+                CloseDepthSource(Source);
             }
             else
             {
-                fprintf(stderr, "Could not create the connection.\n");
+                fprintf(stderr, "Could not open the depth source.\n");
             }
             
             glfwDestroyWindow(window);
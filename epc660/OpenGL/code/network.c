@@ -17,11 +17,17 @@ typedef SOCKADDR    sockaddr_t;
 #define close_socket(socket) closesocket(socket)
 #define get_last_error(X) WSAGetLastError()
 
-HANDLE EventBufferRead;
-HANDLE EventBufferFull;
-HANDLE EndThread;
-HANDLE ProducerThread;
-DWORD ThreadID;
+#define atomic_load_long(Pointer) InterlockedCompareExchange((volatile LONG *)(Pointer), 0, 0)
+#define atomic_exchange_long(Pointer, Value) InterlockedExchange((volatile LONG *)(Pointer), (Value))
+#define read_fence() MemoryBarrier()
+
+typedef WSABUF io_vector_t;
+
+#define io_vector_base(Vector) ((Vector).buf)
+#define io_vector_length(Vector) ((Vector).len)
+
+#define would_block() (WSAGetLastError() == WSAEWOULDBLOCK)
+#define interrupted() (WSAGetLastError() == WSAEINTR)
 
 #elif defined(__linux__)
 
@@ -29,13 +35,30 @@ DWORD ThreadID;
 // Linux
 
 #include <unistd.h>
+#include <stdlib.h>
 #include <errno.h>
 #include <time.h>
 #include <arpa/inet.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/epoll.h>
+#include <fcntl.h>
 #include <pthread.h>
 
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+// Multishot receives and provided buffer rings are needed, older kernel headers don't have them.
+#if defined(IORING_RECV_MULTISHOT) && defined(__NR_io_uring_setup)
+#define HAS_IO_URING 1
+#endif
+
 typedef int                socket_t;
 typedef struct in_addr     my_in_addr_t;
 typedef struct sockaddr_in sockaddr_in_t;
@@ -46,39 +69,243 @@ typedef struct sockaddr    sockaddr_t;
 #define get_last_error() errno
 #define INVALID_SOCKET -1
 
-pthread_t ProducerThread;
-pthread_mutex_t Mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t ProducerCond = PTHREAD_COND_INITIALIZER;
-pthread_cond_t ConsumerCond = PTHREAD_COND_INITIALIZER;
+#define atomic_load_long(Pointer) __atomic_load_n((Pointer), __ATOMIC_ACQUIRE)
+#define atomic_exchange_long(Pointer, Value) __atomic_exchange_n((Pointer), (Value), __ATOMIC_ACQ_REL)
+#define read_fence() __atomic_thread_fence(__ATOMIC_ACQUIRE)
 
-volatile int BufferFull = 0;
+typedef struct iovec io_vector_t;
+
+#define io_vector_base(Vector) ((Vector).iov_base)
+#define io_vector_length(Vector) ((Vector).iov_len)
+
+#define would_block() (errno == EAGAIN || errno == EWOULDBLOCK)
+#define interrupted() (errno == EINTR)
 
 #endif
 
 // Platform Agnostic
 
+#define MAX_CAMERA_COUNT 8
+
 typedef struct
 {
     socket_t Host;
-    socket_t Client;
+    socket_t Client[MAX_CAMERA_COUNT]; // In the order the cameras connected.
+    int ClientCount;
 } 
 connection;
 
+// The producer and the consumer never share a buffer: the frames are handed over through a triple buffer. The producer
+// always owns one slot (Back) it receives into, the consumer always owns one slot (Front) it processes, and the third
+// slot (Middle) holds the newest complete frame. Handing a slot over is a single atomic exchange of the middle index,
+// so neither thread ever has to wait for the other one to finish.
+#define FRAME_SLOT_COUNT 3
+#define FRAME_SLOT_FRESH 0x4 // Set in MiddleSlot when the frame in it has not been picked up by the consumer yet.
+
+typedef enum
+{
+    IngestBackend_Socket,  // Receives straight into the frame.
+    IngestBackend_IoUring  // Linux only, falls back to IngestBackend_Socket if the kernel does not support it.
+}
+ingest_backend;
+
+// The camera sends every sample as a 32 bit integer but only the lower 12 bits carry the phase. The frames that are
+// handed out hold them as 16 bit values that are already masked, which halves the memory, the copies and the upload.
+typedef uint16_t depth_sample;
+#define DEPTH_SAMPLE_MASK 0xFFF
+
+// The size of one quad as it is handed out for a quad of ImageSize bytes on the wire.
+#define packed_image_size(ImageSize) ((ImageSize) / 4 * (int)sizeof(depth_sample))
+
 typedef struct
 {
     socket_t ClientSocket;
-    uint8_t *Buffer;
-    size_t BufferSize;
-    int ImageSize;
+    uint8_t *Buffer; // FRAME_SLOT_COUNT consecutive slots of BufferSize bytes each.
+    size_t BufferSize; // QuadCount * packed_image_size(ImageSize)
+    int ImageSize; // Bytes per quad on the wire.
+    int ImageHeight;
+    int QuadCount; // Per frame, see GetQuadsPerFrame().
+    ingest_backend Backend;
 }
 get_depth_image_data;
 
-get_depth_image_data *ThreadData;
+// The camera does not send the rows of a quad in order. DestinationRow maps every received row to the row it belongs to
+// so the rows can be put in their final place while packing the samples.
+typedef struct
+{
+    int RowSize; // Bytes per row on the wire.
+    int RowCount;
+    int *DestinationRow;
+}
+quad_layout;
+
+// In front of every quad the camera sends 16 bytes we discard and 8 bytes of image data information.
+#define QUAD_PREAMBLE_SIZE 16
+#define QUAD_INFO_SIZE 8
+#define QUAD_HEADER_SIZE (QUAD_PREAMBLE_SIZE + QUAD_INFO_SIZE)
+
+// The quad counter of the camera has 4 bits but a frame is at most the 8 quads of two modulation frequencies.
+#define MAX_QUADS_PER_FRAME 8
+
+typedef struct
+{
+    int ReceiveBufferSize;    // SO_RCVBUF in bytes, 0 keeps the default of the system.
+    int BusyPollMicroseconds; // SO_BUSY_POLL, Linux only. 0 turns busy polling off.
+}
+receive_settings;
+
+typedef struct uring_ingest uring_ingest;
+
+#if defined(HAS_IO_URING)
+static uring_ingest *CreateUringIngest(socket_t Socket);
+#endif
+
+// GetDepthImage() is a small state machine over the byte stream so it does not matter how TCP splits it up. While the
+// rows of a quad are received the header of the next quad is asked for in the same call, so when the data is there a
+// whole frame takes about one receive call per quad.
+// The receiver announces every quad as soon as it is complete through one word so the consumer can start working on it
+// before the rest of the frame arrived. It holds a counter of the frames that were started (complete or not), which
+// frame slot they are received into and one bit per quad that is complete.
+#define QUAD_PROGRESS_ATTEMPT_MASK 0x1FFFFF
+#define QUAD_PROGRESS(Attempt, Slot, Quads) ((long)((((Attempt) & QUAD_PROGRESS_ATTEMPT_MASK) << 10) | ((Slot) << 8) | (Quads)))
+#define quad_progress_attempt(Progress) (((Progress) >> 10) & QUAD_PROGRESS_ATTEMPT_MASK)
+#define quad_progress_slot(Progress) (((Progress) >> 8) & 0x3)
+#define quad_progress_quads(Progress) ((Progress) & 0xFF)
+
+typedef enum
+{
+    IngestState_Header,
+    IngestState_Payload
+}
+ingest_state;
+
+typedef enum
+{
+    IngestResult_Pending,     // No complete frame yet, the stream has to be asked again once there is more data.
+    IngestResult_Frame,       // A frame was completed.
+    IngestResult_Disconnected // The camera closed the connection or it failed, the stream can't be used anymore.
+}
+ingest_result;
+
+typedef struct
+{
+    socket_t Socket;
+    quad_layout Layout;
+    int ImageSize;
+    int PackedImageSize;
+    int QuadCount; // Per frame, the quads with a higher counter are dropped.
+    uint8_t *Staging; // The quad that is being received, still as the camera sends it.
+
+    ingest_state State;
+    uint8_t Header[QUAD_HEADER_SIZE];
+    int HeaderFill;
+    int QuadCounter;
+    int QuadsFinished; // One bit per quad of the current frame that is completely in the buffer.
+    int PayloadLeft;
+
+    long FrameAttempt;
+    int ProgressSlot; // Set by the owner of the stream before handing in a buffer, ends up in QuadProgress.
+    volatile long QuadProgress;
+
+    io_vector_t Vectors[2]; // The rest of the quad and the header of the next quad.
+    io_vector_t *NextVector;
+    int VectorsLeft;
+
+    uring_ingest *Uring; // NULL when the socket is read directly.
+
+    uint64_t FramesReceived;
+    uint64_t IncompleteFrames; // Frames that were missing a quad and therefore not handed out.
 
-// Connect() will attempt to create a connection between this application and the camera via the socket(), bind(), listen(), accept()
-// functions.
-int Connect(connection *Connection)
+    // Only used for measuring.
+    uint64_t ReceiveCalls;
+}
+ingest_stream;
+
+bool GetDepthImage(ingest_stream *Stream, uint8_t *Buffer);
+
+// Everything that belongs to one camera: its stream and the frame slots it is handed over through.
+typedef struct
+{
+    get_depth_image_data Data;
+    ingest_stream Stream;
+
+    int BackSlot;  // Only touched by the receiver thread.
+    int FrontSlot; // Only touched by the consumer thread.
+    volatile long MiddleSlot;
+
+    uint64_t FramesPublished; // Only touched by the receiver thread.
+    uint64_t FramesTaken;     // Only touched by the consumer thread. FramesPublished - FramesTaken were never looked at.
+
+    socket_t PollHandle; // What the receiver thread currently waits on for this camera, see GetPollHandle().
+    volatile long Disconnected; // Set by the receiver thread once the connection is gone, nothing is waited for then.
+
+#if defined(_WIN32)
+    HANDLE FrameEvent;
+#elif defined(__linux__)
+    pthread_cond_t FrameCondition;
+#endif
+}
+frame_exchange;
+
+// One receiver thread serves all cameras. It waits until any of their sockets has data and only then reads from it, so
+// a slow camera never holds up the others.
+typedef struct
 {
+    frame_exchange *Cameras;
+    int CameraCount;
+
+#if defined(_WIN32)
+    HANDLE Thread;
+    HANDLE EndThread;
+    WSAPOLLFD *PollEntries;
+#elif defined(__linux__)
+    pthread_t Thread;
+    pthread_mutex_t Mutex;
+    int PollFile;
+#endif
+}
+depth_receiver;
+
+// Sets the size of the kernel receive buffer and busy polling for low latency. Failing to do so is not fatal, the
+// connection still works with the defaults of the system.
+int ApplyReceiveSettings(socket_t Socket, receive_settings *Settings)
+{
+    int Result = 0;
+
+    if(Settings->ReceiveBufferSize > 0)
+    {
+        int Size = Settings->ReceiveBufferSize;
+        if(0 != setsockopt(Socket, SOL_SOCKET, SO_RCVBUF, (const char *)&Size, sizeof(Size)))
+        {
+            fprintf(stderr, "Failed to set the receive buffer size. Error: %d\n", get_last_error());
+            Result = -1;
+        }
+    }
+
+    if(Settings->BusyPollMicroseconds > 0)
+    {
+#if defined(__linux__) && defined(SO_BUSY_POLL)
+        int Microseconds = Settings->BusyPollMicroseconds;
+        if(0 != setsockopt(Socket, SOL_SOCKET, SO_BUSY_POLL, &Microseconds, sizeof(Microseconds)))
+        {
+            fprintf(stderr, "Failed to turn on busy polling. Error: %d\n", get_last_error());
+            Result = -1;
+        }
+#else
+        fprintf(stderr, "Busy polling is not supported on this platform.\n");
+        Result = -1;
+#endif
+    }
+
+    return(Result);
+}
+
+// Connect() will attempt to create a connection between this application and the cameras via the socket(), bind(), listen(), accept()
+// functions. It returns once CameraCount cameras have connected.
+int Connect(connection *Connection, int CameraCount, receive_settings *Settings)
+{
+    assert(CameraCount > 0 && CameraCount <= MAX_CAMERA_COUNT);
+
     int Status = 0;	
     int Domain = AF_INET;
     int Protocol;
@@ -119,6 +346,12 @@ int Connect(connection *Connection)
         Service.sin_addr = InAddr;
         Service.sin_port = htons(10002);
         
+        // The accepted socket inherits these so they are already in effect during the handshake.
+        if(Settings)
+        {
+            ApplyReceiveSettings(Socket, Settings);
+        }
+
         Status = bind(Socket, (sockaddr_t *)&Service, sizeof(Service));
         if(0 != Status)
         {
@@ -126,21 +359,31 @@ int Connect(connection *Connection)
             return(-3);
         }
         
-        Status = listen(Socket, 1);
+        Status = listen(Socket, CameraCount);
         if(0 != Status)
         {
             fprintf(stderr, "'listen()' failed. Error: %d\n", get_last_error());
             return(-4);
         }
         
-        socket_t ConnectedSocket = accept(Socket, NULL, NULL);
-        if(!valid_socket(ConnectedSocket))
+        Connection->ClientCount = 0;
+        while(Connection->ClientCount < CameraCount)
         {
-            fprintf(stderr, "'accept()' failed. Error: %d\n", get_last_error());
-            return(-5);
-        }
+            sockaddr_in_t Peer = {0};
+            socklen_t PeerSize = sizeof(Peer);
+            socket_t ConnectedSocket = accept(Socket, (sockaddr_t *)&Peer, &PeerSize);
+            if(!valid_socket(ConnectedSocket))
+            {
+                fprintf(stderr, "'accept()' failed. Error: %d\n", get_last_error());
+                return(-5);
+            }
 
-        Connection->Client = ConnectedSocket;
+            char PeerName[INET_ADDRSTRLEN] = "?";
+            inet_ntop(Domain, &Peer.sin_addr, PeerName, sizeof(PeerName));
+            printf("Camera %d connected from %s.\n", Connection->ClientCount, PeerName);
+
+            Connection->Client[Connection->ClientCount++] = ConnectedSocket;
+        }
     }
     else
     {
@@ -185,80 +428,616 @@ void GetDepthImageInfo(socket_t ClientSocket, uint32_t *WidthOut, uint32_t *Heig
     if(DataSizeOut) *DataSizeOut = DataSize;
 }
 
-// This is the function that collects the data from the socket via the recv() function until it has 
-// all 4 depth images that are required to calculate the depth from.
-void GetDepthImage(socket_t ClientSocket, uint8_t *Buffer, size_t BufferSize, int ImageSize)
+// CreateQuadLayout() precomputes where every received row of a quad has to go. This only depends on the image size
+// so it is done once when the producer thread is created.
+quad_layout CreateQuadLayout(int ImageSize, int ImageHeight)
 {
-    int BytesReceived = 0;
-    
-    if(Buffer)
+    quad_layout Layout;
+    Layout.RowSize = ImageSize / ImageHeight;
+    Layout.RowCount = ImageHeight;
+    Layout.DestinationRow = (int *)malloc(ImageHeight * sizeof(int));
+    assert(Layout.DestinationRow);
+
+    int k = 0;
+
+    // The received rows 0, 2, 4, ... are the first half of the image but in reverse order.
+    for(int j = ImageHeight - 2; j >= 0; j -= 2)
     {
-        int AllBytesReceived = 0;
-        
-        while(1)
+        Layout.DestinationRow[j] = k++;
+    }
+
+    // The received rows 1, 3, 5, ... are the second half of the image.
+    for(int j = 1; j < ImageHeight; j += 2)
+    {
+        Layout.DestinationRow[j] = k++;
+    }
+
+    return(Layout);
+}
+
+// The capture mode in the information of every quad says what a frame is: its lower 3 bits are the quads per modulation
+// frequency and bit 3 is set when the camera runs a sequence of two frequencies. The quad counter then goes on through
+// the quads of the second frequency, so they end up behind the ones of the first.
+static int GetQuadsPerFrame(const uint8_t *ImageDataInformation)
+{
+    uint8_t CaptureMode = ImageDataInformation[2] >> 4;
+    int QuadCount = CaptureMode & 0x7;
+    return((CaptureMode & 0x8) ? 2 * QuadCount : QuadCount);
+}
+
+// What GetQuadsPerFrame() says about the first quad the camera sends. The header is only peeked at so it is still
+// received with the quad. Has to be called before anything was received and returns 0 if the connection is gone.
+int PeekQuadsPerFrame(socket_t Socket)
+{
+    uint8_t Header[QUAD_HEADER_SIZE];
+    int BytesReceived;
+
+#if defined(_WIN32)
+
+    // Peeking does not wait for all of the bytes here, the same ones come back until the rest arrived.
+    do
+    {
+        BytesReceived = recv(Socket, (char *)Header, QUAD_HEADER_SIZE, MSG_PEEK);
+        if(BytesReceived > 0 && BytesReceived < QUAD_HEADER_SIZE)
         {
-            int BytesReceivedTotal = 0;
-            
-            uint32_t Discard[4];
-            BytesReceived = recv(ClientSocket, (char *)Discard, 16, 0);
-            assert(BytesReceived == 16);
-            
-            uint8_t ImageDataInformation[8];
-            BytesReceived = recv(ClientSocket, (char *)ImageDataInformation, 8, 0);
-            assert(BytesReceived == 8);
-            
-            uint8_t CaptureMode = ImageDataInformation[2] >> 4;
-            uint8_t QuadCount = CaptureMode;
-            uint8_t QuadCounter = (ImageDataInformation[7] >> 4);
-            uint8_t MagicByte = ImageDataInformation[3];
-            assert(MagicByte == 0x4a);
-            
-            if(CaptureMode >= 8)
+            Sleep(1);
+        }
+    }
+    while(BytesReceived > 0 && BytesReceived < QUAD_HEADER_SIZE);
+
+#elif defined(__linux__)
+
+    BytesReceived = (int)recv(Socket, Header, QUAD_HEADER_SIZE, MSG_PEEK | MSG_WAITALL);
+
+#endif
+
+    return(BytesReceived == QUAD_HEADER_SIZE ? GetQuadsPerFrame(Header + QUAD_PREAMBLE_SIZE) : 0);
+}
+
+ingest_stream CreateIngestStream(socket_t Socket, int ImageSize, int ImageHeight, int QuadCount, ingest_backend Backend)
+{
+    ingest_stream Stream = {0};
+    Stream.Socket = Socket;
+    Stream.Layout = CreateQuadLayout(ImageSize, ImageHeight);
+    Stream.ImageSize = ImageSize;
+    Stream.PackedImageSize = packed_image_size(ImageSize);
+    Stream.QuadCount = QuadCount;
+    Stream.Staging = (uint8_t *)malloc(ImageSize);
+    Stream.State = IngestState_Header;
+    assert(Stream.Staging);
+
+    if(Backend == IngestBackend_IoUring)
+    {
+#if defined(HAS_IO_URING)
+        Stream.Uring = CreateUringIngest(Socket);
+#endif
+        if(!Stream.Uring)
+        {
+            fprintf(stderr, "io_uring is not available, receiving from the socket directly.\n");
+        }
+    }
+
+    return(Stream);
+}
+
+// Receives into several buffers with one system call. With MSG_WAITALL it only returns early if the call gets
+// interrupted. Returns the number of bytes received, 0 if the connection is gone or a negative value on errors.
+static int ReceiveVectors(ingest_stream *Stream, io_vector_t *Vectors, int VectorCount, int ReceiveFlags)
+{
+    ++Stream->ReceiveCalls;
+
+#if defined(_WIN32)
+
+    DWORD BytesReceived = 0;
+    DWORD Flags = ReceiveFlags;
+    int Result = WSARecv(Stream->Socket, Vectors, VectorCount, &BytesReceived, &Flags, NULL, NULL);
+    return(Result == 0 ? (int)BytesReceived : -1);
+
+#elif defined(__linux__)
+
+    struct msghdr Message = {0};
+    Message.msg_iov = Vectors;
+    Message.msg_iovlen = VectorCount;
+    return((int)recvmsg(Stream->Socket, &Message, ReceiveFlags));
+
+#endif
+}
+
+// Called once the header of a quad is complete. Points the vectors at the staging memory for the quad.
+static void BeginQuad(ingest_stream *Stream, uint8_t *Buffer)
+{
+    uint8_t *ImageDataInformation = Stream->Header + QUAD_PREAMBLE_SIZE;
+
+    uint8_t QuadCounter = (ImageDataInformation[7] >> 4);
+    uint8_t MagicByte = ImageDataInformation[3];
+    assert(MagicByte == 0x4a);
+    assert(QuadCounter < MAX_QUADS_PER_FRAME);
+
+    // A quad counter that does not go up starts a new frame, even if the previous one is missing quads. This has to be
+    // announced before anything of it is written to the buffer, see FinishQuads().
+    if(QuadCounter <= Stream->QuadCounter || Stream->FrameAttempt == 0)
+    {
+        Stream->QuadsFinished = 0;
+        ++Stream->FrameAttempt;
+        atomic_exchange_long(&Stream->QuadProgress, QUAD_PROGRESS(Stream->FrameAttempt, Stream->ProgressSlot, 0));
+    }
+
+    // The information is part of the first received row.
+    memcpy(Stream->Staging, ImageDataInformation, QUAD_INFO_SIZE);
+
+    io_vector_base(Stream->Vectors[0]) = (char *)(Stream->Staging + QUAD_INFO_SIZE);
+    io_vector_length(Stream->Vectors[0]) = Stream->ImageSize - QUAD_INFO_SIZE;
+    Stream->VectorsLeft = 1;
+
+    // The next quad of the same frame follows right away so we can wait for its header together with this quad. After
+    // the last quad we don't, otherwise the frame would only be finished once the next one starts coming in.
+    if(QuadCounter != Stream->QuadCount - 1)
+    {
+        io_vector_base(Stream->Vectors[1]) = (char *)Stream->Header;
+        io_vector_length(Stream->Vectors[1]) = QUAD_HEADER_SIZE;
+        ++Stream->VectorsLeft;
+    }
+
+    Stream->NextVector = Stream->Vectors;
+    Stream->QuadCounter = QuadCounter;
+    Stream->PayloadLeft = Stream->ImageSize - QUAD_INFO_SIZE;
+    Stream->HeaderFill = 0;
+    Stream->State = IngestState_Payload;
+}
+
+// Moves the vectors forward by the number of bytes that were just written into them. Vectors that are complete are
+// skipped and the partially filled one continues where it stopped.
+static void AdvanceVectors(ingest_stream *Stream, int Bytes)
+{
+    while(Stream->VectorsLeft > 0 && Bytes >= (int)io_vector_length(*Stream->NextVector))
+    {
+        Bytes -= (int)io_vector_length(*Stream->NextVector);
+        ++Stream->NextVector;
+        --Stream->VectorsLeft;
+    }
+
+    if(Stream->VectorsLeft > 0)
+    {
+        io_vector_base(*Stream->NextVector) = (char *)io_vector_base(*Stream->NextVector) + Bytes;
+        io_vector_length(*Stream->NextVector) -= Bytes;
+    }
+}
+
+// Converts the quad in the staging memory to depth_samples and puts the rows in their proper order on the way. This is
+// the only place that writes to the frame.
+static void PackQuad(ingest_stream *Stream, uint8_t *Buffer)
+{
+    quad_layout *Layout = &Stream->Layout;
+    int SampleCount = Layout->RowSize / (int)sizeof(uint32_t);
+    depth_sample *Image = (depth_sample *)(Buffer + Stream->QuadCounter * Stream->PackedImageSize);
+
+    for(int j = 0; j < Layout->RowCount; ++j)
+    {
+        uint32_t *Source = (uint32_t *)(Stream->Staging + j * Layout->RowSize);
+        depth_sample *Destination = Image + Layout->DestinationRow[j] * SampleCount;
+
+        for(int i = 0; i < SampleCount; ++i)
+        {
+            Destination[i] = (depth_sample)(Source[i] & DEPTH_SAMPLE_MASK);
+        }
+    }
+}
+
+// Accounts for payload bytes that arrived. Returns true if that finished the last quad of a frame.
+static bool FinishPayload(ingest_stream *Stream, uint8_t *Buffer, int Bytes)
+{
+    Stream->PayloadLeft -= Bytes;
+
+    if(Stream->PayloadLeft == 0)
+    {
+        Stream->State = IngestState_Header;
+
+        // A camera that sends more quads per frame than the buffer has room for (see GetQuadsPerFrame()) only gets
+        // the first ones of its frames handed out.
+        if(Stream->QuadCounter >= Stream->QuadCount)
+        {
+            return(false);
+        }
+
+        PackQuad(Stream, Buffer);
+
+        Stream->QuadsFinished |= 1 << Stream->QuadCounter;
+        atomic_exchange_long(&Stream->QuadProgress, QUAD_PROGRESS(Stream->FrameAttempt, Stream->ProgressSlot, Stream->QuadsFinished));
+
+        if(Stream->QuadCounter == Stream->QuadCount - 1)
+        {
+            // Only frames for which all quads arrived are handed out. The first one after connecting for example can
+            // start in the middle. An incomplete frame simply gets overwritten by the next one.
+            if(Stream->QuadsFinished == (1 << Stream->QuadCount) - 1)
+            {
+                ++Stream->FramesReceived;
+                return(true);
+            }
+
+            ++Stream->IncompleteFrames;
+        }
+    }
+
+    return(false);
+}
+
+// Runs bytes that were already received into memory through the state machine. Stops at the end of a frame and
+// returns true, *Consumed tells how many of the bytes were used up to that point.
+static bool ConsumeBytes(ingest_stream *Stream, uint8_t *Buffer, const uint8_t *Data, int Size, int *Consumed)
+{
+    int Used = 0;
+    bool FrameDone = false;
+
+    while(Used < Size && !FrameDone)
+    {
+        if(Stream->State == IngestState_Header)
+        {
+            int Count = QUAD_HEADER_SIZE - Stream->HeaderFill;
+            if(Count > Size - Used)
             {
-                QuadCount = CaptureMode - 8;
+                Count = Size - Used;
             }
-            
-            char *Pointer = (char *)(Buffer + QuadCounter * ImageSize);
-            
-            memcpy(Pointer, ImageDataInformation, 8);
-            Pointer += 8;
-            
-            do
+
+            memcpy(Stream->Header + Stream->HeaderFill, Data + Used, Count);
+            Stream->HeaderFill += Count;
+            Used += Count;
+
+            if(Stream->HeaderFill == QUAD_HEADER_SIZE)
             {
-                BytesReceived = recv(ClientSocket, Pointer, ImageSize - BytesReceivedTotal - 8, 0);
-                
-                Pointer += BytesReceived;
-                BytesReceivedTotal += BytesReceived;
-                AllBytesReceived += BytesReceived;
+                BeginQuad(Stream, Buffer);
             }
-            while(BytesReceivedTotal != ImageSize - 8);
-            
-            if(QuadCounter == 3)
-                break;
+        }
+        else
+        {
+            // Only the payload is copied here, the vector for the next header is just for the socket path.
+            int Count = Stream->PayloadLeft;
+            if(Count > Size - Used)
+            {
+                Count = Size - Used;
+            }
+
+            int Copied = 0;
+            while(Copied < Count)
+            {
+                int Length = (int)io_vector_length(*Stream->NextVector);
+                if(Length > Count - Copied)
+                {
+                    Length = Count - Copied;
+                }
+
+                memcpy(io_vector_base(*Stream->NextVector), Data + Used + Copied, Length);
+                AdvanceVectors(Stream, Length);
+                Copied += Length;
+            }
+
+            Used += Count;
+            FrameDone = FinishPayload(Stream, Buffer, Count);
         }
     }
+
+    *Consumed = Used;
+    return(FrameDone);
 }
 
-// ThreadProc is the function that will be run by the producer thread. It will start collecting the depth data and when 
-// it has all the data it will signal the other thread and then waits until the other thread has processed the data fully.
+#if defined(HAS_IO_URING)
+#include "uring_ingest.c"
+#endif
+
+// Tells a receive that failed because there is no data for now apart from one that lost the connection. The latter is
+// reported and there is no way back from it.
+static ingest_result ReceiveFailed(int BytesReceived, bool Block)
+{
+    if(BytesReceived < 0 && !Block && would_block())
+    {
+        return(IngestResult_Pending);
+    }
+
+    if(BytesReceived == 0)
+    {
+        fprintf(stderr, "The camera closed the connection.\n");
+    }
+    else
+    {
+        fprintf(stderr, "Failed to receive the depth image. Error: %d\n", get_last_error());
+    }
+
+    return(IngestResult_Disconnected);
+}
+
+// Runs the socket path of the state machine. With Block set it only returns once a frame is complete. Otherwise the
+// socket has to be non-blocking and it returns IngestResult_Pending as soon as there is no more data.
+static ingest_result ReceiveDepthImage(ingest_stream *Stream, uint8_t *Buffer, bool Block)
+{
+    int Flags = Block ? MSG_WAITALL : 0;
+
+    while(1)
+    {
+        if(Stream->State == IngestState_Header)
+        {
+            if(Stream->HeaderFill < QUAD_HEADER_SIZE)
+            {
+                io_vector_t Vector;
+                io_vector_base(Vector) = (char *)(Stream->Header + Stream->HeaderFill);
+                io_vector_length(Vector) = QUAD_HEADER_SIZE - Stream->HeaderFill;
+
+                int BytesReceived = ReceiveVectors(Stream, &Vector, 1, Flags);
+                if(BytesReceived <= 0)
+                {
+                    if(BytesReceived < 0 && interrupted())
+                    {
+                        continue;
+                    }
+
+                    return(ReceiveFailed(BytesReceived, Block));
+                }
+
+                Stream->HeaderFill += BytesReceived;
+            }
+            else
+            {
+                BeginQuad(Stream, Buffer);
+            }
+        }
+        else
+        {
+            int BytesReceived = ReceiveVectors(Stream, Stream->NextVector, Stream->VectorsLeft, Flags);
+            if(BytesReceived <= 0)
+            {
+                if(BytesReceived < 0 && interrupted())
+                {
+                    continue;
+                }
+
+                return(ReceiveFailed(BytesReceived, Block));
+            }
+
+            AdvanceVectors(Stream, BytesReceived);
+
+            // Whatever goes beyond the payload went into the header of the next quad.
+            int PayloadBytes = BytesReceived;
+            if(PayloadBytes > Stream->PayloadLeft)
+            {
+                PayloadBytes = Stream->PayloadLeft;
+                Stream->HeaderFill = BytesReceived - Stream->PayloadLeft;
+            }
+
+            if(FinishPayload(Stream, Buffer, PayloadBytes))
+            {
+                return(IngestResult_Frame);
+            }
+
+            // Give the caller the chance to hand out the quad right away.
+            if(!Block && Stream->State == IngestState_Header)
+            {
+                return(IngestResult_Pending);
+            }
+        }
+    }
+}
+
+// This is the function that collects the data from the socket until it has all depth images (4, or 8 for two modulation
+// frequencies) that are required to calculate the depth from. Every quad is packed to depth_samples with its rows in their final place as soon as it is
+// complete so the images are laid out linearly. Returns false if the connection is gone.
+bool GetDepthImage(ingest_stream *Stream, uint8_t *Buffer)
+{
+    if(Buffer)
+    {
+#if defined(HAS_IO_URING)
+        if(Stream->Uring)
+        {
+            return(GetDepthImageUring(Stream, Buffer, true) == IngestResult_Frame);
+        }
+#endif
+
+        return(ReceiveDepthImage(Stream, Buffer, true) == IngestResult_Frame);
+    }
+
+    return(false);
+}
+
+// The same as GetDepthImage() but it never waits. It returns IngestResult_Frame if that completed a frame and
+// IngestResult_Pending once there is no more data for now or after a quad was completed. This is what the receiver
+// thread uses to serve several cameras.
+ingest_result PollDepthImage(ingest_stream *Stream, uint8_t *Buffer)
+{
+#if defined(HAS_IO_URING)
+    if(Stream->Uring)
+    {
+        return(GetDepthImageUring(Stream, Buffer, false));
+    }
+#endif
+
+    return(ReceiveDepthImage(Stream, Buffer, false));
+}
+
+// What the receiver thread has to wait on to know that PollDepthImage() has something to do.
+static socket_t GetPollHandle(ingest_stream *Stream)
+{
+#if defined(HAS_IO_URING)
+    if(Stream->Uring)
+    {
+        return(Stream->Uring->RingFile);
+    }
+#endif
+
+    return(Stream->Socket);
+}
+
+static void SetNonBlocking(socket_t Socket)
+{
+#if defined(_WIN32)
+
+    u_long NonBlocking = 1;
+    ioctlsocket(Socket, FIONBIO, &NonBlocking);
+
+#elif defined(__linux__)
+
+    fcntl(Socket, F_SETFL, fcntl(Socket, F_GETFL, 0) | O_NONBLOCK);
+
+#endif
+}
+
+// PublishFrame() hands the slot the receiver just filled to the consumer and gives the receiver the slot that was in
+// the middle before. If the consumer did not pick up the previous frame in time that frame is simply overwritten.
+static void PublishFrame(frame_exchange *Camera)
+{
+    long Previous = atomic_exchange_long(&Camera->MiddleSlot, Camera->BackSlot | FRAME_SLOT_FRESH);
+    Camera->BackSlot = (int)(Previous & ~FRAME_SLOT_FRESH);
+    ++Camera->FramesPublished;
+}
+
+static uint8_t *GetSlotMemory(frame_exchange *Camera, int Slot)
+{
+    return(Camera->Data.Buffer + Slot * Camera->Data.BufferSize);
+}
+
+// Tells the receiver thread what to wait on for the camera. This changes if a camera falls back from io_uring to its
+// socket, the ring is closed then and drops out of the poll set by itself. Returns false if that is not possible.
+static bool WatchCamera(depth_receiver *Receiver, frame_exchange *Camera)
+{
+    Camera->PollHandle = GetPollHandle(&Camera->Stream);
+
+#if defined(_WIN32)
+
+    WSAPOLLFD *Entry = &Receiver->PollEntries[Camera - Receiver->Cameras];
+    Entry->fd = Camera->PollHandle;
+    Entry->events = POLLRDNORM;
+
+#elif defined(__linux__)
+
+    struct epoll_event Event = {0};
+    Event.events = EPOLLIN;
+    Event.data.ptr = Camera;
+    if(0 != epoll_ctl(Receiver->PollFile, EPOLL_CTL_ADD, Camera->PollHandle, &Event))
+    {
+        fprintf(stderr, "Failed to wait for camera %d. Error: %d\n", (int)(Camera - Receiver->Cameras), get_last_error());
+        return(false);
+    }
+
+#endif
+
+    return(true);
+}
+
+// Wakes up the consumer of the camera if it waits in WaitForNewestFrame() or WaitForNewQuads().
+static void WakeConsumer(depth_receiver *Receiver, frame_exchange *Camera)
+{
+#if defined(_WIN32)
+
+    SetEvent(Camera->FrameEvent);
+
+#elif defined(__linux__)
+
+    // The mutex is only held for the signal itself so a consumer that is just about to go to sleep cannot miss the wake
+    // up. The frame itself was already handed over without any lock.
+    pthread_mutex_lock(&Receiver->Mutex);
+    pthread_cond_signal(&Camera->FrameCondition);
+    pthread_mutex_unlock(&Receiver->Mutex);
+
+#endif
+}
+
+// Takes a camera whose connection is gone out of the poll set and closes its socket, the other cameras are served as
+// before. Its consumer is woken up so it stops waiting for frames that never come.
+static void DropCamera(depth_receiver *Receiver, frame_exchange *Camera)
+{
+    int CameraIndex = (int)(Camera - Receiver->Cameras);
+    ingest_stream *Stream = &Camera->Stream;
+
+#if defined(_WIN32)
+
+    // WSAPoll() skips entries with a negative socket.
+    Receiver->PollEntries[CameraIndex].fd = INVALID_SOCKET;
+
+#elif defined(__linux__)
+
+    epoll_ctl(Receiver->PollFile, EPOLL_CTL_DEL, Camera->PollHandle, NULL);
+
+#endif
+
+#if defined(HAS_IO_URING)
+    if(Stream->Uring)
+    {
+        DestroyUringIngest(Stream->Uring);
+        Stream->Uring = NULL;
+    }
+#endif
+
+    close_socket(Stream->Socket);
+    Stream->Socket = INVALID_SOCKET;
+    Camera->PollHandle = INVALID_SOCKET;
+    printf("Camera %d disconnected.\n", CameraIndex);
+
+    atomic_exchange_long(&Camera->Disconnected, 1);
+    WakeConsumer(Receiver, Camera);
+}
+
+// Receives whatever one camera has sent so far and publishes every frame that got completed on the way. The consumer
+// is also woken up for single quads in case it processes them as they come in.
+static void ServiceCamera(depth_receiver *Receiver, frame_exchange *Camera)
+{
+    ingest_stream *Stream = &Camera->Stream;
+    long Progress = Stream->QuadProgress;
+
+    while(1)
+    {
+        Stream->ProgressSlot = Camera->BackSlot;
+        ingest_result Result = PollDepthImage(Stream, GetSlotMemory(Camera, Camera->BackSlot));
+        if(Result == IngestResult_Disconnected)
+        {
+            DropCamera(Receiver, Camera);
+            return;
+        }
+
+        if(Result == IngestResult_Frame)
+        {
+            PublishFrame(Camera);
+        }
+        else if(Progress == Stream->QuadProgress)
+        {
+            break;
+        }
+        Progress = Stream->QuadProgress;
+
+        WakeConsumer(Receiver, Camera);
+    }
+
+    if(Camera->PollHandle != GetPollHandle(&Camera->Stream) && !WatchCamera(Receiver, Camera))
+    {
+        DropCamera(Receiver, Camera);
+    }
+}
+
+// ThreadProc is the function that will be run by the receiver thread. It waits until any of the cameras has sent
+// something, collects it and publishes the frames that are complete. It never waits for the consumer.
 #if defined(_WIN32)
 DWORD WINAPI ThreadProc(LPVOID Param)
 {
-    get_depth_image_data *DepthImageData = (get_depth_image_data *)Param;
+    depth_receiver *Receiver = (depth_receiver *)Param;
 
     while(1)
     {
-        DWORD WaitResult = WaitForSingleObject(EndThread, 0);
+        DWORD WaitResult = WaitForSingleObject(Receiver->EndThread, 0);
         if(WaitResult == WAIT_OBJECT_0)
         {
             break;
         }
 
-        WaitForSingleObject(EventBufferRead, INFINITE);
+        // WSAPoll() can't wait for the event as well so it times out regularly to check for it.
+        int ReadyCount = WSAPoll(Receiver->PollEntries, Receiver->CameraCount, 100);
+        if(ReadyCount < 0)
         {
-            GetDepthImage(DepthImageData->ClientSocket, DepthImageData->Buffer, DepthImageData->BufferSize, DepthImageData->ImageSize);
+            // It does not wait when all cameras are gone.
+            Sleep(100);
+        }
+
+        for(int CameraIndex = 0; CameraIndex < Receiver->CameraCount && ReadyCount > 0; ++CameraIndex)
+        {
+            if(Receiver->PollEntries[CameraIndex].revents)
+            {
+                ServiceCamera(Receiver, &Receiver->Cameras[CameraIndex]);
+            }
         }
-        SetEvent(EventBufferFull);
     }
 
     return(0);
@@ -268,115 +1047,331 @@ DWORD WINAPI ThreadProc(LPVOID Param)
 #if defined(__linux__)
 void *ThreadProc(void *Param)
 {
-    get_depth_image_data *DepthImageData = (get_depth_image_data *)Param;
+    depth_receiver *Receiver = (depth_receiver *)Param;
+
+    // io_uring cameras only become ready once their receive is armed, which the first call does.
+    for(int CameraIndex = 0; CameraIndex < Receiver->CameraCount; ++CameraIndex)
+    {
+        ServiceCamera(Receiver, &Receiver->Cameras[CameraIndex]);
+    }
 
+    struct epoll_event Events[MAX_CAMERA_COUNT];
     while(1)
     {
-        pthread_mutex_lock(&Mutex);
+        int ReadyCount = epoll_wait(Receiver->PollFile, Events, MAX_CAMERA_COUNT, -1);
+        for(int EventIndex = 0; EventIndex < ReadyCount; ++EventIndex)
         {
-            while(BufferFull)
-            {
-                pthread_cond_wait(&ProducerCond, &Mutex);
-            }
-
-            GetDepthImage(DepthImageData->ClientSocket, DepthImageData->Buffer, DepthImageData->BufferSize, DepthImageData->ImageSize);
-            BufferFull = 1;
-            
+            ServiceCamera(Receiver, (frame_exchange *)Events[EventIndex].data.ptr);
         }
-        pthread_mutex_unlock(&Mutex);
-
-        pthread_cond_signal(&ConsumerCond);
     }
 
     return(NULL);
 }
 #endif
 
-// This creates the thread and other required things for running this producer consumer thread model.
-void CreateMyThread(get_depth_image_data *ThreadDataIn)
+// Frees everything CreateReceiver() set up, the receiver thread must not run anymore. The frame slots and the sockets of
+// the cameras that are still connected belong to the caller.
+static void FreeReceiver(depth_receiver *Receiver)
 {
+    for(int CameraIndex = 0; CameraIndex < Receiver->CameraCount; ++CameraIndex)
+    {
+        frame_exchange *Camera = &Receiver->Cameras[CameraIndex];
+        ingest_stream *Stream = &Camera->Stream;
+
+#if defined(HAS_IO_URING)
+        if(Stream->Uring)
+        {
+            DestroyUringIngest(Stream->Uring);
+        }
+#endif
+
+        free(Stream->Layout.DestinationRow);
+        free(Stream->Staging);
+
+#if defined(_WIN32)
+
+        CloseHandle(Camera->FrameEvent);
+
+#elif defined(__linux__)
+
+        pthread_cond_destroy(&Camera->FrameCondition);
+
+#endif
+    }
+
 #if defined(_WIN32)
 
-    EventBufferRead = CreateEvent(NULL, FALSE, TRUE, "EventBufferRead");
-    EventBufferFull = CreateEvent(NULL, FALSE, FALSE, "EventBufferFull");
-    EndThread = CreateEvent(NULL, FALSE, FALSE, "EndThread");
+    if(Receiver->Thread)
+    {
+        CloseHandle(Receiver->Thread);
+    }
+    CloseHandle(Receiver->EndThread);
+    free(Receiver->PollEntries);
+
+#elif defined(__linux__)
+
+    close(Receiver->PollFile);
+    pthread_mutex_destroy(&Receiver->Mutex);
+
+#endif
+
+    free(Receiver->Cameras);
+    free(Receiver);
+}
+
+// This creates the receiver thread and everything it shares with the consumer for CameraCount cameras.
+// Cameras[i].Buffer has to point to FRAME_SLOT_COUNT * Cameras[i].BufferSize bytes. Returns NULL if the cameras can't
+// be waited for.
+depth_receiver *CreateReceiver(get_depth_image_data *Cameras, int CameraCount)
+{
+    assert(CameraCount > 0 && CameraCount <= MAX_CAMERA_COUNT);
+
+    depth_receiver *Receiver = (depth_receiver *)calloc(1, sizeof(depth_receiver));
+    Receiver->Cameras = (frame_exchange *)calloc(CameraCount, sizeof(frame_exchange));
+    Receiver->CameraCount = CameraCount;
+    assert(Receiver->Cameras);
+
+#if defined(_WIN32)
+
+    Receiver->EndThread = CreateEvent(NULL, FALSE, FALSE, NULL);
+    Receiver->PollEntries = (WSAPOLLFD *)calloc(CameraCount, sizeof(WSAPOLLFD));
+
+#elif defined(__linux__)
+
+    pthread_mutex_init(&Receiver->Mutex, NULL);
+    Receiver->PollFile = epoll_create1(0);
+    assert(Receiver->PollFile >= 0);
+
+    // The consumer waits with a timeout, measure it on the monotonic clock so it is immune to wall clock changes.
+    pthread_condattr_t ConditionAttributes;
+    pthread_condattr_init(&ConditionAttributes);
+    pthread_condattr_setclock(&ConditionAttributes, CLOCK_MONOTONIC);
+
+#endif
+
+    for(int CameraIndex = 0; CameraIndex < CameraCount; ++CameraIndex)
+    {
+        frame_exchange *Camera = &Receiver->Cameras[CameraIndex];
+        get_depth_image_data *Data = &Cameras[CameraIndex];
+
+        Camera->Data = *Data;
+        Camera->Stream = CreateIngestStream(Data->ClientSocket, Data->ImageSize, Data->ImageHeight, Data->QuadCount, Data->Backend);
+        Camera->BackSlot = 0;
+        Camera->MiddleSlot = 1;
+        Camera->FrontSlot = 2;
+
+        SetNonBlocking(Data->ClientSocket);
+
+#if defined(_WIN32)
+
+        Camera->FrameEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+
+#elif defined(__linux__)
+
+        pthread_cond_init(&Camera->FrameCondition, &ConditionAttributes);
+
+#endif
+    }
+
+#if defined(__linux__)
+
+    pthread_condattr_destroy(&ConditionAttributes);
 
-    ThreadData = (get_depth_image_data *)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(get_depth_image_data));
+#endif
+
+    // Only once all cameras are set up so a failure can simply tear everything down.
+    for(int CameraIndex = 0; CameraIndex < CameraCount; ++CameraIndex)
+    {
+        if(!WatchCamera(Receiver, &Receiver->Cameras[CameraIndex]))
+        {
+            FreeReceiver(Receiver);
+            return(NULL);
+        }
+    }
 
-    *ThreadData = *ThreadDataIn;
+#if defined(_WIN32)
 
-    ProducerThread = CreateThread(NULL,
-                                  0,
-                                  ThreadProc,
-                                  ThreadData,
-                                  0,
-                                  &ThreadID);
+    Receiver->Thread = CreateThread(NULL, 0, ThreadProc, Receiver, 0, NULL);
 
 #elif defined(__linux__)
 
-    pthread_create(&ProducerThread, NULL, ThreadProc, NULL);
+    pthread_create(&Receiver->Thread, NULL, ThreadProc, Receiver);
 
 #endif
+
+    return(Receiver);
 }
 
-// This signals the producer thread that it should stop executing.
-void TerminateMyThread(void)
+// This signals the receiver thread that it should stop executing, waits until it did and frees the receiver.
+void TerminateReceiver(depth_receiver *Receiver)
 {
 #if defined(_WIN32)
 
-    SetEvent(EndThread);
-    WaitForSingleObject(ProducerThread, INFINITE);
+    SetEvent(Receiver->EndThread);
+    WaitForSingleObject(Receiver->Thread, INFINITE);
 
 #elif defined(__linux)
 
-    pthread_cancel(ProducerThread);
+    pthread_cancel(Receiver->Thread);
+    pthread_join(Receiver->Thread, NULL);
 
 #endif
+
+    FreeReceiver(Receiver);
 }
 
+// TakeNewestFrame() swaps the consumer's slot with the middle slot if the receiver published a frame since the last
+// call and returns it. Otherwise it returns NULL and the consumer keeps working with what it has.
+static uint8_t *TakeNewestFrame(frame_exchange *Camera)
+{
+    if(atomic_load_long(&Camera->MiddleSlot) & FRAME_SLOT_FRESH)
+    {
+        long Previous = atomic_exchange_long(&Camera->MiddleSlot, Camera->FrontSlot);
+        Camera->FrontSlot = (int)(Previous & ~FRAME_SLOT_FRESH);
+        ++Camera->FramesTaken;
+
+        return(GetSlotMemory(Camera, Camera->FrontSlot));
+    }
+
+    return(NULL);
+}
 
-// This function waits until the timeout triggers or the producer thread signals that it has the depth data
-// ready for further processing.
-int WaitForOtherThread(int TimeoutInMilliseconds)
+// This function returns the newest complete set of depth images of a camera or NULL if the receiver thread did not
+// deliver a new one within the timeout. The returned memory belongs to the caller until the next call for the same
+// camera, the receiver thread keeps receiving into a different slot in the meantime.
+uint8_t *WaitForNewestFrame(depth_receiver *Receiver, int CameraIndex, int TimeoutInMilliseconds)
 {
+    frame_exchange *Camera = &Receiver->Cameras[CameraIndex];
+
+    uint8_t *Frame = TakeNewestFrame(Camera);
+    if(Frame)
+    {
+        return(Frame);
+    }
+
+    // Nothing comes anymore from a camera that is gone.
+    if(atomic_load_long(&Camera->Disconnected))
+    {
+        return(NULL);
+    }
+
 #if defined(_WIN32)
 
-    DWORD Result = WaitForSingleObject(EventBufferFull, TimeoutInMilliseconds);
-    return(Result == WAIT_OBJECT_0); // WAIT_OBJECT_0 means EventBufferFull was signaled
+    WaitForSingleObject(Camera->FrameEvent, TimeoutInMilliseconds);
 
 #elif defined(__linux__)
 
-    int Result = 0;
-
-    pthread_mutex_lock(&Mutex);
+    struct timespec Timeout;
+    clock_gettime(CLOCK_MONOTONIC, &Timeout);
+    Timeout.tv_sec += TimeoutInMilliseconds / 1000;
+    Timeout.tv_nsec += (long)(TimeoutInMilliseconds % 1000) * 1000000;
+    if(Timeout.tv_nsec >= 1000000000)
     {
-        struct timespec Timeout;
-        clock_gettime(CLOCK_REALTIME, &Timeout);
-        Timeout.tv_nsec += TimeoutInMilliseconds * 1000000;
+        Timeout.tv_sec += 1;
+        Timeout.tv_nsec -= 1000000000;
+    }
 
-        while(!BufferFull && Result == 0)
+    pthread_mutex_lock(&Receiver->Mutex);
+    {
+        int Result = 0;
+        while(!(atomic_load_long(&Camera->MiddleSlot) & FRAME_SLOT_FRESH) && !atomic_load_long(&Camera->Disconnected) && Result == 0)
         {
-            Result = pthread_cond_timedwait(&ConsumerCond, &Mutex, &Timeout);
+            Result = pthread_cond_timedwait(&Camera->FrameCondition, &Receiver->Mutex, &Timeout);
         }
     }
-    pthread_mutex_unlock(&Mutex);
-
-    return(Result == 0);
+    pthread_mutex_unlock(&Receiver->Mutex);
 
 #endif
+
+    return(TakeNewestFrame(Camera));
 }
 
-// Signals the producer thread that the main thread has read the depth data so it can start collecting 
-// depth data from the camera again.
-void SignalOtherThread(void)
+// The incremental mode. Instead of whole frames the consumer picks up every quad as soon as the receiver finished it,
+// e.g. to upload it to the GPU while the rest of the frame is still on its way. Only the step that needs all the quads
+// has to wait for the last one. The quads are read from the slot the receiver is working on, this is only safe as long
+// as the consumer does not take frames from the same camera with WaitForNewestFrame() as well.
+typedef struct
+{
+    long Progress;  // The QuadProgress the quads were taken at.
+    int QuadsTaken; // The quads of that frame the consumer already has.
+}
+quad_cursor;
+
+// Returns the quads that were completed since the last call (one bit per quad) or 0 if there were none within the
+// timeout. *FrameOut points to the frame they are in, laid out the same way as a complete one.
+int WaitForNewQuads(depth_receiver *Receiver, int CameraIndex, quad_cursor *Cursor, int TimeoutInMilliseconds, uint8_t **FrameOut)
 {
+    frame_exchange *Camera = &Receiver->Cameras[CameraIndex];
+
+    long Progress = atomic_load_long(&Camera->Stream.QuadProgress);
+    if(Progress == Cursor->Progress && !atomic_load_long(&Camera->Disconnected))
+    {
 #if defined(_WIN32)
 
-    SetEvent(EventBufferRead);
+        WaitForSingleObject(Camera->FrameEvent, TimeoutInMilliseconds);
 
 #elif defined(__linux__)
 
-    pthread_cond_signal(&ProducerCond);
+        struct timespec Timeout;
+        clock_gettime(CLOCK_MONOTONIC, &Timeout);
+        Timeout.tv_sec += TimeoutInMilliseconds / 1000;
+        Timeout.tv_nsec += (long)(TimeoutInMilliseconds % 1000) * 1000000;
+        if(Timeout.tv_nsec >= 1000000000)
+        {
+            Timeout.tv_sec += 1;
+            Timeout.tv_nsec -= 1000000000;
+        }
+
+        pthread_mutex_lock(&Receiver->Mutex);
+        {
+            int Result = 0;
+            while(atomic_load_long(&Camera->Stream.QuadProgress) == Progress && !atomic_load_long(&Camera->Disconnected) && Result == 0)
+            {
+                Result = pthread_cond_timedwait(&Camera->FrameCondition, &Receiver->Mutex, &Timeout);
+            }
+        }
+        pthread_mutex_unlock(&Receiver->Mutex);
 
 #endif
+
+        Progress = atomic_load_long(&Camera->Stream.QuadProgress);
+    }
+
+    // A different frame means the quads taken so far are of no use anymore.
+    if(quad_progress_attempt(Progress) != quad_progress_attempt(Cursor->Progress))
+    {
+        Cursor->QuadsTaken = 0;
+    }
+    Cursor->Progress = Progress;
+
+    *FrameOut = GetSlotMemory(Camera, quad_progress_slot(Progress));
+    return(quad_progress_quads(Progress) & ~Cursor->QuadsTaken);
+}
+
+// Has to be called once the consumer is done reading the quads WaitForNewQuads() returned. It checks that the receiver
+// did not start to overwrite them in the meantime, which can only happen if the consumer took longer than a whole
+// frame. Returns true if the consumer now has all quads of the frame.
+bool FinishQuads(depth_receiver *Receiver, int CameraIndex, quad_cursor *Cursor, int Quads)
+{
+    frame_exchange *Camera = &Receiver->Cameras[CameraIndex];
+
+    // The reads of the quads must not move past the check.
+    read_fence();
+    long Progress = atomic_load_long(&Camera->Stream.QuadProgress);
+
+    // Every frame is announced before the receiver writes to its slot. The slot of the frame we read from is untouched
+    // as long as the receiver is still on that frame or has moved on to the next one in a different slot (which
+    // means ours was published).
+    long Attempt = quad_progress_attempt(Cursor->Progress);
+    long Ahead = (quad_progress_attempt(Progress) - Attempt) & QUAD_PROGRESS_ATTEMPT_MASK;
+    bool Intact = (Ahead == 0) || (Ahead == 1 && quad_progress_slot(Progress) != quad_progress_slot(Cursor->Progress));
+
+    if(!Intact)
+    {
+        Cursor->QuadsTaken = 0;
+        return(false);
+    }
+
+    Cursor->QuadsTaken |= Quads;
+    return(Quads != 0 && Cursor->QuadsTaken == (1 << Camera->Stream.QuadCount) - 1);
 }
@@ -48,6 +48,8 @@ typedef void   type_glDispatchCompute(GLuint num_groups_x, GLuint num_groups_y,
 typedef void   type_glMemoryBarrier(GLbitfield barriers);
 typedef void   type_glUniform1i(GLint location, GLint v0);
 typedef void   type_glUniform1f(GLint location, GLfloat v0);
+typedef void   type_glUniform2f(GLint location, GLfloat v0, GLfloat v1);
+typedef void   type_glUniform1fv(GLint location, GLsizei count, const GLfloat *value);
 typedef void   type_glTexStorage2D(GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height);
 
 #define GL_DEBUG_SEVERITY_HIGH                  0x9146
@@ -99,6 +101,7 @@ typedef void   type_glTexStorage2D(GLenum target, GLsizei levels, GLenum interna
 #define GL_CLAMP_TO_EDGE                        0x812F
 #define GL_RGBA32F                              0x8814
 #define GL_RG32F                                0x8230
+#define GL_R32F                                 0x822E
 #define GL_R16UI                                0x8234
 #define GL_R32I                                 0x8235
 #define GL_RG                                   0x8227
@@ -128,8 +131,16 @@ typedef struct
     GLuint depth_texture;
     GLuint xyzw_table_texture;
     GLuint rgba_color_texture;
+    GLuint colormap_texture;
+    GLuint ray_texture;
+    GLuint history_texture; // Only with temporal_filter.
     
     dimensions depth_image_dimensions;
+    phase_unwrapping unwrap;
+    int image_count; // Per frame, 4 or 8 for two modulation frequencies.
+    float min_signal; // (2 * lowest amplitude)^2, see depth_source.MinAmplitude.
+    bool temporal_filter;
+    bool spatial_filter;
     
     opengl_function(glDebugMessageCallback);
     opengl_function(glCreateShader);
@@ -169,6 +180,8 @@ typedef struct
     opengl_function(glMemoryBarrier);
     opengl_function(glUniform1i);
     opengl_function(glUniform1f);
+    opengl_function(glUniform2f);
+    opengl_function(glUniform1fv);
     opengl_function(glTexStorage2D);
 
 } open_gl;
@@ -191,6 +204,7 @@ static void compile_default_program(open_gl *opengl)
     GLuint vertex_shader = opengl->glCreateShader(GL_VERTEX_SHADER);
     char *vertex_code = GLSL(layout(binding = 0, rgba32f) readonly uniform image2D xyzw_tex;
                              layout(binding = 1, rgba32f) readonly uniform image2D rgba_tex;
+                             layout(binding = 3) uniform sampler1D colormap;
                              
                              layout(location = 0) uniform mat4 mvp;
                              layout(location = 1) uniform float point_size;
@@ -204,9 +218,17 @@ static void compile_default_program(open_gl *opengl)
                                  vec4 vertex_position = imageLoad(xyzw_tex, pixel);
                                  vec4 vertex_color = imageLoad(rgba_tex, pixel);
 
-                                 color = vertex_color;
+                                 // The color is (hue, 1, 1) in HSV, the hue picks the color of the colormap.
+                                 color = vec4(texture(colormap, vertex_color.x).rgb, vertex_color.a);
                                  gl_Position = mvp * vertex_position;
                                  gl_PointSize = point_size;
+
+                                 // Points that were dropped are moved out of the clip volume, so they are clipped
+                                 // before they are rasterized instead of discarded for every fragment.
+                                 if(vertex_color.a == 0.0f)
+                                 {
+                                     gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+                                 }
                              }
                              );
     opengl->glShaderSource(vertex_shader, 1, &vertex_code, NULL);
@@ -223,12 +245,7 @@ static void compile_default_program(open_gl *opengl)
                                        discard;
                                    }
 
-                                   // converting from hsv to rgb below
-                                   // code from: https://stackoverflow.com/questions/15095909/from-rgb-to-hsv-in-opengl-glsl
-                                   vec4 k = vec4(1.0, 2.0 / 3.0, 1.0 / 3.0, 3.0);
-                                   vec3 p = abs(fract(color.xxx + k.xyz) * 6.0 - k.www);
-                                   vec3 color_rgb = color.z * mix(k.xxx, clamp(p - k.xxx, 0.0, 1.0), color.y);
-                                   frag_color = vec4(color_rgb.rgb, 1.0);
+                                   frag_color = vec4(color.rgb, 1.0);
                                }
                                );
     opengl->glShaderSource(fragment_shader, 1, &fragment_code, NULL);
@@ -262,6 +279,10 @@ static void compile_default_program(open_gl *opengl)
     opengl->default_program = program;
 }
 
+// The compute shader works on tiles of COMPUTE_TILE_SIZE x COMPUTE_TILE_SIZE pixels, it has to be the local size in the
+// shader.
+#define COMPUTE_TILE_SIZE 16
+
 static void compile_compute_program(open_gl *opengl)
 {
     GLuint compute_shader = opengl->glCreateShader(GL_COMPUTE_SHADER);
@@ -270,11 +291,127 @@ static void compile_compute_program(open_gl *opengl)
 
                               layout(location = 0) uniform float min_depth;
                               layout(location = 1) uniform float max_depth;
-                              layout(location = 2) uniform isampler2D depth_image;
-                              layout(location = 3) uniform float focal_length_mm;
-                              layout(location = 4) uniform float pixels_per_mm;
+                              layout(location = 2) uniform usampler2D depth_image;
+                              layout(location = 3) uniform sampler2D ray_table;
+
+                              // See phase_unwrapping, multiples are its Multiple[0] and Multiple[1].
+                              layout(location = 4) uniform int frequency_count;
+                              layout(location = 5) uniform vec2 multiples;
+                              layout(location = 6) uniform float distance_per_turn;
+                              layout(location = 7) uniform float unwrap_tolerance;
+                              layout(location = 8) uniform float unwrap_offsets[16];
+
+                              // The squared length of the sample differences of a pixel has to reach it, it is 4
+                              // times the squared amplitude.
+                              layout(location = 24) uniform float min_signal;
+
+                              // The temporal filter of depth_source.c, see DEPTH_TEMPORAL_WEIGHT. The history is the distance of every
+                              // pixel along its ray in the last frame, it stays on the GPU.
+                              layout(binding = 3, r32f) uniform image2D history_image;
+                              layout(location = 25) uniform bool temporal_filter;
+                              layout(location = 26) uniform float temporal_weight;
+                              layout(location = 27) uniform float temporal_tolerance;
+
+                              // The spatial filter of depth_source.c, see DEPTH_FILTER_TOLERANCE.
+                              layout(location = 28) uniform bool spatial_filter;
+                              layout(location = 29) uniform float filter_tolerance;
+                              layout(location = 30) uniform int filter_min_neighbors;
                               
-                              layout(local_size_x = 1, local_size_y = 1) in;
+                              layout(local_size_x = 16, local_size_y = 16) in;
+
+                              // The distances of the tile and of the pixels around it for the spatial filter, each of them decoded once
+                              // for all the invocations that need it.
+                              shared float distance_tile[18][18];
+
+                              // The sample differences of pixel in the 4 images of one modulation frequency whose top
+                              // left corner in depth_image is corner.
+                              vec2 load_differences(ivec2 corner, ivec2 pixel, int width, int height)
+                              {
+                                  ivec2 pixel_image1 = corner + pixel;
+                                  ivec2 pixel_image2 = corner + pixel + ivec2(width, 0);
+                                  ivec2 pixel_image3 = corner + pixel + ivec2(0, height);
+                                  ivec2 pixel_image4 = corner + pixel + ivec2(width, height);
+
+                                  // The samples only hold the 12 bits of the phase, they were masked while receiving them.
+                                  int value_image0 = int(texelFetch(depth_image, pixel_image1, 0).x) - 2048;
+                                  int value_image1 = int(texelFetch(depth_image, pixel_image2, 0).x) - 2048;
+                                  int value_image2 = int(texelFetch(depth_image, pixel_image3, 0).x) - 2048;
+                                  int value_image3 = int(texelFetch(depth_image, pixel_image4, 0).x) - 2048;
+
+                                  return(vec2(float(value_image3 - value_image1), float(value_image2 - value_image0)));
+                              }
+
+                              // The phase of the sample differences in turns from 0 to 1, as per the specification.
+                              float phase_turns(vec2 differences)
+                              {
+                                  float pi = 3.1415927;
+                                  return((pi + atan(differences.x, differences.y)) / (2.0 * pi));
+                              }
+
+                              // The distance along the ray through pixel, 0 for a pixel without one.
+                              float decode_distance(ivec2 pixel, int width, int height)
+                              {
+                                  // The images of a second frequency are right of those of the first.
+                                  vec2 differences0 = load_differences(ivec2(0, 0), pixel, width, height);
+                                  vec2 differences1 = differences0;
+                                  if(frequency_count == 2)
+                                  {
+                                      differences1 = load_differences(ivec2(2 * width, 0), pixel, width, height);
+                                  }
+
+                                  // Too little signal for a phase, most of these pixels are background.
+                                  float signal = min(dot(differences0, differences0), dot(differences1, differences1));
+                                  if(signal < min_signal)
+                                  {
+                                      return(0.0);
+                                  }
+
+                                  if(frequency_count == 2)
+                                  {
+                                      // The phases are unwrapped like phase_unwrapping describes.
+                                      float turns0 = phase_turns(differences0);
+                                      float turns1 = phase_turns(differences1);
+
+                                      float wraps = turns0 * multiples.y - turns1 * multiples.x;
+                                      float rounded = roundEven(wraps);
+                                      int last_index = int(multiples.x + multiples.y) - 2;
+                                      int index = clamp(int(rounded) + int(multiples.x) - 1, 0, last_index);
+
+                                      // The phases disagree, the pixel has no distance both frequencies could measure.
+                                      if(abs(wraps - rounded) > unwrap_tolerance)
+                                      {
+                                          return(0.0);
+                                      }
+                                      return(((turns0 * multiples.x + turns1 * multiples.y) + unwrap_offsets[index]) * distance_per_turn);
+                                  }
+                                  return(phase_turns(differences0) * distance_per_turn);
+                              }
+
+                              // The mean distance of the neighbors of the pixel at local (+ 1 in distance_tile) on its surface, 0 for a
+                              // pixel without a distance or with too few of them (a flying pixel).
+                              float filter_distance(ivec2 local)
+                              {
+                                  float depth = distance_tile[local.y + 1][local.x + 1];
+                                  float tolerance = depth * filter_tolerance;
+
+                                  float sum = 0.0;
+                                  int count = 0;
+                                  for(int y = local.y; y <= local.y + 2; ++y)
+                                  {
+                                      for(int x = local.x; x <= local.x + 2; ++x)
+                                      {
+                                          float neighbor = distance_tile[y][x];
+                                          if(abs(neighbor - depth) <= tolerance)
+                                          {
+                                              sum += neighbor;
+                                              ++count;
+                                          }
+                                      }
+                                  }
+
+                                  // The pixel itself is one of them.
+                                  return((depth != 0.0 && count > filter_min_neighbors) ? sum / float(count) : 0.0);
+                              }
 
                               void main()
                               {
@@ -283,47 +420,55 @@ static void compile_compute_program(open_gl *opengl)
                                   int width = dimensions.x;
                                   int height = dimensions.y;
 
-                                  // Since the dispatch was called with the depth dimensions of the image and the gpu runs on threads
-                                  // we need to find out which pixel we need to modify which is done by calling the function.
+                                  // The dispatch covers the depth dimensions of the image in tiles of 16x16 pixels, every invocation
+                                  // computes one of them.
                                   ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+                                  ivec2 local = ivec2(gl_LocalInvocationID.xy);
+
+                                  // The tile for the spatial filter. Outside of the image there is no distance.
+                                  if(spatial_filter)
+                                  {
+                                      ivec2 corner = ivec2(gl_WorkGroupID.xy) * 16 - 1;
+                                      for(uint i = gl_LocalInvocationIndex; i < 18 * 18; i += 16 * 16)
+                                      {
+                                          ivec2 neighbor = corner + ivec2(i % 18, i / 18);
+                                          bool inside = all(greaterThanEqual(neighbor, ivec2(0))) && all(lessThan(neighbor, dimensions));
+                                          distance_tile[i / 18][i % 18] = inside ? decode_distance(neighbor, width, height) : 0.0;
+                                      }
+                                  }
+                                  memoryBarrierShared();
+                                  barrier();
+
+                                  // The image does not have to be a multiple of the tile size.
+                                  if(any(greaterThanEqual(pixel, dimensions)))
+                                  {
+                                      return;
+                                  }
 
-                                  // The principal point is the middle of the depth image.
-                                  vec2 principal_point = vec2(dimensions / 2);
-                                  
-                                  ivec2 pixel_image1 = pixel;
-                                  ivec2 pixel_image2 = pixel + ivec2(width, 0);
-                                  ivec2 pixel_image3 = pixel + ivec2(0, height);
-                                  ivec2 pixel_image4 = pixel + ivec2(width, height);
-                                  
                                   //
                                   // Computing 3D position.
-                                  int value_image0 = (texelFetch(depth_image, pixel_image1, 0).x & 0xFFF) - 2048;
-                                  int value_image1 = (texelFetch(depth_image, pixel_image2, 0).x & 0xFFF) - 2048;
-                                  int value_image2 = (texelFetch(depth_image, pixel_image3, 0).x & 0xFFF) - 2048;
-                                  int value_image3 = (texelFetch(depth_image, pixel_image4, 0).x & 0xFFF) - 2048;
-                                                                    
-                                  float w = 1.0f;
-
-                                  // Calculating the depth value from 4 images as per the specification.
-                                  float y = float(value_image3 - value_image1);
-                                  float x = float(value_image2 - value_image0);
-                                  
-                                  float c = 300000000.0;
-                                  float f = 12000000.0;
-                                  float pi = 3.1416; // 3.1415926535897932384626433832795
+                                  float depth = spatial_filter ? filter_distance(local) : decode_distance(pixel, width, height);
 
-                                  float depth = (c / 2) * (1 / (2 * pi * f)) * (pi + atan(y, x));
+                                  // A dropped pixel has no history either, its distance is 0.
+                                  if(temporal_filter)
+                                  {
+                                      float history = imageLoad(history_image, pixel).r;
+                                      float difference = depth - history;
+                                      bool same_surface = abs(difference) <= depth * temporal_tolerance;
+                                      depth = same_surface ? history + difference * temporal_weight : depth;
+                                      imageStore(history_image, pixel, vec4(depth));
+                                  }
 
-                                  // Calculating the 3d position from the depth.
-                                  float focal_length = pixels_per_mm * focal_length_mm; // Calculate the focal length in pixels.
+                                  // Calculating the 3d position from the depth, it is the distance along the ray through
+                                  // the pixel (see ComputePixelRays()).
+                                  vec3 ray = texelFetch(ray_table, pixel, 0).xyz;
+                                  float z = depth * ray.z;
                                   
-                                  vec2 xy_value = (pixel - principal_point) / focal_length;
-                                  float z = depth / sqrt(xy_value.x * xy_value.x + xy_value.y * xy_value.y + 1);
-                                  
-                                  vec3 position = vec3(xy_value.x * z, xy_value.y * z, -z);
+                                  vec3 position = vec3(depth * ray.x, depth * ray.y, -z);
 
-                                  // Ignore poins where the z value is bigger than the max_depth.
-                                  if(z > max_depth)
+                                  // Ignore the dropped pixels and the points where the z value is bigger than the max_depth.
+                                  float w = 1.0f;
+                                  if(z <= 0.0 || z > max_depth)
                                   {
                                       w = 0.0f;
                                   }
@@ -375,11 +520,30 @@ static void compile_compute_program(open_gl *opengl)
     opengl->compute_program = program;
 }
 
-open_gl *opengl_init(dimensions depth_image_dimensions)
+void opengl_set_colormap(open_gl *opengl, colormap_kind kind)
+{
+    uint8_t colormap[COLORMAP_SIZE * 4];
+    colormap_build(kind, colormap);
+
+    opengl->glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_1D, opengl->colormap_texture);
+    glTexSubImage1D(GL_TEXTURE_1D, 0, 0, COLORMAP_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, colormap);
+}
+
+// rays holds the direction of the ray through every pixel of a depth image, 4 floats per pixel of which the first 3 are
+// used, see ComputePixelRays(). unwrap says how many modulation frequencies a frame has, see GetPhaseUnwrapping().
+// Pixels with less than min_amplitude are dropped. With temporal_filter the distances are averaged over time, see
+// DEPTH_TEMPORAL_WEIGHT, with spatial_filter they are filtered first, see DEPTH_FILTER_TOLERANCE.
+open_gl *opengl_init(dimensions depth_image_dimensions, const float *rays, const phase_unwrapping *unwrap, float min_amplitude, bool temporal_filter, bool spatial_filter)
 {
     open_gl *opengl = (open_gl *)malloc(sizeof(open_gl));
 
     opengl->depth_image_dimensions = depth_image_dimensions;
+    opengl->unwrap = *unwrap;
+    opengl->image_count = 4 * unwrap->FrequencyCount;
+    opengl->min_signal = 4.0f * min_amplitude * min_amplitude;
+    opengl->temporal_filter = temporal_filter;
+    opengl->spatial_filter = spatial_filter;
     
 #define get_opengl_function(name) opengl->name = (type_##name *)glfwGetProcAddress(#name);
     
@@ -421,6 +585,8 @@ open_gl *opengl_init(dimensions depth_image_dimensions)
     get_opengl_function(glMemoryBarrier);
     get_opengl_function(glUniform1i);
     get_opengl_function(glUniform1f);
+    get_opengl_function(glUniform2f);
+    get_opengl_function(glUniform1fv);
     get_opengl_function(glTexStorage2D);
     
 #ifdef DEBUG
@@ -438,7 +604,8 @@ open_gl *opengl_init(dimensions depth_image_dimensions)
     glGenTextures(1, &opengl->depth_texture);
     opengl->glActiveTexture(GL_TEXTURE2);
     glBindTexture(GL_TEXTURE_2D, opengl->depth_texture);
-    opengl->glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32I, depth_image_dimensions.w * 2, depth_image_dimensions.h * 2);
+    opengl->glTexStorage2D(GL_TEXTURE_2D, 1, GL_R16UI, depth_image_dimensions.w * 2 * unwrap->FrequencyCount,
+                           depth_image_dimensions.h * 2);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -461,6 +628,39 @@ open_gl *opengl_init(dimensions depth_image_dimensions)
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+
+    // The colors of the hues, see colormap.c. Filtering blends neighboring entries like the conversion from HSV did.
+    glGenTextures(1, &opengl->colormap_texture);
+    opengl->glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_1D, opengl->colormap_texture);
+    glTexImage1D(GL_TEXTURE_1D, 0, GL_RGBA8, COLORMAP_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    opengl_set_colormap(opengl, COLORMAP_HUE);
+
+    // The rays only depend on the lens so they are uploaded once.
+    glGenTextures(1, &opengl->ray_texture);
+    opengl->glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_2D, opengl->ray_texture);
+    opengl->glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32F, depth_image_dimensions.w, depth_image_dimensions.h);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, depth_image_dimensions.w, depth_image_dimensions.h, GL_RGBA, GL_FLOAT, rays);
+
+    if(temporal_filter)
+    {
+        // No pixel has a history yet.
+        float *zeros = (float *)calloc((size_t)depth_image_dimensions.w * depth_image_dimensions.h, sizeof(float));
+        glGenTextures(1, &opengl->history_texture);
+        opengl->glActiveTexture(GL_TEXTURE5);
+        glBindTexture(GL_TEXTURE_2D, opengl->history_texture);
+        opengl->glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32F, depth_image_dimensions.w, depth_image_dimensions.h);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, depth_image_dimensions.w, depth_image_dimensions.h, GL_RED, GL_FLOAT, zeros);
+        free(zeros);
+    }
     
     GLuint dummy_vertex_array;
     opengl->glGenVertexArrays(1, &dummy_vertex_array);
@@ -469,7 +669,28 @@ open_gl *opengl_init(dimensions depth_image_dimensions)
     return(opengl);
 }
 
-void calculate_point_cloud(open_gl *opengl, uint8_t *depth_buffer, size_t single_image_size)
+// Copies one of the depth images into its quarter of depth_texture, or eighth for two modulation frequencies. This can
+// be done as soon as the image arrived, the images don't depend on each other.
+void upload_depth_quad(open_gl *opengl, uint8_t *depth_image, int quad)
+{
+    uint32_t width = opengl->depth_image_dimensions.w;
+    uint32_t height = opengl->depth_image_dimensions.h;
+
+    // Since we need 4 images to calculate the proper depth image I made the input texture twice the size in both dimensions so
+    // that the texture can be filled with all 4 depth images. Image 0 goes to the top left, 1 to the top right, 2 to the
+    // bottom left and 3 to the bottom right. The 4 images of a second modulation frequency go right of them.
+    uint32_t x = ((quad & 1) ? width : 0) + (quad >> 2) * 2 * width;
+    uint32_t y = (quad & 2) ? height : 0;
+
+    opengl->glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, opengl->depth_texture);
+    // glTexSubImage2D() modifies a part of the whole texture which is specified by the 3rd to 6th parameter.
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, GL_RED_INTEGER, GL_UNSIGNED_SHORT, depth_image);
+}
+
+// Runs the compute shader that calculates the point cloud from the depth images in depth_texture. Only this step needs
+// all of them.
+void combine_depth_quads(open_gl *opengl)
 {
     uint32_t width = opengl->depth_image_dimensions.w;
     uint32_t height = opengl->depth_image_dimensions.h;
@@ -478,14 +699,11 @@ void calculate_point_cloud(open_gl *opengl, uint8_t *depth_buffer, size_t single
 
     opengl->glActiveTexture(GL_TEXTURE2);
     glBindTexture(GL_TEXTURE_2D, opengl->depth_texture);
-    // Since we need 4 images to calculate the proper depth image I made the input texture twice the size in both dimensions so
-    // that the texture can be filled with all 4 depth images.
-    // The following glTexSubImage2D() calls modify a part of the whole texture which is specified by the 3rd to 6th parameter.
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RED_INTEGER, GL_INT, depth_buffer + 0 * single_image_size);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, width, 0, width, height, GL_RED_INTEGER, GL_INT, depth_buffer + 1 * single_image_size);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, height, width, height, GL_RED_INTEGER, GL_INT, depth_buffer + 2 * single_image_size);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, width, height, width, height, GL_RED_INTEGER, GL_INT, depth_buffer + 3 * single_image_size);
     opengl->glUniform1i(2, 2);
+
+    opengl->glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_2D, opengl->ray_texture);
+    opengl->glUniform1i(3, 4);
     
     opengl->glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, opengl->xyzw_table_texture);
@@ -494,15 +712,44 @@ void calculate_point_cloud(open_gl *opengl, uint8_t *depth_buffer, size_t single
     opengl->glActiveTexture(GL_TEXTURE1);
     glBindTexture(GL_TEXTURE_2D, opengl->rgba_color_texture);
     opengl->glBindImageTexture(2, opengl->rgba_color_texture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+
+    if(opengl->temporal_filter)
+    {
+        opengl->glActiveTexture(GL_TEXTURE5);
+        glBindTexture(GL_TEXTURE_2D, opengl->history_texture);
+        opengl->glBindImageTexture(3, opengl->history_texture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32F);
+    }
     
-    opengl->glUniform1f(0,  0.0f); // min range in m
-    opengl->glUniform1f(1, 12.5f); // max range in m
-    opengl->glUniform1f(3,  3.7f); // focal length in mm
-    opengl->glUniform1f(4, 50.0f); // pixels per mm
-
-    // Call the compute shader here.
-    opengl->glDispatchCompute(width, height, 1);
-    opengl->glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    phase_unwrapping *unwrap = &opengl->unwrap;
+    opengl->glUniform1f(0, 0.0f); // min range in m
+    opengl->glUniform1f(1, unwrap->Range); // max range in m
+    opengl->glUniform1i(4, unwrap->FrequencyCount);
+    opengl->glUniform2f(5, (float)unwrap->Multiple[0], (float)unwrap->Multiple[1]);
+    opengl->glUniform1f(6, unwrap->DistancePerTurn);
+    opengl->glUniform1f(7, PHASE_UNWRAP_TOLERANCE);
+    opengl->glUniform1fv(8, PHASE_UNWRAP_MAX_OFFSETS, unwrap->Offsets);
+    opengl->glUniform1f(24, opengl->min_signal);
+    opengl->glUniform1i(25, opengl->temporal_filter);
+    opengl->glUniform1f(26, DEPTH_TEMPORAL_WEIGHT);
+    opengl->glUniform1f(27, DEPTH_TEMPORAL_TOLERANCE);
+    opengl->glUniform1i(28, opengl->spatial_filter);
+    opengl->glUniform1f(29, DEPTH_FILTER_TOLERANCE);
+    opengl->glUniform1i(30, DEPTH_FILTER_MIN_NEIGHBORS);
+
+    // Call the compute shader here, on whole tiles. The history is read with imageLoad() by the next dispatch.
+    opengl->glDispatchCompute((width + COMPUTE_TILE_SIZE - 1) / COMPUTE_TILE_SIZE,
+                              (height + COMPUTE_TILE_SIZE - 1) / COMPUTE_TILE_SIZE, 1);
+    opengl->glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+}
+
+void calculate_point_cloud(open_gl *opengl, uint8_t *depth_buffer, size_t single_image_size)
+{
+    for(int quad = 0; quad < opengl->image_count; ++quad)
+    {
+        upload_depth_quad(opengl, depth_buffer + quad * single_image_size, quad);
+    }
+
+    combine_depth_quads(opengl);
 }
 
 void render_point_cloud(open_gl *opengl, dimensions render_dimensions, view_control *control, float point_size)
@@ -528,6 +775,9 @@ void render_point_cloud(open_gl *opengl, dimensions render_dimensions, view_cont
     glBindTexture(GL_TEXTURE_2D, opengl->rgba_color_texture);
     // Binds the texture to the binding specified in the shader (binding 1).
     opengl->glBindImageTexture(1, opengl->rgba_color_texture, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+
+    opengl->glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_1D, opengl->colormap_texture);
     
     uint32_t render_width = render_dimensions.w;
     uint32_t render_height = render_dimensions.h;
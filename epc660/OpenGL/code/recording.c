@@ -0,0 +1,744 @@
+// A recording of the raw depth frames of a camera together with when they arrived and the intrinsics of the camera, so
+// whatever the camera saw can be played again in any of the visualizers, as often as needed.
+//
+// The file starts with a recording_header and the intrinsics right after it. What the intrinsics look like is up to the
+// depth source that wrote them. Every frame follows as a recording_frame_header and the samples, both starting at a
+// multiple of RECORDING_ALIGNMENT so the samples can be used straight from the mapped file. At the end there is an index
+// with the offset and timestamp of every frame so any frame can be found without reading the ones in front of it.
+//
+// The samples are either stored as they are, which lets a replay hand them out without touching them, or compressed
+// with rvl.c, which makes them about a third of the size but has to decode them again.
+//
+// The index is only written when the recording is finished. If the process never got there the reader walks over the
+// frame headers instead, which is why a recording of a crash can still be played.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <assert.h>
+
+#if defined(_WIN32)
+
+#include <windows.h>
+
+#elif defined(__linux__)
+
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#endif
+
+#define RECORDING_MAGIC 0x52564350 // "PCVR"
+#define RECORDING_FRAME_MAGIC 0x4d415246 // "FRAM"
+#define RECORDING_VERSION 2 // Version 1 had no encoding, the padding of the header reads as recording_encoding_raw.
+#define RECORDING_ALIGNMENT 64
+
+// How many frames may wait for the writer thread. Frames that come in while all of them are taken are dropped, the
+// visualizer never waits for the disk.
+#define RECORDING_QUEUE_LENGTH 8
+
+typedef enum
+{
+    recording_device_k4a = 1,
+    recording_device_epc660 = 2
+} recording_device;
+
+typedef enum
+{
+    recording_encoding_raw = 0,
+    recording_encoding_rvl = 1 // Only for 16 bit samples.
+} recording_encoding;
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t device; // recording_device
+    uint32_t width;
+    uint32_t height;
+    uint32_t image_count; // A frame is image_count images of width * height samples, one after another.
+    uint32_t sample_size; // In bytes.
+    uint32_t intrinsics_size;
+    uint64_t frame_count; // 0 until the recording is finished.
+    uint64_t index_offset; // 0 until the recording is finished.
+    uint32_t encoding; // recording_encoding
+    uint32_t reserved;
+} recording_header;
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t size; // Of the samples as they are stored, they start RECORDING_ALIGNMENT bytes after the header.
+    uint64_t timestamp; // Nanoseconds since the first frame.
+} recording_frame_header;
+
+typedef struct
+{
+    uint64_t offset; // Of the samples.
+    uint32_t size;
+    uint32_t reserved;
+    uint64_t timestamp;
+} recording_index_entry;
+
+static uint64_t recording_align(uint64_t size)
+{
+    return((size + RECORDING_ALIGNMENT - 1) & ~(uint64_t)(RECORDING_ALIGNMENT - 1));
+}
+
+// A monotonic clock in nanoseconds.
+static uint64_t recording_get_time(void)
+{
+#if defined(_WIN32)
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    uint64_t seconds = (uint64_t)counter.QuadPart / (uint64_t)frequency.QuadPart;
+    uint64_t rest = (uint64_t)counter.QuadPart % (uint64_t)frequency.QuadPart;
+    return(seconds * 1000000000ull + rest * 1000000000ull / (uint64_t)frequency.QuadPart);
+#elif defined(__linux__)
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return((uint64_t)time.tv_sec * 1000000000ull + (uint64_t)time.tv_nsec);
+#endif
+}
+
+//
+// writer
+
+// The thread that hands the frames to recording_writer_push() only copies them into the queue, everything that touches
+// the file happens on the writer thread.
+typedef struct
+{
+    FILE *file;
+    uint64_t file_size;
+    recording_header header;
+
+    recording_index_entry *index;
+    uint64_t index_capacity;
+
+    uint8_t *queue; // RECORDING_QUEUE_LENGTH slots of slot_size bytes.
+    size_t slot_size;
+    uint8_t *encoded; // Where the writer thread compresses a frame to, only for recording_encoding_rvl.
+    recording_index_entry queued[RECORDING_QUEUE_LENGTH]; // Size and timestamp of the frame in every slot.
+    int queue_start;
+    int queue_count;
+    bool stopping;
+
+    bool started;
+    uint64_t start_time;
+    uint64_t frames_dropped;
+    bool write_failed;
+
+#if defined(_WIN32)
+    HANDLE thread;
+    CRITICAL_SECTION lock;
+    CONDITION_VARIABLE queue_changed;
+#elif defined(__linux__)
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t queue_changed;
+#endif
+} recording_writer;
+
+static void recording_lock(recording_writer *writer)
+{
+#if defined(_WIN32)
+    EnterCriticalSection(&writer->lock);
+#elif defined(__linux__)
+    pthread_mutex_lock(&writer->lock);
+#endif
+}
+
+static void recording_unlock(recording_writer *writer)
+{
+#if defined(_WIN32)
+    LeaveCriticalSection(&writer->lock);
+#elif defined(__linux__)
+    pthread_mutex_unlock(&writer->lock);
+#endif
+}
+
+static void recording_signal(recording_writer *writer)
+{
+#if defined(_WIN32)
+    WakeConditionVariable(&writer->queue_changed);
+#elif defined(__linux__)
+    pthread_cond_signal(&writer->queue_changed);
+#endif
+}
+
+static void recording_wait(recording_writer *writer)
+{
+#if defined(_WIN32)
+    SleepConditionVariableCS(&writer->queue_changed, &writer->lock, INFINITE);
+#elif defined(__linux__)
+    pthread_cond_wait(&writer->queue_changed, &writer->lock);
+#endif
+}
+
+// Writes size bytes and pads them with zeros to the next multiple of RECORDING_ALIGNMENT.
+static void recording_write_aligned(recording_writer *writer, const void *data, uint64_t size)
+{
+    static const uint8_t padding[RECORDING_ALIGNMENT] = {0};
+    uint64_t aligned_size = recording_align(size);
+
+    if(fwrite(data, 1, (size_t)size, writer->file) != (size_t)size ||
+       fwrite(padding, 1, (size_t)(aligned_size - size), writer->file) != (size_t)(aligned_size - size))
+    {
+        writer->write_failed = true;
+    }
+    writer->file_size += aligned_size;
+}
+
+static void recording_write_frame(recording_writer *writer, const uint8_t *data, const recording_index_entry *frame)
+{
+    if(writer->header.frame_count == writer->index_capacity)
+    {
+        writer->index_capacity = writer->index_capacity ? 2 * writer->index_capacity : 1024;
+        writer->index = (recording_index_entry *)realloc(writer->index, (size_t)writer->index_capacity * sizeof(recording_index_entry));
+        assert(writer->index);
+    }
+
+    uint32_t size = frame->size;
+    if(writer->header.encoding == recording_encoding_rvl)
+    {
+        size = (uint32_t)rvl_encode((const uint16_t *)data, frame->size / sizeof(uint16_t), writer->encoded);
+        data = writer->encoded;
+    }
+
+    recording_frame_header frame_header = { RECORDING_FRAME_MAGIC, size, frame->timestamp };
+    recording_write_aligned(writer, &frame_header, sizeof(frame_header));
+
+    recording_index_entry *entry = writer->index + writer->header.frame_count++;
+    *entry = *frame;
+    entry->offset = writer->file_size;
+    entry->size = size;
+    recording_write_aligned(writer, data, size);
+}
+
+#if defined(_WIN32)
+static DWORD WINAPI recording_writer_thread_proc(LPVOID param)
+#elif defined(__linux__)
+static void *recording_writer_thread_proc(void *param)
+#endif
+{
+    recording_writer *writer = (recording_writer *)param;
+
+    recording_lock(writer);
+    while(1)
+    {
+        while(writer->queue_count == 0 && !writer->stopping)
+        {
+            recording_wait(writer);
+        }
+
+        // Everything that was queued before the recording was finished still ends up in the file.
+        if(writer->queue_count == 0)
+        {
+            break;
+        }
+
+        int slot = writer->queue_start;
+        recording_unlock(writer);
+
+        recording_write_frame(writer, writer->queue + (size_t)slot * writer->slot_size, &writer->queued[slot]);
+
+        recording_lock(writer);
+        writer->queue_start = (writer->queue_start + 1) % RECORDING_QUEUE_LENGTH;
+        --writer->queue_count;
+    }
+    recording_unlock(writer);
+
+    return(0);
+}
+
+// Starts a recording of frames in the format of the header, only the device, width, height, image_count, sample_size
+// and encoding of it are used. Returns NULL if the file cannot be created.
+recording_writer *recording_writer_create(const char *path, const recording_header *format, const void *intrinsics, uint32_t intrinsics_size)
+{
+    FILE *file = fopen(path, "wb");
+    if(!file)
+    {
+        fprintf(stderr, "Could not create the recording %s.\n", path);
+        return(NULL);
+    }
+
+    recording_writer *writer = (recording_writer *)calloc(1, sizeof(recording_writer));
+    writer->file = file;
+    writer->header = *format;
+    writer->header.magic = RECORDING_MAGIC;
+    writer->header.version = RECORDING_VERSION;
+    writer->header.intrinsics_size = intrinsics_size;
+    writer->header.frame_count = 0;
+    writer->header.index_offset = 0;
+
+    writer->slot_size = (size_t)recording_align((uint64_t)format->width * format->height * format->image_count * format->sample_size);
+    writer->queue = (uint8_t *)malloc(writer->slot_size * RECORDING_QUEUE_LENGTH);
+    if(format->encoding == recording_encoding_rvl)
+    {
+        assert(format->sample_size == sizeof(uint16_t));
+        writer->encoded = (uint8_t *)malloc(rvl_max_encoded_size(writer->slot_size / sizeof(uint16_t)));
+    }
+    if(!writer->queue || (format->encoding == recording_encoding_rvl && !writer->encoded))
+    {
+        fprintf(stderr, "Not enough memory available to record.\n");
+        fclose(file);
+        free(writer->queue);
+        free(writer->encoded);
+        free(writer);
+        return(NULL);
+    }
+
+    recording_write_aligned(writer, &writer->header, sizeof(recording_header));
+    recording_write_aligned(writer, intrinsics, intrinsics_size);
+
+#if defined(_WIN32)
+    InitializeCriticalSection(&writer->lock);
+    InitializeConditionVariable(&writer->queue_changed);
+    writer->thread = CreateThread(NULL, 0, recording_writer_thread_proc, writer, 0, NULL);
+#elif defined(__linux__)
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->queue_changed, NULL);
+    pthread_create(&writer->thread, NULL, recording_writer_thread_proc, writer);
+#endif
+
+    return(writer);
+}
+
+// Queues a copy of the frame, it is stamped with the time of this call. Only one thread may push frames. Returns false
+// if the frame had to be dropped because the writer thread fell behind.
+bool recording_writer_push(recording_writer *writer, const void *frame, uint32_t size)
+{
+    uint64_t now = recording_get_time();
+    if(!writer->started)
+    {
+        writer->started = true;
+        writer->start_time = now;
+    }
+
+    assert(size <= writer->slot_size);
+
+    recording_lock(writer);
+    bool full = (writer->queue_count == RECORDING_QUEUE_LENGTH);
+    int slot = (writer->queue_start + writer->queue_count) % RECORDING_QUEUE_LENGTH;
+    if(full)
+    {
+        ++writer->frames_dropped;
+    }
+    recording_unlock(writer);
+
+    if(full)
+    {
+        return(false);
+    }
+
+    // The writer thread does not look at the slot before it is counted in queue_count.
+    memcpy(writer->queue + (size_t)slot * writer->slot_size, frame, size);
+    writer->queued[slot].size = size;
+    writer->queued[slot].timestamp = now - writer->start_time;
+
+    recording_lock(writer);
+    ++writer->queue_count;
+    recording_signal(writer);
+    recording_unlock(writer);
+
+    return(true);
+}
+
+// Waits until every queued frame is in the file, writes the index and frees the writer.
+void recording_writer_close(recording_writer *writer)
+{
+    recording_lock(writer);
+    writer->stopping = true;
+    recording_signal(writer);
+    recording_unlock(writer);
+
+#if defined(_WIN32)
+    WaitForSingleObject(writer->thread, INFINITE);
+    CloseHandle(writer->thread);
+    DeleteCriticalSection(&writer->lock);
+#elif defined(__linux__)
+    pthread_join(writer->thread, NULL);
+    pthread_mutex_destroy(&writer->lock);
+    pthread_cond_destroy(&writer->queue_changed);
+#endif
+
+    writer->header.index_offset = writer->file_size;
+    recording_write_aligned(writer, writer->index, writer->header.frame_count * sizeof(recording_index_entry));
+
+    // Only now the header says the recording is complete.
+    fseek(writer->file, 0, SEEK_SET);
+    if(fwrite(&writer->header, sizeof(recording_header), 1, writer->file) != 1 || fclose(writer->file) != 0)
+    {
+        writer->write_failed = true;
+    }
+
+    if(writer->write_failed)
+    {
+        fprintf(stderr, "Writing the recording failed, it is probably incomplete.\n");
+    }
+    printf("Recorded %llu frames, %llu were dropped because the disk was too slow.\n",
+           (unsigned long long)writer->header.frame_count, (unsigned long long)writer->frames_dropped);
+
+    free(writer->index);
+    free(writer->queue);
+    free(writer->encoded);
+    free(writer);
+}
+
+//
+// reader
+
+typedef struct
+{
+    recording_header header;
+    const uint8_t *intrinsics;
+    uint64_t frame_count;
+    const recording_index_entry *index; // Points into the file, or to rebuilt_index for unfinished recordings.
+    recording_index_entry *rebuilt_index;
+    uint16_t *decoded; // The last frame that was decoded, only for recording_encoding_rvl.
+    uint64_t frame_size; // Of a frame after decoding.
+    uint8_t *view;
+    uint64_t view_size;
+} recording_reader;
+
+// Whether the file starts like a recording, without mapping it.
+bool recording_file_check(const char *path)
+{
+    uint32_t magic = 0;
+    FILE *file = fopen(path, "rb");
+    if(file)
+    {
+        if(fread(&magic, sizeof(magic), 1, file) != 1)
+        {
+            magic = 0;
+        }
+        fclose(file);
+    }
+    return(magic == RECORDING_MAGIC);
+}
+
+static void recording_unmap(recording_reader *reader)
+{
+#if defined(_WIN32)
+    UnmapViewOfFile(reader->view);
+#elif defined(__linux__)
+    munmap(reader->view, (size_t)reader->view_size);
+#endif
+    reader->view = NULL;
+}
+
+// Walks over the frame headers of a recording that was not finished. Stops at the first frame that is not completely
+// in the file.
+static void recording_rebuild_index(recording_reader *reader)
+{
+    uint64_t offset = recording_align(sizeof(recording_header)) + recording_align(reader->header.intrinsics_size);
+    uint64_t capacity = 0;
+
+    while(offset + RECORDING_ALIGNMENT <= reader->view_size)
+    {
+        const recording_frame_header *frame_header = (const recording_frame_header *)(reader->view + offset);
+        uint64_t data_offset = offset + RECORDING_ALIGNMENT;
+        if(frame_header->magic != RECORDING_FRAME_MAGIC || data_offset + frame_header->size > reader->view_size)
+        {
+            break;
+        }
+
+        if(reader->frame_count == capacity)
+        {
+            capacity = capacity ? 2 * capacity : 1024;
+            reader->rebuilt_index = (recording_index_entry *)realloc(reader->rebuilt_index, (size_t)capacity * sizeof(recording_index_entry));
+            assert(reader->rebuilt_index);
+        }
+
+        recording_index_entry *entry = reader->rebuilt_index + reader->frame_count++;
+        entry->offset = data_offset;
+        entry->size = frame_header->size;
+        entry->reserved = 0;
+        entry->timestamp = frame_header->timestamp;
+
+        offset = data_offset + recording_align(frame_header->size);
+    }
+
+    reader->index = reader->rebuilt_index;
+}
+
+// The frame of the index that is not completely in the file, or that has another size than a frame while it is stored
+// as it is, or frame_count if there is none. recording_reader_get_frame() hands out the frames without looking at them.
+static uint64_t recording_find_damaged_frame(const recording_reader *reader)
+{
+    for(uint64_t frame = 0; frame < reader->frame_count; ++frame)
+    {
+        const recording_index_entry *entry = reader->index + frame;
+        bool in_file = entry->offset <= reader->view_size && entry->size <= reader->view_size - entry->offset;
+        if(!in_file || (reader->header.encoding == recording_encoding_raw && entry->size != reader->frame_size))
+        {
+            return(frame);
+        }
+    }
+    return(reader->frame_count);
+}
+
+// Maps the recording. Nothing of it is read up front except the index, frames are only paged in when they are used.
+bool recording_reader_open(recording_reader *reader, const char *path)
+{
+    memset(reader, 0, sizeof(recording_reader));
+
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(file != INVALID_HANDLE_VALUE)
+    {
+        LARGE_INTEGER file_size;
+        if(GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0)
+        {
+            HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+            if(mapping)
+            {
+                reader->view = (uint8_t *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                reader->view_size = (uint64_t)file_size.QuadPart;
+                // the view keeps the mapping alive
+                CloseHandle(mapping);
+            }
+        }
+        CloseHandle(file);
+    }
+#elif defined(__linux__)
+    int file = open(path, O_RDONLY);
+    if(file >= 0)
+    {
+        struct stat file_status;
+        if(0 == fstat(file, &file_status) && file_status.st_size > 0)
+        {
+            void *view = mmap(NULL, (size_t)file_status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+            if(view != MAP_FAILED)
+            {
+                reader->view = (uint8_t *)view;
+                reader->view_size = (uint64_t)file_status.st_size;
+            }
+        }
+        close(file);
+    }
+#endif
+
+    if(!reader->view)
+    {
+        fprintf(stderr, "Could not open the recording %s.\n", path);
+        return(false);
+    }
+
+    if(reader->view_size < sizeof(recording_header))
+    {
+        reader->header.magic = 0;
+    }
+    else
+    {
+        memcpy(&reader->header, reader->view, sizeof(recording_header));
+    }
+
+    uint64_t intrinsics_offset = recording_align(sizeof(recording_header));
+    if(reader->header.magic != RECORDING_MAGIC || reader->header.version > RECORDING_VERSION ||
+       intrinsics_offset + reader->header.intrinsics_size > reader->view_size ||
+       (reader->header.encoding != recording_encoding_raw &&
+        (reader->header.encoding != recording_encoding_rvl || reader->header.sample_size != sizeof(uint16_t))))
+    {
+        fprintf(stderr, "%s is not a recording this version can read.\n", path);
+        recording_unmap(reader);
+        return(false);
+    }
+    reader->intrinsics = reader->view + intrinsics_offset;
+    reader->frame_size = (uint64_t)reader->header.width * reader->header.height * reader->header.image_count * reader->header.sample_size;
+
+    if(reader->header.encoding == recording_encoding_rvl)
+    {
+        reader->decoded = (uint16_t *)malloc((size_t)reader->frame_size);
+        assert(reader->decoded);
+    }
+
+    uint64_t index_offset = reader->header.index_offset;
+    if(index_offset != 0 && index_offset <= reader->view_size &&
+       reader->header.frame_count <= (reader->view_size - index_offset) / sizeof(recording_index_entry))
+    {
+        reader->index = (const recording_index_entry *)(reader->view + reader->header.index_offset);
+        reader->frame_count = reader->header.frame_count;
+    }
+    else
+    {
+        recording_rebuild_index(reader);
+        printf("The recording %s was not finished, %llu frames of it are complete.\n", path, (unsigned long long)reader->frame_count);
+    }
+
+    uint64_t damaged_frame = recording_find_damaged_frame(reader);
+    if(damaged_frame < reader->frame_count)
+    {
+        fprintf(stderr, "The recording %s is damaged, frame %llu of it is cut off or has the wrong size.\n", path,
+                (unsigned long long)damaged_frame);
+        recording_unmap(reader);
+        free(reader->rebuilt_index);
+        free(reader->decoded);
+        memset(reader, 0, sizeof(recording_reader));
+        return(false);
+    }
+
+    return(true);
+}
+
+// The samples of a frame. Stored as they are they come straight from the file and stay valid until the reader is
+// closed, compressed ones only until the next call. Returns NULL if the frame cannot be decoded.
+const void *recording_reader_get_frame(recording_reader *reader, uint64_t frame)
+{
+    assert(frame < reader->frame_count);
+    const uint8_t *data = reader->view + reader->index[frame].offset;
+
+    if(reader->header.encoding == recording_encoding_rvl)
+    {
+        if(!rvl_decode(data, reader->index[frame].size, reader->decoded, (size_t)(reader->frame_size / sizeof(uint16_t))))
+        {
+            fprintf(stderr, "Frame %llu of the recording is damaged.\n", (unsigned long long)frame);
+            return(NULL);
+        }
+        return(reader->decoded);
+    }
+
+    return(data);
+}
+
+void recording_reader_close(recording_reader *reader)
+{
+    recording_unmap(reader);
+    free(reader->rebuilt_index);
+    free(reader->decoded);
+    reader->rebuilt_index = NULL;
+    reader->decoded = NULL;
+    reader->index = NULL;
+}
+
+//
+// player
+
+// Plays a recording in a loop. Paced, it hands out the frames when they are due according to their timestamps and
+// skips the ones the visualizer was too slow for, like the camera would. Otherwise it hands out every frame in order as
+// fast as it is asked for them, which makes two runs over the same recording see exactly the same frames.
+typedef struct
+{
+    recording_reader reader;
+    bool paced;
+    uint64_t next;
+    uint64_t loop_start; // When the first frame of the current pass was due.
+} recording_player;
+
+bool recording_player_open(recording_player *player, const char *path, bool paced)
+{
+    if(!recording_reader_open(&player->reader, path))
+    {
+        return(false);
+    }
+
+    if(player->reader.frame_count == 0)
+    {
+        fprintf(stderr, "The recording %s has no frames.\n", path);
+        recording_reader_close(&player->reader);
+        return(false);
+    }
+
+    player->paced = paced;
+    player->next = 0;
+    player->loop_start = recording_get_time();
+    return(true);
+}
+
+// The length of one pass: up to the last frame and one more frame period.
+static uint64_t recording_player_length(recording_player *player)
+{
+    uint64_t frame_count = player->reader.frame_count;
+    uint64_t last = player->reader.index[frame_count - 1].timestamp;
+    uint64_t length = (frame_count > 1) ? last + last / (frame_count - 1) : 0;
+    return((length > 0) ? length : 1);
+}
+
+// Never waits. Returns the number of the frame to show or -1 if no frame became due since the last call.
+int64_t recording_player_next(recording_player *player)
+{
+    recording_reader *reader = &player->reader;
+
+    if(!player->paced)
+    {
+        int64_t frame = (int64_t)player->next;
+        player->next = (player->next + 1) % reader->frame_count;
+        return(frame);
+    }
+
+    uint64_t elapsed = recording_get_time() - player->loop_start;
+
+    if(player->next == reader->frame_count)
+    {
+        uint64_t length = recording_player_length(player);
+        if(elapsed < length)
+        {
+            return(-1);
+        }
+
+        // After a long pause the next pass starts now instead of rushing through the frames that were missed.
+        uint64_t passes = elapsed / length;
+        player->loop_start += (passes > 1) ? elapsed : passes * length;
+        elapsed = (passes > 1) ? 0 : elapsed - length;
+        player->next = 0;
+    }
+
+    int64_t frame = -1;
+    while(player->next < reader->frame_count && reader->index[player->next].timestamp <= elapsed)
+    {
+        frame = (int64_t)player->next++;
+    }
+
+    return(frame);
+}
+
+// How long until recording_player_next() has a frame, in nanoseconds.
+static uint64_t recording_player_time_to_next(recording_player *player)
+{
+    if(!player->paced)
+    {
+        return(0);
+    }
+
+    uint64_t elapsed = recording_get_time() - player->loop_start;
+    uint64_t due = (player->next < player->reader.frame_count) ? player->reader.index[player->next].timestamp : recording_player_length(player);
+    return((due > elapsed) ? due - elapsed : 0);
+}
+
+// Like recording_player_next() but waits at most timeout_in_milliseconds for the next frame to become due.
+int64_t recording_player_wait(recording_player *player, int timeout_in_milliseconds)
+{
+    int64_t frame = recording_player_next(player);
+    if(frame >= 0)
+    {
+        return(frame);
+    }
+
+    uint64_t wait = recording_player_time_to_next(player);
+    uint64_t timeout = (uint64_t)timeout_in_milliseconds * 1000000ull;
+    if(wait > timeout)
+    {
+        wait = timeout;
+    }
+
+#if defined(_WIN32)
+    Sleep((DWORD)((wait + 999999ull) / 1000000ull));
+#elif defined(__linux__)
+    struct timespec duration = { (time_t)(wait / 1000000000ull), (long)(wait % 1000000000ull) };
+    nanosleep(&duration, NULL);
+#endif
+
+    return(recording_player_next(player));
+}
+
+void recording_player_close(recording_player *player)
+{
+    recording_reader_close(&player->reader);
+}
@@ -0,0 +1,348 @@
+//
+// io_uring ingest backend (Linux only)
+//
+// One multishot receive stays armed on the socket for as long as possible. The kernel picks the memory for every
+// receive from a ring of buffers we registered up front, so there is no system call per receive and the producer
+// thread only wakes up when data has arrived. The completions of a multishot receive come in stream order and are run
+// through the same state machine the socket path uses.
+//
+// There is no liburing dependency, the ring is set up with the raw system calls.
+
+#define URING_ENTRY_COUNT 4
+#define URING_BUFFER_COUNT 64 // Has to be a power of 2.
+#define URING_BUFFER_SIZE (64 * 1024)
+#define URING_BUFFER_GROUP 0
+#define URING_WAIT_TIMEOUT_NS 100000000 // So a blocking GetDepthImage() can still be cancelled when the camera stops sending.
+
+struct uring_ingest
+{
+    int RingFile;
+    socket_t Socket;
+
+    // The mappings and their sizes so they can be unmapped again. A mapping that was not created is NULL.
+    uint8_t *Ring; // The submission and the completion ring share it.
+    size_t RingSize;
+    size_t SubmissionEntriesSize;
+    size_t BufferRingSize;
+    size_t BufferMemorySize;
+
+    unsigned *SubmissionTail;
+    unsigned SubmissionMask;
+    unsigned *SubmissionArray;
+    struct io_uring_sqe *SubmissionEntries;
+
+    unsigned *CompletionHead;
+    unsigned *CompletionTail;
+    unsigned CompletionMask;
+    struct io_uring_cqe *CompletionEntries;
+
+    struct io_uring_buf_ring *BufferRing;
+    uint8_t *BufferMemory;
+    unsigned short BufferTail;
+
+    bool Armed;
+    bool ReceivedAnything;
+
+    // A completion whose rest belongs to the next frame.
+    int PendingBuffer;
+    int PendingOffset;
+    int PendingSize;
+};
+
+static int UringSetup(unsigned Entries, struct io_uring_params *Params)
+{
+    return((int)syscall(__NR_io_uring_setup, Entries, Params));
+}
+
+static int UringEnter(int RingFile, unsigned ToSubmit, unsigned MinComplete, unsigned Flags, void *Argument, size_t ArgumentSize)
+{
+    return((int)syscall(__NR_io_uring_enter, RingFile, ToSubmit, MinComplete, Flags, Argument, ArgumentSize));
+}
+
+static int UringRegister(int RingFile, unsigned Opcode, void *Argument, unsigned ArgumentCount)
+{
+    return((int)syscall(__NR_io_uring_register, RingFile, Opcode, Argument, ArgumentCount));
+}
+
+// Hands a buffer back to the kernel so the multishot receive can fill it again.
+static void RecycleUringBuffer(uring_ingest *Uring, int BufferID)
+{
+    struct io_uring_buf *Entry = &Uring->BufferRing->bufs[Uring->BufferTail & (URING_BUFFER_COUNT - 1)];
+    Entry->addr = (uint64_t)(uintptr_t)(Uring->BufferMemory + (size_t)BufferID * URING_BUFFER_SIZE);
+    Entry->len = URING_BUFFER_SIZE;
+    Entry->bid = (unsigned short)BufferID;
+
+    ++Uring->BufferTail;
+    __atomic_store_n(&Uring->BufferRing->tail, Uring->BufferTail, __ATOMIC_RELEASE);
+}
+
+// Queues the multishot receive. It is submitted with the next UringEnter().
+static void ArmUringReceive(uring_ingest *Uring)
+{
+    unsigned Tail = *Uring->SubmissionTail;
+    unsigned Index = Tail & Uring->SubmissionMask;
+
+    struct io_uring_sqe *Entry = &Uring->SubmissionEntries[Index];
+    memset(Entry, 0, sizeof(*Entry));
+    Entry->opcode = IORING_OP_RECV;
+    Entry->fd = Uring->Socket;
+    Entry->ioprio = IORING_RECV_MULTISHOT;
+    Entry->flags = IOSQE_BUFFER_SELECT;
+    Entry->buf_group = URING_BUFFER_GROUP;
+
+    Uring->SubmissionArray[Index] = Index;
+    __atomic_store_n(Uring->SubmissionTail, Tail + 1, __ATOMIC_RELEASE);
+
+    Uring->Armed = true;
+}
+
+static void UnmapUring(void *Memory, size_t Size)
+{
+    if(Memory && Memory != MAP_FAILED)
+    {
+        munmap(Memory, Size);
+    }
+}
+
+// Also cleans up after a CreateUringIngest() that failed half way.
+static void DestroyUringIngest(uring_ingest *Uring)
+{
+    if(Uring->RingFile >= 0)
+    {
+        close(Uring->RingFile);
+    }
+
+    UnmapUring(Uring->Ring, Uring->RingSize);
+    UnmapUring(Uring->SubmissionEntries, Uring->SubmissionEntriesSize);
+    UnmapUring(Uring->BufferRing, Uring->BufferRingSize);
+    UnmapUring(Uring->BufferMemory, Uring->BufferMemorySize);
+    free(Uring);
+}
+
+// Returns NULL if the kernel is missing anything we need, the caller then uses the socket path.
+static uring_ingest *CreateUringIngest(socket_t Socket)
+{
+    uring_ingest *Uring = (uring_ingest *)calloc(1, sizeof(uring_ingest));
+    if(!Uring)
+    {
+        return(NULL);
+    }
+    Uring->Socket = Socket;
+    Uring->PendingBuffer = -1;
+
+    // No IORING_SETUP_COOP_TASKRUN: the receiver thread waits for the ring with epoll and that has to see the
+    // completions without the thread entering the kernel for the ring first.
+    struct io_uring_params Params;
+    memset(&Params, 0, sizeof(Params));
+    Uring->RingFile = UringSetup(URING_ENTRY_COUNT, &Params);
+
+    // We need the single mmap and the timeout argument for waiting (5.11).
+    if(Uring->RingFile < 0 || !(Params.features & IORING_FEAT_SINGLE_MMAP) || !(Params.features & IORING_FEAT_EXT_ARG))
+    {
+        DestroyUringIngest(Uring);
+        return(NULL);
+    }
+
+    size_t SubmissionRingSize = Params.sq_off.array + Params.sq_entries * sizeof(unsigned);
+    size_t CompletionRingSize = Params.cq_off.cqes + Params.cq_entries * sizeof(struct io_uring_cqe);
+    Uring->RingSize = (SubmissionRingSize > CompletionRingSize) ? SubmissionRingSize : CompletionRingSize;
+    Uring->SubmissionEntriesSize = Params.sq_entries * sizeof(struct io_uring_sqe);
+
+    Uring->Ring = (uint8_t *)mmap(NULL, Uring->RingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, Uring->RingFile, IORING_OFF_SQ_RING);
+    Uring->SubmissionEntries = (struct io_uring_sqe *)mmap(NULL, Uring->SubmissionEntriesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, Uring->RingFile, IORING_OFF_SQES);
+    if(Uring->Ring == MAP_FAILED || Uring->SubmissionEntries == MAP_FAILED)
+    {
+        DestroyUringIngest(Uring);
+        return(NULL);
+    }
+
+    uint8_t *Ring = Uring->Ring;
+
+    Uring->SubmissionTail = (unsigned *)(Ring + Params.sq_off.tail);
+    Uring->SubmissionMask = *(unsigned *)(Ring + Params.sq_off.ring_mask);
+    Uring->SubmissionArray = (unsigned *)(Ring + Params.sq_off.array);
+
+    Uring->CompletionHead = (unsigned *)(Ring + Params.cq_off.head);
+    Uring->CompletionTail = (unsigned *)(Ring + Params.cq_off.tail);
+    Uring->CompletionMask = *(unsigned *)(Ring + Params.cq_off.ring_mask);
+    Uring->CompletionEntries = (struct io_uring_cqe *)(Ring + Params.cq_off.cqes);
+
+    // The ring of buffer descriptors and the buffers themselves. Both stay registered with the kernel for the lifetime
+    // of the stream.
+    Uring->BufferRingSize = URING_BUFFER_COUNT * sizeof(struct io_uring_buf);
+    Uring->BufferMemorySize = (size_t)URING_BUFFER_COUNT * URING_BUFFER_SIZE;
+    Uring->BufferRing = (struct io_uring_buf_ring *)mmap(NULL, Uring->BufferRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    Uring->BufferMemory = (uint8_t *)mmap(NULL, Uring->BufferMemorySize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if(Uring->BufferRing == MAP_FAILED || Uring->BufferMemory == MAP_FAILED)
+    {
+        DestroyUringIngest(Uring);
+        return(NULL);
+    }
+
+    struct io_uring_buf_reg Registration;
+    memset(&Registration, 0, sizeof(Registration));
+    Registration.ring_addr = (uint64_t)(uintptr_t)Uring->BufferRing;
+    Registration.ring_entries = URING_BUFFER_COUNT;
+    Registration.bgid = URING_BUFFER_GROUP;
+    if(0 != UringRegister(Uring->RingFile, IORING_REGISTER_PBUF_RING, &Registration, 1))
+    {
+        DestroyUringIngest(Uring);
+        return(NULL);
+    }
+
+    for(int BufferID = 0; BufferID < URING_BUFFER_COUNT; ++BufferID)
+    {
+        RecycleUringBuffer(Uring, BufferID);
+    }
+
+    return(Uring);
+}
+
+// Feeds the rest of a buffer into the state machine. Returns true if a frame got finished, the remaining bytes are kept
+// for the next frame. Otherwise the buffer goes back to the kernel.
+static bool ConsumeUringBuffer(ingest_stream *Stream, uint8_t *Buffer, int BufferID, int Offset, int Size)
+{
+    uring_ingest *Uring = Stream->Uring;
+    uint8_t *Data = Uring->BufferMemory + (size_t)BufferID * URING_BUFFER_SIZE;
+
+    int Consumed = 0;
+    bool FrameDone = ConsumeBytes(Stream, Buffer, Data + Offset, Size - Offset, &Consumed);
+
+    if(Offset + Consumed < Size)
+    {
+        Uring->PendingBuffer = BufferID;
+        Uring->PendingOffset = Offset + Consumed;
+        Uring->PendingSize = Size;
+    }
+    else
+    {
+        Uring->PendingBuffer = -1;
+        RecycleUringBuffer(Uring, BufferID);
+    }
+
+    return(FrameDone);
+}
+
+static ingest_result ReceiveDepthImage(ingest_stream *Stream, uint8_t *Buffer, bool Block);
+
+// Same as the socket path of GetDepthImage(). With Block set it returns once a complete frame is in Buffer. Otherwise
+// it only looks at the completions that are already there and returns IngestResult_Pending when they are used up or a
+// quad was completed. IngestResult_Disconnected means the connection or the ring failed.
+static ingest_result GetDepthImageUring(ingest_stream *Stream, uint8_t *Buffer, bool Block)
+{
+    uring_ingest *Uring = Stream->Uring;
+
+    if(Uring->PendingBuffer >= 0)
+    {
+        if(ConsumeUringBuffer(Stream, Buffer, Uring->PendingBuffer, Uring->PendingOffset, Uring->PendingSize))
+        {
+            return(IngestResult_Frame);
+        }
+    }
+
+    bool Flushed = false;
+    while(1)
+    {
+        unsigned Head = *Uring->CompletionHead;
+        unsigned Tail = __atomic_load_n(Uring->CompletionTail, __ATOMIC_ACQUIRE);
+
+        if(Head == Tail)
+        {
+            unsigned ToSubmit = 0;
+            if(!Uring->Armed)
+            {
+                ArmUringReceive(Uring);
+                ToSubmit = 1;
+            }
+
+            if(!Block)
+            {
+                // The ring also polls as readable if completions are only queued up as task work. Entering the kernel
+                // without waiting runs that work, and it submits the receive if it has to be armed again. If there is
+                // still nothing after that the caller can go back to sleep.
+                if(Flushed && !ToSubmit)
+                {
+                    return(IngestResult_Pending);
+                }
+
+                ++Stream->ReceiveCalls;
+                if(UringEnter(Uring->RingFile, ToSubmit, 0, IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR)
+                {
+                    fprintf(stderr, "io_uring_enter() failed. Error: %d\n", errno);
+                    return(IngestResult_Disconnected);
+                }
+                Flushed = true;
+                continue;
+            }
+
+            struct __kernel_timespec Timeout = { 0, URING_WAIT_TIMEOUT_NS };
+            struct io_uring_getevents_arg Argument;
+            memset(&Argument, 0, sizeof(Argument));
+            Argument.ts = (uint64_t)(uintptr_t)&Timeout;
+
+            ++Stream->ReceiveCalls;
+            int Result = UringEnter(Uring->RingFile, ToSubmit, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &Argument, sizeof(Argument));
+            if(Result < 0 && errno != ETIME && errno != EINTR)
+            {
+                fprintf(stderr, "io_uring_enter() failed. Error: %d\n", errno);
+                return(IngestResult_Disconnected);
+            }
+
+            // io_uring_enter() is not a cancellation point.
+            pthread_testcancel();
+            continue;
+        }
+
+        struct io_uring_cqe *Completion = &Uring->CompletionEntries[Head & Uring->CompletionMask];
+        int Result = Completion->res;
+        unsigned Flags = Completion->flags;
+        __atomic_store_n(Uring->CompletionHead, Head + 1, __ATOMIC_RELEASE);
+
+        if(!(Flags & IORING_CQE_F_MORE))
+        {
+            // The multishot receive stopped, e.g. because all buffers are in use. It gets armed again next time we wait.
+            Uring->Armed = false;
+        }
+
+        if(Result > 0)
+        {
+            Uring->ReceivedAnything = true;
+
+            int BufferID = (int)(Flags >> IORING_CQE_BUFFER_SHIFT);
+            int QuadsFinished = Stream->QuadsFinished;
+            if(ConsumeUringBuffer(Stream, Buffer, BufferID, 0, Result))
+            {
+                return(IngestResult_Frame);
+            }
+
+            // Give the caller the chance to hand out the quad right away.
+            if(!Block && QuadsFinished != Stream->QuadsFinished)
+            {
+                return(IngestResult_Pending);
+            }
+        }
+        else if(Result == 0)
+        {
+            fprintf(stderr, "The camera closed the connection.\n");
+            return(IngestResult_Disconnected);
+        }
+        else if(Result == -ENOBUFS)
+        {
+            // Nothing got lost, the data is still in the socket.
+        }
+        else if(!Uring->ReceivedAnything && (Result == -EINVAL || Result == -EOPNOTSUPP))
+        {
+            // The kernel has io_uring but no multishot receives (before 6.0). Nothing was received yet so we can
+            // still switch over to the socket.
+            fprintf(stderr, "io_uring does not support multishot receives, receiving from the socket directly.\n");
+            Stream->Uring = NULL;
+            DestroyUringIngest(Uring);
+            return(ReceiveDepthImage(Stream, Buffer, Block));
+        }
+        else
+        {
+            fprintf(stderr, "io_uring receive failed. Error: %d\n", -Result);
+            return(IngestResult_Disconnected);
+        }
+    }
+}
@@ -10,6 +10,11 @@
 #include <pcl/visualization/pcl_visualizer.h>
 
 #include "network.c"
+#include "rvl.c"
+#include "recording.c"
+#include "depth_source.c"
+#include "job_system.c"
+#include "colormap.c"
 
 #define clamp(x, low, high) std::max(low, std::min(high, x))
 
@@ -28,6 +33,15 @@ typedef struct
 }
 v3f;
 
+typedef struct
+{
+    int16_t x, y, z; // In millimeters.
+    uint16_t hue; // In 1/65535 of the color circle.
+}
+packed_point;
+
+#include "point_cloud.c"
+
 typedef struct
 {
     struct
@@ -48,114 +62,42 @@ typedef struct
 }
 point;
 
-v3f HSV2RGB(v3f HSV) 
+// PCL looks down the other z axis than the OpenGL visualizers point_cloud.c computes the points for.
+#define POINT_CONVERSION_GRAIN 8192 // Points per tile.
+
+typedef struct
 {
-	v3f RGB;
-	
-    int I;
-    float F, P, Q, T;
-	
-	float H = HSV.x;
-	float S = HSV.y;
-	float V = HSV.z;
-	
-    if (S == 0) // No saturation => grayscale; V == lightness/darkness
-	{
-        RGB = { V, V, V };
-    }
-	else
-	{
-		H *= 6;
-		I = (int)H;
-		F = H - I;
-		P = V * (1 - S);
-		Q = V * (1 - S * F);
-		T = V * (1 - S * (1 - F));
-		switch (I) {
-			case 0:  RGB = {V, T, P}; break;
-			case 1:  RGB = {Q, V, P}; break;
-			case 2:  RGB = {P, V, T}; break;
-			case 3:  RGB = {P, Q, V}; break;
-			case 4:  RGB = {T, P, V}; break;
-			default: RGB = {V, P, Q}; break;
-		}
-	}
-	
-	return(RGB);
+    const packed_point *Points;
+    pcl::PointXYZRGB *Converted;
+    const uint8_t *Colormap; // See colormap.c.
 }
+point_conversion;
 
-static void calculate_point_cloud(point *PointCloud, uint32_t *PointCount, v2f *XYMap, uint16_t *DepthMap, int DepthMapCount)
+// M switches to the next colormap.
+static void KeyboardCallback(const pcl::visualization::KeyboardEvent &Event, void *Data)
 {
-    uint32_t InsertIndex = 0;
-    for(size_t i = 0; i < DepthMapCount; ++i)
+    colormap_kind *Kind = (colormap_kind *)Data;
+    if(Event.keyDown() && (Event.getKeySym() == "m" || Event.getKeySym() == "M"))
     {
-        float d = (float)DepthMap[i];
-        
-        point Point;
-        Point.Position.X = XYMap[i].x * d / 1000.0f;
-        Point.Position.Y = -XYMap[i].y * d / 1000.0f;
-        Point.Position.Z = -d / 1000.0f;
-        
-        if(Point.Position.Z != 0.0f)
-        {
-            // interpolate
-            float min_z = 0.5f;
-            float max_z = 3.86f;
-            
-            float hue = (-Point.Position.Z - min_z) / (max_z - min_z);
-            hue = clamp(hue, 0.0f, 1.0f);
-
-            // the hue of the hsv color goes from red to red so we want to scale with 2/3 which is blue
-            float range = 2.0f / 3.0f;
-            
-            hue *= range;
-            hue = range - hue;
-
-            v3f RGB = HSV2RGB({ hue, 1.0f, 1.0f });
-
-            Point.Color.R = RGB.x;
-            Point.Color.G = RGB.y;
-            Point.Color.B = RGB.z;
-
-            PointCloud[InsertIndex++] = Point;
-        }
+        *Kind = (colormap_kind)((*Kind + 1) % COLORMAP_COUNT);
     }
-
-    *PointCount = InsertIndex;
 }
 
-void to_proper_layout(uint8_t *depth_map, size_t depth_map_size, size_t single_image_size, int width, int height, uint8_t *scratch_memory)
+static void ConvertPoints(void *Data, int Begin, int End)
 {
-    memcpy(scratch_memory, depth_map, depth_map_size);
-
-    size_t row_size = width * sizeof(int);
-
-    int k = 0;
-    for(int i = 0; i < 4; ++i)
+    point_conversion *Conversion = (point_conversion *)Data;
+    for(int i = Begin; i < End; ++i)
     {
-        uint8_t *scratch_image = scratch_memory + i * single_image_size;
-
-        // go through image by 2 rows starting at the end and going to 1
-        for(int j = height - 2; j >= 0; j -= 2)
-        {
-            uint8_t *scratch_row = scratch_image + j * row_size;
-            uint8_t *row = depth_map + k * row_size;
-
-            memcpy(row, scratch_row, row_size);
-
-            ++k;
-        }
-
-        // go through image by 2 rows starting at beginning going to end
-        for(int j = 1; j < height; j += 2)
-        {
-            uint8_t *scratch_row = scratch_image + j * row_size;
-            uint8_t *row = depth_map + k * row_size;
-
-            memcpy(row, scratch_row, row_size);
-        
-            ++k;
-        }
+        const packed_point *In = Conversion->Points + i;
+        pcl::PointXYZRGB &Point = Conversion->Converted[i];
+        Point.x = -In->x * 0.001f;
+        Point.y = In->y * 0.001f;
+        Point.z = -In->z * 0.001f;
+
+        const uint8_t *RGBA = Conversion->Colormap + colormap_index_16(In->hue) * 4;
+        Point.r = RGBA[0];
+        Point.g = RGBA[1];
+        Point.b = RGBA[2];
     }
 }
 
@@ -191,50 +133,27 @@ static void PrintFPS(float DeltaTime)
     }
 }
 
-int main(void)
+int main(int ArgumentCount, char **Arguments)
 {
-    connection Connection =
-    {
-        INVALID_SOCKET,
-        INVALID_SOCKET
-    };
+    // The camera, a recording or a synthetic scene, see depth_source.c for the arguments. For the camera this waits
+    // until it connected and starts the "producer" thread that gets the data from it.
+    depth_source Source_;
+    depth_source *Source = &Source_;
 
-    // This will create a socket, bind it, listen and accept when a connection comes in.
-    int Connected = Connect(&Connection);
-    if(0 == Connected)
+    if(OpenDepthSource(Source, ArgumentCount, Arguments))
     {
-        int depth_map_width = 320;
-        int depth_map_height = 240;
-        int depth_image_size = 307200;
-
-        size_t depth_map_size = depth_image_size * 4;
-
-        uint8_t *depth_map = (uint8_t *)malloc(depth_map_size);
-        if(NULL == depth_map)
-        {
-            fprintf(stderr, "Not enough memory available to run this process.\n");
-            exit(-1);
-        }
-
-        // Allocate memory to temporarily operate in when laying out memory properly.
-        uint8_t *scratch_memory = (uint8_t *)malloc(depth_map_size);
-        if(NULL == scratch_memory)
-        {
-            fprintf(stderr, "Not enough memory available to run.\n");
-            exit(-1);
-        }
-
-        // This all relevant data the thread functions needs. (Kinda like normal function parameters.)
-        get_depth_image_data ThreadDataIn = 
-        {
-            Connection.Client,
-            depth_map,
-            depth_map_size,
-            depth_image_size
-        };
-
-        // Starts a producer thread that gets the data from the ToF-camera and puts it into depth_map.
-        CreateMyThread(&ThreadDataIn);
+        // The distance per radian of phase and the direction of every pixel are computed once, see point_cloud.c.
+        depth_source_intrinsics Intrinsics;
+        GetDepthSourceIntrinsics(Source, &Intrinsics);
+        ray_table Rays = CreateRayTable(&Intrinsics, Source->MinAmplitude, Source->Filter, false);
+        packed_point *Points = (packed_point *)malloc((size_t)Rays.PixelCount * sizeof(packed_point));
+        packed_point *Scratch = (packed_point *)malloc((size_t)Rays.PixelCount * sizeof(packed_point));
+        assert(Points && Scratch);
+        // The distance of every pixel in the last frame for the temporal filter, updated in place.
+        float *History = Source->Temporal ? (float *)calloc(Rays.PixelCount, sizeof(float)) : NULL;
+
+        // The point cloud and its conversion are computed on every core, see point_cloud.c.
+        job_system *Jobs = job_system_create(0);
 
         boost::shared_ptr<pcl::visualization::PCLVisualizer> viewer (new pcl::visualization::PCLVisualizer ("3D Viewer"));
         pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_ptr (new pcl::PointCloud<pcl::PointXYZRGB>);
@@ -244,87 +163,41 @@ int main(void)
         viewer->addCoordinateSystem(1.0);
         viewer->initCameraParameters();
 
-        float DeltaTime = 0.0f;
+        // The colors of the points, switched from the keyboard callback.
+        colormap_kind ColormapKind = COLORMAP_HUE;
+        colormap_kind RequestedColormapKind = COLORMAP_HUE;
+        uint8_t Colormap[COLORMAP_SIZE * 4];
+        colormap_build(ColormapKind, Colormap);
+        viewer->registerKeyboardCallback(KeyboardCallback, &RequestedColormapKind);
 
-        int *depth_map_int = (int *)depth_map;
+        float DeltaTime = 0.0f;
 
         while(!viewer->wasStopped())
         {
             std::chrono::steady_clock::time_point Begin = std::chrono::steady_clock::now();
 
-            // Here we are waiting for the producer thread to signal that the Buffer is full. We time out at 5ms which is ~200 Hz.
-            if(WaitForOtherThread(5))
+            if(RequestedColormapKind != ColormapKind)
             {
-                // to_proper_layout() lays the depth data out in 4 consecutive images. Here we use the extra memory we allocated earlier.
-                to_proper_layout(depth_map, depth_map_size, depth_image_size, depth_map_width, depth_map_height, scratch_memory);
+                ColormapKind = RequestedColormapKind;
+                colormap_build(ColormapKind, Colormap);
+                printf("Colormap: %s\n", colormap_name(ColormapKind));
+            }
 
+            // Here we pick up the newest frame the producer thread has finished. If there is none yet we wait for one
+            // but time out at 5ms which is ~200 Hz. The producer keeps receiving into another slot in the meantime.
+            depth_sample *depth_map_samples = NextDepthFrame(Source, 5);
+            if(depth_map_samples)
+            {
                 // fill PCL point cloud with new data
-                cloud_ptr->points.clear();
-            
-                uint32_t InsertIndex = 0;
-                int depth_map_count = depth_map_width * depth_map_height;
-                for(int i = 0; i < depth_map_count; ++i)
-                {
-                    int pixel[2] = { i % depth_map_width, i / depth_map_width };
-                    int principal_point[2] = { depth_map_width / 2, depth_map_height / 2 };
+                uint32_t PointCount = ComputePointCloud(Jobs, Points, Scratch, &Rays, depth_map_samples, History);
+                cloud_ptr->points.resize(PointCount);
+                point_conversion Conversion = { Points, cloud_ptr->points.data(), Colormap };
+                job_parallel_for(Jobs, (int)PointCount, POINT_CONVERSION_GRAIN, ConvertPoints, &Conversion);
 
-                    int d0 = (depth_map_int[i + depth_map_count * 0] & 0xFFF) - 2048;
-                    int d1 = (depth_map_int[i + depth_map_count * 1] & 0xFFF) - 2048;
-                    int d2 = (depth_map_int[i + depth_map_count * 2] & 0xFFF) - 2048;
-                    int d3 = (depth_map_int[i + depth_map_count * 3] & 0xFFF) - 2048;
-
-                    float diff0 = (float)(d3 - d1);
-                    float diff1 = (float)(d2 - d0);
-
-                    float c = 300000000.0f;
-                    float f = 12000000.0f;
-                    float pi = 3.1416f;
-
-                    float depth = (c / 2) * (1 / (2 * pi * f)) * (pi + atan2f(diff0, diff1));
-
-                    float focal_length = 50.0f * 3.7f; // pixels per mm * focal length [mm]
-
-                    float x = (pixel[0] - principal_point[0]) / focal_length;
-                    float y = (pixel[1] - principal_point[1]) / focal_length;
-
-                    float z = depth / sqrtf(x * x + y * y + 1);
-                    
-                    pcl::PointXYZRGB Point;
-                    Point.x = -x * z;
-                    Point.y = y * z;
-                    Point.z = z;
-
-                    float min_z = 0.0f;
-                    float max_z = 12.5f;
-                    
-                    if(z != 0.0f || z >= min_z || z <= max_z)
-                    {
-                        // interpolate
-                        
-                        float hue = (z - min_z) / (max_z - min_z);
-                        hue = clamp(hue, 0.0f, 1.0f);
-
-                        // the hue of the hsv color goes from red to red so we want to scale with 2/3 which is blue
-                        float range = 2.0f / 3.0f;
-                        
-                        hue *= range;
-                        hue = range - hue;
-
-                        v3f RGB = HSV2RGB({ hue, 1.0f, 1.0f });
-
-                        Point.r = RGB.x * 255;
-                        Point.g = RGB.y * 255;
-                        Point.b = RGB.z * 255;
-
-                        cloud_ptr->points.push_back(Point);
-                    }
-                }
+                ReleaseDepthFrame(Source, depth_map_samples);
 
                 cloud_ptr->width = (int)cloud_ptr->points.size();
                 cloud_ptr->height = 1;
-                
-                // Signal that the buffer was read so that the producer thread can start filling in the depth buffer.
-                SignalOtherThread();
             }
 
             // display using pcl
@@ -336,17 +209,16 @@ int main(void)
             PrintFPS(DeltaTime);
         }
         
-        free(scratch_memory);
-        free(depth_map);
-
-        TerminateMyThread();
-
-        Disconnect(Connection.Host);
-        
+        job_system_destroy(Jobs);
+        free(Points);
+        free(Scratch);
+        free(History);
+        FreeRayTable(&Rays);
+        CloseDepthSource(Source);
     }
     else
     {
-        fprintf(stderr, "Failed to establish a connection.\n");
+        fprintf(stderr, "Failed to open the depth source.\n");
         return(-1);
     }
 
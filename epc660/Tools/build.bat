@@ -0,0 +1,27 @@
+@echo off
+
+IF NOT EXIST build mkdir build
+pushd build
+
+set compile_flags=/std:c11 /nologo /GR- /EHa- /Oi /WX /W4 /wd4100 /wd4189 /external:anglebrackets /external:W0 /FC
+set linker_flags=/opt:ref /subsystem:console ws2_32.lib
+
+echo Building...
+echo:
+
+echo ingest_benchmark
+cl %compile_flags% /MT /O2 /D "RELEASE" /D "NDEBUG" /D "_CRT_SECURE_NO_WARNINGS" /Fe"ingest_benchmark" ../code/ingest_benchmark.c /link %linker_flags%
+
+echo:
+echo camera_emulator
+cl %compile_flags% /MT /O2 /D "RELEASE" /D "NDEBUG" /D "_CRT_SECURE_NO_WARNINGS" /Fe"camera_emulator" ../code/camera_emulator.c /link %linker_flags%
+
+echo:
+echo rvl_benchmark
+cl %compile_flags% /MT /O2 /D "RELEASE" /D "NDEBUG" /D "_CRT_SECURE_NO_WARNINGS" /Fe"rvl_benchmark" ../code/rvl_benchmark.c /link %linker_flags%
+
+echo:
+echo point_cloud_benchmark
+cl %compile_flags% /MT /O2 /D "RELEASE" /D "NDEBUG" /D "_CRT_SECURE_NO_WARNINGS" /Fe"point_cloud_benchmark" ../code/point_cloud_benchmark.c /link %linker_flags%
+
+popd
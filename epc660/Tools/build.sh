@@ -0,0 +1,24 @@
+#!/bin/bash
+
+mkdir -p build
+pushd build >/dev/null 2>&1
+
+printf "Building...\n\n"
+
+printf "ingest_benchmark\n\n"
+
+gcc -o ingest_benchmark ../code/ingest_benchmark.c -O3 -g0 -DRELEASE -DNDEBUG -lm -lrt -pthread
+
+printf "\ncamera_emulator\n\n"
+
+gcc -o camera_emulator ../code/camera_emulator.c -O3 -g0 -DRELEASE -DNDEBUG -lm -lrt -pthread
+
+printf "\nrvl_benchmark\n\n"
+
+gcc -o rvl_benchmark ../code/rvl_benchmark.c -O3 -g0 -DRELEASE -DNDEBUG -lm -lrt -pthread
+
+printf "\npoint_cloud_benchmark\n\n"
+
+gcc -o point_cloud_benchmark ../code/point_cloud_benchmark.c -O3 -g0 -DRELEASE -DNDEBUG -lm -lrt -pthread
+
+popd >/dev/null 2>&1
@@ -0,0 +1,369 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <memory.h>
+
+#include "../../OpenGL/code/network.c"
+#include "../../OpenGL/code/rvl.c"
+#include "../../OpenGL/code/recording.c"
+#include "../../OpenGL/code/depth_source.c"
+
+/*
+Plays the epc660 for a visualizer on a machine without the camera. It connects to the port the visualizers listen on
+and sends frames exactly the way the camera does: every frame as 4 quads, or 8 for two modulation frequencies, each of
+them the 16 byte preamble, the 8 bytes of image data information and the rows of samples in the order the camera sends
+them.
+
+The frames come from the same depth sources the visualizers can read, so the emulator can send the synthetic scene, a
+recording or a dump of what the camera sent. Every frame is encoded again, which means a dump may start with any quad
+of a frame. The frames have two modulation frequencies when the source has them, e.g. "synthetic dual".
+
+Usage: camera_emulator [options] [synthetic [dual] | replay <recording or dump file> [fast]]
+
+  -r <frames per second>  0 sends as fast as the connection takes the data (line rate). Default: 30.
+  -n <frames>             Stops after this many frames, 0 never stops. Default: 0.
+  -a <address>            Where the visualizer listens. Default: 192.168.10.1, see Connect().
+  -p <port>               Default: 10002.
+  -c <bytes>              Largest piece a quad is handed to send() in, 0 sends every quad at once. Default: 0.
+  -d <n>                  Leaves out one quad of every nth frame to check that incomplete frames are dropped. Default: 0.
+
+Once per second it reports how many frames went out, the throughput and how many frames could not be sent in time
+because the visualizer did not take the data fast enough. To emulate several cameras start it once per camera.
+*/
+
+#define EMULATOR_DEFAULT_RATE 30.0
+#define EMULATOR_PORT 10002
+#define EMULATOR_CAPTURE_MODE 4 // 4 quads per modulation frequency.
+#define EMULATOR_CAPTURE_MODE_TWO_FREQUENCIES 0x8 // See GetQuadsPerFrame().
+
+typedef struct
+{
+    double FramesPerSecond;
+    int FrameCount;
+    const char *Address;
+    int Port;
+    int ChunkSize;
+    int DropEvery;
+}
+emulator_settings;
+
+#if defined(_WIN32)
+#define SEND_FLAGS 0
+#elif defined(__linux__)
+#define SEND_FLAGS MSG_NOSIGNAL // A visualizer that went away should end up as an error, not as SIGPIPE.
+#endif
+
+static double GetWallClockTime(void)
+{
+#if defined(_WIN32)
+
+    LARGE_INTEGER Counter, Frequency;
+    QueryPerformanceCounter(&Counter);
+    QueryPerformanceFrequency(&Frequency);
+    return((double)Counter.QuadPart / (double)Frequency.QuadPart);
+
+#elif defined(__linux__)
+
+    struct timespec Time;
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+    return((double)Time.tv_sec + (double)Time.tv_nsec * 1e-9);
+
+#endif
+}
+
+// Waits until GetWallClockTime() reaches Time.
+static void SleepUntil(double Time)
+{
+    double Now = GetWallClockTime();
+    if(Time <= Now)
+    {
+        return;
+    }
+
+#if defined(_WIN32)
+
+    Sleep((DWORD)((Time - Now) * 1000.0));
+
+#elif defined(__linux__)
+
+    struct timespec Until;
+    Until.tv_sec = (time_t)Time;
+    Until.tv_nsec = (long)((Time - (double)Until.tv_sec) * 1e9);
+    while(EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &Until, NULL));
+
+#endif
+}
+
+// Connects to the visualizer like the camera does. Since the visualizer may be started after the emulator it keeps
+// trying until somebody listens.
+static socket_t ConnectToVisualizer(const char *Address, int Port)
+{
+#if defined(_WIN32)
+    WSADATA WSAData;
+    if(0 != WSAStartup(MAKEWORD(2, 2), &WSAData))
+    {
+        fprintf(stderr, "WSAStartup failed.\n");
+        return(INVALID_SOCKET);
+    }
+#endif
+
+    sockaddr_in_t Service = {0};
+    Service.sin_family = AF_INET;
+    Service.sin_port = htons((unsigned short)Port);
+    if(1 != inet_pton(AF_INET, Address, &Service.sin_addr))
+    {
+        fprintf(stderr, "'%s' is not an IPv4 address.\n", Address);
+        return(INVALID_SOCKET);
+    }
+
+    printf("Waiting for a visualizer on %s:%d...\n", Address, Port);
+
+    while(1)
+    {
+        socket_t Socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if(!valid_socket(Socket))
+        {
+            fprintf(stderr, "Failed to create the socket. Error: %d\n", get_last_error());
+            return(INVALID_SOCKET);
+        }
+
+        if(0 == connect(Socket, (sockaddr_t *)&Service, sizeof(Service)))
+        {
+            printf("Connected!\n");
+            return(Socket);
+        }
+
+        close_socket(Socket);
+        SleepUntil(GetWallClockTime() + 0.5);
+    }
+}
+
+// Turns a frame as the depth sources hand it out back into what the camera sends for it. The layout is the one
+// CreateQuadLayout() undoes: the received rows 0, 2, 4, ... are the first half of the image in reverse order, the rows
+// 1, 3, 5, ... the second half. The image data information takes the place of the first 8 bytes of the first row, the
+// camera does the same.
+static void EncodeFrame(uint8_t *Wire, depth_sample *Frame, int ImageCount, quad_layout *Layout, int Width)
+{
+    int QuadSize = QUAD_PREAMBLE_SIZE + Layout->RowSize * Layout->RowCount;
+    int CaptureMode = EMULATOR_CAPTURE_MODE | ((ImageCount == 8) ? EMULATOR_CAPTURE_MODE_TWO_FREQUENCIES : 0);
+
+    for(int Quad = 0; Quad < ImageCount; ++Quad)
+    {
+        uint8_t *Preamble = Wire + Quad * QuadSize;
+        uint8_t *Information = Preamble + QUAD_PREAMBLE_SIZE;
+        depth_sample *Image = Frame + (size_t)Quad * Width * Layout->RowCount;
+
+        // What GetDepthImageInfo() reads: the size of the image data, its width and height and the quad counter.
+        uint32_t Meta[4] = { (uint32_t)(Layout->RowSize * Layout->RowCount), (uint32_t)Width, (uint32_t)Layout->RowCount, (uint32_t)Quad };
+        memcpy(Preamble, Meta, QUAD_PREAMBLE_SIZE);
+
+        for(int j = 0; j < Layout->RowCount; ++j)
+        {
+            uint32_t *Destination = (uint32_t *)(Information + j * Layout->RowSize);
+            depth_sample *Source = Image + Layout->DestinationRow[j] * Width;
+
+            for(int i = 0; i < Width; ++i)
+            {
+                Destination[i] = Source[i];
+            }
+        }
+
+        memset(Information, 0, QUAD_INFO_SIZE);
+        Information[2] = (uint8_t)(CaptureMode << 4);
+        Information[3] = 0x4a;
+        Information[7] = (uint8_t)(Quad << 4);
+    }
+}
+
+// Returns false once the visualizer is gone.
+static bool SendAll(socket_t Socket, const uint8_t *Data, size_t Size, int ChunkSize)
+{
+    size_t BytesSent = 0;
+    while(BytesSent < Size)
+    {
+        size_t Count = Size - BytesSent;
+        if(ChunkSize > 0 && Count > (size_t)ChunkSize)
+        {
+            Count = ChunkSize;
+        }
+
+        int Result = send(Socket, (const char *)(Data + BytesSent), (int)Count, SEND_FLAGS);
+        if(Result <= 0)
+        {
+            return(false);
+        }
+        BytesSent += Result;
+    }
+
+    return(true);
+}
+
+static bool ParseSettings(emulator_settings *Settings, int ArgumentCount, char **Arguments, int *FirstSourceArgument)
+{
+    Settings->FramesPerSecond = EMULATOR_DEFAULT_RATE;
+    Settings->FrameCount = 0;
+    Settings->Address = "192.168.10.1";
+    Settings->Port = EMULATOR_PORT;
+    Settings->ChunkSize = 0;
+    Settings->DropEvery = 0;
+
+    int Index = 1;
+    while(Index < ArgumentCount && Arguments[Index][0] == '-')
+    {
+        if(Index + 1 >= ArgumentCount)
+        {
+            fprintf(stderr, "The option %s needs a value.\n", Arguments[Index]);
+            return(false);
+        }
+
+        const char *Value = Arguments[Index + 1];
+        switch(Arguments[Index][1])
+        {
+            case 'r': Settings->FramesPerSecond = atof(Value); break;
+            case 'n': Settings->FrameCount = atoi(Value); break;
+            case 'a': Settings->Address = Value; break;
+            case 'p': Settings->Port = atoi(Value); break;
+            case 'c': Settings->ChunkSize = atoi(Value); break;
+            case 'd': Settings->DropEvery = atoi(Value); break;
+            default:
+            {
+                fprintf(stderr, "Unknown option %s.\n", Arguments[Index]);
+                return(false);
+            }
+        }
+
+        Index += 2;
+    }
+
+    *FirstSourceArgument = Index;
+    return(true);
+}
+
+int main(int ArgumentCount, char **Arguments)
+{
+    emulator_settings Settings;
+    int FirstSourceArgument;
+    if(!ParseSettings(&Settings, ArgumentCount, Arguments, &FirstSourceArgument))
+    {
+        fprintf(stderr, "Usage: camera_emulator [-r fps] [-n frames] [-a address] [-p port] [-c bytes] [-d n] [synthetic [dual] | replay <recording or dump file> [fast]]\n");
+        return(-1);
+    }
+
+    // OpenDepthSource() expects the name of the source in the second argument, the first one is skipped like the name
+    // of a program. Without one the emulator sends the synthetic scene, emulating the camera with the camera makes no
+    // sense.
+    char *SyntheticArguments[2] = { Arguments[0], "synthetic" };
+    int SourceArgumentCount = ArgumentCount - FirstSourceArgument + 1;
+    char **SourceArguments = Arguments + FirstSourceArgument - 1;
+    if(SourceArgumentCount < 2)
+    {
+        SourceArgumentCount = 2;
+        SourceArguments = SyntheticArguments;
+    }
+    else if(0 == strcmp(SourceArguments[1], "live"))
+    {
+        fprintf(stderr, "The emulator can only send the synthetic scene or a dump.\n");
+        return(-1);
+    }
+
+    depth_source Source;
+    if(!OpenDepthSource(&Source, SourceArgumentCount, SourceArguments))
+    {
+        fprintf(stderr, "Could not open the depth source.\n");
+        return(-1);
+    }
+
+    quad_layout Layout = CreateQuadLayout(EPC660_IMAGE_SIZE, EPC660_HEIGHT);
+    size_t QuadSize = QUAD_PREAMBLE_SIZE + EPC660_IMAGE_SIZE;
+    uint8_t *Wire = (uint8_t *)malloc(Source.ImageCount * QuadSize);
+    assert(Wire);
+
+    socket_t Socket = ConnectToVisualizer(Settings.Address, Settings.Port);
+    if(!valid_socket(Socket))
+    {
+        return(-1);
+    }
+
+    double FramePeriod = (Settings.FramesPerSecond > 0.0) ? 1.0 / Settings.FramesPerSecond : 0.0;
+    double Start = GetWallClockTime();
+    double NextFrameTime = Start;
+    double NextReport = Start + 1.0;
+
+    uint64_t FramesSent = 0, FramesLate = 0, BytesSent = 0;
+    uint64_t ReportFrames = 0, ReportBytes = 0;
+    bool Connected = true;
+
+    for(int Frame = 0; Connected && (Settings.FrameCount == 0 || Frame < Settings.FrameCount); ++Frame)
+    {
+        depth_sample *DepthMap = NextDepthFrame(&Source, 0);
+        if(NULL == DepthMap)
+        {
+            fprintf(stderr, "The depth source has no complete frame.\n");
+            break;
+        }
+
+        EncodeFrame(Wire, DepthMap, Source.ImageCount, &Layout, EPC660_WIDTH);
+        ReleaseDepthFrame(&Source, DepthMap);
+
+        SleepUntil(NextFrameTime);
+
+        // The quad that is left out moves through all of them.
+        int DroppedQuad = (Settings.DropEvery > 0 && (Frame + 1) % Settings.DropEvery == 0) ? (Frame / Settings.DropEvery) % Source.ImageCount : -1;
+
+        for(int Quad = 0; Connected && Quad < Source.ImageCount; ++Quad)
+        {
+            if(Quad != DroppedQuad)
+            {
+                Connected = SendAll(Socket, Wire + Quad * QuadSize, QuadSize, Settings.ChunkSize);
+                ReportBytes += QuadSize;
+            }
+        }
+
+        if(!Connected)
+        {
+            printf("The visualizer closed the connection.\n");
+            break;
+        }
+
+        ++ReportFrames;
+
+        // Like the camera the emulator does not send faster to catch up, a frame that is late delays the following ones.
+        double Now = GetWallClockTime();
+        NextFrameTime += FramePeriod;
+        if(FramePeriod > 0.0 && Now > NextFrameTime)
+        {
+            ++FramesLate;
+            NextFrameTime = Now;
+        }
+
+        if(Now >= NextReport)
+        {
+            double Elapsed = Now - (NextReport - 1.0);
+            printf("%.1f frames/s, %.1f MB/s, %llu late\n", (double)ReportFrames / Elapsed,
+                   (double)ReportBytes / Elapsed / (1024.0 * 1024.0), (unsigned long long)FramesLate);
+
+            FramesSent += ReportFrames;
+            BytesSent += ReportBytes;
+            ReportFrames = ReportBytes = 0;
+            NextReport = Now + 1.0;
+        }
+    }
+
+    FramesSent += ReportFrames;
+    BytesSent += ReportBytes;
+
+    double Elapsed = GetWallClockTime() - Start;
+    printf("%llu frames in %.2f s (%.1f frames/s, %.1f MB/s), %llu late\n", (unsigned long long)FramesSent, Elapsed,
+           (double)FramesSent / Elapsed, (double)BytesSent / Elapsed / (1024.0 * 1024.0), (unsigned long long)FramesLate);
+
+    close_socket(Socket);
+    CloseDepthSource(&Source);
+    free(Layout.DestinationRow);
+    free(Wire);
+
+    return(0);
+}
@@ -0,0 +1,321 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <memory.h>
+
+#include "../../OpenGL/code/network.c"
+
+/*
+Measures how expensive it is to get the epc660 frames out of the socket. A sender thread plays the camera over a
+loopback TCP connection as fast as it can and the main thread receives the frames with the same GetDepthImage()
+the visualizers use. At the end it reports the receive calls (= system calls) per frame and the CPU time the
+receiving thread spent per frame.
+
+Usage: ingest_benchmark [frames] [receive buffer size in bytes] [busy poll in microseconds] [socket|uring|legacy]
+
+'socket' (the default) and 'uring' select the ingest backend. For 'uring' the receive calls are the
+io_uring_enter() calls. With 'legacy' the frames are received the way it was done before the streaming parser: one recv() for the
+preamble, one for the image data information and then recv() until the quad is complete. Since the rows were
+not in their proper order back then the time for reordering them afterwards is included.
+*/
+
+#define DEPTH_MAP_WIDTH 320
+#define DEPTH_MAP_HEIGHT 240
+#define DEPTH_IMAGE_SIZE 307200
+
+typedef struct
+{
+    socket_t Socket;
+    int FrameCount;
+}
+sender_data;
+
+// Builds what the camera sends for one frame: 4 quads, each consisting of the preamble, the image data information
+// and the image data.
+static uint8_t *CreateFrameStream(size_t *SizeOut)
+{
+    size_t QuadSize = QUAD_PREAMBLE_SIZE + DEPTH_IMAGE_SIZE;
+    uint8_t *Stream = (uint8_t *)calloc(4, QuadSize);
+    assert(Stream);
+
+    for(int Quad = 0; Quad < 4; ++Quad)
+    {
+        uint8_t *Information = Stream + Quad * QuadSize + QUAD_PREAMBLE_SIZE;
+        Information[2] = 4 << 4;
+        Information[3] = 0x4a;
+        Information[7] = (uint8_t)(Quad << 4);
+
+        uint32_t *Samples = (uint32_t *)(Information + QUAD_INFO_SIZE);
+        for(int i = 0; i < (DEPTH_IMAGE_SIZE - QUAD_INFO_SIZE) / 4; ++i)
+        {
+            Samples[i] = (uint32_t)(i * 7 + Quad) & 0xFFF;
+        }
+    }
+
+    *SizeOut = 4 * QuadSize;
+    return(Stream);
+}
+
+#if defined(_WIN32)
+static DWORD WINAPI SenderProc(LPVOID Param)
+#elif defined(__linux__)
+static void *SenderProc(void *Param)
+#endif
+{
+    sender_data *Sender = (sender_data *)Param;
+
+    size_t StreamSize;
+    uint8_t *Stream = CreateFrameStream(&StreamSize);
+
+    for(int Frame = 0; Frame < Sender->FrameCount; ++Frame)
+    {
+        size_t BytesSent = 0;
+        while(BytesSent < StreamSize)
+        {
+            int Result = send(Sender->Socket, (const char *)(Stream + BytesSent), (int)(StreamSize - BytesSent), 0);
+            if(Result <= 0)
+            {
+                fprintf(stderr, "'send()' failed. Error: %d\n", get_last_error());
+                exit(-1);
+            }
+            BytesSent += Result;
+        }
+    }
+
+    free(Stream);
+    return(0);
+}
+
+static void LegacyGetDepthImage(ingest_stream *Stream, uint8_t *Buffer, uint8_t *Scratch)
+{
+    while(1)
+    {
+        uint32_t Discard[4];
+        ++Stream->ReceiveCalls;
+        int BytesReceived = recv(Stream->Socket, (char *)Discard, 16, 0);
+        assert(BytesReceived == 16);
+
+        uint8_t ImageDataInformation[8];
+        ++Stream->ReceiveCalls;
+        BytesReceived = recv(Stream->Socket, (char *)ImageDataInformation, 8, 0);
+        assert(BytesReceived == 8);
+
+        uint8_t QuadCounter = (ImageDataInformation[7] >> 4);
+        char *Pointer = (char *)(Buffer + QuadCounter * Stream->ImageSize);
+        memcpy(Pointer, ImageDataInformation, 8);
+        Pointer += 8;
+
+        int BytesReceivedTotal = 0;
+        do
+        {
+            ++Stream->ReceiveCalls;
+            BytesReceived = recv(Stream->Socket, Pointer, Stream->ImageSize - BytesReceivedTotal - 8, 0);
+            assert(BytesReceived > 0);
+
+            Pointer += BytesReceived;
+            BytesReceivedTotal += BytesReceived;
+        }
+        while(BytesReceivedTotal != Stream->ImageSize - 8);
+
+        if(QuadCounter == 3)
+        {
+            ++Stream->FramesReceived;
+            break;
+        }
+    }
+
+    memcpy(Scratch, Buffer, 4 * Stream->ImageSize);
+
+    quad_layout *Layout = &Stream->Layout;
+    for(int Quad = 0; Quad < 4; ++Quad)
+    {
+        uint8_t *Image = Buffer + Quad * Stream->ImageSize;
+        uint8_t *ScratchImage = Scratch + Quad * Stream->ImageSize;
+
+        for(int j = 0; j < Layout->RowCount; ++j)
+        {
+            memcpy(Image + Layout->DestinationRow[j] * Layout->RowSize, ScratchImage + j * Layout->RowSize, Layout->RowSize);
+        }
+    }
+}
+
+// Returns the CPU time (user + system) the calling thread has used so far in seconds.
+static double GetThreadCPUTime(void)
+{
+#if defined(_WIN32)
+
+    FILETIME Creation, Exit, Kernel, User;
+    GetThreadTimes(GetCurrentThread(), &Creation, &Exit, &Kernel, &User);
+    ULARGE_INTEGER KernelTime = {{Kernel.dwLowDateTime, Kernel.dwHighDateTime}};
+    ULARGE_INTEGER UserTime = {{User.dwLowDateTime, User.dwHighDateTime}};
+    return((double)(KernelTime.QuadPart + UserTime.QuadPart) * 1e-7);
+
+#elif defined(__linux__)
+
+    struct timespec Time;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &Time);
+    return((double)Time.tv_sec + (double)Time.tv_nsec * 1e-9);
+
+#endif
+}
+
+static double GetWallClockTime(void)
+{
+#if defined(_WIN32)
+
+    LARGE_INTEGER Counter, Frequency;
+    QueryPerformanceCounter(&Counter);
+    QueryPerformanceFrequency(&Frequency);
+    return((double)Counter.QuadPart / (double)Frequency.QuadPart);
+
+#elif defined(__linux__)
+
+    struct timespec Time;
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+    return((double)Time.tv_sec + (double)Time.tv_nsec * 1e-9);
+
+#endif
+}
+
+// Connects two sockets over loopback. The receiving end gets the receive settings applied the same way Connect()
+// does it for the camera.
+static int ConnectLoopback(socket_t *ReceiverOut, socket_t *SenderOut, receive_settings *Settings)
+{
+    int Status;
+
+#if defined(_WIN32)
+    WSADATA WSAData;
+    Status = WSAStartup(MAKEWORD(2, 2), &WSAData);
+    if(Status != 0)
+    {
+        fprintf(stderr, "WSAStartup failed.\n");
+        return(-1);
+    }
+#endif
+
+    socket_t Listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if(!valid_socket(Listener))
+    {
+        fprintf(stderr, "Failed to create the socket. Error: %d\n", get_last_error());
+        return(-2);
+    }
+
+    ApplyReceiveSettings(Listener, Settings);
+
+    sockaddr_in_t Service = {0};
+    Service.sin_family = AF_INET;
+    Service.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    Service.sin_port = 0;
+
+    Status = bind(Listener, (sockaddr_t *)&Service, sizeof(Service));
+    if(0 != Status)
+    {
+        fprintf(stderr, "Failed to bind the socket. Error: %d\n", get_last_error());
+        return(-3);
+    }
+
+    socklen_t ServiceSize = sizeof(Service);
+    getsockname(Listener, (sockaddr_t *)&Service, &ServiceSize);
+    listen(Listener, 1);
+
+    socket_t Sender = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    Status = connect(Sender, (sockaddr_t *)&Service, sizeof(Service));
+    if(0 != Status)
+    {
+        fprintf(stderr, "'connect()' failed. Error: %d\n", get_last_error());
+        return(-4);
+    }
+
+    socket_t Receiver = accept(Listener, NULL, NULL);
+    if(!valid_socket(Receiver))
+    {
+        fprintf(stderr, "'accept()' failed. Error: %d\n", get_last_error());
+        return(-5);
+    }
+
+    close_socket(Listener);
+
+    *ReceiverOut = Receiver;
+    *SenderOut = Sender;
+    return(0);
+}
+
+int main(int ArgumentCount, char **Arguments)
+{
+    int FrameCount = (ArgumentCount > 1) ? atoi(Arguments[1]) : 2000;
+    receive_settings Settings =
+    {
+        (ArgumentCount > 2) ? atoi(Arguments[2]) : 4 * 1024 * 1024,
+        (ArgumentCount > 3) ? atoi(Arguments[3]) : 0
+    };
+    const char *Mode = (ArgumentCount > 4) ? Arguments[4] : "socket";
+    bool Legacy = (0 == strcmp(Mode, "legacy"));
+    ingest_backend Backend = (0 == strcmp(Mode, "uring")) ? IngestBackend_IoUring : IngestBackend_Socket;
+
+    socket_t Receiver, Sender;
+    if(0 != ConnectLoopback(&Receiver, &Sender, &Settings))
+    {
+        return(-1);
+    }
+
+    uint8_t *Buffer = (uint8_t *)malloc(DEPTH_IMAGE_SIZE * 4);
+    uint8_t *Scratch = (uint8_t *)malloc(DEPTH_IMAGE_SIZE * 4);
+    assert(Buffer && Scratch);
+
+    ingest_stream Stream = CreateIngestStream(Receiver, DEPTH_IMAGE_SIZE, DEPTH_MAP_HEIGHT, 4, Backend);
+
+    sender_data SenderData = { Sender, FrameCount };
+
+#if defined(_WIN32)
+    HANDLE SenderThread = CreateThread(NULL, 0, SenderProc, &SenderData, 0, NULL);
+#elif defined(__linux__)
+    pthread_t SenderThread;
+    pthread_create(&SenderThread, NULL, SenderProc, &SenderData);
+#endif
+
+    double WallStart = GetWallClockTime();
+    double CPUStart = GetThreadCPUTime();
+
+    for(int Frame = 0; Frame < FrameCount; ++Frame)
+    {
+        if(Legacy)
+        {
+            LegacyGetDepthImage(&Stream, Buffer, Scratch);
+        }
+        else
+        {
+            if(!GetDepthImage(&Stream, Buffer))
+            {
+                break;
+            }
+        }
+    }
+
+    double CPUTime = GetThreadCPUTime() - CPUStart;
+    double WallTime = GetWallClockTime() - WallStart;
+
+#if defined(_WIN32)
+    WaitForSingleObject(SenderThread, INFINITE);
+#elif defined(__linux__)
+    pthread_join(SenderThread, NULL);
+#endif
+
+    double Frames = (double)Stream.FramesReceived;
+    const char *Name = Legacy ? "legacy" : (Stream.Uring ? "io_uring" : "socket");
+    printf("%s ingest, %d frames, SO_RCVBUF %d, busy poll %d us\n", Name, FrameCount,
+           Settings.ReceiveBufferSize, Settings.BusyPollMicroseconds);
+    printf("receive calls per frame: %.2f\n", (double)Stream.ReceiveCalls / Frames);
+    printf("CPU time per frame:      %.1f us\n", CPUTime / Frames * 1e6);
+    printf("wall time per frame:     %.1f us (%.0f frames/s)\n", WallTime / Frames * 1e6, Frames / WallTime);
+
+    close_socket(Sender);
+    close_socket(Receiver);
+    free(Buffer);
+    free(Scratch);
+
+    return(0);
+}
@@ -0,0 +1,489 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <memory.h>
+#include <math.h>
+
+#include "../../OpenGL/code/network.c"
+#include "../../OpenGL/code/rvl.c"
+#include "../../OpenGL/code/recording.c"
+#include "../../OpenGL/code/depth_source.c"
+#include "../../CPU-plus-OpenGL/code/job_system.c"
+#include "../../CPU-plus-OpenGL/code/opengl_renderer.h"
+#include "../../CPU-plus-OpenGL/code/point_cloud.c"
+
+/*
+Measures the point cloud kernels of point_cloud.c against the loop with atan2f() and sqrtf() the CPU visualizers
+used before them.
+
+First it compares FastAtan2() with atan2() in double precision for every pair of sample differences the camera can
+deliver (both from -4095 to 4095) and reports the largest error in radians and what it means for the distance. Then
+it computes the point clouds of frames of the synthetic scene, or of a recording, with the old loop and every kernel
+the CPU supports, reports the time per frame and the speedup and checks that the kernels find the same points as the
+scalar one, bit for bit, and how far they are from the points of the old loop. The kernels write packed_points of 8
+bytes with the coordinates in millimeters where the old loop wrote color_points of 24 bytes with floats, so that
+difference includes the rounding to a millimeter.
+
+Last it computes them with the best kernel on 1 to as many threads as there are cores, the way the visualizers do in
+tiles of rows on a job_system, and reports the time per frame and the speedup over one thread. The points have to be
+the same as from the scalar kernel for every thread count.
+
+All of that keeps every pixel like the old loop did. At the end the kernels run once more the way the visualizers run
+them, with the pixels below the lowest amplitude of the depth source dropped before their phase is computed, and it
+reports how many points are left and the speedup over keeping them all. Then once more with the temporal filter
+(DEPTH_TEMPORAL_WEIGHT) on top, with one kernel after the other and with the best one on all threads, and it reports
+what the filter adds to a frame. The history carries over from one frame to the next, so the frames are computed in
+order with a history of 0 before the first one to compare the points. Last the same with the spatial filter
+(DEPTH_FILTER_TOLERANCE) instead, which reports how many more pixels it drops and what it adds to a frame.
+
+With dual the synthetic scene has frames of two modulation frequencies, so the kernels unwrap the phases. The old loop
+only knew one frequency, it computes the points of the first 4 images and its points are not compared.
+
+Usage: point_cloud_benchmark [dual | recording]
+*/
+
+#define BENCHMARK_FRAMES 30
+#define BENCHMARK_ROUNDS 20
+
+// The loop of calculate_point_cloud() in CPU-plus-OpenGL before point_cloud.c, without the comments.
+static uint32_t ReferencePointCloud(color_point *vertex_array, depth_sample *depth_map, int depth_map_width, int depth_map_height)
+{
+    int insert_index = 0;
+    int depth_map_count = depth_map_width * depth_map_height;
+    for(int i = 0; i < depth_map_count; ++i)
+    {
+        int pixel[2] = { i % depth_map_width, i / depth_map_width };
+        int principal_point[2] = { depth_map_width / 2, depth_map_height / 2 };
+
+        int d0 = depth_map[i + depth_map_count * 0] - 2048;
+        int d1 = depth_map[i + depth_map_count * 1] - 2048;
+        int d2 = depth_map[i + depth_map_count * 2] - 2048;
+        int d3 = depth_map[i + depth_map_count * 3] - 2048;
+
+        float diff0 = (float)(d3 - d1);
+        float diff1 = (float)(d2 - d0);
+
+        float c = 300000000.0f;
+        float f = 12000000.0f;
+        float pi = 3.1416f;
+
+        float depth = (c / 2) * (1 / (2 * pi * f)) * (pi + atan2f(diff0, diff1));
+
+        float focal_length = 50.0f * 3.7f;
+
+        float x = (pixel[0] - principal_point[0]) / focal_length;
+        float y = (pixel[1] - principal_point[1]) / focal_length;
+
+        float z = depth / sqrtf(x * x + y * y + 1);
+
+        color_point point;
+        point.xyz[0] = x * z;
+        point.xyz[1] = y * z;
+        point.xyz[2] = -z;
+
+        float min_z = 0.0f;
+        float max_z = 12.5f;
+
+        if(z != 0.0f && z >= min_z && z <= max_z)
+        {
+#define clamp(x, low, high) (x) < (low) ? (low) : ((x) > (high) ? (high) : (x))
+
+            float hue = (-point.xyz[2] - min_z) / (max_z - min_z);
+            hue = clamp(hue, 0.0f, 1.0f);
+
+            float range = 2.0f / 3.0f;
+
+            hue *= range;
+            hue = range - hue;
+
+            point.rgb[0] = hue;
+            point.rgb[1] = 1.0f;
+            point.rgb[2] = 1.0f;
+
+            vertex_array[insert_index++] = point;
+        }
+    }
+
+    return((uint32_t)insert_index);
+}
+
+static double GetTime(void)
+{
+    return((double)recording_get_time() * 1e-9);
+}
+
+static void MeasureAtan2Error(float DepthPerRadian)
+{
+    double MaxError = 0.0;
+    int WorstY = 0, WorstX = 0;
+    for(int Y = -4095; Y <= 4095; ++Y)
+    {
+        for(int X = -4095; X <= 4095; ++X)
+        {
+            double Error = fabs((double)FastAtan2((float)Y, (float)X) - atan2((double)Y, (double)X));
+            if(Error > MaxError)
+            {
+                MaxError = Error;
+                WorstY = Y;
+                WorstX = X;
+            }
+        }
+    }
+
+    printf("FastAtan2() over all sample differences\n");
+    printf("  largest error:    %.2e rad at (%d, %d), %.4f mm of distance\n\n", MaxError, WorstY, WorstX,
+           MaxError * DepthPerRadian * 1000.0);
+}
+
+// Kernel is a point_cloud_kernel or -1 for the old loop, which writes color_points instead of packed_points.
+static size_t PointSize(int Kernel)
+{
+    return((Kernel < 0) ? sizeof(color_point) : sizeof(packed_point));
+}
+
+// History is NULL without the temporal filter, the old loop has none.
+static uint32_t Compute(int Kernel, void *Points, const ray_table *Rays, depth_sample *Frame, float *History, int Width, int Height)
+{
+    if(Kernel < 0)
+    {
+        return(ReferencePointCloud((color_point *)Points, Frame, Width, Height));
+    }
+    return(ComputePointCloudWith((point_cloud_kernel)Kernel, (packed_point *)Points, Rays, Frame, History));
+}
+
+// Milliseconds per frame of the fastest round. Like in the visualizers every frame goes into the same vertex array,
+// only afterwards the points of every frame are computed once more into Points to compare them, from a history of 0.
+static double Measure(int Kernel, void *Points, uint32_t *PointCounts, const ray_table *Rays, depth_sample *Frames, float *History, int Width, int Height)
+{
+    size_t FrameSize = 4 * (size_t)Rays->Unwrap.FrequencyCount * Rays->PixelCount;
+
+    double Best = 1e30;
+    for(int Round = 0; Round < BENCHMARK_ROUNDS; ++Round)
+    {
+        double Start = GetTime();
+        for(int Frame = 0; Frame < BENCHMARK_FRAMES; ++Frame)
+        {
+            Compute(Kernel, Points, Rays, Frames + Frame * FrameSize, History, Width, Height);
+        }
+        double Time = GetTime() - Start;
+        Best = (Time < Best) ? Time : Best;
+    }
+
+    if(History)
+    {
+        memset(History, 0, Rays->PixelCount * sizeof(float));
+    }
+    for(int Frame = 0; Frame < BENCHMARK_FRAMES; ++Frame)
+    {
+        void *FramePoints = (char *)Points + (size_t)Frame * Rays->PixelCount * PointSize(Kernel);
+        PointCounts[Frame] = Compute(Kernel, FramePoints, Rays, Frames + Frame * FrameSize, History, Width, Height);
+    }
+
+    return(Best / BENCHMARK_FRAMES * 1000.0);
+}
+
+// Milliseconds per frame of the fastest round with ComputePointCloudParallel(), the points go to Points like in
+// Measure().
+static double MeasureParallel(job_system *Jobs, point_cloud_kernel Kernel, packed_point *Points, packed_point *Scratch, uint32_t *PointCounts, const ray_table *Rays, depth_sample *Frames, float *History)
+{
+    size_t FrameSize = 4 * (size_t)Rays->Unwrap.FrequencyCount * Rays->PixelCount;
+
+    double Best = 1e30;
+    for(int Round = 0; Round < BENCHMARK_ROUNDS; ++Round)
+    {
+        double Start = GetTime();
+        for(int Frame = 0; Frame < BENCHMARK_FRAMES; ++Frame)
+        {
+            ComputePointCloudParallel(Jobs, Kernel, Points, Scratch, Rays, Frames + Frame * FrameSize, History);
+        }
+        double Time = GetTime() - Start;
+        Best = (Time < Best) ? Time : Best;
+    }
+
+    if(History)
+    {
+        memset(History, 0, Rays->PixelCount * sizeof(float));
+    }
+    for(int Frame = 0; Frame < BENCHMARK_FRAMES; ++Frame)
+    {
+        PointCounts[Frame] = ComputePointCloudParallel(Jobs, Kernel, Points + (size_t)Frame * Rays->PixelCount, Scratch, Rays,
+                                                       Frames + Frame * FrameSize, History);
+    }
+
+    return(Best / BENCHMARK_FRAMES * 1000.0);
+}
+
+int main(int ArgumentCount, char **Arguments)
+{
+    bool Dual = (ArgumentCount > 1 && 0 == strcmp(Arguments[1], "dual"));
+    bool Replay = (ArgumentCount > 1 && !Dual);
+    char *SyntheticArguments[3] = { Arguments[0], "synthetic", "dual" };
+    char *ReplayArguments[4] = { Arguments[0], "replay", Replay ? Arguments[1] : NULL, "fast" };
+
+    depth_source Source;
+    bool Opened = Replay ? OpenDepthSource(&Source, 4, ReplayArguments) : OpenDepthSource(&Source, Dual ? 3 : 2, SyntheticArguments);
+    if(!Opened)
+    {
+        fprintf(stderr, "Could not open the depth source.\n");
+        return(-1);
+    }
+
+    depth_source_intrinsics Intrinsics;
+    GetDepthSourceIntrinsics(&Source, &Intrinsics);
+    ray_table Rays = CreateRayTable(&Intrinsics, 0.0f, false, false);
+
+    MeasureAtan2Error(Rays.DepthPerRadian);
+
+    size_t FrameSize = (size_t)Source.ImageCount * Rays.PixelCount;
+    depth_sample *Frames = (depth_sample *)malloc(BENCHMARK_FRAMES * FrameSize * sizeof(depth_sample));
+    packed_point *Points = (packed_point *)malloc(BENCHMARK_FRAMES * (size_t)Rays.PixelCount * sizeof(packed_point));
+    packed_point *Expected = (packed_point *)malloc(BENCHMARK_FRAMES * (size_t)Rays.PixelCount * sizeof(packed_point));
+    color_point *ReferencePoints = (color_point *)malloc(BENCHMARK_FRAMES * (size_t)Rays.PixelCount * sizeof(color_point));
+    uint32_t PointCounts[BENCHMARK_FRAMES], ExpectedCounts[BENCHMARK_FRAMES];
+    assert(Frames && Points && Expected && ReferencePoints);
+
+    for(int Frame = 0; Frame < BENCHMARK_FRAMES; ++Frame)
+    {
+        depth_sample *Samples = NextDepthFrame(&Source, 1000);
+        if(!Samples)
+        {
+            fprintf(stderr, "The depth source has no frame.\n");
+            return(-1);
+        }
+        memcpy(Frames + Frame * FrameSize, Samples, FrameSize * sizeof(depth_sample));
+        ReleaseDepthFrame(&Source, Samples);
+    }
+
+    printf("%s, %dx%d, %d frames, %d bytes per point (%d for the old loop)\n", Replay ? Arguments[1] : (Dual ? "synthetic dual" : "synthetic"),
+           Intrinsics.Width, Intrinsics.Height, BENCHMARK_FRAMES, (int)sizeof(packed_point), (int)sizeof(color_point));
+
+    double KernelTimes[PointCloudKernel_Count];
+    double ScalarTime = Measure(PointCloudKernel_Scalar, Expected, ExpectedCounts, &Rays, Frames, NULL, Intrinsics.Width, Intrinsics.Height);
+    double ReferenceTime = Measure(-1, ReferencePoints, PointCounts, &Rays, Frames, NULL, Intrinsics.Width, Intrinsics.Height);
+
+    // How far the old loop is from the kernels, in meters.
+    float MaxDifference = 0.0f;
+    bool SameCount = true;
+    for(int Frame = 0; !Dual && Frame < BENCHMARK_FRAMES; ++Frame)
+    {
+        SameCount = SameCount && PointCounts[Frame] == ExpectedCounts[Frame];
+        for(uint32_t i = 0; SameCount && i < ExpectedCounts[Frame]; ++i)
+        {
+            const color_point *A = ReferencePoints + (size_t)Frame * Rays.PixelCount + i;
+            const packed_point *B = Expected + (size_t)Frame * Rays.PixelCount + i;
+            float Coordinates[3] = { B->x * 0.001f, B->y * 0.001f, B->z * 0.001f };
+            for(int k = 0; k < 3; ++k)
+            {
+                float Difference = fabsf(A->xyz[k] - Coordinates[k]);
+                MaxDifference = (Difference > MaxDifference) ? Difference : MaxDifference;
+            }
+        }
+    }
+
+    if(Dual)
+    {
+        printf("  old loop:  %7.3f ms per frame                   one frequency only\n", ReferenceTime);
+    }
+    else
+    {
+        printf("  old loop:  %7.3f ms per frame                   largest difference %.3f mm%s\n", ReferenceTime,
+               MaxDifference * 1000.0f, SameCount ? "" : ", DIFFERENT POINT COUNT");
+    }
+    printf("  scalar:    %7.3f ms per frame  (%5.2fx)\n", ScalarTime, ReferenceTime / ScalarTime);
+    KernelTimes[PointCloudKernel_Scalar] = ScalarTime;
+
+    bool Passed = SameCount;
+    point_cloud_kernel BestKernel = GetBestPointCloudKernel();
+    for(int Kernel = PointCloudKernel_Scalar + 1; Kernel <= (int)BestKernel; ++Kernel)
+    {
+        memset(Points, 0, BENCHMARK_FRAMES * (size_t)Rays.PixelCount * sizeof(packed_point));
+        double Time = Measure(Kernel, Points, PointCounts, &Rays, Frames, NULL, Intrinsics.Width, Intrinsics.Height);
+        KernelTimes[Kernel] = Time;
+
+        bool Identical = true;
+        for(int Frame = 0; Frame < BENCHMARK_FRAMES; ++Frame)
+        {
+            Identical = Identical && PointCounts[Frame] == ExpectedCounts[Frame] &&
+                        0 == memcmp(Points + (size_t)Frame * Rays.PixelCount, Expected + (size_t)Frame * Rays.PixelCount,
+                                    ExpectedCounts[Frame] * sizeof(packed_point));
+        }
+        Passed = Passed && Identical;
+
+        printf("  %-8s   %7.3f ms per frame  (%5.2fx)  %s\n", PointCloudKernelNames[Kernel], Time, ReferenceTime / Time,
+               Identical ? "same points as scalar" : "DIFFERENT POINTS THAN SCALAR");
+    }
+
+    printf("\n%s on 1 to %d threads\n", PointCloudKernelNames[BestKernel], job_get_processor_count());
+
+    packed_point *Scratch = (packed_point *)malloc((size_t)Rays.PixelCount * sizeof(packed_point));
+    assert(Scratch);
+    double SingleThreadTime = 0.0;
+    for(int ThreadCount = 1; ThreadCount <= job_get_processor_count(); ++ThreadCount)
+    {
+        job_system *Jobs = job_system_create(ThreadCount);
+        memset(Points, 0, BENCHMARK_FRAMES * (size_t)Rays.PixelCount * sizeof(packed_point));
+        double Time = MeasureParallel(Jobs, BestKernel, Points, Scratch, PointCounts, &Rays, Frames, NULL);
+        job_system_destroy(Jobs);
+        SingleThreadTime = (ThreadCount == 1) ? Time : SingleThreadTime;
+
+        bool Identical = true;
+        for(int Frame = 0; Frame < BENCHMARK_FRAMES; ++Frame)
+        {
+            Identical = Identical && PointCounts[Frame] == ExpectedCounts[Frame] &&
+                        0 == memcmp(Points + (size_t)Frame * Rays.PixelCount, Expected + (size_t)Frame * Rays.PixelCount,
+                                    ExpectedCounts[Frame] * sizeof(packed_point));
+        }
+        Passed = Passed && Identical;
+
+        printf("  %2d thread%s  %7.3f ms per frame  (%5.2fx)  %s\n", ThreadCount, (ThreadCount == 1) ? " " : "s", Time, SingleThreadTime / Time,
+               Identical ? "same points as scalar" : "DIFFERENT POINTS THAN SCALAR");
+    }
+
+    ray_table CulledRays = CreateRayTable(&Intrinsics, Source.MinAmplitude, false, false);
+    double CulledTimes[PointCloudKernel_Count];
+    double CulledScalarTime = Measure(PointCloudKernel_Scalar, Expected, ExpectedCounts, &CulledRays, Frames, NULL, Intrinsics.Width, Intrinsics.Height);
+    CulledTimes[PointCloudKernel_Scalar] = CulledScalarTime;
+
+    uint64_t PointTotal = 0;
+    for(int Frame = 0; Frame < BENCHMARK_FRAMES; ++Frame)
+    {
+        PointTotal += ExpectedCounts[Frame];
+    }
+
+    printf("\nWithout the pixels below an amplitude of %.0f, %.1f%% of the pixels are points\n", Source.MinAmplitude,
+           100.0 * (double)PointTotal / ((double)BENCHMARK_FRAMES * Rays.PixelCount));
+    printf("  scalar:    %7.3f ms per frame  (%5.2fx)\n", CulledScalarTime, ScalarTime / CulledScalarTime);
+
+    for(int Kernel = PointCloudKernel_Scalar + 1; Kernel <= (int)BestKernel; ++Kernel)
+    {
+        memset(Points, 0, BENCHMARK_FRAMES * (size_t)Rays.PixelCount * sizeof(packed_point));
+        double Time = Measure(Kernel, Points, PointCounts, &CulledRays, Frames, NULL, Intrinsics.Width, Intrinsics.Height);
+        CulledTimes[Kernel] = Time;
+
+        bool Identical = true;
+        for(int Frame = 0; Frame < BENCHMARK_FRAMES; ++Frame)
+        {
+            Identical = Identical && PointCounts[Frame] == ExpectedCounts[Frame] &&
+                        0 == memcmp(Points + (size_t)Frame * Rays.PixelCount, Expected + (size_t)Frame * Rays.PixelCount,
+                                    ExpectedCounts[Frame] * sizeof(packed_point));
+        }
+        Passed = Passed && Identical;
+
+        printf("  %-8s   %7.3f ms per frame  (%5.2fx)  %s\n", PointCloudKernelNames[Kernel], Time, KernelTimes[Kernel] / Time,
+               Identical ? "same points as scalar" : "DIFFERENT POINTS THAN SCALAR");
+    }
+
+    float *History = (float *)malloc((size_t)Rays.PixelCount * sizeof(float));
+    assert(History);
+    memset(History, 0, (size_t)Rays.PixelCount * sizeof(float));
+    double TemporalScalarTime = Measure(PointCloudKernel_Scalar, Expected, ExpectedCounts, &CulledRays, Frames, History, Intrinsics.Width, Intrinsics.Height);
+
+    printf("\nWith the temporal filter as well\n");
+    printf("  scalar:    %7.3f ms per frame  (%+6.3f ms)\n", TemporalScalarTime, TemporalScalarTime - CulledScalarTime);
+
+    for(int Kernel = PointCloudKernel_Scalar + 1; Kernel <= (int)BestKernel + 1; ++Kernel)
+    {
+        // The one after the best kernel is the best one on all threads.
+        bool AllThreads = (Kernel > (int)BestKernel);
+        memset(Points, 0, BENCHMARK_FRAMES * (size_t)Rays.PixelCount * sizeof(packed_point));
+        double Time;
+        if(AllThreads)
+        {
+            job_system *Jobs = job_system_create(0);
+            Time = MeasureParallel(Jobs, BestKernel, Points, Scratch, PointCounts, &CulledRays, Frames, History);
+            job_system_destroy(Jobs);
+        }
+        else
+        {
+            Time = Measure(Kernel, Points, PointCounts, &CulledRays, Frames, History, Intrinsics.Width, Intrinsics.Height);
+        }
+
+        bool Identical = true;
+        for(int Frame = 0; Frame < BENCHMARK_FRAMES; ++Frame)
+        {
+            Identical = Identical && PointCounts[Frame] == ExpectedCounts[Frame] &&
+                        0 == memcmp(Points + (size_t)Frame * Rays.PixelCount, Expected + (size_t)Frame * Rays.PixelCount,
+                                    ExpectedCounts[Frame] * sizeof(packed_point));
+        }
+        Passed = Passed && Identical;
+
+        if(AllThreads)
+        {
+            printf("  %-8s   %7.3f ms per frame  on %d thread%s  %s\n", PointCloudKernelNames[BestKernel], Time,
+                   job_get_processor_count(), (job_get_processor_count() == 1) ? "" : "s", Identical ? "same points as scalar" : "DIFFERENT POINTS THAN SCALAR");
+        }
+        else
+        {
+            printf("  %-8s   %7.3f ms per frame  (%+6.3f ms)  %s\n", PointCloudKernelNames[Kernel], Time, Time - CulledTimes[Kernel],
+                   Identical ? "same points as scalar" : "DIFFERENT POINTS THAN SCALAR");
+        }
+    }
+
+    ray_table FilteredRays = CreateRayTable(&Intrinsics, Source.MinAmplitude, true, false);
+    double FilteredScalarTime = Measure(PointCloudKernel_Scalar, Expected, ExpectedCounts, &FilteredRays, Frames, NULL, Intrinsics.Width, Intrinsics.Height);
+
+    uint64_t FilteredTotal = 0;
+    for(int Frame = 0; Frame < BENCHMARK_FRAMES; ++Frame)
+    {
+        FilteredTotal += ExpectedCounts[Frame];
+    }
+
+    printf("\nWith the spatial filter instead, it drops %.1f%% of the pixels more\n",
+           100.0 * (double)(PointTotal - FilteredTotal) / ((double)BENCHMARK_FRAMES * Rays.PixelCount));
+    printf("  scalar:    %7.3f ms per frame  (%+6.3f ms)\n", FilteredScalarTime, FilteredScalarTime - CulledScalarTime);
+
+    for(int Kernel = PointCloudKernel_Scalar + 1; Kernel <= (int)BestKernel + 1; ++Kernel)
+    {
+        // The one after the best kernel is the best one on all threads.
+        bool AllThreads = (Kernel > (int)BestKernel);
+        memset(Points, 0, BENCHMARK_FRAMES * (size_t)Rays.PixelCount * sizeof(packed_point));
+        double Time;
+        if(AllThreads)
+        {
+            job_system *Jobs = job_system_create(0);
+            Time = MeasureParallel(Jobs, BestKernel, Points, Scratch, PointCounts, &FilteredRays, Frames, NULL);
+            job_system_destroy(Jobs);
+        }
+        else
+        {
+            Time = Measure(Kernel, Points, PointCounts, &FilteredRays, Frames, NULL, Intrinsics.Width, Intrinsics.Height);
+        }
+
+        bool Identical = true;
+        for(int Frame = 0; Frame < BENCHMARK_FRAMES; ++Frame)
+        {
+            Identical = Identical && PointCounts[Frame] == ExpectedCounts[Frame] &&
+                        0 == memcmp(Points + (size_t)Frame * Rays.PixelCount, Expected + (size_t)Frame * Rays.PixelCount,
+                                    ExpectedCounts[Frame] * sizeof(packed_point));
+        }
+        Passed = Passed && Identical;
+
+        if(AllThreads)
+        {
+            printf("  %-8s   %7.3f ms per frame  on %d thread%s  %s\n", PointCloudKernelNames[BestKernel], Time,
+                   job_get_processor_count(), (job_get_processor_count() == 1) ? "" : "s", Identical ? "same points as scalar" : "DIFFERENT POINTS THAN SCALAR");
+        }
+        else
+        {
+            printf("  %-8s   %7.3f ms per frame  (%+6.3f ms)  %s\n", PointCloudKernelNames[Kernel], Time, Time - CulledTimes[Kernel],
+                   Identical ? "same points as scalar" : "DIFFERENT POINTS THAN SCALAR");
+        }
+    }
+    FreeRayTable(&FilteredRays);
+
+    free(History);
+    free(Scratch);
+    FreeRayTable(&CulledRays);
+
+    free(Frames);
+    free(Points);
+    free(Expected);
+    free(ReferencePoints);
+    FreeRayTable(&Rays);
+    CloseDepthSource(&Source);
+    return(Passed ? 0 : -1);
+}
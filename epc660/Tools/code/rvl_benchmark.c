@@ -0,0 +1,256 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <memory.h>
+
+#include "../../OpenGL/code/network.c"
+#include "../../OpenGL/code/rvl.c"
+#include "../../OpenGL/code/recording.c"
+#include "../../OpenGL/code/depth_source.c"
+
+/*
+Measures the depth codec (rvl.c) on real frames. The frames come from recordings of either camera, without any the
+synthetic epc660 scene is used. For every input it checks that all frames come back exactly as they were and reports
+the compression ratio and how many megabytes of samples per second are encoded and decoded, with SSE2 and with the
+scalar code. Copying the frames with memcpy() is given for comparison, that is what the codec costs on top of a raw
+recording.
+
+Usage: rvl_benchmark [recording ...]
+
+Only the first BENCHMARK_MAX_FRAMES frames of a recording are used. Every measurement is repeated
+BENCHMARK_ROUNDS times over all of them and the fastest round is reported.
+*/
+
+#define BENCHMARK_MAX_FRAMES 120
+#define BENCHMARK_ROUNDS 5
+
+typedef size_t encode_function(const uint16_t *Samples, size_t SampleCount, uint8_t *Output);
+typedef bool decode_function(const uint8_t *Input, size_t InputSize, uint16_t *Samples, size_t SampleCount);
+
+typedef struct
+{
+    uint16_t *Samples; // FrameCount frames of SamplesPerFrame samples one after another.
+    size_t SamplesPerFrame;
+    int FrameCount;
+}
+frame_set;
+
+static bool LoadRecording(frame_set *Frames, const char *Path)
+{
+    recording_reader Reader;
+    if(!recording_reader_open(&Reader, Path))
+    {
+        return(false);
+    }
+
+    if(Reader.header.sample_size != sizeof(uint16_t) || Reader.frame_count == 0)
+    {
+        fprintf(stderr, "%s has no 16 bit frames.\n", Path);
+        recording_reader_close(&Reader);
+        return(false);
+    }
+
+    Frames->SamplesPerFrame = (size_t)Reader.header.width * Reader.header.height * Reader.header.image_count;
+    Frames->FrameCount = (Reader.frame_count < BENCHMARK_MAX_FRAMES) ? (int)Reader.frame_count : BENCHMARK_MAX_FRAMES;
+    Frames->Samples = (uint16_t *)malloc(Frames->FrameCount * Frames->SamplesPerFrame * sizeof(uint16_t));
+    assert(Frames->Samples);
+
+    int Loaded = 0;
+    for(int Frame = 0; Frame < Frames->FrameCount; ++Frame)
+    {
+        const void *Data = recording_reader_get_frame(&Reader, (uint64_t)Frame);
+        if(Data)
+        {
+            memcpy(Frames->Samples + Loaded++ * Frames->SamplesPerFrame, Data, Frames->SamplesPerFrame * sizeof(uint16_t));
+        }
+    }
+    Frames->FrameCount = Loaded;
+
+    recording_reader_close(&Reader);
+    return(Loaded > 0);
+}
+
+static bool LoadSyntheticScene(frame_set *Frames)
+{
+    char *Arguments[2] = { "rvl_benchmark", "synthetic" };
+    depth_source Source;
+    if(!OpenDepthSource(&Source, 2, Arguments))
+    {
+        return(false);
+    }
+
+    Frames->SamplesPerFrame = (size_t)Source.ImageCount * Source.Width * Source.Height;
+    Frames->FrameCount = BENCHMARK_MAX_FRAMES;
+    Frames->Samples = (uint16_t *)malloc(Frames->FrameCount * Frames->SamplesPerFrame * sizeof(uint16_t));
+    assert(Frames->Samples);
+
+    for(int Frame = 0; Frame < Frames->FrameCount; ++Frame)
+    {
+        depth_sample *DepthMap = NextDepthFrame(&Source, 0);
+        assert(DepthMap);
+        memcpy(Frames->Samples + Frame * Frames->SamplesPerFrame, DepthMap, Frames->SamplesPerFrame * sizeof(uint16_t));
+        ReleaseDepthFrame(&Source, DepthMap);
+    }
+
+    CloseDepthSource(&Source);
+    return(true);
+}
+
+static double GetTime(void)
+{
+    return((double)recording_get_time() * 1e-9);
+}
+
+// Megabytes of samples per second for the fastest of the rounds.
+static double Throughput(const frame_set *Frames, double Seconds)
+{
+    return((double)Frames->FrameCount * Frames->SamplesPerFrame * sizeof(uint16_t) / Seconds / (1024.0 * 1024.0));
+}
+
+// Encodes every frame into its own slot of Encoded and returns the fastest round, the sizes go to EncodedSizes.
+static double MeasureEncode(const frame_set *Frames, encode_function *Encode, uint8_t *Encoded, size_t SlotSize, size_t *EncodedSizes)
+{
+    double Best = 1e30;
+    for(int Round = 0; Round < BENCHMARK_ROUNDS; ++Round)
+    {
+        double Start = GetTime();
+        for(int Frame = 0; Frame < Frames->FrameCount; ++Frame)
+        {
+            EncodedSizes[Frame] = Encode(Frames->Samples + Frame * Frames->SamplesPerFrame, Frames->SamplesPerFrame,
+                                         Encoded + Frame * SlotSize);
+        }
+        double Time = GetTime() - Start;
+        Best = (Time < Best) ? Time : Best;
+    }
+    return(Best);
+}
+
+// Decodes every frame and returns the fastest round, or a negative time if a frame does not come back exactly.
+static double MeasureDecode(const frame_set *Frames, decode_function *Decode, const uint8_t *Encoded, size_t SlotSize,
+                            const size_t *EncodedSizes, uint16_t *Decoded)
+{
+    double Best = 1e30;
+    for(int Round = 0; Round < BENCHMARK_ROUNDS; ++Round)
+    {
+        double Start = GetTime();
+        for(int Frame = 0; Frame < Frames->FrameCount; ++Frame)
+        {
+            if(!Decode(Encoded + Frame * SlotSize, EncodedSizes[Frame], Decoded + Frame * Frames->SamplesPerFrame,
+                       Frames->SamplesPerFrame))
+            {
+                return(-1.0);
+            }
+        }
+        double Time = GetTime() - Start;
+        Best = (Time < Best) ? Time : Best;
+    }
+
+    size_t Size = Frames->FrameCount * Frames->SamplesPerFrame * sizeof(uint16_t);
+    return((0 == memcmp(Decoded, Frames->Samples, Size)) ? Best : -1.0);
+}
+
+static double MeasureCopy(const frame_set *Frames, uint16_t *Copy)
+{
+    size_t Size = Frames->FrameCount * Frames->SamplesPerFrame * sizeof(uint16_t);
+    double Best = 1e30;
+    for(int Round = 0; Round < BENCHMARK_ROUNDS; ++Round)
+    {
+        double Start = GetTime();
+        memcpy(Copy, Frames->Samples, Size);
+        double Time = GetTime() - Start;
+        Best = (Time < Best) ? Time : Best;
+    }
+    return(Best);
+}
+
+static bool RunBenchmark(const char *Name, const frame_set *Frames)
+{
+    size_t SlotSize = rvl_max_encoded_size(Frames->SamplesPerFrame);
+    uint8_t *Encoded = (uint8_t *)malloc(Frames->FrameCount * SlotSize);
+    uint8_t *EncodedScalar = (uint8_t *)malloc(Frames->FrameCount * SlotSize);
+    size_t *EncodedSizes = (size_t *)malloc(Frames->FrameCount * sizeof(size_t));
+    size_t *EncodedSizesScalar = (size_t *)malloc(Frames->FrameCount * sizeof(size_t));
+    uint16_t *Decoded = (uint16_t *)malloc(Frames->FrameCount * Frames->SamplesPerFrame * sizeof(uint16_t));
+    assert(Encoded && EncodedScalar && EncodedSizes && EncodedSizesScalar && Decoded);
+
+    double EncodeTime = MeasureEncode(Frames, rvl_encode, Encoded, SlotSize, EncodedSizes);
+    double EncodeTimeScalar = MeasureEncode(Frames, rvl_encode_scalar, EncodedScalar, SlotSize, EncodedSizesScalar);
+    double DecodeTime = MeasureDecode(Frames, rvl_decode, Encoded, SlotSize, EncodedSizes, Decoded);
+    memset(Decoded, 0, Frames->FrameCount * Frames->SamplesPerFrame * sizeof(uint16_t));
+    double DecodeTimeScalar = MeasureDecode(Frames, rvl_decode_scalar, Encoded, SlotSize, EncodedSizes, Decoded);
+    double CopyTime = MeasureCopy(Frames, Decoded);
+
+    // Both encoders have to produce the same bytes, otherwise a recording would depend on the machine it was made on.
+    bool SameOutput = true;
+    uint64_t EncodedTotal = 0;
+    for(int Frame = 0; Frame < Frames->FrameCount; ++Frame)
+    {
+        SameOutput = SameOutput && EncodedSizes[Frame] == EncodedSizesScalar[Frame] &&
+                     0 == memcmp(Encoded + Frame * SlotSize, EncodedScalar + Frame * SlotSize, EncodedSizes[Frame]);
+        EncodedTotal += EncodedSizes[Frame];
+    }
+    bool Lossless = DecodeTime > 0.0 && DecodeTimeScalar > 0.0;
+
+    uint64_t RawTotal = (uint64_t)Frames->FrameCount * Frames->SamplesPerFrame * sizeof(uint16_t);
+    printf("%s: %d frames of %zu samples\n", Name, Frames->FrameCount, Frames->SamplesPerFrame);
+    printf("  ratio:            %.2f (%.1f KB per frame)\n", (double)RawTotal / EncodedTotal,
+           (double)EncodedTotal / Frames->FrameCount / 1024.0);
+#if defined(RVL_SSE2)
+    printf("  encode:           %.0f MB/s SSE2, %.0f MB/s scalar\n", Throughput(Frames, EncodeTime), Throughput(Frames, EncodeTimeScalar));
+    if(Lossless)
+    {
+        printf("  decode:           %.0f MB/s SSE2, %.0f MB/s scalar\n", Throughput(Frames, DecodeTime), Throughput(Frames, DecodeTimeScalar));
+    }
+#else
+    printf("  encode:           %.0f MB/s (scalar only)\n", Throughput(Frames, EncodeTimeScalar));
+    if(Lossless)
+    {
+        printf("  decode:           %.0f MB/s (scalar only)\n", Throughput(Frames, DecodeTimeScalar));
+    }
+#endif
+    printf("  memcpy:           %.0f MB/s\n", Throughput(Frames, CopyTime));
+    printf("  lossless:         %s\n", Lossless ? "yes" : "NO");
+    printf("  same as scalar:   %s\n", SameOutput ? "yes" : "NO");
+
+    free(Encoded);
+    free(EncodedScalar);
+    free(EncodedSizes);
+    free(EncodedSizesScalar);
+    free(Decoded);
+    return(Lossless && SameOutput);
+}
+
+int main(int ArgumentCount, char **Arguments)
+{
+    bool Passed = true;
+
+    if(ArgumentCount < 2)
+    {
+        frame_set Frames;
+        if(!LoadSyntheticScene(&Frames))
+        {
+            fprintf(stderr, "Could not create the synthetic scene.\n");
+            return(-1);
+        }
+        Passed = RunBenchmark("synthetic", &Frames);
+        free(Frames.Samples);
+    }
+
+    for(int i = 1; i < ArgumentCount; ++i)
+    {
+        frame_set Frames;
+        if(!LoadRecording(&Frames, Arguments[i]))
+        {
+            Passed = false;
+            continue;
+        }
+        Passed = RunBenchmark(Arguments[i], &Frames) && Passed;
+        free(Frames.Samples);
+    }
+
+    return(Passed ? 0 : -1);
+}